@@ -0,0 +1,100 @@
+
+/**
+
+cost of invoking the callbacks stored by instantFSM :
+std::function (storage used up to now) against priv::Callback
+
+*/
+
+#include "instantFSM.h"
+
+#include <benchmark/benchmark.h>
+
+#include <functional>
+
+using namespace ifsm;
+
+namespace {
+  struct Counters{
+    int mFirst;
+    int mSecond;
+    int mThird;
+  };
+}
+
+/**
+std::function holding a lambda capturing three pointers, wrapped into f(SM) like fixParams used to
+*/
+static void StdFunctionAction(benchmark::State& pState){
+  Counters lCounters = {0, 0, 0};
+  int* lFirst = &lCounters.mFirst;
+  int* lSecond = &lCounters.mSecond;
+  int* lThird = &lCounters.mThird;
+  auto lCallable = [lFirst, lSecond, lThird](){ ++*lFirst; ++*lSecond; ++*lThird; };
+  std::vector<std::function<void(StateMachine&)>> lCallbacks;
+  for (int i = 0; i < 64; ++i){
+    lCallbacks.push_back(std::function<void(StateMachine&)>([lCallable](StateMachine&){ lCallable(); }));
+  }
+  StateMachine* lMachine = nullptr;
+
+  for (auto _ : pState){
+    for (auto& lCallback : lCallbacks){
+      lCallback(*lMachine);
+    }
+  }
+  benchmark::DoNotOptimize(lCounters);
+  pState.SetItemsProcessed(pState.iterations() * lCallbacks.size());
+}
+BENCHMARK(StdFunctionAction);
+
+/**
+the same lambda held by priv::ActionCallback
+*/
+static void CallbackAction(benchmark::State& pState){
+  Counters lCounters = {0, 0, 0};
+  int* lFirst = &lCounters.mFirst;
+  int* lSecond = &lCounters.mSecond;
+  int* lThird = &lCounters.mThird;
+  auto lCallable = [lFirst, lSecond, lThird](){ ++*lFirst; ++*lSecond; ++*lThird; };
+  std::vector<priv::ActionCallback> lCallbacks;
+  for (int i = 0; i < 64; ++i){
+    lCallbacks.push_back(priv::ActionCallback(lCallable));
+  }
+  StateMachine* lMachine = nullptr;
+
+  for (auto _ : pState){
+    for (auto& lCallback : lCallbacks){
+      lCallback(*lMachine);
+    }
+  }
+  benchmark::DoNotOptimize(lCounters);
+  pState.SetItemsProcessed(pState.iterations() * lCallbacks.size());
+}
+BENCHMARK(CallbackAction);
+
+/**
+construction of the callback holders themselves
+*/
+static void StdFunctionConstruction(benchmark::State& pState){
+  int lFirst = 0, lSecond = 0, lThird = 0;
+  int* lPointers[] = {&lFirst, &lSecond, &lThird};
+  for (auto _ : pState){
+    auto lCallable = [lPointers](){ ++*lPointers[0]; };
+    std::function<void(StateMachine&)> lCallback([lCallable](StateMachine&){ lCallable(); });
+    benchmark::DoNotOptimize(lCallback);
+  }
+}
+BENCHMARK(StdFunctionConstruction);
+
+static void CallbackConstruction(benchmark::State& pState){
+  int lFirst = 0, lSecond = 0, lThird = 0;
+  int* lPointers[] = {&lFirst, &lSecond, &lThird};
+  for (auto _ : pState){
+    auto lCallable = [lPointers](){ ++*lPointers[0]; };
+    priv::ActionCallback lCallback(lCallable);
+    benchmark::DoNotOptimize(lCallback);
+  }
+}
+BENCHMARK(CallbackConstruction);
+
+BENCHMARK_MAIN();
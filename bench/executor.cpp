@@ -0,0 +1,107 @@
+
+/**
+
+throughput of StateMachineExecutor with many small machines, against the number of workers,
+and of the orthogonal regions of one machine run on it
+
+*/
+
+#include "instantFSM.h"
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ifsm;
+
+/**
+range(0) workers, 1024 machines receiving 64 events each per iteration
+*/
+static void ExecutorThroughput(benchmark::State& pState){
+  const std::size_t lMachineCount = 1024;
+  const std::size_t lEventsPerMachine = 64;
+
+  std::vector<int> lCounts(lMachineCount, 0);
+  std::vector<std::unique_ptr<StateMachine>> lMachines;
+  for (std::size_t lMachine = 0; lMachine < lMachineCount; ++lMachine){
+    int* lCount = &lCounts[lMachine];
+    lMachines.push_back(std::unique_ptr<StateMachine>(new StateMachine(
+      State("S1", initialTag,
+        OnEvent("tick", [lCount](){ ++*lCount; }),
+        Transition(OnEvent("flip"), Target("S2"))
+      ),
+      State("S2",
+        OnEvent("tick", [lCount](){ ++*lCount; }),
+        Transition(OnEvent("flip"), Target("S1"))
+      )
+    )));
+    lMachines.back()->enter();
+  }
+
+  StateMachineExecutor lExecutor(pState.range(0));
+  std::vector<StateMachineExecutor::Handle> lHandles;
+  for (auto& lMachine : lMachines){
+    lHandles.push_back(lExecutor.attach(*lMachine));
+  }
+  const EventId lTick = lMachines[0]->event("tick");
+  const EventId lFlip = lMachines[0]->event("flip");
+
+  for (auto _ : pState){
+    for (std::size_t lEvent = 0; lEvent < lEventsPerMachine; ++lEvent){
+      for (StateMachineExecutor::Handle lHandle : lHandles){
+        lExecutor.post(lHandle, lEvent % 8 == 0 ? lFlip : lTick);
+      }
+    }
+    lExecutor.wait();
+  }
+  benchmark::DoNotOptimize(lCounts.data());
+  pState.SetItemsProcessed(pState.iterations() * lMachineCount * lEventsPerMachine);
+}
+BENCHMARK(ExecutorThroughput)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
+/**
+a parallel state of 8 regions flipping on the same event, each OnEntry waiting for 100us as
+an I/O bound callback would : on the calling thread with range(0) == 0, otherwise
+on an executor of range(0) workers
+*/
+static void ParallelRegions(benchmark::State& pState){
+  auto lRegion = [](int pIndex){
+    const std::string lName = "R" + std::to_string(pIndex);
+    return State(lName,
+      State(lName + "a", initialTag,
+        OnEntry([](){ std::this_thread::sleep_for(std::chrono::microseconds(100)); }),
+        Transition(OnEvent("flip"), Target(lName + "b"))
+      ),
+      State(lName + "b",
+        OnEntry([](){ std::this_thread::sleep_for(std::chrono::microseconds(100)); }),
+        Transition(OnEvent("flip"), Target(lName + "a"))
+      )
+    );
+  };
+
+  StateMachine lMachine(
+    State("P", initialTag, parallelTag,
+      lRegion(0), lRegion(1), lRegion(2), lRegion(3), lRegion(4), lRegion(5), lRegion(6), lRegion(7)
+    )
+  );
+
+  std::unique_ptr<StateMachineExecutor> lExecutor;
+  if (pState.range(0) != 0){
+    lExecutor.reset(new StateMachineExecutor(static_cast<std::size_t>(pState.range(0))));
+    lMachine.setRegionExecutor(lExecutor.get());
+  }
+  lMachine.enter();
+  const EventId lFlip = lMachine.event("flip");
+
+  for (auto _ : pState){
+    lMachine.pushEvent(lFlip);
+  }
+  pState.SetItemsProcessed(pState.iterations());
+}
+BENCHMARK(ParallelRegions)->Arg(0)->Arg(2)->Arg(8)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,735 @@
+
+/**
+
+microbenchmarks of StateMachine : construction, event dispatch, transitions and inState
+on generated charts of configurable depth and width
+
+*/
+
+#include "instantFSM.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace ifsm;
+
+namespace {
+
+  template <std::size_t... Is>
+  struct Indices{};
+
+  template <std::size_t N, std::size_t... Is>
+  struct MakeIndices : MakeIndices<N - 1, N - 1, Is...>{};
+
+  template <std::size_t... Is>
+  struct MakeIndices<0, Is...>{
+    typedef Indices<Is...> type;
+  };
+
+  std::string name(const std::string& pPrefix, std::size_t pIndex){
+    return pPrefix + std::to_string(pIndex);
+  }
+
+  /*
+  flat chart : S0 ... SN-1, each one going to the next on "next"
+  */
+  priv::StateDef flatState(std::size_t pIndex, std::size_t pCount, int& pEntries){
+    return State(name("S", pIndex),
+      OnEntry([&pEntries](){ ++pEntries; }),
+      Transition(
+        OnEvent("next"),
+        Target(name("S", (pIndex + 1) % pCount))
+      )
+    );
+  }
+
+  template <std::size_t... Is>
+  std::shared_ptr<const StateChart> makeFlatChart(Indices<Is...>, int& pEntries){
+    const std::size_t lCount = sizeof...(Is) + 1;
+    return std::make_shared<const StateChart>(
+      State("S0", initialTag,
+        OnEntry([&pEntries](){ ++pEntries; }),
+        Transition(OnEvent("next"), Target("S1"))
+      ),
+      flatState(Is + 1, lCount, pEntries)...
+    );
+  }
+
+  template <std::size_t... Is>
+  std::unique_ptr<StateMachine> makeFlat(Indices<Is...>, int& pEntries){
+    const std::size_t lCount = sizeof...(Is) + 1;
+    return std::unique_ptr<StateMachine>(new StateMachine(
+      State("S0", initialTag,
+        OnEntry([&pEntries](){ ++pEntries; }),
+        Transition(OnEvent("next"), Target("S1"))
+      ),
+      flatState(Is + 1, lCount, pEntries)...
+    ));
+  }
+
+  /*
+  nested chart : two chains A and B of pDepth states, swapping between their leaves on "swap"
+  */
+  priv::StateDef chain(const std::string& pPrefix, const std::string& pOther, std::size_t pLevel, std::size_t pDepth, int& pEntries){
+    if (pLevel + 1 == pDepth){
+      return State(name(pPrefix, pLevel), initialTag,
+        OnEntry([&pEntries](){ ++pEntries; }),
+        Transition(OnEvent("swap"), Target(name(pOther, 0)))
+      );
+    }
+    return State(name(pPrefix, pLevel), initialTag,
+      OnEntry([&pEntries](){ ++pEntries; }),
+      chain(pPrefix, pOther, pLevel + 1, pDepth, pEntries)
+    );
+  }
+
+  std::unique_ptr<StateMachine> makeDeep(std::size_t pDepth, int& pEntries){
+    return std::unique_ptr<StateMachine>(new StateMachine(
+      State("A", initialTag, chain("A", "B", 0, pDepth, pEntries)),
+      State("B", chain("B", "A", 0, pDepth, pEntries))
+    ));
+  }
+
+  /*
+  balanced binary tree of pCount states numbered in heap order, the first child of each state being initial.
+  each leaf goes to the next one on "next"
+  */
+  priv::StateDef treeNode(std::size_t pNode, std::size_t pCount, bool pInitial, int& pEntries){
+    const std::size_t lFirstLeaf = pCount / 2;
+    if (pNode >= lFirstLeaf){
+      priv::TransitionDef lNext = Transition(OnEvent("next"), Target(name("T", lFirstLeaf + (pNode - lFirstLeaf + 1) % (pCount - lFirstLeaf))));
+      if (pInitial){
+        return State(name("T", pNode), initialTag, OnEntry([&pEntries](){ ++pEntries; }), std::move(lNext));
+      }
+      return State(name("T", pNode), OnEntry([&pEntries](){ ++pEntries; }), std::move(lNext));
+    }
+
+    priv::StateDef lFirst = treeNode(2 * pNode + 1, pCount, true, pEntries);
+    priv::StateDef lSecond = treeNode(2 * pNode + 2, pCount, false, pEntries);
+    if (pInitial){
+      return State(name("T", pNode), initialTag, OnEntry([&pEntries](){ ++pEntries; }), std::move(lFirst), std::move(lSecond));
+    }
+    return State(name("T", pNode), OnEntry([&pEntries](){ ++pEntries; }), std::move(lFirst), std::move(lSecond));
+  }
+
+  /*
+  wide chart : a parallel state of N regions, each one flipping between two states on "flip"
+  */
+  priv::StateDef region(std::size_t pIndex, int& pEntries){
+    return State(name("R", pIndex),
+      State(name("R", pIndex) + "a", initialTag,
+        OnEntry([&pEntries](){ ++pEntries; }),
+        Transition(OnEvent("flip"), Target(name("R", pIndex) + "b"))
+      ),
+      State(name("R", pIndex) + "b",
+        OnEntry([&pEntries](){ ++pEntries; }),
+        Transition(OnEvent("flip"), Target(name("R", pIndex) + "a"))
+      )
+    );
+  }
+
+  template <std::size_t... Is>
+  std::unique_ptr<StateMachine> makeWide(Indices<Is...>, int& pEntries){
+    return std::unique_ptr<StateMachine>(new StateMachine(
+      State("P", initialTag, parallelTag, region(Is, pEntries)...)
+    ));
+  }
+
+  /*
+  the charts of samples/audioPlayer.cpp and samples/gameState.cpp, their callbacks counting calls
+  */
+  std::shared_ptr<const StateChart> makeAudioPlayerChart(int& pCalls){
+    return std::make_shared<const StateChart>(
+      OnEvent("quit", [&pCalls](){ ++pCalls; }),
+      State("stopped", initialTag,
+        OnEntry([&pCalls](){ ++pCalls; }),
+        Transition(OnEvent("play"), Target("playing")),
+        OnExit([&pCalls](){ ++pCalls; })
+      ),
+      State("playing",
+        OnEntry([&pCalls](){ ++pCalls; }),
+        Transition(OnEvent("pause"), Target("paused")),
+        Transition(OnEvent("stop"), Target("stopped"))
+      ),
+      State("paused",
+        OnEntry([&pCalls](){ ++pCalls; }),
+        Transition(OnEvent("play"), Target("playing")),
+        Transition(OnEvent("stop"), Target("stopped"))
+      )
+    );
+  }
+
+  std::shared_ptr<const StateChart> makeGameStateChart(int& pCalls){
+    return std::make_shared<const StateChart>(
+      State("splashscreen", initialTag,
+        Transition(OnEvent("splashscreentimer_done"), Target("menu")),
+        Transition(OnEvent("update"), Action([&pCalls](){ ++pCalls; }))
+      ),
+      State("menu",
+        Transition(OnEvent("quit"), Action([&pCalls](){ ++pCalls; })),
+        Transition(OnEvent("newgame"), Action([&pCalls](){ ++pCalls; }), Target("loading")),
+        Transition(OnEvent("loadgame"), Action([&pCalls](){ ++pCalls; }), Target("loading")),
+        Transition(OnEvent("update"), Action([&pCalls](){ ++pCalls; }))
+      ),
+      State("loading",
+        Transition(OnEvent("update"), Action([&pCalls](){ ++pCalls; })),
+        Transition(OnEvent("game_loaded"), Target("ingame"))
+      ),
+      State("ingame",
+        Transition(OnEvent("update"), Action([&pCalls](){ ++pCalls; })),
+        Transition(OnEvent("pause"), Target("paused"))
+      ),
+      State("paused",
+        Transition(OnEvent("update"), Action([&pCalls](){ ++pCalls; })),
+        Transition(OnEvent("unpause"), Target("ingame")),
+        Transition(OnEvent("quit"), Action([&pCalls](){ ++pCalls; }))
+      )
+    );
+  }
+
+  /*
+  the wide chart next to a state Q, the only one reacting to "quiet"
+  */
+  template <std::size_t... Is>
+  std::unique_ptr<StateMachine> makeQuiet(Indices<Is...>, int& pEntries){
+    return std::unique_ptr<StateMachine>(new StateMachine(
+      State("P", initialTag, parallelTag, region(Is, pEntries)...),
+      State("Q", Transition(OnEvent("quiet"), Target("P")))
+    ));
+  }
+}
+
+/**
+construction of a flat chart of N states
+*/
+template <std::size_t N>
+static void ConstructFlat(benchmark::State& pState){
+  int lEntries = 0;
+  for (auto _ : pState){
+    std::unique_ptr<StateMachine> lMachine = makeFlat(typename MakeIndices<N - 1>::type(), lEntries);
+    benchmark::DoNotOptimize(lMachine.get());
+  }
+}
+BENCHMARK_TEMPLATE(ConstructFlat, 16);
+BENCHMARK_TEMPLATE(ConstructFlat, 64);
+BENCHMARK_TEMPLATE(ConstructFlat, 256);
+
+/**
+construction of a balanced binary tree of range(0) - 1 states : the build is linear in the number of states
+*/
+static void ConstructTree(benchmark::State& pState){
+  int lEntries = 0;
+  const std::size_t lCount = static_cast<std::size_t>(pState.range(0)) - 1;
+  for (auto _ : pState){
+    std::shared_ptr<const StateChart> lChart = std::make_shared<const StateChart>(treeNode(0, lCount, true, lEntries));
+    benchmark::DoNotOptimize(lChart.get());
+  }
+  pState.SetComplexityN(pState.range(0));
+}
+BENCHMARK(ConstructTree)->RangeMultiplier(4)->Range(16, 16384)->Complexity(benchmark::oN);
+
+/**
+instance of a shared chart of N states
+*/
+template <std::size_t N>
+static void InstantiateFlat(benchmark::State& pState){
+  int lEntries = 0;
+  std::shared_ptr<const StateChart> lChart = makeFlatChart(typename MakeIndices<N - 1>::type(), lEntries);
+  for (auto _ : pState){
+    StateMachine lMachine(lChart);
+    benchmark::DoNotOptimize(&lMachine);
+  }
+  pState.counters["bytes"] = static_cast<double>(StateMachine(lChart).memoryUsage().total());
+}
+BENCHMARK_TEMPLATE(InstantiateFlat, 16);
+BENCHMARK_TEMPLATE(InstantiateFlat, 256);
+
+/**
+bytes per instance of the sample charts, range(0) selecting audioPlayer or gameState, once entered and
+after a round of events has grown its buffers. the chart, shared by the instances, is reported apart
+*/
+static void SampleFootprint(benchmark::State& pState){
+  int lCalls = 0;
+  const bool lGame = pState.range(0) != 0;
+  std::shared_ptr<const StateChart> lChart = lGame ? makeGameStateChart(lCalls) : makeAudioPlayerChart(lCalls);
+  const std::vector<std::string> lEvents = lGame
+    ? std::vector<std::string>{ "update", "splashscreentimer_done", "newgame", "game_loaded", "pause", "unpause" }
+    : std::vector<std::string>{ "play", "pause", "play", "stop" };
+
+  MemoryUsage lUsage = MemoryUsage();
+  for (auto _ : pState){
+    StateMachine lMachine(lChart);
+    lMachine.enter();
+    lMachine.pushEvents(lEvents.begin(), lEvents.end());
+    lUsage = lMachine.memoryUsage();
+    benchmark::DoNotOptimize(&lMachine);
+  }
+  pState.SetLabel(lGame ? "gameState" : "audioPlayer");
+  pState.counters["bytes"] = static_cast<double>(lUsage.total());
+  pState.counters["states"] = static_cast<double>(lUsage.mStates);
+  pState.counters["transitions"] = static_cast<double>(lUsage.mTransitions);
+  pState.counters["queues"] = static_cast<double>(lUsage.mQueues);
+  pState.counters["chart_bytes"] = static_cast<double>(lChart->memoryUsage().total());
+}
+BENCHMARK(SampleFootprint)->Arg(0)->Arg(1);
+
+/**
+construction of two nested chains of range(0) states each
+*/
+static void ConstructDeep(benchmark::State& pState){
+  int lEntries = 0;
+  for (auto _ : pState){
+    std::unique_ptr<StateMachine> lMachine = makeDeep(pState.range(0), lEntries);
+    benchmark::DoNotOptimize(lMachine.get());
+  }
+  pState.SetComplexityN(pState.range(0));
+}
+BENCHMARK(ConstructDeep)->RangeMultiplier(4)->Range(4, 256)->Complexity(benchmark::oN);
+
+/**
+targetless OnEvent handler on the root state
+*/
+static void PushEventTargetless(benchmark::State& pState){
+  int lCount = 0;
+  StateMachine lMachine(
+    OnEvent("tick", [&lCount](){ ++lCount; }),
+    State("S", initialTag)
+  );
+  lMachine.enter();
+
+  for (auto _ : pState){
+    lMachine.pushEvent("tick");
+  }
+  benchmark::DoNotOptimize(lCount);
+  pState.SetItemsProcessed(pState.iterations());
+}
+BENCHMARK(PushEventTargetless);
+
+static void PushEventIdTargetless(benchmark::State& pState){
+  int lCount = 0;
+  StateMachine lMachine(
+    OnEvent("tick", [&lCount](){ ++lCount; }),
+    State("S", initialTag)
+  );
+  lMachine.enter();
+  const EventId lTick = lMachine.event("tick");
+
+  for (auto _ : pState){
+    lMachine.pushEvent(lTick);
+  }
+  benchmark::DoNotOptimize(lCount);
+  pState.SetItemsProcessed(pState.iterations());
+}
+BENCHMARK(PushEventIdTargetless);
+
+/**
+batch of range(0) targetless events pushed at once
+*/
+static void PushEventsBatch(benchmark::State& pState){
+  int lCount = 0;
+  StateMachine lMachine(
+    OnEvent("tick", [&lCount](){ ++lCount; }),
+    State("S", initialTag)
+  );
+  lMachine.enter();
+  std::vector<EventId> lBatch(pState.range(0), lMachine.event("tick"));
+
+  for (auto _ : pState){
+    lMachine.pushEvents(lBatch.begin(), lBatch.end());
+  }
+  benchmark::DoNotOptimize(lCount);
+  pState.SetItemsProcessed(pState.iterations() * lBatch.size());
+}
+BENCHMARK(PushEventsBatch)->Range(8, 512);
+
+/**
+transition between sibling states of a flat chart
+*/
+static void FlatTransition(benchmark::State& pState){
+  int lEntries = 0;
+  std::unique_ptr<StateMachine> lMachine = makeFlat(MakeIndices<15>::type(), lEntries);
+  lMachine->enter();
+  const EventId lNext = lMachine->event("next");
+
+  for (auto _ : pState){
+    lMachine->pushEvent(lNext);
+  }
+  benchmark::DoNotOptimize(lEntries);
+  pState.SetItemsProcessed(pState.iterations());
+}
+BENCHMARK(FlatTransition);
+
+/**
+an event followed by an eventless transition, checked only in the region the event changed
+*/
+static void EventlessCompletion(benchmark::State& pState){
+  bool lReady = true;
+  StateMachine lMachine(
+    State("Root", initialTag, parallelTag,
+      State("Worker",
+        State("Idle", initialTag,
+          Transition(OnEvent("work"), Target("Busy"))
+        ),
+        State("Busy",
+          Transition(Condition([&](){ return lReady; }), Target("Idle"))
+        )
+      ),
+      State("Monitor",
+        State("Watching", initialTag,
+          Transition(Condition([&](){ return !lReady; }), Target("Alarm"))
+        ),
+        State("Alarm")
+      )
+    )
+  );
+  lMachine.enter();
+  const EventId lWork = lMachine.event("work");
+
+  for (auto _ : pState){
+    lMachine.pushEvent(lWork);
+  }
+  pState.SetItemsProcessed(pState.iterations());
+}
+BENCHMARK(EventlessCompletion);
+
+/**
+FlatTransition recorded to an EventLog
+*/
+static void RecordedFlatTransition(benchmark::State& pState){
+  int lEntries = 0;
+  std::unique_ptr<StateMachine> lMachine = makeFlat(MakeIndices<15>::type(), lEntries);
+  lMachine->enter();
+  const EventId lNext = lMachine->event("next");
+  EventLog lLog;
+  lMachine->setEventLog(&lLog);
+
+  std::size_t lRecorded = 0;
+  for (auto _ : pState){
+    lMachine->pushEvent(lNext);
+    //restart the log now and then, reusing its buffer
+    if (++lRecorded == (1 << 20)){
+      lMachine->setEventLog(&lLog);
+      lRecorded = 0;
+    }
+  }
+  benchmark::DoNotOptimize(lEntries);
+  pState.SetItemsProcessed(pState.iterations());
+  pState.counters["bytes_per_record"] = static_cast<double>(lLog.bytes().size()) / (lRecorded ? lRecorded : 1);
+}
+BENCHMARK(RecordedFlatTransition);
+
+/**
+replay of range(0) recorded FlatTransition events, with callbacks or not
+*/
+static void ReplayFlat(benchmark::State& pState){
+  int lEntries = 0;
+  std::unique_ptr<StateMachine> lMachine = makeFlat(MakeIndices<15>::type(), lEntries);
+  EventLog lLog;
+  lMachine->setEventLog(&lLog);
+  lMachine->enter();
+  const EventId lNext = lMachine->event("next");
+  for (std::int64_t lEvent = 0; lEvent < pState.range(0); ++lEvent){
+    lMachine->pushEvent(lNext);
+  }
+  lMachine->setEventLog(nullptr);
+
+  std::unique_ptr<StateMachine> lReplayed = makeFlat(MakeIndices<15>::type(), lEntries);
+  const EventLog::ReplayMode lMode = pState.range(1) ? EventLog::WithCallbacks : EventLog::WithoutCallbacks;
+  for (auto _ : pState){
+    lLog.replay(*lReplayed, lMode);
+  }
+  benchmark::DoNotOptimize(lEntries);
+  pState.SetItemsProcessed(pState.iterations() * pState.range(0));
+}
+BENCHMARK(ReplayFlat)->Args({ 10000, 0 })->Args({ 10000, 1 });
+
+/**
+transition exiting and entering range(0) nested states on each side
+*/
+static void DeepTransition(benchmark::State& pState){
+  int lEntries = 0;
+  std::unique_ptr<StateMachine> lMachine = makeDeep(pState.range(0), lEntries);
+  lMachine->enter();
+  const EventId lSwap = lMachine->event("swap");
+
+  for (auto _ : pState){
+    lMachine->pushEvent(lSwap);
+  }
+  benchmark::DoNotOptimize(lEntries);
+  pState.SetItemsProcessed(pState.iterations());
+  pState.SetComplexityN(pState.range(0));
+}
+BENCHMARK(DeepTransition)->RangeMultiplier(4)->Range(4, 256)->Complexity();
+
+/**
+N parallel regions transitioning on the same event : selection and conflict resolution
+*/
+template <std::size_t N>
+static void WideParallelTransition(benchmark::State& pState){
+  int lEntries = 0;
+  std::unique_ptr<StateMachine> lMachine = makeWide(typename MakeIndices<N>::type(), lEntries);
+  lMachine->enter();
+  const EventId lFlip = lMachine->event("flip");
+
+  for (auto _ : pState){
+    lMachine->pushEvent(lFlip);
+  }
+  benchmark::DoNotOptimize(lEntries);
+  pState.SetItemsProcessed(pState.iterations() * N);
+}
+BENCHMARK_TEMPLATE(WideParallelTransition, 4);
+BENCHMARK_TEMPLATE(WideParallelTransition, 16);
+BENCHMARK_TEMPLATE(WideParallelTransition, 64);
+
+/**
+event handled by no active state of N parallel regions : rejected before selection
+*/
+template <std::size_t N>
+static void UnhandledEvent(benchmark::State& pState){
+  int lEntries = 0;
+  std::unique_ptr<StateMachine> lMachine = makeQuiet(typename MakeIndices<N>::type(), lEntries);
+  lMachine->enter();
+  const EventId lQuiet = lMachine->event("quiet");
+
+  for (auto _ : pState){
+    lMachine->pushEvent(lQuiet);
+  }
+  pState.SetItemsProcessed(pState.iterations());
+  pState.counters["unhandled"] = static_cast<double>(lMachine->unhandledEvents());
+}
+BENCHMARK_TEMPLATE(UnhandledEvent, 1);
+BENCHMARK_TEMPLATE(UnhandledEvent, 16);
+BENCHMARK_TEMPLATE(UnhandledEvent, 64);
+
+/**
+a composite state left and entered again, three levels deep : with a deep history, and emulated by
+entering the initial states and pushing an event to get back to the previous configuration
+*/
+static void HistoryResume(benchmark::State& pState){
+  StateMachine lMachine(
+    State("Paused", initialTag,
+      Transition(OnEvent("resume"), Target("Session"))
+    ),
+    State("Session", deepHistoryTag,
+      Transition(OnEvent("pause"), Target("Paused")),
+      State("Menu", initialTag,
+        Transition(OnEvent("open"), Target("Level"))
+      ),
+      State("Level",
+        State("Start", initialTag,
+          Transition(OnEvent("open"), Target("Boss"))
+        ),
+        State("Boss")
+      )
+    )
+  );
+  lMachine.enter();
+  lMachine.pushEvents({ "resume", "open", "open" });
+  const EventId lPause = lMachine.event("pause");
+  const EventId lResume = lMachine.event("resume");
+
+  for (auto _ : pState){
+    lMachine.pushEvent(lPause);
+    lMachine.pushEvent(lResume);
+  }
+  pState.SetItemsProcessed(pState.iterations());
+}
+BENCHMARK(HistoryResume);
+
+static void EmulatedHistoryResume(benchmark::State& pState){
+  StateMachine lMachine(
+    State("Paused", initialTag,
+      Transition(OnEvent("resume"), Target("Session"))
+    ),
+    State("Session",
+      Transition(OnEvent("pause"), Target("Paused")),
+      State("Menu", initialTag,
+        Transition(OnEvent("open"), Target("Level")),
+        Transition(OnEvent("restore"), Target("Boss"))
+      ),
+      State("Level",
+        State("Start", initialTag,
+          Transition(OnEvent("open"), Target("Boss"))
+        ),
+        State("Boss")
+      )
+    )
+  );
+  lMachine.enter();
+  lMachine.pushEvents({ "resume", "open", "open" });
+  const EventId lPause = lMachine.event("pause");
+  const EventId lResume = lMachine.event("resume");
+  const EventId lRestore = lMachine.event("restore");
+
+  for (auto _ : pState){
+    lMachine.pushEvent(lPause);
+    lMachine.pushEvent(lResume);
+    lMachine.pushEvent(lRestore);
+  }
+  pState.SetItemsProcessed(pState.iterations());
+}
+BENCHMARK(EmulatedHistoryResume);
+
+/**
+snapshot of N parallel regions restored into another instance of the chart
+*/
+template <std::size_t N>
+static void SnapshotRestore(benchmark::State& pState){
+  int lEntries = 0;
+  std::unique_ptr<StateMachine> lMachine = makeWide(typename MakeIndices<N>::type(), lEntries);
+  lMachine->enter();
+  StateMachine lReplica(lMachine->chart());
+
+  for (auto _ : pState){
+    lReplica.restore(lMachine->snapshot());
+  }
+  pState.counters["bytes"] = static_cast<double>(lMachine->snapshot().size());
+}
+BENCHMARK_TEMPLATE(SnapshotRestore, 4);
+BENCHMARK_TEMPLATE(SnapshotRestore, 64);
+
+/**
+transitions between two states with After transitions, among the pending timers of other machines :
+each transition cancels a timer and arms another one
+*/
+static void AfterTransitionChurn(benchmark::State& pState){
+  TimerWheel lWheel;
+  std::shared_ptr<const StateChart> lChart = std::make_shared<const StateChart>(
+    State("S1", initialTag,
+      Transition(After(std::chrono::seconds(30)), Target("S2")),
+      Transition(OnEvent("flip"), Target("S2"))
+    ),
+    State("S2",
+      Transition(After(std::chrono::minutes(5)), Target("S1")),
+      Transition(OnEvent("flip"), Target("S1"))
+    )
+  );
+
+  std::vector<std::unique_ptr<StateMachine>> lPending;
+  for (int64_t lIndex = 0; lIndex < pState.range(0); ++lIndex){
+    lPending.emplace_back(new StateMachine(lChart));
+    lPending.back()->setTimerWheel(lWheel);
+    lPending.back()->enter();
+  }
+
+  StateMachine lMachine(lChart);
+  lMachine.setTimerWheel(lWheel);
+  lMachine.enter();
+  const EventId lFlip = lMachine.event("flip");
+
+  for (auto _ : pState){
+    lMachine.pushEvent(lFlip);
+  }
+  pState.SetItemsProcessed(pState.iterations());
+}
+BENCHMARK(AfterTransitionChurn)->Arg(0)->Arg(100000);
+
+/**
+range(0) instances of a three state chart stepped by the same event : through an InstancePool,
+and as separate StateMachine instances. one state out of three has an OnEntry callback
+*/
+namespace {
+  std::shared_ptr<const StateChart> makeCrowdChart(int& pEntries){
+    return std::make_shared<const StateChart>(
+      State("Idle", initialTag, Transition(OnEvent("tick"), Target("Walk"))),
+      State("Walk", Transition(OnEvent("tick"), Target("Run"))),
+      State("Run", OnEntry([&pEntries](){ ++pEntries; }), Transition(OnEvent("tick"), Target("Idle")))
+    );
+  }
+}
+
+static void BroadcastPool(benchmark::State& pState){
+  int lEntries = 0;
+  InstancePool lPool(makeCrowdChart(lEntries));
+  lPool.add(static_cast<std::size_t>(pState.range(0)));
+  const EventId lTick = lPool.event("tick");
+
+  for (auto _ : pState){
+    lPool.broadcast(lTick);
+  }
+  benchmark::DoNotOptimize(lEntries);
+  pState.SetItemsProcessed(pState.iterations() * pState.range(0));
+}
+BENCHMARK(BroadcastPool)->Arg(1000)->Arg(100000);
+
+static void BroadcastMachines(benchmark::State& pState){
+  int lEntries = 0;
+  std::shared_ptr<const StateChart> lChart = makeCrowdChart(lEntries);
+  std::vector<std::unique_ptr<StateMachine>> lMachines;
+  for (int64_t lIndex = 0; lIndex < pState.range(0); ++lIndex){
+    lMachines.emplace_back(new StateMachine(lChart));
+    lMachines.back()->enter();
+  }
+  const EventId lTick = lChart->event("tick");
+
+  for (auto _ : pState){
+    for (auto& lMachine : lMachines){
+      lMachine->pushEvent(lTick);
+    }
+  }
+  benchmark::DoNotOptimize(lEntries);
+  pState.SetItemsProcessed(pState.iterations() * pState.range(0));
+}
+BENCHMARK(BroadcastMachines)->Arg(1000)->Arg(100000);
+
+/**
+inState lookups by name in a flat chart of 256 states
+*/
+static void InState(benchmark::State& pState){
+  int lEntries = 0;
+  std::unique_ptr<StateMachine> lMachine = makeFlat(MakeIndices<255>::type(), lEntries);
+  lMachine->enter();
+  const std::string lActive = "S0";
+  const std::string lInactive = "S128";
+
+  for (auto _ : pState){
+    benchmark::DoNotOptimize(lMachine->inState(lActive));
+    benchmark::DoNotOptimize(lMachine->inState(lInactive));
+  }
+  pState.SetItemsProcessed(pState.iterations() * 2);
+}
+BENCHMARK(InState);
+
+/**
+the same lookups through StateId resolved once
+*/
+static void InStateId(benchmark::State& pState){
+  int lEntries = 0;
+  std::unique_ptr<StateMachine> lMachine = makeFlat(MakeIndices<255>::type(), lEntries);
+  lMachine->enter();
+  const StateId lActive = lMachine->state("S0");
+  const StateId lInactive = lMachine->state("S128");
+
+  for (auto _ : pState){
+    benchmark::DoNotOptimize(lMachine->inState(lActive));
+    benchmark::DoNotOptimize(lMachine->inState(lInactive));
+  }
+  pState.SetItemsProcessed(pState.iterations() * 2);
+}
+BENCHMARK(InStateId);
+
+/**
+range(0) states of a flat chart of 256 states tested at once against the active configuration
+*/
+static void ConfigurationIncludes(benchmark::State& pState){
+  int lEntries = 0;
+  std::unique_ptr<StateMachine> lMachine = makeFlat(MakeIndices<255>::type(), lEntries);
+  lMachine->enter();
+  StateSet lMask;
+  lMask.resize(lMachine->chart()->stateCount());
+  for (int64_t lState = 0; lState < pState.range(0); ++lState){
+    lMask.set(static_cast<std::size_t>(lState * 255 / pState.range(0)) + 1);
+  }
+
+  for (auto _ : pState){
+    benchmark::DoNotOptimize(lMachine->activeConfiguration().includes(lMask));
+    benchmark::DoNotOptimize(lMachine->activeConfiguration().intersects(lMask));
+  }
+  pState.SetItemsProcessed(pState.iterations() * pState.range(0));
+}
+BENCHMARK(ConfigurationIncludes)->Arg(1)->Arg(32);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,507 @@
+#include <instantFSM.h> 
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ifsm;
+
+/**
+AsyncProducers
+several threads push events while the owning thread processes them.
+meant to be run under ThreadSanitizer (cmake -DINSTANTFSM_TSAN=ON)
+*/
+TEST(instantFSM_concurrency, AsyncProducers){
+  const int lProducerCount = 4;
+  const int lEventsPerProducer = 20000;
+
+  int lTicks = 0;
+  int lFlips = 0;
+
+  StateMachine machine(
+    OnEvent("tick", [&lTicks](){ ++lTicks; }),
+    State("S1", initialTag,
+      Transition(OnEvent("flip"), Target("S2"), Action([&lFlips](){ ++lFlips; }))
+    ),
+    State("S2",
+      Transition(OnEvent("flip"), Target("S1"), Action([&lFlips](){ ++lFlips; }))
+    )
+  );
+  machine.enter();
+
+  const EventId lTick = machine.event("tick");
+  std::atomic<int> lStarted(0);
+  std::vector<std::thread> lProducers;
+  for (int lProducer = 0; lProducer < lProducerCount; ++lProducer){
+    lProducers.push_back(std::thread([&machine, &lStarted, lTick, lProducer, lEventsPerProducer](){
+      ++lStarted;
+      for (int lEvent = 0; lEvent < lEventsPerProducer; ++lEvent){
+        if (lProducer % 2 == 0){
+          machine.pushEventAsync(lTick);
+        } else {
+          machine.pushEventAsync(lEvent % 2 == 0 ? "tick" : "flip");
+        }
+      }
+    }));
+  }
+
+  const int lExpectedFlips = (lProducerCount / 2) * (lEventsPerProducer / 2);
+  const int lExpectedTicks = lProducerCount * lEventsPerProducer - lExpectedFlips;
+
+  //the owner thread keeps processing while the producers run
+  while (lTicks + lFlips < lExpectedTicks + lExpectedFlips){
+    machine.processEvents();
+    ASSERT_TRUE(machine.inState("S1") != machine.inState("S2"));
+  }
+
+  for (std::thread& lThread : lProducers){
+    lThread.join();
+  }
+  machine.processEvents();
+
+  ASSERT_EQ(lStarted.load(), lProducerCount);
+  ASSERT_EQ(lTicks, lExpectedTicks);
+  ASSERT_EQ(lFlips, lExpectedFlips);
+  ASSERT_TRUE(machine.inState("S1"));
+}
+
+/**
+AsyncOrdering
+events of a single producer are processed in the order they were pushed,
+after the events already pending
+*/
+TEST(instantFSM_concurrency, AsyncOrdering){
+  std::vector<int> lXpResult;
+
+  StateMachine machine(
+    OnEvent("one", [&lXpResult](){ lXpResult.push_back(1); }),
+    OnEvent("two", [&lXpResult](){ lXpResult.push_back(2); })
+  );
+  machine.enter();
+
+  std::thread lProducer([&machine](){
+    for (int i = 0; i < 100; ++i){
+      machine.pushEventAsync(i % 2 == 0 ? "one" : "two");
+    }
+  });
+  lProducer.join();
+
+  ASSERT_TRUE(lXpResult.empty());
+  machine.pushEvent("one");
+
+  ASSERT_EQ(lXpResult.size(), 101u);
+  for (int i = 0; i < 100; ++i){
+    ASSERT_EQ(lXpResult[i], i % 2 == 0 ? 1 : 2);
+  }
+  ASSERT_EQ(lXpResult[100], 1);
+}
+
+/**
+ExecutorProcessesAllEvents
+events posted from several threads to many machines are all processed,
+and a machine is never processed by two workers at once
+*/
+TEST(instantFSM_concurrency, ExecutorProcessesAllEvents){
+  const int lMachineCount = 64;
+  const int lEventsPerMachine = 500;
+
+  struct Session{
+    int mTicks;
+    std::atomic<int> mInside;
+    std::atomic<int> mOverlaps;
+  };
+  std::vector<std::unique_ptr<Session>> lSessions;
+  std::vector<std::unique_ptr<StateMachine>> lMachines;
+
+  for (int lMachine = 0; lMachine < lMachineCount; ++lMachine){
+    Session* lSession = new Session;
+    lSession->mTicks = 0;
+    lSession->mInside.store(0);
+    lSession->mOverlaps.store(0);
+    lSessions.push_back(std::unique_ptr<Session>(lSession));
+
+    lMachines.push_back(std::unique_ptr<StateMachine>(new StateMachine(
+      OnEvent("tick", [lSession](){
+        if (lSession->mInside.fetch_add(1) != 0){
+          ++lSession->mOverlaps;
+        }
+        ++lSession->mTicks;
+        lSession->mInside.fetch_sub(1);
+      }),
+      State("S1", initialTag,
+        Transition(OnEvent("flip"), Target("S2"))
+      ),
+      State("S2",
+        Transition(OnEvent("flip"), Target("S1"))
+      )
+    )));
+    lMachines.back()->enter();
+  }
+
+  {
+    StateMachineExecutor lExecutor(4);
+    ASSERT_EQ(lExecutor.threadCount(), 4u);
+
+    std::vector<StateMachineExecutor::Handle> lHandles;
+    for (auto& lMachine : lMachines){
+      lHandles.push_back(lExecutor.attach(*lMachine));
+    }
+
+    std::vector<std::thread> lProducers;
+    for (int lProducer = 0; lProducer < 2; ++lProducer){
+      lProducers.push_back(std::thread([&lExecutor, &lHandles, &lMachines, lEventsPerMachine](){
+        const EventId lTick = lMachines[0]->event("tick");
+        for (int lEvent = 0; lEvent < lEventsPerMachine / 2; ++lEvent){
+          for (std::size_t lMachine = 0; lMachine < lHandles.size(); ++lMachine){
+            if (lEvent % 2 == 0){
+              lExecutor.post(lHandles[lMachine], lTick);
+            } else {
+              lExecutor.post(lHandles[lMachine], "tick");
+            }
+          }
+        }
+        for (std::size_t lMachine = 0; lMachine < lHandles.size(); ++lMachine){
+          lExecutor.post(lHandles[lMachine], "flip");
+        }
+      }));
+    }
+
+    for (std::thread& lThread : lProducers){
+      lThread.join();
+    }
+    lExecutor.wait();
+  }
+
+  for (int lMachine = 0; lMachine < lMachineCount; ++lMachine){
+    ASSERT_EQ(lSessions[lMachine]->mTicks, lEventsPerMachine);
+    ASSERT_EQ(lSessions[lMachine]->mOverlaps.load(), 0);
+    ASSERT_TRUE(lMachines[lMachine]->inState("S1"));
+  }
+}
+
+/**
+ExecutorRethrows
+an exception thrown while processing a machine reaches wait, once, and the other machines are still processed
+*/
+TEST(instantFSM_concurrency, ExecutorRethrows){
+  const int lMachineCount = 8;
+  const int lEventsPerMachine = 100;
+
+  std::atomic<int> lTicks(0);
+  std::vector<std::unique_ptr<StateMachine>> lMachines;
+  for (int lMachine = 0; lMachine < lMachineCount; ++lMachine){
+    lMachines.push_back(std::unique_ptr<StateMachine>(new StateMachine(
+      OnEvent("tick", [&lTicks](){ ++lTicks; }),
+      OnEvent("boom", [](){ throw std::runtime_error("boom"); }),
+      State("S1", initialTag)
+    )));
+    lMachines.back()->enter();
+  }
+
+  StateMachineExecutor lExecutor(4);
+  std::vector<StateMachineExecutor::Handle> lHandles;
+  for (auto& lMachine : lMachines){
+    lHandles.push_back(lExecutor.attach(*lMachine));
+  }
+
+  lExecutor.post(lHandles[0], "boom");
+  for (int lEvent = 0; lEvent < lEventsPerMachine; ++lEvent){
+    for (int lMachine = 1; lMachine < lMachineCount; ++lMachine){
+      lExecutor.post(lHandles[lMachine], "tick");
+    }
+  }
+  ASSERT_THROW(lExecutor.wait(), std::runtime_error);
+  ASSERT_EQ(lTicks.load(), (lMachineCount - 1) * lEventsPerMachine);
+
+  //the error was reported : the executor goes on
+  for (int lMachine = 1; lMachine < lMachineCount; ++lMachine){
+    lExecutor.post(lHandles[lMachine], "tick");
+  }
+  ASSERT_NO_THROW(lExecutor.wait());
+  ASSERT_EQ(lTicks.load(), (lMachineCount - 1) * (lEventsPerMachine + 1));
+}
+
+/**
+TimersOnExecutor
+machines attached to an executor share a wheel advanced by another thread : timers are armed and
+canceled from the workers while the wheel fires, and each fired timer is processed on a worker
+*/
+TEST(instantFSM_concurrency, TimersOnExecutor){
+  const int lMachineCount = 64;
+  const int lRoundCount = 50;
+
+  std::atomic<int> lDone(0);
+  std::atomic<int> lArmed(0);
+
+  std::shared_ptr<const StateChart> lChart = std::make_shared<const StateChart>(
+    State("Idle", initialTag,
+      Transition(OnEvent("arm"), Target("Waiting"))
+    ),
+    State("Waiting",
+      OnEntry([&](){ ++lArmed; }),
+      Transition(OnEvent("cancel"), Target("Idle")),
+      Transition(After(std::chrono::milliseconds(2)), Target("Done"))
+    ),
+    State("Done",
+      OnEntry([&](){ ++lDone; })
+    )
+  );
+
+  TimerWheel lWheel(std::chrono::microseconds(500));
+  std::vector<std::unique_ptr<StateMachine>> lMachines;
+  for (int lMachine = 0; lMachine < lMachineCount; ++lMachine){
+    lMachines.push_back(std::unique_ptr<StateMachine>(new StateMachine(lChart)));
+    lMachines.back()->setTimerWheel(lWheel);
+    lMachines.back()->enter();
+  }
+
+  {
+    StateMachineExecutor lExecutor(4);
+    std::vector<StateMachineExecutor::Handle> lHandles;
+    for (auto& lMachine : lMachines){
+      lHandles.push_back(lExecutor.attach(*lMachine));
+    }
+
+    std::atomic<bool> lAdvancing(true);
+    std::thread lTicker([&lWheel, &lAdvancing](){
+      while (lAdvancing.load()){
+        lWheel.advance();
+        std::this_thread::yield();
+      }
+    });
+
+    //timers armed and canceled over and over, some of them firing before their cancel is processed
+    for (int lRound = 0; lRound < lRoundCount; ++lRound){
+      for (StateMachineExecutor::Handle& lHandle : lHandles){
+        lExecutor.post(lHandle, "arm");
+        lExecutor.post(lHandle, "cancel");
+      }
+    }
+    for (StateMachineExecutor::Handle& lHandle : lHandles){
+      lExecutor.post(lHandle, "arm");
+    }
+
+    const std::chrono::steady_clock::time_point lDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (lDone.load() != lMachineCount && std::chrono::steady_clock::now() < lDeadline){
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    lAdvancing.store(false);
+    lTicker.join();
+    lExecutor.wait();
+  }
+
+  ASSERT_EQ(lDone.load(), lMachineCount);
+  ASSERT_GE(lArmed.load(), lMachineCount);
+  ASSERT_EQ(lWheel.pendingCount(), 0u);
+  for (auto& lMachine : lMachines){
+    ASSERT_TRUE(lMachine->inState("Done"));
+  }
+}
+
+/**
+RegionsOnExecutor
+transitions of orthogonal regions have their callbacks run on the executor one phase at a time :
+every exit before any action, every action before any entry
+*/
+namespace {
+  //runs the tasks in order on the calling thread, counting the phases
+  struct PhaseCounter : RegionExecutor{
+    PhaseCounter() : mPhases(0), mTasks(0){}
+
+    virtual void forEach(std::size_t pCount, const std::function<void(std::size_t)>& pTask){
+      ++mPhases;
+      mTasks += pCount;
+      for (std::size_t lIndex = 0; lIndex < pCount; ++lIndex){
+        pTask(lIndex);
+      }
+    }
+
+    int mPhases;
+    std::size_t mTasks;
+  };
+}
+
+TEST(instantFSM_concurrency, RegionsOnExecutor){
+  const int lRegionCount = 8;
+  std::atomic<int> lExits(0);
+  std::atomic<int> lActions(0);
+  std::atomic<int> lEntries(0);
+  std::atomic<int> lOutOfOrder(0);
+
+  auto lRegion = [&](int pIndex){
+    const std::string lName = "R" + std::to_string(pIndex);
+    return State(lName,
+      State(lName + "a", initialTag,
+        OnExit([&](){
+          lOutOfOrder += lActions.load() != 0 ? 1 : 0;
+          ++lExits;
+        }),
+        Transition(OnEvent("flip"), Target(lName + "b"), Action([&](){
+          lOutOfOrder += lExits.load() != lRegionCount || lEntries.load() != 0 ? 1 : 0;
+          ++lActions;
+        }))
+      ),
+      State(lName + "b",
+        OnEntry([&, lName](StateMachine& pMachine){
+          lOutOfOrder += lActions.load() != lRegionCount || !pMachine.inState(lName + "b") ? 1 : 0;
+          ++lEntries;
+        }),
+        Transition(OnEvent("flip"), Target(lName + "a"))
+      )
+    );
+  };
+
+  std::shared_ptr<const StateChart> lChart = std::make_shared<const StateChart>(
+    State("P", initialTag, parallelTag,
+      lRegion(0), lRegion(1), lRegion(2), lRegion(3), lRegion(4), lRegion(5), lRegion(6), lRegion(7)
+    ),
+    OnEvent("ping", [](){})
+  );
+
+  PhaseCounter lCounter;
+  StateMachine lCounted(lChart);
+  lCounted.setRegionExecutor(&lCounter);
+  ASSERT_EQ(lCounted.regionExecutor(), &lCounter);
+  lCounted.enter();
+  lCounted.pushEvent("flip");
+  ASSERT_EQ(lCounter.mPhases, 3);
+  ASSERT_EQ(lCounter.mTasks, 3u * lRegionCount);
+  //a single transition runs on the calling thread
+  lCounted.pushEvent("ping");
+  ASSERT_EQ(lCounter.mPhases, 3);
+  ASSERT_EQ(lOutOfOrder.load(), 0);
+
+  StateMachineExecutor lExecutor(4);
+  StateMachine lMachine(lChart);
+  lMachine.setRegionExecutor(&lExecutor);
+  lMachine.enter();
+  for (int lRound = 0; lRound < 50; ++lRound){
+    lExits.store(0);
+    lActions.store(0);
+    lEntries.store(0);
+    lMachine.pushEvent("flip");
+    ASSERT_EQ(lEntries.load(), lRound % 2 == 0 ? lRegionCount : 0);
+    for (int lIndex = 0; lIndex < lRegionCount; ++lIndex){
+      ASSERT_TRUE(lMachine.inState("R" + std::to_string(lIndex) + (lRound % 2 == 0 ? "b" : "a")));
+    }
+  }
+  ASSERT_EQ(lOutOfOrder.load(), 0);
+
+  //exceptions are rethrown on the calling thread once the phase is done
+  std::atomic<int> lRan(0);
+  ASSERT_THROW(lExecutor.forEach(16, [&lRan](std::size_t pIndex){
+    ++lRan;
+    if (pIndex == 3){
+      throw std::runtime_error("task");
+    }
+  }), std::runtime_error);
+  ASSERT_EQ(lRan.load(), 16);
+}
+
+/**
+RegionsKeepTheirOrder
+the transitions taken in the same region run on a single task, in document order, and the
+executor is only used when at least two regions take transitions
+*/
+TEST(instantFSM_concurrency, RegionsKeepTheirOrder){
+  PhaseCounter lCounter;
+  std::vector<std::string> lTrace;
+
+  //targetless transitions of a chart without parallel state
+  StateMachine lFlat(
+    State("S", initialTag,
+      Transition(OnEvent("ping"), Action([&lTrace](){ lTrace.push_back("first"); })),
+      OnEvent("ping", [&lTrace](){ lTrace.push_back("second"); })
+    )
+  );
+  lFlat.setRegionExecutor(&lCounter);
+  lFlat.enter();
+  lFlat.pushEvent("ping");
+  ASSERT_EQ(lCounter.mPhases, 0);
+  ASSERT_EQ(lTrace, std::vector<std::string>({ "first", "second" }));
+
+  //R0 takes two transitions and R1 one : two tasks per phase, and R0 runs its own in order
+  std::vector<std::string> lFirstRegion;
+  std::vector<std::string> lSecondRegion;
+  std::shared_ptr<const StateChart> lChart = std::make_shared<const StateChart>(
+    State("P", initialTag, parallelTag,
+      State("R0",
+        State("R0a", initialTag,
+          Transition(OnEvent("go"), Action([&lFirstRegion](){ lFirstRegion.push_back("action"); })),
+          OnEvent("go", [&lFirstRegion](){ lFirstRegion.push_back("reaction"); })
+        )
+      ),
+      State("R1",
+        State("R1a", initialTag,
+          Transition(OnEvent("go"), Target("R1b"), Action([&lSecondRegion](){ lSecondRegion.push_back("to b"); }))
+        ),
+        State("R1b",
+          Transition(OnEvent("go"), Target("R1a"), Action([&lSecondRegion](){ lSecondRegion.push_back("to a"); }))
+        )
+      )
+    )
+  );
+
+  StateMachine lCounted(lChart);
+  lCounted.setRegionExecutor(&lCounter);
+  lCounted.enter();
+  lCounted.pushEvent("go");
+  ASSERT_EQ(lCounter.mPhases, 3);
+  ASSERT_EQ(lCounter.mTasks, 6u);
+  ASSERT_EQ(lFirstRegion, std::vector<std::string>({ "action", "reaction" }));
+  ASSERT_TRUE(lCounted.inState("R1b"));
+
+  //a transition leaving a parallel state groups the regions nested in it with its own
+  std::shared_ptr<const StateChart> lNested = std::make_shared<const StateChart>(
+    State("P", initialTag, parallelTag,
+      State("R0",
+        State("Q", initialTag, parallelTag,
+          State("Qa", Transition(OnEvent("go"), Action([&lFirstRegion](){ lFirstRegion.push_back("stay"); }))),
+          State("Qb", Transition(OnEvent("go"), Target("R0x"), Action([&lFirstRegion](){ lFirstRegion.push_back("leave"); })))
+        ),
+        State("R0x")
+      ),
+      State("R1", Transition(OnEvent("go"), Action([&lSecondRegion](){ lSecondRegion.push_back("other"); })))
+    )
+  );
+  lFirstRegion.clear();
+  lCounter.mPhases = 0;
+  lCounter.mTasks = 0;
+  StateMachine lNestedMachine(lNested);
+  lNestedMachine.setRegionExecutor(&lCounter);
+  lNestedMachine.enter();
+  lNestedMachine.pushEvent("go");
+  ASSERT_EQ(lCounter.mPhases, 3);
+  ASSERT_EQ(lCounter.mTasks, 6u);
+  ASSERT_EQ(lFirstRegion, std::vector<std::string>({ "stay", "leave" }));
+  ASSERT_TRUE(lNestedMachine.inState("R0x"));
+
+  //the transitions of a region share its data without synchronization
+  StateMachineExecutor lExecutor(4);
+  StateMachine lMachine(lChart);
+  lMachine.setRegionExecutor(&lExecutor);
+  lMachine.enter();
+  lFirstRegion.clear();
+  lSecondRegion.clear();
+  for (int lRound = 0; lRound < 100; ++lRound){
+    lMachine.pushEvent("go");
+  }
+  ASSERT_EQ(lFirstRegion.size(), 200u);
+  for (std::size_t lIndex = 0; lIndex < lFirstRegion.size(); lIndex += 2){
+    ASSERT_EQ(lFirstRegion[lIndex], "action");
+    ASSERT_EQ(lFirstRegion[lIndex + 1], "reaction");
+  }
+  ASSERT_EQ(lSecondRegion.size(), 100u);
+  ASSERT_TRUE(lMachine.inState("R1a"));
+}
+
+int main(int argc, char** argv){
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
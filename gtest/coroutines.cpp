@@ -0,0 +1,190 @@
+#include <instantFSM.h>
+
+#include "gtest/gtest.h"
+
+#include <coroutine>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace ifsm;
+
+/**
+suspends the coroutines awaiting it until open is called, like a pending I/O
+*/
+struct Gate{
+  struct Awaiter{
+    bool await_ready() const { return false; }
+
+    void await_suspend(std::coroutine_handle<> pCoroutine){
+      mGate->mWaiting.push_back(pCoroutine);
+    }
+
+    void await_resume() const {}
+
+    Gate* mGate;
+  };
+
+  Awaiter wait(){
+    return Awaiter{ this };
+  }
+
+  void open(){
+    std::vector<std::coroutine_handle<>> lWaiting;
+    lWaiting.swap(mWaiting);
+    for (std::coroutine_handle<> lCoroutine : lWaiting){
+      lCoroutine.resume();
+    }
+  }
+
+  std::vector<std::coroutine_handle<>> mWaiting;
+};
+
+TEST(instantFSM_coroutines, ActionSuspendsTransition){
+  Gate lGate;
+  std::vector<std::string> lTrace;
+
+  StateMachine machine(
+    State("S1", initialTag,
+      OnExit([&](){ lTrace.push_back("exit S1"); }),
+      Transition(OnEvent("next"), Target("S2"), Action([&]() -> Task {
+        lTrace.push_back("begin action");
+        co_await lGate.wait();
+        lTrace.push_back("end action");
+      }))
+    ),
+    State("S2",
+      OnEntry([&](){ lTrace.push_back("enter S2"); }),
+      Transition(OnEvent("back"), Target("S1"))
+    )
+  );
+
+  machine.enter();
+  ASSERT_FALSE(machine.isSuspended());
+
+  machine.pushEvent("next");
+  ASSERT_TRUE(machine.isSuspended());
+  ASSERT_FALSE(machine.inState("S1"));
+  ASSERT_FALSE(machine.inState("S2"));
+  ASSERT_EQ(lTrace, (std::vector<std::string>{ "exit S1", "begin action" }));
+
+  //queued until the transition has been taken
+  machine.pushEvent("back");
+  machine.processEvents();
+  ASSERT_TRUE(machine.isSuspended());
+  ASSERT_EQ(lTrace.size(), 2u);
+
+  //the coroutine completes, the transition resumes on the next call
+  lGate.open();
+  ASSERT_TRUE(machine.isSuspended());
+  ASSERT_EQ(lTrace.size(), 3u);
+
+  machine.processEvents();
+  ASSERT_FALSE(machine.isSuspended());
+  ASSERT_EQ(lTrace, (std::vector<std::string>{ "exit S1", "begin action", "end action", "enter S2" }));
+  ASSERT_TRUE(machine.inState("S1"));
+}
+
+TEST(instantFSM_coroutines, EntryCallbacks){
+  Gate lGate;
+  int lEntered = 0;
+  EventId lPayload = 0;
+
+  StateMachine machine(
+    State("S1", initialTag,
+      OnEntry([&](StateMachine&) -> Task {
+        co_await lGate.wait();
+        ++lEntered;
+      }),
+      OnEntry([&](){ ++lEntered; }),
+      Transition(OnEvent("next"), Target("S2"))
+    ),
+    State("S2",
+      //completes without suspending : the same as a synchronous callback
+      OnEntry([&]() -> Task { ++lEntered; co_return; }),
+      Transition(OnEvent("value"), Target("S1"), Action([&](const EventId& pValue) -> Task {
+        lPayload = pValue;
+        co_return;
+      }))
+    )
+  );
+
+  machine.enter();
+  ASSERT_TRUE(machine.isSuspended());
+  ASSERT_TRUE(machine.inState("S1"));
+  ASSERT_EQ(lEntered, 0);
+
+  machine.pushEvent("next");
+  lGate.open();
+  ASSERT_EQ(lEntered, 1);
+
+  //the remaining OnEntry callback runs, then the queued event
+  machine.pushEvent("value", EventId(7));
+  ASSERT_EQ(lEntered, 3);
+  ASSERT_TRUE(machine.inState("S1"));
+  ASSERT_TRUE(machine.isSuspended());
+  ASSERT_EQ(lPayload, 7u);
+
+  //an abandoned coroutine still completes on its own
+  machine.leave();
+  lGate.open();
+  ASSERT_EQ(lEntered, 4);
+}
+
+TEST(instantFSM_coroutines, ExceptionsAndAbandon){
+  Gate lGate;
+  bool lFinished = false;
+
+  StateMachine machine(
+    State("S1", initialTag,
+      Transition(OnEvent("fail"), Target("S2"), Action([&]() -> Task {
+        co_await lGate.wait();
+        throw std::runtime_error("failed");
+      })),
+      Transition(OnEvent("wait"), Target("S2"), Action([&]() -> Task {
+        co_await lGate.wait();
+        lFinished = true;
+      }))
+    ),
+    State("S2",
+      OnExit([&]() -> Task {
+        co_await lGate.wait();
+        lFinished = true;
+      })
+    )
+  );
+
+  machine.enter();
+  machine.pushEvent("fail");
+  lGate.open();
+  ASSERT_THROW(machine.processEvents(), std::runtime_error);
+  ASSERT_FALSE(machine.isSuspended());
+
+  //leave abandons the suspended transition : the coroutine completes on its own
+  machine.leave();
+  machine.enter();
+  machine.pushEvent("wait");
+  ASSERT_TRUE(machine.isSuspended());
+  machine.leave();
+  ASSERT_FALSE(machine.isSuspended());
+  lGate.open();
+  ASSERT_TRUE(lFinished);
+
+  //leave doesn't await the Tasks of OnExit callbacks
+  machine.enter();
+  machine.pushEvent("wait");
+  lGate.open();
+  machine.processEvents();
+  ASSERT_TRUE(machine.inState("S2"));
+  lFinished = false;
+  machine.leave();
+  ASSERT_FALSE(machine.isSuspended());
+  ASSERT_FALSE(machine.isActive());
+  lGate.open();
+  ASSERT_TRUE(lFinished);
+}
+
+int main(int argc, char** argv){
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
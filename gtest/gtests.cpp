@@ -3,8 +3,31 @@
 
 #include "gtest/gtest.h"
 
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <iterator>
+#include <numeric>
+
 using namespace ifsm;
 
+//count heap allocations, to check that processing events doesn't allocate
+static std::size_t gAllocationCount = 0;
+
+void* operator new(std::size_t pSize){
+  ++gAllocationCount;
+  void* lPtr = std::malloc(pSize == 0 ? 1 : pSize);
+  if (lPtr == nullptr){
+    throw std::bad_alloc();
+  }
+  return lPtr;
+}
+
+void operator delete(void* pPtr) NOEXCEPT{
+  std::free(pPtr);
+}
+
 /**
 Canonical
 */
@@ -784,6 +807,310 @@ TEST(instantFSM, ParallelConflictingTransition){
 
 }
 
+/**
+ParallelAncestorTransition
+*/
+TEST(instantFSM, ParallelAncestorTransition){
+  std::vector<std::string> lXpResult;
+  std::vector<std::string> lRefResult = { "S1", "S2A" };
+
+  StateMachine machine(
+    State("S1", parallelTag, initialTag,
+      OnEvent("event", [&lXpResult](){
+        lXpResult.push_back("S1");
+      }),
+      State("S1A"),
+      State("S1B")
+    ),
+    State("S2",
+      State("S2A", initialTag,
+        OnEvent("event", [&lXpResult](){
+          lXpResult.push_back("S2A");
+        })
+      )
+    ),
+    Transition(OnEvent("next"), Target("S2A"))
+  );
+
+  machine.enter();
+
+  //S1 transitions are candidates for both S1A and S1B but must fire once
+  machine.pushEvent("event");
+  machine.pushEvent("next");
+  machine.pushEvent("event");
+
+  ASSERT_EQ(lRefResult, lXpResult);
+
+}
+
+/**
+ParallelRegionsConfiguration
+*/
+TEST(instantFSM, ParallelRegionsConfiguration){
+  std::vector<std::string> lXpResult;
+  std::vector<std::string> lRefResult = { "SA2 entry : SA1 inactive, SB1 active" };
+
+  StateMachine machine(parallelTag,
+    State("SA",
+      State("SA1", initialTag,
+        Transition(OnEvent("a"), Target("SA2"))
+      ),
+      State("SA2",
+        OnEntry([&lXpResult](StateMachine& pMachine){
+          lXpResult.push_back(std::string("SA2 entry : ")
+            + (pMachine.inState("SA1") ? "SA1 active" : "SA1 inactive") + ", "
+            + (pMachine.inState("SB1") ? "SB1 active" : "SB1 inactive"));
+        })
+      )
+    ),
+    State("SB",
+      State("SB1", initialTag,
+        Transition(OnEvent("b"), Target("SB2"))
+      ),
+      State("SB2")
+    )
+  );
+
+  machine.enter();
+
+  ASSERT_TRUE(machine.inState("SA1"));
+  ASSERT_TRUE(machine.inState("SB1"));
+
+  machine.pushEvent("a");
+
+  ASSERT_FALSE(machine.inState("SA1"));
+  ASSERT_TRUE(machine.inState("SA2"));
+  ASSERT_TRUE(machine.inState("SB1"));
+
+  machine.pushEvent("b");
+
+  ASSERT_TRUE(machine.inState("SA"));
+  ASSERT_TRUE(machine.inState("SA2"));
+  ASSERT_TRUE(machine.inState("SB"));
+  ASSERT_FALSE(machine.inState("SB1"));
+  ASSERT_TRUE(machine.inState("SB2"));
+
+  machine.leave();
+
+  ASSERT_FALSE(machine.inState("SA"));
+  ASSERT_FALSE(machine.inState("SA2"));
+  ASSERT_FALSE(machine.inState("SB2"));
+
+  ASSERT_EQ(lRefResult, lXpResult);
+
+}
+
+/**
+ParallelRegionsSimultaneousTransitions
+*/
+TEST(instantFSM, ParallelRegionsSimultaneousTransitions){
+  std::vector<std::string> lXpResult;
+  std::vector<std::string> lRefResult = { "SA1 exit", "SB1 exit", "SA2 entry", "SB2 entry" };
+
+  StateMachine machine(parallelTag,
+    State("SA",
+      State("SA1", initialTag,
+        OnExit([&lXpResult](){lXpResult.push_back("SA1 exit"); }),
+        Transition(OnEvent("event"), Target("SA2"))
+      ),
+      State("SA2",
+        OnEntry([&lXpResult](){lXpResult.push_back("SA2 entry"); })
+      )
+    ),
+    State("SB",
+      State("SB1", initialTag,
+        OnExit([&lXpResult](){lXpResult.push_back("SB1 exit"); }),
+        Transition(OnEvent("event"), Target("SB2"))
+      ),
+      State("SB2",
+        OnEntry([&lXpResult](){lXpResult.push_back("SB2 entry"); })
+      )
+    )
+  );
+
+  machine.enter();
+
+  //both transitions exit disjoint sets of states : none preempts the other
+  machine.pushEvent("event");
+
+  ASSERT_TRUE(machine.inState("SA2"));
+  ASSERT_TRUE(machine.inState("SB2"));
+
+  ASSERT_EQ(lRefResult, lXpResult);
+
+}
+
+/**
+TransitionToParallelSibling
+*/
+TEST(instantFSM, TransitionToParallelSibling){
+  std::vector<std::string> lXpResult;
+  std::vector<std::string> lRefResult = { "SB1 exit", "SA1 exit", "SA1 entry", "SB2 entry" };
+
+  StateMachine machine(parallelTag,
+    State("SA",
+      State("SA1", initialTag,
+        OnEntry([&lXpResult](){lXpResult.push_back("SA1 entry"); }),
+        OnExit([&lXpResult](){lXpResult.push_back("SA1 exit"); }),
+        Transition(OnEvent("event"), Target("SB2"))
+      )
+    ),
+    State("SB",
+      State("SB1", initialTag,
+        OnExit([&lXpResult](){lXpResult.push_back("SB1 exit"); })
+      ),
+      State("SB2",
+        OnEntry([&lXpResult](){lXpResult.push_back("SB2 entry"); })
+      )
+    )
+  );
+
+  machine.enter();
+  lXpResult.clear();
+
+  //both regions are exited then entered again, SA region through its initial state
+  machine.pushEvent("event");
+
+  ASSERT_TRUE(machine.inState("SA"));
+  ASSERT_TRUE(machine.inState("SA1"));
+  ASSERT_TRUE(machine.inState("SB"));
+  ASSERT_TRUE(machine.inState("SB2"));
+  ASSERT_FALSE(machine.inState("SB1"));
+
+  ASSERT_EQ(lRefResult, lXpResult);
+
+}
+
+/**
+TransitionToAncestor
+*/
+TEST(instantFSM, TransitionToAncestor){
+  std::vector<std::string> lXpResult;
+  std::vector<std::string> lRefResult = { "S1B exit", "S1 exit", "S1 entry", "S1A entry" };
+
+  StateMachine machine(
+    State("S1", initialTag,
+      OnEntry([&lXpResult](){lXpResult.push_back("S1 entry"); }),
+      OnExit([&lXpResult](){lXpResult.push_back("S1 exit"); }),
+      State("S1A", initialTag,
+        OnEntry([&lXpResult](){lXpResult.push_back("S1A entry"); }),
+        Transition(OnEvent("next"), Target("S1B"))
+      ),
+      State("S1B",
+        OnExit([&lXpResult](){lXpResult.push_back("S1B exit"); }),
+        Transition(OnEvent("reset"), Target("S1"))
+      )
+    )
+  );
+
+  machine.enter();
+  machine.pushEvent("next");
+  lXpResult.clear();
+
+  machine.pushEvent("reset");
+
+  ASSERT_TRUE(machine.inState("S1A"));
+  ASSERT_FALSE(machine.inState("S1B"));
+
+  ASSERT_EQ(lRefResult, lXpResult);
+
+}
+
+/**
+NoAllocationAfterWarmUp
+*/
+TEST(instantFSM, NoAllocationAfterWarmUp){
+  int lEntries = 0;
+  int lActions = 0;
+
+  StateMachine machine(parallelTag,
+    State("SA",
+      State("SA1", initialTag,
+        Transition(OnEvent("toggle"), Target("SA2"), Action([&lActions](){ ++lActions; }))
+      ),
+      State("SA2",
+        OnEntry([&lEntries](){ ++lEntries; }),
+        Transition(OnEvent("toggle"), Target("SA1"))
+      )
+    ),
+    State("SB",
+      OnEvent("tick", [&lActions](StateMachine& pMachine){
+        ++lActions;
+        pMachine.pushEvent("toggle");
+      })
+    )
+  );
+
+  EventId lTick = machine.event("tick");
+  EventId lToggle = machine.event("toggle");
+
+  machine.enter();
+
+  //warm up : let the internal buffers grow
+  for (int lIndex = 0; lIndex < 10; ++lIndex){
+    machine.pushEvent(lTick);
+    machine.pushEvent(lToggle);
+    machine.pushEvent("tick");
+  }
+
+  lEntries = 0;
+  lActions = 0;
+  std::size_t lAllocations = gAllocationCount;
+
+  for (int lIndex = 0; lIndex < 1000; ++lIndex){
+    machine.pushEvent(lTick);
+    machine.pushEvent(lToggle);
+    machine.pushEvent("tick");
+  }
+
+  ASSERT_EQ(lAllocations, gAllocationCount);
+  ASSERT_EQ(1500, lEntries);
+  ASSERT_EQ(3500, lActions);
+
+}
+
+/**
+PushEventId
+*/
+TEST(instantFSM, PushEventId){
+  std::vector<std::string> lXpResult;
+  std::vector<std::string> lRefResult = { "S1 event", "S2 other", "S2 event" };
+
+  StateMachine machine(
+    State("S1", initialTag,
+      OnEvent("event", [&lXpResult](){
+        lXpResult.push_back("S1 event");
+      }),
+      Transition(OnEvent("other"), Target("S2"))
+    ),
+    State("S2",
+      OnEvent("event", [&lXpResult](){
+        lXpResult.push_back("S2 event");
+      }),
+      OnEvent("other", [&lXpResult](){
+        lXpResult.push_back("S2 other");
+      })
+    )
+  );
+
+  EventId lEvent = machine.event("event");
+  EventId lOther = machine.event("other");
+  ASSERT_NE(lEvent, lOther);
+
+  machine.enter();
+
+  machine.pushEvent(lEvent);
+  machine.pushEvent(lOther);
+  ASSERT_TRUE(machine.inState("S2"));
+  machine.pushEvent(lOther);
+  machine.pushEvent("event");
+  machine.pushEvent("unknown");
+  machine.pushEvent(InvalidEvent);
+
+  ASSERT_EQ(lRefResult, lXpResult);
+
+}
+
 
 /**
 TransitionBetweenParallel
@@ -931,6 +1258,1319 @@ TEST(instantFSM, ThrowsEventAlreadySpecified){
 
 }
 
+/**
+Throws NoSuchEvent
+*/
+TEST(instantFSM, ThrowsNoSuchEvent){
+  StateMachine machine(
+    State("S1", initialTag,
+      OnEvent("event", [](){})
+    )
+  );
+
+  ASSERT_NO_THROW(machine.event("event"));
+  ASSERT_THROW(machine.event("doesnotexist"), ifsm::NoSuchEvent);
+
+}
+
+namespace staticChart{
+  struct S1; struct S11; struct S12; struct S2; struct S21; struct S22;
+  struct next; struct jump; struct back; struct count;
+}
+
+/**
+StaticStateMachine
+*/
+TEST(instantFSM, StaticStateMachine){
+  using namespace staticChart;
+  std::vector<std::string> lXpResult;
+
+  auto machine = makeStaticStateMachine(
+    typed::OnEntry([&lXpResult](){lXpResult.push_back("root");}),
+    typed::State<S1>(initialTag,
+      typed::OnEntry([&lXpResult](){lXpResult.push_back("S1");}),
+      typed::OnExit([&lXpResult](){lXpResult.push_back("~S1");}),
+      typed::Transition(
+        typed::OnEvent<next>(),
+        typed::Target<S2>(),
+        typed::Action([&lXpResult](){lXpResult.push_back("S1->S2");})
+      )
+    ),
+    typed::State<S2>(
+      typed::OnEntry([&lXpResult](){lXpResult.push_back("S2");}),
+      typed::OnExit([&lXpResult](){lXpResult.push_back("~S2");}),
+      typed::Transition(
+        typed::OnEvent<next>(),
+        typed::Target<S1>()
+      )
+    )
+  );
+
+  ASSERT_FALSE(machine.isActive());
+  machine.enter();
+  ASSERT_TRUE(machine.inState<S1>());
+  machine.pushEvent<next>();
+  ASSERT_TRUE(machine.inState<S2>());
+  ASSERT_FALSE(machine.inState<S1>());
+  machine.pushEvent<jump>();
+  ASSERT_TRUE(machine.inState<S2>());
+  machine.pushEvent<next>();
+  machine.leave();
+  ASSERT_FALSE(machine.inState<S1>());
+
+  std::vector<std::string> lRefResult = {"root", "S1", "~S1", "S1->S2", "S2", "~S2", "S1", "~S1"};
+  ASSERT_EQ(lXpResult, lRefResult);
+}
+
+/**
+StaticStateMachineMatchesStateMachine
+the same nested chart defined for both machines produces the same callbacks
+*/
+TEST(instantFSM, StaticStateMachineMatchesStateMachine){
+  using namespace staticChart;
+  std::vector<std::string> lXpResult;
+  std::vector<std::string> lRefResult;
+  int lCount = 0;
+  int lRefCount = 0;
+
+  auto lStatic = makeStaticStateMachine(
+    typed::OnEvent<count>([&lCount](){++lCount;}),
+    typed::State<S1>(initialTag,
+      typed::OnEntry([&lXpResult](){lXpResult.push_back("S1");}),
+      typed::OnExit([&lXpResult](){lXpResult.push_back("~S1");}),
+      typed::Transition(typed::OnEvent<jump>(), typed::Target<S22>()),
+      typed::State<S11>(initialTag,
+        typed::OnEntry([&lXpResult](){lXpResult.push_back("S11");}),
+        typed::OnExit([&lXpResult](){lXpResult.push_back("~S11");}),
+        typed::Transition(typed::OnEvent<next>(), typed::Target<S12>())
+      ),
+      typed::State<S12>(
+        typed::OnEntry([&lXpResult](){lXpResult.push_back("S12");}),
+        typed::OnExit([&lXpResult](){lXpResult.push_back("~S12");}),
+        typed::Transition(typed::OnEvent<next>(), typed::Condition([&lCount](){return lCount > 0;}), typed::Target<S2>()),
+        typed::Transition(typed::OnEvent<back>(), typed::Target<S1>())
+      )
+    ),
+    typed::State<S2>(
+      typed::OnEntry([&lXpResult](){lXpResult.push_back("S2");}),
+      typed::OnExit([&lXpResult](){lXpResult.push_back("~S2");}),
+      typed::Transition(typed::OnEvent<back>(), typed::Target<S11>(), typed::Action([&lXpResult](){lXpResult.push_back("back");})),
+      typed::State<S21>(initialTag,
+        typed::OnEntry([&lXpResult](){lXpResult.push_back("S21");}),
+        typed::OnExit([&lXpResult](){lXpResult.push_back("~S21");})
+      ),
+      typed::State<S22>(
+        typed::OnEntry([&lXpResult](){lXpResult.push_back("S22");}),
+        typed::OnExit([&lXpResult](){lXpResult.push_back("~S22");}),
+        typed::Transition(typed::OnEvent<next>(), typed::Target<S2>())
+      )
+    )
+  );
+
+  StateMachine lDynamic(
+    OnEvent("count", [&lRefCount](){++lRefCount;}),
+    State("S1", initialTag,
+      OnEntry([&lRefResult](){lRefResult.push_back("S1");}),
+      OnExit([&lRefResult](){lRefResult.push_back("~S1");}),
+      Transition(OnEvent("jump"), Target("S22")),
+      State("S11", initialTag,
+        OnEntry([&lRefResult](){lRefResult.push_back("S11");}),
+        OnExit([&lRefResult](){lRefResult.push_back("~S11");}),
+        Transition(OnEvent("next"), Target("S12"))
+      ),
+      State("S12",
+        OnEntry([&lRefResult](){lRefResult.push_back("S12");}),
+        OnExit([&lRefResult](){lRefResult.push_back("~S12");}),
+        Transition(OnEvent("next"), Condition([&lRefCount](){return lRefCount > 0;}), Target("S2")),
+        Transition(OnEvent("back"), Target("S1"))
+      )
+    ),
+    State("S2",
+      OnEntry([&lRefResult](){lRefResult.push_back("S2");}),
+      OnExit([&lRefResult](){lRefResult.push_back("~S2");}),
+      Transition(OnEvent("back"), Target("S11"), Action([&lRefResult](){lRefResult.push_back("back");})),
+      State("S21", initialTag,
+        OnEntry([&lRefResult](){lRefResult.push_back("S21");}),
+        OnExit([&lRefResult](){lRefResult.push_back("~S21");})
+      ),
+      State("S22",
+        OnEntry([&lRefResult](){lRefResult.push_back("S22");}),
+        OnExit([&lRefResult](){lRefResult.push_back("~S22");}),
+        Transition(OnEvent("next"), Target("S2"))
+      )
+    )
+  );
+
+  lStatic.enter();
+  lDynamic.enter();
+
+  lStatic.pushEvent<next>(); lDynamic.pushEvent("next");
+  lStatic.pushEvent<next>(); lDynamic.pushEvent("next");
+  ASSERT_TRUE(lStatic.inState<S12>());
+  ASSERT_TRUE(lDynamic.inState("S12"));
+  lStatic.pushEvent<back>(); lDynamic.pushEvent("back");
+  lStatic.pushEvent<count>(); lDynamic.pushEvent("count");
+  lStatic.pushEvent<next>(); lDynamic.pushEvent("next");
+  lStatic.pushEvent<next>(); lDynamic.pushEvent("next");
+  ASSERT_TRUE(lStatic.inState<S2>());
+  ASSERT_TRUE(lStatic.inState<S21>());
+  ASSERT_TRUE(lDynamic.inState("S21"));
+  lStatic.pushEvent<back>(); lDynamic.pushEvent("back");
+  lStatic.pushEvent<jump>(); lDynamic.pushEvent("jump");
+  ASSERT_TRUE(lStatic.inState<S22>());
+  ASSERT_TRUE(lDynamic.inState("S22"));
+  lStatic.pushEvent<next>(); lDynamic.pushEvent("next");
+  lStatic.leave();
+  lDynamic.leave();
+
+  ASSERT_EQ(lCount, 1);
+  ASSERT_EQ(lXpResult, lRefResult);
+}
+
+/**
+CallbackInlineStorage
+callables up to InlineCapacity are stored without allocation, larger ones still work
+*/
+TEST(instantFSM, CallbackInlineStorage){
+  int lFirst = 0;
+  int lSecond = 0;
+  int lThird = 0;
+  StateMachine* lMachine = nullptr;
+
+  std::size_t lAllocations = gAllocationCount;
+  priv::ActionCallback lSmall([&lFirst, &lSecond, &lThird](){ ++lFirst; ++lSecond; ++lThird; });
+  priv::ActionCallback lMoved(std::move(lSmall));
+  ASSERT_EQ(gAllocationCount, lAllocations);
+  ASSERT_FALSE(lSmall);
+
+  lMoved(*lMachine);
+  ASSERT_EQ(lFirst + lSecond + lThird, 3);
+
+  int* lPointers[8] = {&lFirst, &lFirst, &lFirst, &lFirst, &lFirst, &lFirst, &lFirst, &lFirst};
+  priv::ActionCallback lLarge([lPointers](StateMachine&){ for (int* lPointer : lPointers){ ++*lPointer; } });
+  ASSERT_GT(gAllocationCount, lAllocations);
+  lLarge(*lMachine);
+  ASSERT_EQ(lFirst, 9);
+
+  priv::ConditionCallback lCondition([](){ return true; });
+  ASSERT_TRUE(lCondition(*lMachine));
+}
+
+/**
+PushEvents
+a batch is processed like the same events pushed one by one,
+events pushed from a callback are queued after the batch
+*/
+TEST(instantFSM, PushEvents){
+  std::vector<std::string> lXpResult;
+
+  StateMachine machine(
+    State("S1", initialTag,
+      OnEntry([&lXpResult](){lXpResult.push_back("S1");}),
+      Transition(OnEvent("next"), Target("S2"))
+    ),
+    State("S2",
+      OnEntry([&lXpResult](StateMachine& pMachine){lXpResult.push_back("S2"); pMachine.pushEvent("back");}),
+      Transition(OnEvent("next"), Target("S3")),
+      Transition(OnEvent("back"), Target("S1"))
+    ),
+    State("S3",
+      OnEntry([&lXpResult](){lXpResult.push_back("S3");}),
+      Transition(OnEvent("back"), Target("S1"))
+    )
+  );
+
+  machine.enter();
+  machine.pushEvents({"next", "unknown", "next"});
+  ASSERT_TRUE(machine.inState("S1"));
+
+  std::vector<std::string> lRefResult = {"S1", "S2", "S3", "S1"};
+  ASSERT_EQ(lXpResult, lRefResult);
+
+  lXpResult.clear();
+  const EventId lNext = machine.event("next");
+  const EventId lBack = machine.event("back");
+  machine.pushEvents({lNext, lBack});
+
+  EventId lEvents[] = {lNext, lNext, lBack};
+  machine.pushEvents(lEvents, 3);
+
+  std::istringstream lStream("next back");
+  machine.pushEvents(std::istream_iterator<std::string>(lStream), std::istream_iterator<std::string>());
+
+  lRefResult = {"S2", "S1", "S2", "S3", "S1", "S2", "S1"};
+  ASSERT_EQ(lXpResult, lRefResult);
+}
+
+namespace {
+  struct Session : public StateMachine{
+    explicit Session(std::shared_ptr<const StateChart> pChart)
+      : StateMachine(pChart)
+      , mEntries(0)
+    {}
+
+    int mEntries;
+  };
+}
+
+/**
+SharedStateChart
+instances of the same chart have their own configuration,
+and reach their own data through the StateMachine& parameter
+*/
+TEST(instantFSM, SharedStateChart){
+  std::shared_ptr<const StateChart> lChart = std::make_shared<const StateChart>(
+    State("S1", initialTag,
+      OnEntry([](StateMachine& pMachine){ ++static_cast<Session&>(pMachine).mEntries; }),
+      Transition(OnEvent("next"), Target("S2"))
+    ),
+    State("S2",
+      Transition(OnEvent("next"), Target("S1"))
+    )
+  );
+
+  Session lFirst(lChart);
+  Session lSecond(lChart);
+  ASSERT_EQ(lFirst.chart(), lSecond.chart());
+
+  lFirst.enter();
+  lSecond.enter();
+  lFirst.pushEvent("next");
+  ASSERT_TRUE(lFirst.inState("S2"));
+  ASSERT_TRUE(lSecond.inState("S1"));
+
+  lFirst.pushEvent(lChart->event("next"));
+  lSecond.pushEvent("next");
+  ASSERT_TRUE(lFirst.inState("S1"));
+  ASSERT_TRUE(lSecond.inState("S2"));
+
+  ASSERT_EQ(lFirst.mEntries, 2);
+  ASSERT_EQ(lSecond.mEntries, 1);
+
+  ASSERT_EQ(lChart.use_count(), 3);
+}
+
+TEST(instantFSM, SnapshotRestore){
+  int lEntries = 0;
+  std::shared_ptr<const StateChart> lChart = std::make_shared<const StateChart>(
+    State("P", initialTag, parallelTag,
+      OnEntry([&lEntries](){ ++lEntries; }),
+      State("A",
+        State("A1", initialTag, Transition(OnEvent("a"), Target("A2"))),
+        State("A2", Transition(OnEvent("a"), Target("A1")))
+      ),
+      State("B",
+        State("B1", initialTag, Transition(OnEvent("b"), Target("B2"))),
+        State("B2", OnEntry([&lEntries](){ ++lEntries; }))
+      )
+    )
+  );
+
+  StateMachine lSource(lChart);
+  std::vector<std::uint8_t> lInactive = lSource.snapshot();
+  lSource.enter();
+  lSource.pushEvents({ "a", "b" });
+  ASSERT_EQ(lEntries, 2);
+
+  std::vector<std::uint8_t> lBlob = lSource.snapshot();
+  StateMachine lTarget(lChart);
+  lTarget.restore(lBlob);
+  ASSERT_EQ(lEntries, 2);
+  ASSERT_TRUE(lTarget.isActive());
+  ASSERT_TRUE(lTarget.inState("P"));
+  ASSERT_TRUE(lTarget.inState("A2"));
+  ASSERT_TRUE(lTarget.inState("B2"));
+  ASSERT_FALSE(lTarget.inState("A1"));
+  ASSERT_EQ(lTarget.snapshot(), lBlob);
+
+  //the restored configuration keeps running
+  lTarget.pushEvent("a");
+  ASSERT_TRUE(lTarget.inState("A1"));
+  ASSERT_TRUE(lSource.inState("A2"));
+
+  //a chart with the same structure accepts the snapshot
+  StateMachine lSameStructure(
+    State("P", initialTag, parallelTag,
+      State("A",
+        State("A1", initialTag, Transition(OnEvent("a"), Target("A2"))),
+        State("A2", Transition(OnEvent("a"), Target("A1")))
+      ),
+      State("B",
+        State("B1", initialTag, Transition(OnEvent("b"), Target("B2"))),
+        State("B2")
+      )
+    )
+  );
+  lSameStructure.restore(lBlob);
+  ASSERT_TRUE(lSameStructure.inState("B2"));
+
+  StateMachine lOther(
+    State("S1", initialTag, Transition(OnEvent("a"), Target("S2"))),
+    State("S2")
+  );
+  lOther.enter();
+  ASSERT_THROW(lOther.restore(lBlob), InvalidSnapshot);
+  ASSERT_TRUE(lOther.inState("S1"));
+
+  //truncated or inconsistent blobs are rejected and the configuration is kept
+  std::vector<std::uint8_t> lTruncated(lBlob.begin(), lBlob.end() - 1);
+  ASSERT_THROW(lTarget.restore(lTruncated), InvalidSnapshot);
+  std::vector<std::uint8_t> lOnlyOneRegion(lBlob.begin(), lBlob.begin() + 9);
+  lOnlyOneRegion.push_back(1);
+  lOnlyOneRegion.push_back(lBlob[10]);
+  ASSERT_THROW(lTarget.restore(lOnlyOneRegion), InvalidSnapshot);
+  ASSERT_TRUE(lTarget.inState("A1"));
+  ASSERT_TRUE(lTarget.inState("B2"));
+
+  lTarget.restore(lInactive);
+  ASSERT_FALSE(lTarget.isActive());
+  ASSERT_FALSE(lTarget.inState("B2"));
+}
+
+/**
+payload counting its copies, to check that events don't copy it
+*/
+struct Order{
+  Order(int pQuantity, int* pCopies)
+    : mQuantity(pQuantity)
+    , mCopies(pCopies)
+  {}
+  Order(const Order& pRhs)
+    : mQuantity(pRhs.mQuantity)
+    , mCopies(pRhs.mCopies){
+    ++*mCopies;
+  }
+  Order(Order&& pRhs) NOEXCEPT
+    : mQuantity(pRhs.mQuantity)
+    , mCopies(pRhs.mCopies)
+  {}
+
+  int mQuantity;
+  int* mCopies;
+};
+
+TEST(instantFSM, EventPayloads){
+  int lCopies = 0;
+  int lFilled = 0;
+  const Order* lSeen = nullptr;
+  std::vector<std::string> lNotes;
+
+  StateMachine machine(
+    OnEvent("note", [&lNotes](const std::string& pNote){ lNotes.push_back(pNote); }),
+    State("Idle", initialTag,
+      Transition(
+        OnEvent("order"),
+        Condition([](const Order& pOrder){ return pOrder.mQuantity > 0; }),
+        Target("Filling"),
+        Action([&lFilled, &lSeen](StateMachine& pMachine, const Order& pOrder){
+          lFilled += pOrder.mQuantity;
+          lSeen = &pOrder;
+          //queued while processing : the payload is moved into the queue
+          pMachine.pushEvent("note", std::string("queued"));
+        })
+      )
+    ),
+    State("Filling",
+      Transition(OnEvent("done"), Target("Idle"))
+    )
+  );
+  machine.enter();
+
+  //a condition expecting a payload is false for events without one, or with another type
+  machine.pushEvent("order");
+  machine.pushEvent("order", 42);
+  ASSERT_TRUE(machine.inState("Idle"));
+
+  Order lEmpty(0, &lCopies);
+  machine.pushEvent("order", lEmpty);
+  ASSERT_TRUE(machine.inState("Idle"));
+
+  //processed right away : the callbacks see the caller's object
+  Order lOrder(3, &lCopies);
+  machine.pushEvent(machine.event("order"), lOrder);
+  ASSERT_TRUE(machine.inState("Filling"));
+  ASSERT_EQ(lFilled, 3);
+  ASSERT_EQ(lSeen, &lOrder);
+  ASSERT_EQ(lNotes, std::vector<std::string>{ "queued" });
+  ASSERT_EQ(machine.eventPayload<Order>(), nullptr);
+  ASSERT_EQ(lCopies, 0);
+
+  //a note without payload doesn't call the callback
+  lNotes.clear();
+  machine.pushEvents({ "note" });
+  ASSERT_TRUE(lNotes.empty());
+
+  //large payloads are stored on the heap
+  std::vector<int> lLarge(1000, 1);
+  const int* lLargeData = lLarge.data();
+  int lSum = 0;
+  const int* lReceived = nullptr;
+  StateMachine lHeap(
+    OnEvent("sum", [&lSum, &lReceived](const std::vector<int>& pValues){
+      lSum = std::accumulate(pValues.begin(), pValues.end(), 0);
+      lReceived = pValues.data();
+    }),
+    OnEvent("relay", [&lLargeData](StateMachine& pMachine){
+      std::vector<int> lValues(10, 2);
+      lLargeData = lValues.data();
+      pMachine.pushEvent("sum", std::move(lValues));
+    })
+  );
+  lHeap.enter();
+  lHeap.pushEvent("sum", std::move(lLarge));
+  ASSERT_EQ(lSum, 1000);
+  ASSERT_EQ(lReceived, lLargeData);
+
+  //queued while processing : the vector is moved, not copied
+  lHeap.pushEvent("relay");
+  ASSERT_EQ(lSum, 20);
+  ASSERT_EQ(lReceived, lLargeData);
+}
+
+TEST(instantFSM, EventPriorities){
+  std::vector<std::string> lTrace;
+
+  StateMachine machine(
+    OnEvent("burst", [&lTrace](StateMachine& pMachine){
+      lTrace.push_back("burst");
+      //raised events are processed before the queued external ones
+      pMachine.pushEvent("log", EventPriority::Internal);
+    }),
+    OnEvent("log", [&lTrace](){ lTrace.push_back("log"); }),
+    OnEvent("start", [&lTrace](StateMachine& pMachine){
+      lTrace.push_back("start");
+      pMachine.pushEvents({ "burst", "burst" });
+      pMachine.pushEvent(pMachine.event("abort"), EventPriority::High);
+      pMachine.pushEvent("payload", std::string("internal"), EventPriority::Internal);
+    }),
+    OnEvent("payload", [&lTrace](const std::string& pValue){ lTrace.push_back(pValue); }),
+    State("Running", initialTag,
+      Transition(OnEvent("abort"), Target("Aborted"), Action([&lTrace](){ lTrace.push_back("abort"); }))
+    ),
+    State("Aborted")
+  );
+  machine.enter();
+
+  machine.pushEvent("start");
+  std::vector<std::string> lExpected = { "start", "internal", "abort", "burst", "log", "burst", "log" };
+  ASSERT_EQ(lTrace, lExpected);
+  ASSERT_TRUE(machine.inState("Aborted"));
+}
+
+TEST(instantFSM, DeferredEvents){
+  std::vector<std::string> lTrace;
+
+  StateMachine machine(
+    State("Busy", initialTag,
+      Defer("job"),
+      Transition(OnEvent("ready"), Target("Idle")),
+      State("Loading", initialTag,
+        //a transition taken for the event doesn't defer it
+        Transition(OnEvent("job"), Condition([](const std::string& pJob){ return pJob == "urgent"; }),
+          Action([&lTrace](const std::string& pJob){ lTrace.push_back(pJob); }))
+      )
+    ),
+    State("Idle",
+      Transition(OnEvent("job"), Target("Working"), Action([&lTrace](const std::string& pJob){ lTrace.push_back(pJob); }))
+    ),
+    State("Working",
+      Defer("job"),
+      Transition(OnEvent("done"), Target("Idle"))
+    )
+  );
+  machine.enter();
+
+  machine.pushEvent("job", std::string("first"));
+  machine.pushEvent("job", std::string("urgent"));
+  machine.pushEvent("job", std::string("second"));
+  ASSERT_EQ(lTrace, std::vector<std::string>{ "urgent" });
+
+  //exiting Busy releases both jobs : the first one starts Working, which defers the second one
+  machine.pushEvent("ready");
+  ASSERT_TRUE(machine.inState("Working"));
+  ASSERT_EQ(lTrace, std::vector<std::string>({ "urgent", "first" }));
+
+  machine.pushEvent("done");
+  ASSERT_TRUE(machine.inState("Working"));
+  ASSERT_EQ(lTrace, std::vector<std::string>({ "urgent", "first", "second" }));
+
+  //leaving the machine drops the deferred events
+  machine.pushEvent("job", std::string("dropped"));
+  machine.leave();
+  machine.enter();
+  machine.pushEvent("ready");
+  ASSERT_TRUE(machine.inState("Idle"));
+  ASSERT_EQ(lTrace.size(), 3u);
+}
+
+TEST(instantFSM, AfterTransitions){
+  const TimerWheel::Clock::time_point lStart;
+  TimerWheel lWheel(std::chrono::milliseconds(1), lStart);
+  int lTimeouts = 0;
+
+  std::shared_ptr<const StateChart> lChart = std::make_shared<const StateChart>(
+    State("Waiting", initialTag,
+      Transition(After(std::chrono::milliseconds(500)), Target("TimedOut"),
+        Action([&lTimeouts](){ ++lTimeouts; })),
+      Transition(OnEvent("reply"), Target("Done"))
+    ),
+    State("TimedOut",
+      Transition(After(std::chrono::seconds(1)), Target("Waiting"))
+    ),
+    State("Done",
+      Transition(OnEvent("retry"), Target("Waiting"))
+    )
+  );
+
+  StateMachine lLate(lChart);
+  StateMachine lEarly(lChart);
+  lLate.setTimerWheel(lWheel);
+  lEarly.setTimerWheel(lWheel);
+  lLate.enter();
+  lEarly.enter();
+  ASSERT_EQ(lWheel.pendingCount(), 2u);
+
+  ASSERT_EQ(lWheel.advance(lStart + std::chrono::milliseconds(300)), 0u);
+
+  //exiting the state cancels its timer
+  lEarly.pushEvent("reply");
+  ASSERT_TRUE(lEarly.inState("Done"));
+  ASSERT_EQ(lWheel.pendingCount(), 1u);
+
+  ASSERT_EQ(lWheel.advance(lStart + std::chrono::milliseconds(499)), 0u);
+  ASSERT_EQ(lWheel.advance(lStart + std::chrono::milliseconds(500)), 1u);
+  ASSERT_TRUE(lLate.inState("TimedOut"));
+  ASSERT_EQ(lTimeouts, 1);
+
+  //the delay counts from the entry in the state
+  lEarly.pushEvent("retry");
+  ASSERT_EQ(lWheel.advance(lStart + std::chrono::milliseconds(999)), 0u);
+  ASSERT_EQ(lWheel.advance(lStart + std::chrono::milliseconds(1000)), 1u);
+  ASSERT_TRUE(lEarly.inState("TimedOut"));
+  ASSERT_TRUE(lLate.inState("TimedOut"));
+
+  //long delays go through the coarser levels of the wheel
+  ASSERT_EQ(lWheel.advance(lStart + std::chrono::milliseconds(1499)), 0u);
+  ASSERT_EQ(lWheel.advance(lStart + std::chrono::milliseconds(1500)), 1u);
+  ASSERT_TRUE(lLate.inState("Waiting"));
+  ASSERT_TRUE(lEarly.inState("TimedOut"));
+
+  //leaving the machine cancels its timers
+  lLate.leave();
+  ASSERT_EQ(lWheel.pendingCount(), 1u);
+  ASSERT_EQ(lWheel.advance(lStart + std::chrono::milliseconds(2000)), 1u);
+  ASSERT_TRUE(lEarly.inState("Waiting"));
+  ASSERT_EQ(lTimeouts, 2);
+  lEarly.pushEvent("reply");
+  ASSERT_EQ(lWheel.pendingCount(), 0u);
+
+  ASSERT_THROW(StateMachine(State("S", initialTag, Transition(OnEvent("e"), After(std::chrono::seconds(1))))), EventAlreadySpecified);
+}
+
+TEST(instantFSM, TimerWheelLevels){
+  const TimerWheel::Clock::time_point lStart;
+  TimerWheel lWheel(std::chrono::milliseconds(1), lStart);
+  std::vector<int> lFired;
+
+  //one machine per delay, spanning the four levels of the wheel
+  const int lDelays[] = { 1, 255, 256, 257, 65535, 65536, 70000, 16777216, 20000000 };
+  std::vector<std::unique_ptr<StateMachine>> lMachines;
+  for (int lDelay : lDelays){
+    lMachines.emplace_back(new StateMachine(
+      State("Armed", initialTag,
+        Transition(After(std::chrono::milliseconds(lDelay)), Target("Fired"), Action([&lFired, lDelay](){ lFired.push_back(lDelay); }))
+      ),
+      State("Fired")
+    ));
+    lMachines.back()->setTimerWheel(lWheel);
+    lMachines.back()->enter();
+  }
+
+  //each timer fires on its tick, not one tick earlier
+  for (int lDelay : lDelays){
+    lWheel.advance(lStart + std::chrono::milliseconds(lDelay - 1));
+    ASSERT_TRUE(lFired.empty() || lFired.back() < lDelay);
+    lWheel.advance(lStart + std::chrono::milliseconds(lDelay));
+    ASSERT_EQ(lFired.back(), lDelay);
+  }
+  ASSERT_EQ(lFired.size(), sizeof(lDelays) / sizeof(lDelays[0]));
+  ASSERT_EQ(lWheel.pendingCount(), 0u);
+}
+
+TEST(instantFSM, StateIdQueries){
+  StateMachine machine(
+    State("Menu", initialTag,
+      Transition(OnEvent("play"), Target("Playing"))
+    ),
+    State("Playing", parallelTag,
+      State("World",
+        State("Day", initialTag, Transition(OnEvent("dusk"), Target("Night"))),
+        State("Night")
+      ),
+      State("Hud",
+        State("Shown", initialTag),
+        State("Hidden")
+      )
+    )
+  );
+
+  const StateId lMenu = machine.state("Menu");
+  const StateId lPlaying = machine.state("Playing");
+  const StateId lNight = machine.state("Night");
+  const StateId lShown = machine.state("Shown");
+  ASSERT_EQ(machine.state("root"), 0u);
+  ASSERT_EQ(lMenu, machine.chart()->stateOrdinal("Menu"));
+  ASSERT_THROW(machine.state("Unknown"), NoSuchState);
+
+  ASSERT_FALSE(machine.inState(StateId(0)));
+  machine.enter();
+  ASSERT_TRUE(machine.inState(StateId(0)));
+  ASSERT_TRUE(machine.inState(lMenu));
+  ASSERT_FALSE(machine.inState(lPlaying));
+  ASSERT_FALSE(machine.inState(InvalidState));
+
+  const StateSet lNightHud = machine.chart()->stateSet({ lNight, lShown });
+  const StateSet& lActive = machine.activeConfiguration();
+  ASSERT_EQ(lActive.size(), machine.chart()->stateCount());
+  ASSERT_EQ(lActive.count(), 2u);
+  ASSERT_FALSE(lActive.intersects(lNightHud));
+
+  machine.pushEvent("play");
+  ASSERT_TRUE(machine.inState(lPlaying));
+  ASSERT_TRUE(lActive.intersects(lNightHud));
+  ASSERT_FALSE(lActive.includes(lNightHud));
+
+  machine.pushEvent("dusk");
+  ASSERT_TRUE(lActive.includes(lNightHud));
+
+  //every set bit matches inState, in increasing order
+  std::vector<std::string> lNames;
+  for (std::size_t lState = lActive.findNext(0); lState != StateSet::npos; lState = lActive.findNext(lState + 1)){
+    ASSERT_TRUE(machine.inState(static_cast<StateId>(lState)));
+    lNames.push_back(machine.chart()->stateName(lState));
+  }
+  std::vector<std::string> lExpected = { "root", "Playing", "World", "Night", "Hud", "Shown" };
+  ASSERT_EQ(lNames, lExpected);
+  ASSERT_EQ(lActive.count(), lExpected.size());
+
+  //another chart's ids are never active
+  ASSERT_FALSE(machine.inState(StateId(machine.chart()->stateCount())));
+  ASSERT_THROW(machine.chart()->stateSet({ StateId(machine.chart()->stateCount()) }), NoSuchState);
+}
+
+TEST(instantFSM, InstancePool){
+  std::vector<std::size_t> lAlerted;
+  std::shared_ptr<const StateChart> lChart;
+  InstancePool* lPool = nullptr;
+  bool lAlwaysNotice = false;
+  int lChases = 0;
+
+  lChart = std::make_shared<const StateChart>(
+    State("Idle", initialTag,
+      Transition(OnEvent("tick"), Target("Walk")),
+      Transition(OnEvent("noise"), Target("Alert"))
+    ),
+    State("Walk",
+      Transition(OnEvent("tick"), Target("Idle")),
+      Transition(OnEvent("noise"), Target("Alert"), Condition([&lPool, &lAlwaysNotice](){ return lAlwaysNotice || lPool->current() % 2 == 0; }))
+    ),
+    State("Alert",
+      OnEntry([&lAlerted, &lPool](){ lAlerted.push_back(lPool->current()); }),
+      State("Look", initialTag, Transition(OnEvent("tick"), Target("Chase"))),
+      State("Chase", OnEntry([&lChases](){ ++lChases; }), Transition(OnEvent("tick"), Target("Idle")))
+    )
+  );
+
+  InstancePool lInstances(lChart);
+  lPool = &lInstances;
+  ASSERT_EQ(lInstances.add(4), 0u);
+  ASSERT_EQ(lInstances.size(), 4u);
+  ASSERT_TRUE(lInstances.current() == InstancePool::NoInstance);
+
+  //the same events pushed to independent StateMachines give the same configurations
+  std::vector<std::unique_ptr<StateMachine>> lMachines;
+  for (std::size_t lInstance = 0; lInstance < lInstances.size(); ++lInstance){
+    lMachines.emplace_back(new StateMachine(lChart));
+    lMachines.back()->enter();
+  }
+
+  const EventId lTick = lInstances.event("tick");
+  const EventId lNoise = lInstances.event("noise");
+  lInstances.pushEvent(1, lTick);
+  lInstances.pushEvent(2, lTick);
+  lInstances.pushEvent(3, lNoise);
+  ASSERT_EQ(lAlerted, std::vector<std::size_t>({ 3 }));
+  lAlerted.clear();
+
+  //only the walking instance 2 passes the condition, while 0 is idle and 3 is already alert
+  lInstances.broadcast(lNoise);
+  ASSERT_EQ(lAlerted, std::vector<std::size_t>({ 0, 2 }));
+  ASSERT_TRUE(lInstances.inState(1, lChart->state("Walk")));
+  ASSERT_TRUE(lInstances.inState(2, lChart->state("Alert")));
+  ASSERT_TRUE(lInstances.inState(2, lChart->state("Look")));
+  ASSERT_TRUE(lInstances.inState(2, StateId(0)));
+  ASSERT_FALSE(lInstances.inState(2, lChart->state("Chase")));
+  ASSERT_FALSE(lInstances.inState(2, InvalidState));
+
+  lInstances.broadcast("tick");
+  ASSERT_EQ(lChases, 3);
+  lInstances.broadcast("unknown");
+  lInstances.broadcast(InvalidEvent);
+
+  //standalone machines have no current instance : let them all pass the condition from now on
+  lAlwaysNotice = true;
+  const EventId lSequence[] = { lTick, lNoise, lTick, lTick, lNoise, lNoise, lTick };
+  lInstances.add();
+  lMachines.emplace_back(new StateMachine(lChart));
+  lMachines.back()->enter();
+  for (std::size_t lInstance = 0; lInstance < 4; ++lInstance){
+    lMachines[lInstance]->pushEvent(lInstance == 3 ? lNoise : lTick);
+  }
+  lMachines[0]->pushEvent(lNoise);
+  lMachines[2]->pushEvent(lNoise);
+  for (std::size_t lInstance = 0; lInstance < 4; ++lInstance){
+    lMachines[lInstance]->pushEvent(lTick);
+  }
+  for (EventId lEvent : lSequence){
+    lInstances.broadcast(lEvent);
+    for (auto& lMachine : lMachines){
+      lMachine->pushEvent(lEvent);
+    }
+    for (std::size_t lInstance = 0; lInstance < lInstances.size(); ++lInstance){
+      ASSERT_TRUE(lMachines[lInstance]->inState(lInstances.activeState(lInstance)));
+    }
+  }
+
+  ASSERT_THROW(InstancePool(std::make_shared<const StateChart>(
+    State("P", initialTag, parallelTag, State("A"), State("B"))
+  )), UnsupportedChart);
+  ASSERT_THROW(InstancePool(std::make_shared<const StateChart>(
+    State("A", initialTag, Defer("e"), Transition(OnEvent("f"), Target("B"))),
+    State("B")
+  )), UnsupportedChart);
+}
+
+TEST(instantFSM, InstancePoolThrowingCallback){
+  InstancePool* lPool = nullptr;
+  bool lThrow = true;
+
+  std::shared_ptr<const StateChart> lChart = std::make_shared<const StateChart>(
+    State("Idle", initialTag,
+      Transition(OnEvent("hit"), Target("Hurt"))
+    ),
+    State("Hurt",
+      OnEntry([&lPool, &lThrow](){
+        if (lThrow && lPool->current() == 1){
+          throw std::runtime_error("hurt");
+        }
+      }),
+      Transition(OnEvent("heal"), Target("Idle"))
+    )
+  );
+
+  InstancePool lInstances(lChart);
+  lPool = &lInstances;
+  lInstances.add(3);
+
+  //the instance that threw and those after it stay in their row
+  ASSERT_THROW(lInstances.broadcast("hit"), std::runtime_error);
+  ASSERT_TRUE(lInstances.current() == InstancePool::NoInstance);
+  ASSERT_EQ(lInstances.activeState(0), lChart->state("Hurt"));
+  ASSERT_EQ(lInstances.activeState(1), lChart->state("Idle"));
+  ASSERT_EQ(lInstances.activeState(2), lChart->state("Idle"));
+
+  //and the pool goes on
+  lThrow = false;
+  lInstances.broadcast("hit");
+  for (std::size_t lInstance = 0; lInstance < lInstances.size(); ++lInstance){
+    ASSERT_EQ(lInstances.activeState(lInstance), lChart->state("Hurt"));
+  }
+  lInstances.broadcast("heal");
+  ASSERT_EQ(lInstances.activeState(1), lChart->state("Idle"));
+}
+
+namespace{
+  struct Amount{
+    int mValue;
+  };
+}
+
+TEST(instantFSM, EventLogReplay){
+  int lTotal = 0;
+  int lTicks = 0;
+  auto lChart = std::make_shared<const StateChart>(
+    State("Idle", initialTag,
+      Transition(OnEvent("start"), Target("Running"))
+    ),
+    State("Running",
+      //internal events are recorded as they are processed, and not pushed again by the replay
+      OnEntry([](StateMachine& pMachine){ pMachine.pushEvent("tick"); }),
+      OnEvent("tick", [&](){ ++lTicks; }),
+      Transition(OnEvent("add"), Target("Busy"),
+        Condition([](const Amount& pAmount){ return pAmount.mValue > 0; }),
+        Action([&](const Amount& pAmount){ lTotal += pAmount.mValue; }))
+    ),
+    State("Busy",
+      Transition(OnEvent("done"), Target("Idle"))
+    )
+  );
+
+  EventLog lLog;
+  lLog.recordPayload<Amount>();
+  StateMachine machine(lChart);
+  machine.setEventLog(&lLog);
+  ASSERT_EQ(machine.eventLog(), &lLog);
+
+  const EventId lAdd = machine.event("add");
+  machine.enter();
+  machine.pushEvent("start");
+  machine.pushEvent(lAdd, Amount{ -1 });
+  machine.pushEvent(lAdd, Amount{ 5 });
+  machine.pushEvents({ "done", "start" });
+  machine.pushEvent(lAdd, Amount{ 3 });
+  ASSERT_EQ(lTotal, 8);
+  ASSERT_EQ(lTicks, 2);
+
+  std::vector<EventLog::Record> lRecords = lLog.records();
+  ASSERT_EQ(lRecords.size(), 9u);
+  ASSERT_EQ(lRecords[0].mKind, EventLog::Record::Enter);
+  ASSERT_EQ(lRecords[2].mEvent, machine.event("tick"));
+  ASSERT_EQ(lRecords[3].mEvent, lAdd);
+  ASSERT_TRUE(lRecords[3].mHasPayload);
+  ASSERT_FALSE(lRecords[5].mHasPayload);
+  for (std::size_t lIndex = 1; lIndex < lRecords.size(); ++lIndex){
+    ASSERT_EQ(lRecords[lIndex].mKind, EventLog::Record::Event);
+    ASSERT_TRUE(lRecords[lIndex - 1].mTime <= lRecords[lIndex].mTime);
+  }
+
+  //replayed into a fresh instance, the callbacks see the same events
+  EventLog lReplayer(lLog.bytes());
+  lReplayer.recordPayload<Amount>();
+  StateMachine lCopy(lChart);
+  lReplayer.replay(lCopy);
+  ASSERT_EQ(lCopy.snapshot(), machine.snapshot());
+  ASSERT_EQ(lTotal, 16);
+  ASSERT_EQ(lTicks, 4);
+
+  //without callbacks, only the Conditions are evaluated
+  StateMachine lPartial(lChart);
+  lReplayer.replay(lPartial, EventLog::WithoutCallbacks, 5);
+  ASSERT_TRUE(lPartial.inState("Busy"));
+  lReplayer.replay(lPartial, EventLog::WithoutCallbacks);
+  ASSERT_EQ(lPartial.snapshot(), machine.snapshot());
+  ASSERT_EQ(lTotal, 16);
+  ASSERT_EQ(lTicks, 4);
+
+  //recording restarts from the current configuration
+  machine.setEventLog(nullptr);
+  machine.pushEvent("done");
+  machine.setEventLog(&lLog);
+  machine.pushEvent("start");
+  ASSERT_EQ(lLog.records().size(), 2u);
+  lLog.replay(lCopy, EventLog::WithoutCallbacks);
+  ASSERT_EQ(lCopy.snapshot(), machine.snapshot());
+  machine.setEventLog(nullptr);
+
+  EventLog lUntyped(lReplayer.bytes());
+  ASSERT_THROW(lUntyped.records(), InvalidEventLog);
+  std::vector<std::uint8_t> lTruncated(lReplayer.bytes());
+  lTruncated.pop_back();
+  ASSERT_THROW(EventLog(lTruncated).replay(lCopy), InvalidEventLog);
+  ASSERT_THROW(EventLog(std::vector<std::uint8_t>()), InvalidEventLog);
+  ASSERT_THROW(EventLog(std::vector<std::uint8_t>(3, 0)), InvalidEventLog);
+}
+
+TEST(instantFSM, UnhandledEvents){
+  int lGuards = 0;
+  StateMachine machine(
+    State("P", initialTag, parallelTag,
+      State("A",
+        State("A1", initialTag,
+          Transition(OnEvent("a"), Target("A2"))
+        ),
+        State("A2",
+          Transition(OnEvent("back"), Target("A1"), Condition([&](){ ++lGuards; return true; }))
+        )
+      ),
+      State("B",
+        State("B1", initialTag, Defer("later"),
+          Transition(OnEvent("b"), Target("B2"))
+        ),
+        State("B2",
+          Transition(OnEvent("later"), Target("B1"))
+        )
+      )
+    )
+  );
+
+  //nothing is active yet
+  machine.pushEvent("a");
+  ASSERT_EQ(machine.unhandledEvents(), 1u);
+  machine.enter();
+
+  //handled by a single region
+  machine.pushEvents({ "a", "back", "a" });
+  ASSERT_EQ(machine.unhandledEvents(), 1u);
+  ASSERT_EQ(lGuards, 1);
+
+  //only handled once A2 is exited
+  machine.pushEvents({ "a", "a" });
+  ASSERT_EQ(machine.unhandledEvents(), 3u);
+  ASSERT_TRUE(machine.inState("A2"));
+
+  //rejected, but still deferred by B1 until it is exited
+  machine.pushEvent("later");
+  ASSERT_EQ(machine.unhandledEvents(), 4u);
+  machine.pushEvent("b");
+  ASSERT_TRUE(machine.inState("B1"));
+  ASSERT_EQ(machine.unhandledEvents(), 4u);
+
+  machine.leave();
+  machine.pushEvent("back");
+  ASSERT_EQ(machine.unhandledEvents(), 5u);
+  ASSERT_EQ(lGuards, 1);
+}
+
+TEST(instantFSM, HistoryStates){
+  int lIdleEntries = 0;
+  auto lChart = std::make_shared<const StateChart>(
+    State("Off", initialTag,
+      Transition(OnEvent("power"), Target("Player")),
+      Transition(OnEvent("home"), Target("Idle")),
+      Transition(OnEvent("settings"), Target("Settings"))
+    ),
+    State("Player", shallowHistoryTag,
+      Transition(OnEvent("power"), Target("Off")),
+      State("Idle", initialTag, OnEntry([&](){ ++lIdleEntries; }),
+        Transition(OnEvent("play"), Target("Playing"))
+      ),
+      State("Playing",
+        State("Normal", initialTag,
+          Transition(OnEvent("fast"), Target("Fast"))
+        ),
+        State("Fast")
+      )
+    ),
+    State("Settings", deepHistoryTag, parallelTag,
+      Transition(OnEvent("power"), Target("Off")),
+      State("Audio",
+        State("Mono", initialTag,
+          Transition(OnEvent("stereo"), Target("Stereo"))
+        ),
+        State("Stereo")
+      ),
+      State("Video",
+        State("Low", initialTag,
+          Transition(OnEvent("high"), Target("High"))
+        ),
+        State("High")
+      )
+    )
+  );
+
+  StateMachine machine(lChart);
+  machine.enter();
+  machine.pushEvents({ "power", "play", "fast", "power" });
+  ASSERT_TRUE(machine.inState("Off"));
+  ASSERT_EQ(lIdleEntries, 1);
+
+  //a shallow history enters its last active child, by default below it
+  machine.pushEvent("power");
+  ASSERT_TRUE(machine.inState("Normal"));
+  ASSERT_FALSE(machine.inState("Fast"));
+  ASSERT_EQ(lIdleEntries, 1);
+
+  //a target below the history state doesn't use it
+  machine.pushEvents({ "power", "home" });
+  ASSERT_TRUE(machine.inState("Idle"));
+  ASSERT_EQ(lIdleEntries, 2);
+
+  //a deep history enters its last active atomic states, in every region
+  machine.pushEvents({ "power", "settings", "stereo", "high", "power" });
+  machine.pushEvent("settings");
+  ASSERT_TRUE(machine.inState("Stereo"));
+  ASSERT_TRUE(machine.inState("High"));
+
+  //the history is part of the snapshot
+  machine.pushEvent("power");
+  StateMachine lRestored(lChart);
+  lRestored.restore(machine.snapshot());
+  lRestored.pushEvent("power");
+  ASSERT_TRUE(lRestored.inState("Idle"));
+  lRestored.pushEvents({ "power", "settings" });
+  ASSERT_TRUE(lRestored.inState("Stereo"));
+  ASSERT_TRUE(lRestored.inState("High"));
+
+  //leave forgets it
+  machine.leave();
+  machine.enter();
+  machine.pushEvent("settings");
+  ASSERT_TRUE(machine.inState("Mono"));
+  ASSERT_TRUE(machine.inState("Low"));
+
+  ASSERT_THROW(InstancePool lPool(lChart), UnsupportedChart);
+}
+
+TEST(instantFSM, EventlessTransitions){
+  int lValue = 0;
+  int lChecks = 0;
+  int lOtherChecks = 0;
+  StateMachine machine(
+    State("P", initialTag, parallelTag,
+      State("Counter",
+        State("Counting", initialTag,
+          Transition(OnEvent("add"), Action([&](){ ++lValue; })),
+          Transition(Condition([&](){ ++lChecks; return lValue >= 3; }), Target("Full"))
+        ),
+        //left as soon as it is entered
+        State("Full",
+          Transition(Target("Done"))
+        ),
+        State("Done",
+          Transition(OnEvent("reset"), Target("Counting"), Action([&](){ lValue = 0; }))
+        )
+      ),
+      State("Other",
+        State("Waiting", initialTag,
+          Transition(OnEvent("poke")),
+          Transition(Condition([&](){ ++lOtherChecks; return lValue > 10; }), Target("Never"))
+        ),
+        State("Never")
+      )
+    )
+  );
+
+  //checked once entered
+  machine.enter();
+  ASSERT_EQ(lChecks, 1);
+  ASSERT_EQ(lOtherChecks, 1);
+
+  //a transition only rechecks the states below its domain
+  machine.pushEvent("add");
+  ASSERT_EQ(lChecks, 2);
+  ASSERT_EQ(lOtherChecks, 1);
+  machine.pushEvent("poke");
+  ASSERT_EQ(lChecks, 2);
+  ASSERT_EQ(lOtherChecks, 2);
+
+  //nor does an event that takes no transition
+  machine.pushEvent("reset");
+  ASSERT_EQ(lChecks, 2);
+
+  //the eventless transitions complete the macrostep of the event
+  machine.pushEvents({ "add", "add" });
+  ASSERT_EQ(lChecks, 4);
+  ASSERT_TRUE(machine.inState("Done"));
+  ASSERT_FALSE(machine.inState("Full"));
+
+  machine.pushEvent("reset");
+  ASSERT_TRUE(machine.inState("Counting"));
+  ASSERT_EQ(lChecks, 5);
+  ASSERT_EQ(lOtherChecks, 2);
+}
+
+TEST(instantFSM, EventlessLoop){
+  StateMachine machine(
+    State("Ping", initialTag,
+      Transition(Target("Pong"))
+    ),
+    State("Pong",
+      Transition(OnEvent("stop"), Target("Stopped")),
+      Transition(Target("Ping"))
+    ),
+    State("Stopped")
+  );
+
+  machine.setEventlessLimit(9);
+  ASSERT_THROW(machine.enter(), EventlessLoop);
+
+  //the machine stays in the configuration reached at the limit, and usable
+  ASSERT_TRUE(machine.inState("Pong"));
+  machine.pushEvent("stop");
+  ASSERT_TRUE(machine.inState("Stopped"));
+}
+
+/**
+EventlessBeforePayload
+the eventless transitions pending after a restore are taken before an event with a payload
+*/
+TEST(instantFSM, EventlessBeforePayload){
+  bool lReady = false;
+  std::vector<int> lReceived;
+  std::shared_ptr<const StateChart> lChart = std::make_shared<const StateChart>(
+    State("Waiting", initialTag,
+      Transition(Condition([&lReady](){ return lReady; }), Target("Ready")),
+      Transition(OnEvent("value"), Target("Early"))
+    ),
+    State("Ready",
+      Transition(OnEvent("value"), Action([&lReceived](const int& pValue){ lReceived.push_back(pValue); }))
+    ),
+    State("Early")
+  );
+
+  StateMachine lMachine(lChart);
+  lMachine.enter();
+  const std::vector<std::uint8_t> lSnapshot = lMachine.snapshot();
+
+  lReady = true;
+  StateMachine lRestored(lChart);
+  lRestored.restore(lSnapshot);
+  ASSERT_TRUE(lRestored.inState("Waiting"));
+  lRestored.pushEvent("value", 7);
+  ASSERT_TRUE(lRestored.inState("Ready"));
+  ASSERT_EQ(lReceived, std::vector<int>(1, 7));
+}
+
+/**
+InternalEvents
+the events of the After and eventless transitions are numbered after the named ones, and can't be pushed
+*/
+TEST(instantFSM, InternalEvents){
+  const TimerWheel::Clock::time_point lStart;
+  TimerWheel lWheel(std::chrono::milliseconds(1), lStart);
+
+  std::shared_ptr<const StateChart> lChart = std::make_shared<const StateChart>(
+    State("Waiting", initialTag,
+      Transition(After(std::chrono::seconds(1)), Target("Late")),
+      Transition(OnEvent("go"), Target("Going"))
+    ),
+    State("Going",
+      Transition(Target("Done"))
+    ),
+    State("Late"),
+    State("Done")
+  );
+  ASSERT_EQ(lChart->event("go"), 0u);
+  ASSERT_THROW(lChart->event(std::string(1, '\0') + "after 0"), NoSuchEvent);
+  ASSERT_THROW(lChart->event(std::string(1, '\0') + "eventless"), NoSuchEvent);
+
+  StateMachine lMachine(lChart);
+  lMachine.setTimerWheel(lWheel);
+  lMachine.enter();
+  for (EventId lEvent = 1; lEvent <= 2; ++lEvent){
+    lMachine.pushEvent(lEvent);
+    lMachine.pushEvent(lEvent, 5);
+    lMachine.pushEventAsync(lEvent);
+    lMachine.processEvents();
+  }
+  lMachine.pushEvent(std::string(1, '\0') + "after 0");
+  lMachine.pushEventAsync(std::string(1, '\0') + "eventless");
+  lMachine.processEvents();
+  ASSERT_TRUE(lMachine.inState("Waiting"));
+  ASSERT_EQ(lWheel.pendingCount(), 1u);
+
+  //they still drive their transitions
+  ASSERT_EQ(lWheel.advance(lStart + std::chrono::seconds(1)), 1u);
+  ASSERT_TRUE(lMachine.inState("Late"));
+
+  StateMachine lOther(lChart);
+  lOther.setTimerWheel(lWheel);
+  lOther.enter();
+  lOther.pushEvent("go");
+  ASSERT_TRUE(lOther.inState("Done"));
+  ASSERT_EQ(lWheel.pendingCount(), 0u);
+}
+
+/**
+SingleRegionSelection
+*/
+TEST(instantFSM, SingleRegionSelection){
+  //the same states, alone or as a region of a parallel state : selected directly from the active
+  //atomic state, or by the general algorithm
+  std::vector<std::string> lTrace;
+  auto lRegion = [&lTrace](const std::string& pPrefix){
+    return State(pPrefix + "S", initialTag,
+      Transition(OnEvent("go"), Target(pPrefix + "A"), Action([&lTrace](){ lTrace.push_back("to A"); })),
+      Transition(OnEvent("go"), Action([&lTrace](){ lTrace.push_back("targetless"); })),
+      Transition(OnEvent("go"), Target(pPrefix + "A2"), Action([&lTrace](){ lTrace.push_back("to A2"); })),
+      Transition(OnEvent("go"), Target(pPrefix + "B"), Action([&lTrace](){ lTrace.push_back("to B"); })),
+      Transition(OnEvent("go"), Condition([](){ return false; }), Action([&lTrace](){ lTrace.push_back("disabled"); }))
+    );
+  };
+  auto lTargets = [](const std::string& pPrefix){
+    return State(pPrefix + "A",
+      OnEntry([](){}),
+      State(pPrefix + "A1", initialTag),
+      State(pPrefix + "A2",
+        Transition(OnEvent("back"), Target(pPrefix + "S"))
+      )
+    );
+  };
+
+  StateMachine lSingle(lRegion(""), lTargets(""), State("B"));
+  StateMachine lParallel(
+    State("P", initialTag, parallelTag,
+      State("R", lRegion("R"), lTargets("R"), State("RB")),
+      State("Other")
+    )
+  );
+
+  lSingle.enter();
+  lSingle.pushEvent("go");
+  ASSERT_TRUE(lSingle.inState("A2"));
+  ASSERT_FALSE(lSingle.inState("A1"));
+  std::vector<std::string> lExpected = { "targetless", "to A2" };
+  ASSERT_EQ(lTrace, lExpected);
+
+  lTrace.clear();
+  lParallel.enter();
+  lParallel.pushEvent("go");
+  ASSERT_TRUE(lParallel.inState("RA2"));
+  ASSERT_EQ(lTrace, lExpected);
+
+  //exits from the active atomic state up to the domain
+  lSingle.pushEvent("back");
+  ASSERT_TRUE(lSingle.inState("S"));
+  ASSERT_FALSE(lSingle.inState("A"));
+}
+
+/**
+MemoryUsage
+*/
+TEST(instantFSM, MemoryUsage){
+  std::shared_ptr<const StateChart> lChart = std::make_shared<const StateChart>(
+    State("Idle", initialTag,
+      OnEntry([](){}),
+      Transition(OnEvent("start"), Target("Running"), Condition([](){ return true; }))
+    ),
+    State("Running",
+      Transition(OnEvent("stop"), Target("Idle"), Action([](){}))
+    )
+  );
+
+  const MemoryUsage lChartUsage = lChart->memoryUsage();
+  ASSERT_GE(lChartUsage.mStates, 3 * sizeof(priv::StateImpl));
+  ASSERT_GE(lChartUsage.mCallbacks, 2 * (sizeof(priv::ActionCallback) + sizeof(priv::ConditionCallback)));
+  ASSERT_GT(lChartUsage.mNames, 0u);
+  ASSERT_EQ(lChartUsage.mOther, sizeof(StateChart));
+  ASSERT_EQ(lChartUsage.total(), lChartUsage.mStates + lChartUsage.mTransitions + lChartUsage.mCallbacks
+    + lChartUsage.mQueues + lChartUsage.mNames + lChartUsage.mOther);
+
+  //an instance of a shared chart only counts what it owns
+  StateMachine machine(lChart);
+  machine.enter();
+  MemoryUsage lUsage = machine.memoryUsage();
+  ASSERT_EQ(lUsage.mCallbacks, 0u);
+  ASSERT_EQ(lUsage.mNames, 0u);
+  ASSERT_EQ(lUsage.mOther, sizeof(StateMachine));
+  ASSERT_GT(lUsage.mStates, 0u);
+
+  //the queues grow with the events waiting in them
+  const std::size_t lQueues = lUsage.mQueues;
+  std::vector<std::string> lEvents(100, "start");
+  machine.pushEvents(lEvents.begin(), lEvents.end());
+  lUsage = machine.memoryUsage();
+  ASSERT_GE(lUsage.mQueues, 100 * sizeof(EventId));
+  ASSERT_GT(lUsage.mQueues, lQueues);
+
+  //the chart built by the DSL constructor belongs to the instance
+  StateMachine lPrivate(
+    State("Idle", initialTag)
+  );
+  ASSERT_GT(lPrivate.memoryUsage().mNames, 0u);
+  ASSERT_GE(lPrivate.memoryUsage().total(), sizeof(StateMachine) + sizeof(StateChart));
+}
+
 int main(int argc, char** argv){
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
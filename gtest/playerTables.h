@@ -0,0 +1,113 @@
+//generated by ifsm::StateChart::exportTables, do not edit : export the chart again once it has changed
+#ifndef INSTANTFSM_PLAYER_TABLES_H
+#define INSTANTFSM_PLAYER_TABLES_H
+
+#include "instantFSM.h"
+
+namespace player{
+  namespace state{
+    enum : ifsm::StateId{
+      root = 0,
+      Stopped = 1,
+      Playing = 2,
+      Normal = 3,
+      Fast = 4,
+    };
+  }
+
+  namespace event{
+    enum : ifsm::EventId{
+      reset = 0,
+      play = 1,
+      stop = 2,
+      tick = 3,
+      speed = 4,
+    };
+  }
+
+  //slots of the Action, OnEntry and OnExit callbacks in the TableStateMachine::Callback array
+  namespace callback{
+    enum : std::uint32_t{
+      onEntry_Stopped = 0,
+      onEntry_Playing = 1,
+      onEntry_Normal = 2,
+      onExit_Stopped = 3,
+      onExit_Playing = 4,
+      onExit_Fast = 5,
+      action_Stopped_play = 6,
+      action_Playing_tick = 7,
+      action_Fast_tick = 8,
+    };
+  }
+  static const std::uint32_t CallbackCount = 9;
+
+  //slots of the Conditions in the TableStateMachine::Condition array
+  namespace condition{
+    enum : std::uint32_t{
+      condition_Normal_speed = 0,
+    };
+  }
+  static const std::uint32_t ConditionCount = 1;
+
+  static constexpr ifsm::TableState States[] = {
+    { ifsm::NoTableIndex, 5, ifsm::NoTableIndex, 0, 0, 3, 3 }, //"root"
+    { 0, 2, 0, 0, 1, 3, 4 }, //"Stopped"
+    { 0, 5, ifsm::NoTableIndex, 1, 2, 4, 5 }, //"Playing"
+    { 2, 4, 1, 2, 3, 5, 5 }, //"Normal"
+    { 2, 5, 2, 3, 3, 5, 6 }, //"Fast"
+  };
+
+  static constexpr const char* StateNames[] = {
+    "root",
+    "Stopped",
+    "Playing",
+    "Normal",
+    "Fast",
+  };
+
+  static constexpr const char* EventNames[] = {
+    "reset",
+    "play",
+    "stop",
+    "tick",
+    "speed",
+  };
+
+  static constexpr ifsm::TableTransition Transitions[] = {
+    { 0, 1, 0, 0, 1, ifsm::NoTableIndex, ifsm::NoTableIndex }, //"root" on "reset"
+    { 1, 2, 0, 1, 3, 6, ifsm::NoTableIndex }, //"Stopped" on "play"
+    { 2, 1, 0, 3, 4, ifsm::NoTableIndex, ifsm::NoTableIndex }, //"Playing" on "stop"
+    { 2, ifsm::NoTableIndex, 2, 4, 4, 7, ifsm::NoTableIndex }, //"Playing" on "tick"
+    { 3, 4, 2, 4, 5, ifsm::NoTableIndex, 0 }, //"Normal" on "speed"
+    { 4, 3, 2, 5, 6, ifsm::NoTableIndex, ifsm::NoTableIndex }, //"Fast" on "speed"
+    { 4, ifsm::NoTableIndex, 4, 6, 6, 8, ifsm::NoTableIndex }, //"Fast" on "tick"
+  };
+
+  static constexpr std::uint32_t DispatchOffsets[] = {
+    0, 1, 2, 2, 2, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8,
+    10, 11,
+  };
+
+  static constexpr std::uint32_t DispatchTransitions[] = {
+    0, 1, 0, 2, 3, 4, 0, 2, 6, 3, 5,
+  };
+
+  static constexpr std::uint32_t EntrySequences[] = {
+    1, 2, 3, 1, 4, 3,
+  };
+
+  static constexpr std::uint32_t DefaultEntry[] = {
+    0, 1,
+  };
+
+  static constexpr ifsm::ChartTables Tables = {
+    3284278534562411972ULL,
+    5, States, StateNames,
+    5, EventNames,
+    Transitions, DispatchOffsets, DispatchTransitions, EntrySequences,
+    DefaultEntry, 2,
+    CallbackCount, ConditionCount
+  };
+}
+
+#endif
@@ -0,0 +1,246 @@
+#include <instantFSM.h>
+
+#include "gtest/gtest.h"
+
+#include "playerTables.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace ifsm;
+
+//count heap allocations, to check that a TableStateMachine never allocates
+static std::size_t gAllocationCount = 0;
+
+void* operator new(std::size_t pSize){
+  ++gAllocationCount;
+  void* lPtr = std::malloc(pSize == 0 ? 1 : pSize);
+  if (lPtr == nullptr){
+    throw std::bad_alloc();
+  }
+  return lPtr;
+}
+
+void operator delete(void* pPtr) NOEXCEPT{
+  std::free(pPtr);
+}
+
+/**
+what the callbacks of the player record, and the data their conditions read
+*/
+struct Player{
+  std::vector<std::string> mTrace;
+  bool mMayGoFast = true;
+};
+
+//the Player of the StateMachine, whose callbacks are shared with the chart
+static Player gPlayer;
+
+/**
+the chart playerTables.h was exported from, by makePlayerChart()->exportTables("player")
+*/
+static std::shared_ptr<const StateChart> makePlayerChart(){
+  return std::make_shared<const StateChart>(
+    State("Stopped", initialTag,
+      OnEntry([](){ gPlayer.mTrace.push_back("enter Stopped"); }),
+      OnExit([](){ gPlayer.mTrace.push_back("exit Stopped"); }),
+      Transition(OnEvent("play"), Target("Playing"), Action([](){ gPlayer.mTrace.push_back("action play"); }))
+    ),
+    State("Playing",
+      OnEntry([](){ gPlayer.mTrace.push_back("enter Playing"); }),
+      OnExit([](){ gPlayer.mTrace.push_back("exit Playing"); }),
+      Transition(OnEvent("stop"), Target("Stopped")),
+      Transition(OnEvent("tick"), Action([](){ gPlayer.mTrace.push_back("action tick"); })),
+      State("Normal", initialTag,
+        OnEntry([](){ gPlayer.mTrace.push_back("enter Normal"); }),
+        Transition(OnEvent("speed"), Target("Fast"), Condition([](){ return gPlayer.mMayGoFast; }))
+      ),
+      State("Fast",
+        OnExit([](){ gPlayer.mTrace.push_back("exit Fast"); }),
+        Transition(OnEvent("speed"), Target("Normal")),
+        Transition(OnEvent("tick"), Action([](){ gPlayer.mTrace.push_back("action fast tick"); }))
+      )
+    ),
+    Transition(OnEvent("reset"), Target("Stopped"))
+  );
+}
+
+//the same callbacks, bound to the slots of playerTables.h and reaching their Player through the context
+static void trace(TableStateMachine& pMachine, const char* pLine){
+  static_cast<Player*>(pMachine.context())->mTrace.push_back(pLine);
+}
+
+static void fillPlayerCallbacks(TableStateMachine::Callback* pCallbacks, TableStateMachine::Condition* pConditions){
+  pCallbacks[player::callback::onEntry_Stopped] = [](TableStateMachine& pMachine){ trace(pMachine, "enter Stopped"); };
+  pCallbacks[player::callback::onExit_Stopped] = [](TableStateMachine& pMachine){ trace(pMachine, "exit Stopped"); };
+  pCallbacks[player::callback::action_Stopped_play] = [](TableStateMachine& pMachine){ trace(pMachine, "action play"); };
+  pCallbacks[player::callback::onEntry_Playing] = [](TableStateMachine& pMachine){ trace(pMachine, "enter Playing"); };
+  pCallbacks[player::callback::onExit_Playing] = [](TableStateMachine& pMachine){ trace(pMachine, "exit Playing"); };
+  pCallbacks[player::callback::action_Playing_tick] = [](TableStateMachine& pMachine){ trace(pMachine, "action tick"); };
+  pCallbacks[player::callback::onEntry_Normal] = [](TableStateMachine& pMachine){ trace(pMachine, "enter Normal"); };
+  pCallbacks[player::callback::onExit_Fast] = [](TableStateMachine& pMachine){ trace(pMachine, "exit Fast"); };
+  pCallbacks[player::callback::action_Fast_tick] = [](TableStateMachine& pMachine){ trace(pMachine, "action fast tick"); };
+  pConditions[player::condition::condition_Normal_speed] = [](const TableStateMachine& pMachine){
+    return static_cast<const Player*>(pMachine.context())->mMayGoFast;
+  };
+}
+
+/**
+ExportedSource
+*/
+TEST(instantFSM_tables, ExportedSource){
+  std::ifstream lFile(INSTANTFSM_GTEST_DIR "/playerTables.h");
+  ASSERT_TRUE(lFile.good());
+  const std::string lChecked((std::istreambuf_iterator<char>(lFile)), std::istreambuf_iterator<char>());
+
+  //a chart exports the same header every time : playerTables.h is up to date with makePlayerChart
+  std::shared_ptr<const StateChart> lChart = makePlayerChart();
+  ASSERT_EQ(lChart->exportTables("player"), lChecked);
+  ASSERT_EQ(player::Tables.mFingerprint, lChart->fingerprint());
+
+  ASSERT_EQ(player::state::root, 0u);
+  ASSERT_EQ(player::state::Normal, lChart->stateOrdinal("Normal"));
+  ASSERT_EQ(player::Tables.mStateCount, 5u);
+  ASSERT_EQ(player::CallbackCount, 9u);
+  ASSERT_EQ(player::ConditionCount, 1u);
+}
+
+/**
+SameBehaviour
+*/
+TEST(instantFSM_tables, SameBehaviour){
+  StateMachine lMachine(makePlayerChart());
+
+  Player lPlayer;
+  TableStateMachine::Callback lCallbacks[player::CallbackCount] = {};
+  TableStateMachine::Condition lConditions[player::ConditionCount] = {};
+  fillPlayerCallbacks(lCallbacks, lConditions);
+  TableStateMachine lTables(player::Tables, lCallbacks, lConditions, &lPlayer);
+
+  gPlayer = Player();
+  lMachine.enter();
+  lTables.enter();
+  ASSERT_EQ(lTables.activeState(), player::state::Stopped);
+
+  const std::vector<std::string> lEvents = {
+    "tick", "play", "tick", "speed", "tick", "speed", "stop", "play", "reset", "play", "speed", "unknown"
+  };
+  for (const std::string& lEvent : lEvents){
+    if (lEvent == "stop"){
+      gPlayer.mMayGoFast = lPlayer.mMayGoFast = false;
+    }
+    lMachine.pushEvent(lEvent);
+    if (lEvent != "unknown"){
+      lTables.pushEvent(lTables.event(lEvent));
+    }
+    for (StateId lState = 0; lState < player::Tables.mStateCount; ++lState){
+      ASSERT_EQ(lTables.inState(lState), lMachine.inState(player::Tables.mStateNames[lState])) << lEvent;
+    }
+  }
+  ASSERT_EQ(lTables.unhandledEvents(), 1u);
+  ASSERT_EQ(lTables.activeState(), player::state::Normal);
+
+  lMachine.leave();
+  lTables.leave();
+  ASSERT_FALSE(lTables.isActive());
+  ASSERT_FALSE(lTables.inState(player::state::root));
+  ASSERT_EQ(lTables.activeState(), InvalidState);
+  ASSERT_EQ(lPlayer.mTrace, gPlayer.mTrace);
+
+  std::vector<std::string> lExpected = {
+    "enter Stopped",
+    "exit Stopped", "action play", "enter Playing", "enter Normal",
+    "action tick", "action fast tick"
+  };
+  lPlayer.mTrace.resize(7);
+  ASSERT_EQ(lPlayer.mTrace, lExpected);
+}
+
+/**
+EventsFromCallbacks
+*/
+TEST(instantFSM_tables, EventsFromCallbacks){
+  TableStateMachine::Callback lCallbacks[player::CallbackCount] = {};
+  //entering Playing moves on to Fast, once the transition to Playing is complete
+  lCallbacks[player::callback::onEntry_Playing] = [](TableStateMachine& pMachine){
+    pMachine.pushEvent(player::event::speed);
+    ASSERT_EQ(pMachine.activeState(), player::state::Playing);
+  };
+  TableStateMachine lMachine(player::Tables, lCallbacks, nullptr);
+
+  lMachine.enter();
+  lMachine.pushEvent(player::event::play);
+  ASSERT_TRUE(lMachine.inState(player::state::Fast));
+  ASSERT_EQ(lMachine.state("Fast"), player::state::Fast);
+  ASSERT_THROW(lMachine.state("Paused"), NoSuchState);
+  ASSERT_THROW(lMachine.event("pause"), NoSuchEvent);
+}
+
+/**
+NoAllocation
+*/
+TEST(instantFSM_tables, NoAllocation){
+  const std::size_t lAllocations = gAllocationCount;
+  TableStateMachine lMachine(player::Tables, nullptr, nullptr);
+  lMachine.enter();
+  for (int lIndex = 0; lIndex < 1000; ++lIndex){
+    lMachine.pushEvent(player::event::play);
+    lMachine.pushEvent(player::event::speed);
+    lMachine.pushEvent(player::event::tick);
+    lMachine.pushEvent(player::event::reset);
+  }
+  lMachine.leave();
+  ASSERT_EQ(gAllocationCount, lAllocations);
+}
+
+/**
+QueueFull
+*/
+TEST(instantFSM_tables, QueueFull){
+  TableStateMachine::Callback lCallbacks[player::CallbackCount] = {};
+  lCallbacks[player::callback::onEntry_Stopped] = [](TableStateMachine& pMachine){
+    for (std::size_t lIndex = 0; lIndex <= TableStateMachine::QueueCapacity; ++lIndex){
+      pMachine.pushEvent(player::event::tick);
+    }
+  };
+  TableStateMachine lMachine(player::Tables, lCallbacks, nullptr);
+  ASSERT_THROW(lMachine.enter(), EventQueueFull);
+}
+
+/**
+UnexportableCharts
+*/
+TEST(instantFSM_tables, UnexportableCharts){
+  ASSERT_THROW(StateChart(
+    State("P", initialTag, parallelTag, State("A"), State("B"))
+  ).exportTables("p"), UnexportableChart);
+  ASSERT_THROW(StateChart(
+    State("S1", initialTag, Transition(After(std::chrono::milliseconds(1)), Target("S2"))),
+    State("S2")
+  ).exportTables("p"), UnexportableChart);
+  ASSERT_THROW(StateChart(
+    State("S1", initialTag, Transition(Target("S2"))),
+    State("S2")
+  ).exportTables("p"), UnexportableChart);
+
+  //names that aren't identifiers are still exported
+  std::string lSource = StateChart(
+    State("1 state", initialTag, Transition(OnEvent("go \"now\""), Target("class")), Transition(OnEvent("go-now"), Target("class"))),
+    State("class")
+  ).exportTables("odd");
+  ASSERT_NE(lSource.find("_1_state = 1,"), std::string::npos);
+  ASSERT_NE(lSource.find("class_ = 2,"), std::string::npos);
+  ASSERT_NE(lSource.find("go__now_ = 0,"), std::string::npos);
+  ASSERT_NE(lSource.find("go_now = 1,"), std::string::npos);
+  ASSERT_NE(lSource.find("\"go \\\"now\\\"\""), std::string::npos);
+}
+
+int main(int argc, char** argv){
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
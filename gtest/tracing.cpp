@@ -0,0 +1,121 @@
+#include <instantFSM.h> 
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+using namespace ifsm;
+
+/**
+records the hooks called by a StateMachine, in order
+*/
+struct Tracer : public StateMachineObserver{
+  explicit Tracer(const StateChart& pChart)
+    : mChart(pChart)
+  {}
+
+  virtual void onEvent(const StateMachine& /*pMachine*/, EventId /*pEvent*/){
+    mTrace.push_back("event");
+  }
+
+  virtual void onTransitionsSelected(const StateMachine& /*pMachine*/, EventId /*pEvent*/, const std::uint32_t* /*pTransitions*/, std::size_t pCount){
+    mTrace.push_back("select " + std::to_string(pCount));
+  }
+
+  virtual void beginEnter(const StateMachine& /*pMachine*/, std::size_t pState){
+    mTrace.push_back("enter " + mChart.stateName(pState));
+  }
+
+  virtual void beginExit(const StateMachine& /*pMachine*/, std::size_t pState){
+    mTrace.push_back("exit " + mChart.stateName(pState));
+  }
+
+  virtual void beginAction(const StateMachine& /*pMachine*/, std::size_t pTransition){
+    mTrace.push_back("action " + mChart.stateName(mChart.transitionSource(pTransition)));
+  }
+
+  const StateChart& mChart;
+  std::vector<std::string> mTrace;
+};
+
+TEST(instantFSM_tracing, ObserverHooks){
+  StateMachine machine(
+    State("S1", initialTag,
+      Transition(OnEvent("next"), Target("S2"))
+    ),
+    State("S2",
+      OnEvent("noop", [](){})
+    )
+  );
+
+  Tracer lTracer(*machine.chart());
+  machine.setObserver(&lTracer);
+  ASSERT_EQ(machine.observer(), &lTracer);
+
+  machine.enter();
+  machine.pushEvents({ "next", "noop", "next" });
+  machine.setObserver(nullptr);
+  machine.pushEvent("noop");
+
+  std::vector<std::string> lExpected = {
+    "enter root", "enter S1",
+    "event", "select 1", "exit S1", "action S1", "enter S2",
+    "event", "select 1", "action S2",
+    "event", "select 0"
+  };
+  ASSERT_EQ(lTracer.mTrace, lExpected);
+}
+
+TEST(instantFSM_tracing, StatsCollector){
+  std::shared_ptr<const StateChart> lChart = std::make_shared<const StateChart>(
+    State("S1", initialTag,
+      Transition(OnEvent("next"), Target("S2"))
+    ),
+    State("S2",
+      Transition(OnEvent("next"), Target("S1"), Action([](){ std::this_thread::sleep_for(std::chrono::milliseconds(1)); }))
+    )
+  );
+
+  StateMachine machine(lChart);
+  StatsCollector lStats(*lChart);
+  machine.setObserver(&lStats);
+
+  machine.enter();
+  machine.pushEvents({ "next", "next", "next", "unknown" });
+  machine.leave();
+
+  const std::size_t lS1 = lChart->stateOrdinal("S1");
+  const std::size_t lS2 = lChart->stateOrdinal("S2");
+  ASSERT_EQ(lStats.eventCount(), 3u);
+  ASSERT_EQ(lStats.visitCount(lS1), 2u);
+  ASSERT_EQ(lStats.visitCount(lS2), 2u);
+  ASSERT_EQ(lStats.entryLatency(lS1).count(), 2u);
+  ASSERT_EQ(lStats.exitLatency(lS2).count(), 2u);
+
+  ASSERT_EQ(lChart->transitionCount(), 2u);
+  ASSERT_EQ(lChart->transitionSource(1), lS2);
+  ASSERT_EQ(lStats.fireCount(0), 2u);
+  ASSERT_EQ(lStats.fireCount(1), 1u);
+
+  //the action of S2 sleeps for 1ms, in bucket 19 : [2^19, 2^20) ns, or later
+  const LatencyHistogram& lAction = lStats.actionLatency(1);
+  ASSERT_EQ(lAction.count(), 1u);
+  ASSERT_GE(lAction.total(), std::chrono::milliseconds(1));
+  std::uint64_t lSlow = 0;
+  for (std::size_t lBucket = 19; lBucket < LatencyHistogram::BucketCount; ++lBucket){
+    lSlow += lAction.bucket(lBucket);
+  }
+  ASSERT_EQ(lSlow, 1u);
+  //the action runs once S2 is exited, while the root stays active
+  ASSERT_GE(lStats.dwellTime(0), std::chrono::milliseconds(1));
+
+  lStats.reset();
+  ASSERT_EQ(lStats.fireCount(0), 0u);
+  ASSERT_EQ(lStats.actionLatency(1).count(), 0u);
+}
+
+int main(int argc, char** argv){
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
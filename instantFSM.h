@@ -28,20 +28,73 @@ StateMachine myMachine( parallelTag|State|OnEntry|OnExit|OnEvent|Transition )
     : instantiate the FSM
   myMachine.enter() : enter the root state
   myMachine.pushEvent(std::string("myEvent")) : push an event
+  myMachine.event(std::string("myEvent")) : returns the EventId of the named event
+  myMachine.pushEvent(myEventId) : push an event by its EventId, without any string lookup
+  myMachine.pushEvents(begin, end) / myMachine.pushEvents({...}) : push a batch of events, processed in one pass
+  myMachine.pushEvent(myEventId, myPayload) : push an event along with a payload of any movable type, delivered to callbacks taking it
+  myMachine.pushEvent(myEventId, EventPriority::High) : push an event processed before the Normal ones already queued.
+    Internal events, usually pushed from callbacks, are processed before both
+  myMachine.pushEventAsync(std::string("myEvent")) : push an event from any thread, processed by the next myMachine.processEvents()
   myMachine.inState(std::string("stateName")) : returns true of the named state is active
+  myMachine.state(std::string("stateName")) : returns the StateId of the named state
+  myMachine.inState(myStateId) : returns true if the state is active, without any string lookup
+  myMachine.activeConfiguration() : returns the StateSet of the active states, to test many states at once
+    with StateSet::includes or StateSet::intersects against a set built by myChart.stateSet({...})
+  myMachine.unhandledEvents() : returns how many events no active state had a transition for
   myMachine.leave() : quit all active states
+
+std::shared_ptr<const StateChart> myChart = std::make_shared<const StateChart>( parallelTag|State|OnEntry|OnExit|OnEvent|Transition )
+    : compile a chart once
+StateMachine myInstance(myChart) : instantiate the FSM from a shared chart
+myMachine.memoryUsage() / myChart->memoryUsage() : bytes used by an instance / a chart, by category, and in all with total()
+InstancePool myPool(myChart) : many instances of a chart without parallel states, stored compactly
+  myPool.add(myCount) / myPool.broadcast(myEventId) : enter new instances / push an event to all of them
+myChart->exportTables("player") : the source of a header of constexpr tables, for a chart with a single active atomic state
+TableStateMachine myTables(player::Tables, myCallbacks, myConditions) : run the exported chart without building
+  anything or allocating, its callbacks being function pointers bound to the slots the header numbers
+
+myMachine.setRegionExecutor(&myExecutor) : run the callbacks of transitions taken in different orthogonal regions
+  concurrently on a RegionExecutor, such as a StateMachineExecutor, one phase at a time
+
+EventLog myLog : records the events processed by a machine, to replay them into another one
+  myMachine.setEventLog(&myLog) : start recording, myLog.replay(myOtherMachine) : reconstruct its configuration
+
+TimerWheel myWheel : drives the After transitions of the machines using it, from a single thread
+  myMachine.setTimerWheel(myWheel) : before enter, otherwise TimerWheel::global() is used
+  myWheel.advance() : fire the timers that are due, to be called at least every resolution
+
+#define INSTANTFSM_TRACING before including instantFSM.h, in every translation unit, to enable :
+  myMachine.setObserver(&myObserver) : call a StateMachineObserver, such as StatsCollector, from the hot path.
+  Without INSTANTFSM_TRACING, the tracing hooks compile to nothing
   
-State(std::string("stateName"), parallelTag|initialTag|State|OnEntry|OnExit|OnEvent|Transition) : create a state
+State(std::string("stateName"), parallelTag|initialTag|shallowHistoryTag|deepHistoryTag|State|OnEntry|OnExit|OnEvent|Transition) : create a state
   
   -> OnEntry( void(void) | void(StateMachine&) ) : callback triggered when parent state is entered
   -> OnExit( void(void) | void(StateMachine&) ) : callback triggered when parent state is exited
   -> OnEvent( std::string("myEvent"), void(void) | void(StateMachine&) ) : callback triggered when the event "myEvent" is pushed while the parent state is active.
+  -> Defer( std::string("myEvent") ) : while the state is active, "myEvent" is kept aside when it triggers no transition, and pushed again once the state is exited
+  -> shallowHistoryTag | deepHistoryTag : once the state has been exited, entering it by default enters again the child,
+     or all the descendants, that were active when it was exited rather than its initial ones, until myMachine.leave()
 
 Transition( OnEvent|Target|Action|Condition ) : add a transition
   -> OnEvent( std::string("myEvent") ) : event triggering the transition
   -> Target( std::string("stateName") ) : state to activate when the transition is realised
   -> Action( void(void)|void(StateMachine&) ) : callback triggered after leaving the parent state and before the target state is entered.
   -> Condition( bool(void)|bool(StateMachine&) ) : callback preventing the transition from executing when it returns false
+  -> After( std::chrono::milliseconds(500) ) : instead of OnEvent, trigger the transition once its state has been active for the duration
+
+  A transition with neither OnEvent nor After is eventless : it is taken as soon as its Condition holds, checked once
+  its state, or one of its descendants, has been entered or has taken a transition, and then after each transition
+  taken in its subtree, until none is enabled anymore. myMachine.setEventlessLimit(myCount) bounds the eventless
+  transitions taken in a row, beyond which EventlessLoop is thrown
+
+  Action and OnEvent callbacks may also be void(const T&)|void(StateMachine&, const T&), and Condition
+  bool(const T&)|bool(const StateMachine&, const T&) : they receive the payload of the event, and are only
+  called when the event carries a payload of type T. Otherwise an Action does nothing and a Condition is false.
+
+  With C++20 coroutines, Action, OnEntry and OnExit callbacks may also return an ifsm::Task : while the coroutine
+  is suspended, so is the transition, and myMachine.isSuspended() is true. Events are queued meanwhile, and once
+  the coroutine has completed, the next myMachine.processEvents() or pushEvent resumes the transition
   
 */
 
@@ -50,18 +103,37 @@ Transition( OnEvent|Target|Action|Condition ) : add a transition
 #define INSTANTFSM_H
 
 #include <unordered_map>
-#include <map>
+#include <unordered_set>
 #include <vector>
 #include <string>
 #include <functional>
 #include <utility>
 #include <cstddef>
 #include <algorithm>
-#include <queue>
-#include <list>
+#include <iterator>
 #include <type_traits>
 #include <memory>
 #include <stdexcept>
+#include <cstdint>
+#include <tuple>
+#include <new>
+#include <initializer_list>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <cstring>
+#include <cctype>
+
+// Tracing hooks, only compiled with INSTANTFSM_TRACING
+#if defined(INSTANTFSM_TRACING)
+#  define IFSM_TRACE(pMachine, pCall) do { if ((pMachine).mObserver) { (pMachine).mObserver->pCall; } } while (false)
+#else
+#  define IFSM_TRACE(pMachine, pCall) do { } while (false)
+#endif
 
 // Is noexcept supported?
 #if !defined(_MSC_FULL_VER) || _MSC_VER > 1800
@@ -70,13 +142,132 @@ Transition( OnEvent|Target|Action|Condition ) : add a transition
 #  define NOEXCEPT
 #endif
 
+// How is a deliberate fallthrough between switch cases marked?
+#if __cplusplus >= 201703L
+#  define IFSM_FALLTHROUGH [[fallthrough]]
+#elif defined(__clang__)
+#  define IFSM_FALLTHROUGH [[clang::fallthrough]]
+#elif defined(__GNUC__) && __GNUC__ >= 7
+#  define IFSM_FALLTHROUGH __attribute__((fallthrough))
+#else
+#  define IFSM_FALLTHROUGH do { } while (false)
+#endif
+
+// Are coroutines supported? callbacks may then return an ifsm::Task
+#if defined(__cpp_impl_coroutine)
+#  define INSTANTFSM_COROUTINES
+#  include <coroutine>
+#endif
+
 namespace ifsm{
   class StateMachine;
+  class StateChart;
+  class StateMachineObserver;
+  class TimerWheel;
+  class InstancePool;
+  class EventLog;
+  class Task;
 
   namespace priv{
+    template <class Callable>
+    class TaskCallback;
+
     class StateImpl;
+    struct ExecutorEntry;
+
+    //index of a state in its StateMachine, in document order
+    typedef std::uint32_t StateIndex;
+
+    //index of a transition in its StateMachine
+    typedef std::uint32_t TransitionIndex;
+
+    static const std::uint32_t NoIndex = static_cast<std::uint32_t>(-1);
+
+    //handle of a timer armed in a TimerWheel, 0 when no timer is armed
+    typedef std::uint64_t TimerId;
+  }
+
+  /*
+  Dense identifier of an event, resolved from the event names
+  declared in the StateMachine when it is built
+  */
+  typedef unsigned int EventId;
+
+  /*
+  EventId that no transition reacts to
+  */
+  static const EventId InvalidEvent = static_cast<EventId>(-1);
+
+  /*
+  Dense identifier of a state, its ordinal in document order in the chart : the root state is 0,
+  and the descendants of a state follow it
+  */
+  typedef std::uint32_t StateId;
+
+  /*
+  StateId of no state of any chart
+  */
+  static const StateId InvalidState = static_cast<StateId>(-1);
+
+  /*
+  queue an event is pushed to. The highest priority queue that isn't empty is processed first,
+  each queue in FIFO order. Internal is meant for the events raised by callbacks
+  */
+  enum class EventPriority{
+    Internal,
+    High,
+    Normal
+  };
+
+  namespace priv{
+    static const std::size_t EventPriorityCount = 3;
+
+    //set on the EventId of queued events that carry a payload
+    static const EventId PayloadFlag = static_cast<EventId>(1) << (sizeof(EventId) * 8 - 1);
   }
 
+  /*
+  interface called at each step of event processing, see StateMachine::setObserver.
+  only used when instantFSM.h is compiled with INSTANTFSM_TRACING
+  */
+  class StateMachineObserver{
+  public:
+    virtual ~StateMachineObserver(){}
+
+    //an event is taken from the queue
+    virtual void onEvent(const StateMachine& /*pMachine*/, EventId /*pEvent*/){}
+
+    //the transitions executed for the event, once conflicts are removed. called before any state is exited
+    virtual void onTransitionsSelected(const StateMachine& /*pMachine*/, EventId /*pEvent*/, const std::uint32_t* /*pTransitions*/, std::size_t /*pCount*/){}
+
+    //around the OnEntry callbacks of a state, called once it is active
+    virtual void beginEnter(const StateMachine& /*pMachine*/, std::size_t /*pState*/){}
+    virtual void endEnter(const StateMachine& /*pMachine*/, std::size_t /*pState*/){}
+
+    //around the OnExit callbacks of a state, called once it is inactive
+    virtual void beginExit(const StateMachine& /*pMachine*/, std::size_t /*pState*/){}
+    virtual void endExit(const StateMachine& /*pMachine*/, std::size_t /*pState*/){}
+
+    //around the Action of a transition, called even if the transition has none
+    virtual void beginAction(const StateMachine& /*pMachine*/, std::size_t /*pTransition*/){}
+    virtual void endAction(const StateMachine& /*pMachine*/, std::size_t /*pTransition*/){}
+  };
+
+  /*
+  runs the callbacks of the orthogonal regions of a parallel state concurrently, see StateMachine::setRegionExecutor.
+  StateMachineExecutor is one
+  */
+  class RegionExecutor{
+  public:
+    virtual ~RegionExecutor(){}
+
+    /*
+    call pTask(0) ... pTask(pCount - 1), possibly concurrently, and return once every call has returned.
+    the first exception thrown by a call is rethrown once all of them have returned
+    */
+    virtual void forEach(std::size_t pCount, const std::function<void(std::size_t)>& pTask) = 0;
+  };
+
   class StateMachineException : public std::logic_error {
   protected:
     StateMachineException(const std::string& pWhat)
@@ -138,6 +329,21 @@ namespace ifsm{
   };
 
 
+  class NoSuchEvent : public StateMachineException{
+  public:
+    NoSuchEvent(const std::string& pEvent)
+      : StateMachineException("No transition of the StateMachine reacts to an event named \""+pEvent+"\".")
+      , mName(pEvent){
+
+    }
+
+    virtual ~NoSuchEvent() NOEXCEPT{}
+
+  public:
+    const std::string mName;
+  };
+
+
   class TargetAlreadySpecified : public StateMachineException{
   public:
     TargetAlreadySpecified(const std::string& pTarget)
@@ -172,6 +378,20 @@ namespace ifsm{
       : StateMachineException("A transition has two OnEvent parameters defined. Only one is allowed.")
       {}
   };
+
+  class InvalidSnapshot : public StateMachineException{
+  public:
+    InvalidSnapshot(const std::string& pReason)
+      : StateMachineException("The snapshot can't be restored : "+pReason+".")
+      {}
+  };
+
+  class EventlessLoop : public StateMachineException{
+  public:
+    EventlessLoop(std::size_t pLimit)
+      : StateMachineException("Eventless transitions were taken "+std::to_string(pLimit)+" times in a row. Their Conditions may never become false.")
+      {}
+  };
 }
 
 namespace ifsm{ 
@@ -233,36 +453,455 @@ namespace ifsm{
       static const bool value = sizeof(test<CallableType>(0)) == sizeof(yes);
     };
 
-    //turn f() into f(SM)
-    template<class Callable, typename B = typename std::enable_if<is_callable<Callable>::value>::type>
-    std::function<void(StateMachine&) > fixParams(Callable && pCallable){
-      return std::function<void(StateMachine&) >([pCallable](StateMachine& ){
-        pCallable();
-      });
+    template <class T>
+    struct voider{
+      typedef void type;
+    };
+
+    //number of parameters of type T in Params, to size the containers of a definition upfront
+    template <class T, typename... Params>
+    struct count_of{
+      static const std::size_t value = 0;
+    };
+
+    template <class T, class First, typename... Params>
+    struct count_of<T, First, Params...>{
+      static const std::size_t value = (std::is_same<typename std::decay<First>::type, T>::value ? 1 : 0)
+        + count_of<T, Params...>::value;
+    };
+
+    /*
+    signature of a callable receiving an event payload : Ret(const T&) or Ret(Machine, const T&).
+    value is false for any other callable, and for callables with overloaded or template call operators
+    */
+    template <class CallableType, class = void>
+    struct payload_signature{
+      static const bool value = false;
+    };
+
+    template <class CallableType>
+    struct payload_signature<CallableType, typename voider<decltype(&CallableType::operator())>::type>
+      : payload_signature<decltype(&CallableType::operator())>{};
+
+    template <class Ret, class Arg>
+    struct payload_signature<Ret(*)(Arg), void>{
+      static const bool value = true;
+      typedef Ret result;
+      typedef typename std::decay<Arg>::type type;
+      typedef std::false_type with_machine;
+    };
+
+    template <class Ret, class Machine, class Arg>
+    struct payload_signature<Ret(*)(Machine, Arg), void> : payload_signature<Ret(*)(Arg)>{
+      typedef std::true_type with_machine;
+    };
+
+    template <class Class, class Ret, class Arg>
+    struct payload_signature<Ret(Class::*)(Arg), void> : payload_signature<Ret(*)(Arg)>{};
+
+    template <class Class, class Ret, class Arg>
+    struct payload_signature<Ret(Class::*)(Arg) const, void> : payload_signature<Ret(*)(Arg)>{};
+
+    template <class Class, class Ret, class Machine, class Arg>
+    struct payload_signature<Ret(Class::*)(Machine, Arg), void> : payload_signature<Ret(*)(Machine, Arg)>{};
+
+    template <class Class, class Ret, class Machine, class Arg>
+    struct payload_signature<Ret(Class::*)(Machine, Arg) const, void> : payload_signature<Ret(*)(Machine, Arg)>{};
+
+    //true for a callable receiving an event payload and returning bool
+    template <class CallableType, bool = payload_signature<CallableType>::value>
+    struct payload_condition{
+      static const bool value = false;
+    };
+
+    template <class CallableType>
+    struct payload_condition<CallableType, true>{
+      static const bool value = std::is_same<typename payload_signature<CallableType>::result, bool>::value;
+    };
+
+    //true for an action callable returning a Task, with or without a payload
+    template <class CallableType, bool = payload_signature<CallableType>::value>
+    struct returns_task{
+      static const bool value = returns<CallableType, Task>::value || returns_with<CallableType, Task, StateMachine&>::value;
+    };
+
+    template <class CallableType>
+    struct returns_task<CallableType, true>{
+      static const bool value = std::is_same<typename payload_signature<CallableType>::result, Task>::value;
+    };
+
+    /*
+    state shared by the coroutine of a Task and the StateMachine awaiting it. each side holds a reference :
+    the coroutine releases its own when it completes, and the last one to release destroys the coroutine frame
+    */
+    struct TaskState{
+      std::atomic<unsigned> mReferences;
+      //exception thrown by the coroutine, read once it has completed
+      std::exception_ptr mError;
+      void (*mDestroy)(TaskState*);
+    };
+
+    //release a reference to pTask, destroying its coroutine frame if it is the last one
+    inline void releaseTask(TaskState* pTask);
+
+    //returns whether the coroutine of pTask has completed, for the side still holding a reference
+    inline bool taskDone(const TaskState* pTask);
+
+    /*
+    returns an identifier unique to the type T, compared to find whether a payload is a T
+    */
+    template <class T>
+    const void* payloadType();
+
+    /*
+    Non-copyable holder of an event payload of any movable type, stored inline when it is small
+    enough and can be moved without throwing, otherwise allocated on the heap
+    */
+    class Payload{
+    public:
+      static const std::size_t InlineCapacity = 4 * sizeof(void*);
+
+    public:
+      inline Payload() NOEXCEPT;
+
+      template <class T, typename B = typename std::enable_if<!std::is_same<typename std::decay<T>::type, Payload>::value>::type>
+      explicit Payload(T&& pValue);
+
+      inline Payload(Payload&& pRhs) NOEXCEPT;
+
+      inline Payload& operator=(Payload&& pRhs) NOEXCEPT;
+
+      inline ~Payload();
+
+      inline const void* data() const NOEXCEPT;
+
+      //payloadType of the stored value, nullptr when empty
+      inline const void* type() const NOEXCEPT;
+
+    private:
+      Payload(const Payload&);
+      Payload& operator=(const Payload&);
+
+      typedef std::aligned_storage<InlineCapacity, std::alignment_of<void*>::value>::type Storage;
+
+      enum Operation{ MoveTo, Destroy };
+
+      typedef void (*Manager)(Operation, void*, void*);
+
+      template <class T>
+      struct isInline{
+        static const bool value = sizeof(T) <= InlineCapacity
+          && std::alignment_of<T>::value <= std::alignment_of<Storage>::value
+          && std::is_nothrow_move_constructible<T>::value;
+      };
+
+      template <class T, class Arg>
+      void store(Arg&& pValue, std::true_type);
+
+      template <class T, class Arg>
+      void store(Arg&& pValue, std::false_type);
+
+      template <class T>
+      static void manage(Operation pOperation, void* pStorage, void* pDestination, std::true_type);
+
+      template <class T>
+      static void manage(Operation pOperation, void* pStorage, void* pDestination, std::false_type);
+
+      template <class T, bool Inline>
+      static void manage(Operation pOperation, void* pStorage, void* pDestination);
+
+      inline void reset() NOEXCEPT;
+
+    private:
+      Storage mStorage;
+      const void* mType;
+      Manager mManage;
+      bool mIsInline;
+    };
+
+    /*
+    Non-copyable callable holder. Callables of at most InlineCapacity bytes that can be moved
+    without throwing are stored inline, larger ones are allocated on the heap.
+    A callable that doesn't accept Args is called with no parameter.
+    */
+    template <class Signature>
+    class Callback;
+
+    template <class Ret, typename... Args>
+    class Callback<Ret(Args...)>{
+    public:
+      static const std::size_t InlineCapacity = 4 * sizeof(void*);
+
+    public:
+      inline Callback() NOEXCEPT;
+
+      template <class Callable, typename B = typename std::enable_if<!std::is_same<typename std::decay<Callable>::type, Callback>::value>::type>
+      Callback(Callable&& pCallable);
+
+      inline Callback(Callback&& pRhs) NOEXCEPT;
+
+      inline Callback& operator=(Callback&& pRhs) NOEXCEPT;
+
+      inline ~Callback();
+
+      inline explicit operator bool() const NOEXCEPT;
+
+      inline Ret operator()(Args... pArgs) const;
+
+    private:
+      Callback(const Callback&);
+      Callback& operator=(const Callback&);
+
+      typedef typename std::aligned_storage<InlineCapacity, std::alignment_of<void*>::value>::type Storage;
+
+      enum Operation{ MoveTo, Destroy };
+
+      typedef Ret (*Invoker)(void*, Args...);
+      typedef void (*Manager)(Operation, void*, void*);
+
+      template <class Callable>
+      struct isInline{
+        static const bool value = sizeof(Callable) <= InlineCapacity
+          && std::alignment_of<Callable>::value <= std::alignment_of<Storage>::value
+          && std::is_nothrow_move_constructible<Callable>::value;
+      };
+
+      template <class Callable>
+      static Callable& get(void* pStorage, std::true_type);
+
+      template <class Callable>
+      static Callable& get(void* pStorage, std::false_type);
+
+      template <class Callable>
+      static Ret invoke(void* pStorage, Args... pArgs);
+
+      template <class Callable>
+      static Ret call(Callable& pCallable, std::true_type, Args... pArgs);
+
+      template <class Callable>
+      static Ret call(Callable& pCallable, std::false_type, Args... pArgs);
+
+      template <class Callable>
+      void store(Callable&& pCallable, std::true_type);
+
+      template <class Callable>
+      void store(Callable&& pCallable, std::false_type);
+
+      template <class Callable>
+      static void manage(Operation pOperation, void* pStorage, void* pDestination);
+
+      template <class Callable>
+      static void manage(Operation pOperation, void* pStorage, void* pDestination, std::true_type);
+
+      template <class Callable>
+      static void manage(Operation pOperation, void* pStorage, void* pDestination, std::false_type);
+
+      inline void reset() NOEXCEPT;
+
+    private:
+      Storage mStorage;
+      Invoker mInvoke;
+      Manager mManage;
+    };
+
+    typedef Callback<void(StateMachine&)> ActionCallback;
+    typedef Callback<bool(const StateMachine&)> ConditionCallback;
+
+    /*
+    adapts a callable receiving the payload of the event to a callback receiving the StateMachine.
+    the callable is only called when the event carries a payload of the expected type,
+    otherwise Ret() is returned
+    */
+    template <class Callable>
+    class PayloadCallback{
+    public:
+      typedef payload_signature<Callable> Signature;
+      typedef typename Signature::result Ret;
+      typedef typename Signature::type Type;
+
+    public:
+      template <class C>
+      explicit PayloadCallback(C&& pCallable)
+        : mCallable(std::forward<C>(pCallable))
+      {}
+
+      template <class Machine>
+      Ret operator()(Machine& pRoot){
+        const Type* lPayload = pRoot.template eventPayload<Type>();
+        if (!lPayload){
+          return Ret();
+        }
+        return call(pRoot, *lPayload, typename Signature::with_machine());
+      }
+
+    private:
+      template <class Machine>
+      Ret call(Machine& pRoot, const Type& pPayload, std::true_type){
+        return mCallable(pRoot, pPayload);
+      }
+
+      template <class Machine>
+      Ret call(Machine&, const Type& pPayload, std::false_type){
+        return mCallable(pPayload);
+      }
+
+    private:
+      Callable mCallable;
+    };
+
+    template<class CallbackType, class Callable>
+    CallbackType makeCallback(Callable && pCallable, std::true_type){
+      return CallbackType(std::forward<Callable>(pCallable));
     }
 
-    //turn f(SM) into f(SM) : no change
-    template<class Callable, typename B = typename std::enable_if<is_callable_with<Callable, StateMachine&>::value>::type, typename U = void>
-    std::function<void(StateMachine&) > fixParams(Callable && pCallable){
-      return std::function<void(StateMachine&) >(pCallable);
+    template<class CallbackType, class Callable>
+    CallbackType makeCallback(Callable && pCallable, std::false_type){
+      return CallbackType(PayloadCallback<typename std::decay<Callable>::type>(std::forward<Callable>(pCallable)));
     }
 
-    //turn bool f() into bool f(SM)
-    template<class Callable, typename B = typename std::enable_if<returns<Callable, bool>::value>::type, typename U = void, typename X = void>
-    std::function<bool(const StateMachine&)> fixConditionParams(Callable && pCallable){
-      return std::function<bool(const StateMachine&)>([pCallable](const StateMachine& ){
-        return pCallable();
-      });
+    template<class Callable>
+    ActionCallback fixParams(Callable && pCallable, std::false_type){
+      return makeCallback<ActionCallback>(std::forward<Callable>(pCallable),
+        std::integral_constant<bool, is_callable<Callable>::value || is_callable_with<Callable, StateMachine&>::value>());
     }
 
-    //turn bool f(SM) into bool f(SM) : no change
-    template<class Callable, typename B = typename std::enable_if<returns_with<Callable, bool, const StateMachine&>::value>::type, typename U = void, typename X = void, typename Y = void>
-    std::function<bool(const StateMachine&)> fixConditionParams(Callable && pCallable){
-      return std::function<bool(const StateMachine&)>(pCallable);
+#if defined(INSTANTFSM_COROUTINES)
+    template<class Callable>
+    ActionCallback fixParams(Callable && pCallable, std::true_type){
+      typedef typename std::decay<Callable>::type Type;
+      typedef typename std::conditional<is_callable<Type>::value || is_callable_with<Type, StateMachine&>::value,
+        Type, PayloadCallback<Type>>::type Inner;
+      return ActionCallback(TaskCallback<Inner>(Inner(std::forward<Callable>(pCallable))));
     }
+#endif
+
+    //f() and f(SM) are both stored as f(SM), f(T) and f(SM, T) are wrapped in a PayloadCallback.
+    //callables returning a Task are wrapped in a TaskCallback
+    template<class Callable>
+    ActionCallback fixParams(Callable && pCallable){
+      return fixParams(std::forward<Callable>(pCallable),
+        std::integral_constant<bool, returns_task<typename std::decay<Callable>::type>::value>());
+    }
+
+    //bool f() and bool f(SM) are both stored as bool f(SM), bool f(T) and bool f(SM, T) are wrapped in a PayloadCallback
+    template<class Callable>
+    ConditionCallback fixConditionParams(Callable && pCallable){
+      return makeCallback<ConditionCallback>(std::forward<Callable>(pCallable),
+        std::integral_constant<bool, is_callable<Callable>::value || is_callable_with<Callable, const StateMachine&>::value>());
+    }
+
+  }
+}
+
+#if defined(INSTANTFSM_COROUTINES)
+namespace ifsm{
+  /*
+  return type of a coroutine used as an Action, OnEntry or OnExit callback. the coroutine starts when
+  the callback is called : if it suspends, the StateMachine suspends the transition being taken, and
+  queues the events pushed until the coroutine completes. once it has, the next call to processEvents
+  or pushEvent runs the remaining callbacks of the transition, then the queued events.
+  an exception thrown by the coroutine is rethrown from that call
+  */
+  class Task{
+
+    template <class Callable>
+    friend class priv::TaskCallback;
+
+  private:
+    struct FinalAwaiter;
+
+  public:
+    struct promise_type : priv::TaskState{
+      inline promise_type();
+
+      inline Task get_return_object();
+
+      inline std::suspend_never initial_suspend() const NOEXCEPT;
+
+      inline FinalAwaiter final_suspend() const NOEXCEPT;
+
+      inline void return_void() const NOEXCEPT;
+
+      inline void unhandled_exception();
+
+      //destroy the coroutine frame holding pTask
+      static inline void destroy(priv::TaskState* pTask);
+    };
+
+  public:
+    //an empty Task, done
+    inline Task() NOEXCEPT;
+
+    inline Task(Task&& pRhs) NOEXCEPT;
+
+    inline Task& operator=(Task&& pRhs) NOEXCEPT;
+
+    /*
+    a coroutine still running when its Task is destroyed outside of a StateMachine keeps running,
+    and an exception it throws is lost
+    */
+    inline ~Task();
+
+    //returns whether the coroutine has completed
+    inline bool done() const;
 
+  private:
+    Task(const Task&);
+    Task& operator=(const Task&);
+
+    inline explicit Task(priv::TaskState* pState) NOEXCEPT;
+
+    //give up the reference to the shared state
+    inline priv::TaskState* release() NOEXCEPT;
+
+  private:
+    //the coroutine releases its reference when it completes, and keeps its frame alive until the Task does
+    struct FinalAwaiter{
+      inline bool await_ready() const NOEXCEPT;
+
+      inline bool await_suspend(std::coroutine_handle<promise_type> pCoroutine) const NOEXCEPT;
+
+      inline void await_resume() const NOEXCEPT;
+    };
+
+  private:
+    priv::TaskState* mState;
+  };
+
+  namespace priv{
+    /*
+    adapts a callable returning a Task to an action callback : the StateMachine awaits the Task
+    */
+    template <class Callable>
+    class TaskCallback{
+    public:
+      explicit TaskCallback(Callable&& pCallable)
+        : mCallable(std::move(pCallable))
+      {}
+
+      template <class Machine>
+      void operator()(Machine& pRoot){
+        Task lTask(call(pRoot, std::integral_constant<bool, is_callable_with<Callable&, Machine&>::value>()));
+        pRoot.await(lTask.release());
+      }
+
+    private:
+      template <class Machine>
+      Task call(Machine& pRoot, std::true_type){
+        return mCallable(pRoot);
+      }
+
+      template <class Machine>
+      Task call(Machine&, std::false_type){
+        return mCallable();
+      }
+
+    private:
+      Callable mCallable;
+    };
   }
 }
+#endif
 
 namespace ifsm{
   
@@ -292,17 +931,17 @@ namespace ifsm{
 
     private:
 
-      OnEntryAction(std::function<void(StateMachine&) > && pFun)
+      OnEntryAction(ActionCallback && pFun)
         : mFun(std::move(pFun))
       {}
 
     private:
-      void operator()(StateMachine& pRoot){
+      void operator()(StateMachine& pRoot) const{
         mFun(pRoot);
       }
 
     private:
-      std::function<void(StateMachine&) > mFun;
+      ActionCallback mFun;
 
     };
 
@@ -314,18 +953,18 @@ namespace ifsm{
       friend class StateDef;
       friend class StateImpl;
 
-      OnExitAction(std::function<void(StateMachine&) > && pFun)
+      OnExitAction(ActionCallback && pFun)
         : mFun(std::move(pFun))
       {}
 
     private:
 
-      void operator()(StateMachine& pRoot){
+      void operator()(StateMachine& pRoot) const{
         mFun(pRoot);
       }
 
     private:
-      std::function<void(StateMachine&) > mFun;
+      ActionCallback mFun;
     };
   }
 }
@@ -336,6 +975,7 @@ namespace ifsm{
     class TransitionAction;
     class TransitionCondition;
     class TransitionEvent;
+    class TransitionDelay;
     class TransitionImpl;
     class TransitionDef;
   }
@@ -371,6 +1011,13 @@ namespace ifsm{
   */
   inline priv::TransitionEvent OnEvent(const std::string& pEvent);
 
+  /*
+  Trigger the transition once its source state has been active for pDelay, instead of an event.
+  the timer is armed when the state is entered, and canceled when it is exited
+  */
+  template <class Rep, class Period>
+  priv::TransitionDelay After(const std::chrono::duration<Rep, Period>& pDelay);
+
   /*
   Creates a new transition when called as a parameter of the State function.
   */
@@ -400,11 +1047,11 @@ namespace ifsm{
       friend TransitionAction ifsm::Action(FunType&& pAction);
       friend class ifsm::priv::TransitionDef;
 
-      inline TransitionAction(std::function<void(StateMachine&)>&& pFun);
+      inline TransitionAction(ActionCallback&& pFun);
 
       inline void operator()(StateMachine& pRoot);
 
-      std::function<void(StateMachine&)> mFun;
+      ActionCallback mFun;
     };
 
     class TransitionCondition{
@@ -413,10 +1060,10 @@ namespace ifsm{
       friend TransitionCondition ifsm::Condition(FunType&& pCondition);
       friend class ifsm::priv::TransitionDef;
 
-      inline TransitionCondition(std::function<bool(const StateMachine&)>&& pCond);
+      inline TransitionCondition(ConditionCallback&& pCond);
 
       inline bool operator()(const StateMachine& pRoot);
-      std::function<bool(const StateMachine&)> mCond;
+      ConditionCallback mCond;
     };
 
     class TransitionEvent{
@@ -428,7 +1075,18 @@ namespace ifsm{
 
       std::string mEvent;
     };
-    
+
+    class TransitionDelay{
+
+      template <class Rep, class Period>
+      friend TransitionDelay ifsm::After(const std::chrono::duration<Rep, Period>& pDelay);
+      friend class ifsm::priv::TransitionDef;
+
+      inline TransitionDelay(std::chrono::nanoseconds pDelay);
+
+      std::chrono::nanoseconds mDelay;
+    };
+    
     class TransitionImpl;
 
     class TransitionDef{
@@ -440,7 +1098,8 @@ namespace ifsm{
       
       friend class TransitionImpl;
 
-      friend class StateImpl;
+      friend class ifsm::StateMachine;
+      friend class ifsm::StateChart;
 
     public:
       inline TransitionDef(TransitionDef&& pRhs); 
@@ -457,17 +1116,15 @@ namespace ifsm{
 
       inline void addParameter(priv::TransitionEvent && pEvent);
 
-      template <class T>
-      void addParameters(T&& pParam1);
-
-      template <class T, typename... Params>
-      void addParameters(T&& pParam1, Params && ... pParams);
+      inline void addParameter(priv::TransitionDelay && pDelay);
 
     private:
       std::string mTarget;
       std::string mEvent;
-      std::function<void(StateMachine&)> mAction;
-      std::function<bool(const StateMachine&)> mCondition;
+      ActionCallback mAction;
+      ConditionCallback mCondition;
+      std::chrono::nanoseconds mDelay;
+      bool mHasDelay;
     };
   };
 
@@ -477,21 +1134,16 @@ namespace ifsm{
   namespace priv{
     class TransitionImpl{
       friend class ifsm::StateMachine;
-      friend class ifsm::priv::StateImpl;
+      friend class ifsm::StateChart;
+      friend class ifsm::InstancePool;
     
     public:
-      inline TransitionImpl(const TransitionDef& pDef);
+      inline TransitionImpl(TransitionDef&& pDef, EventId pEvent);
 
     private:
-      inline void setSource(StateImpl* pSource);
+      inline EventId getEvent() const;
 
-      inline void setTarget(StateImpl* pTarget);
-
-      inline const StateImpl* getSource() const;
-      
-      inline const StateImpl* getTarget() const;
-
-      inline const std::string& getEvent() const;
+      inline bool isTargetless() const;
 
       inline bool test(const StateMachine& pRoot) const;
 
@@ -499,11 +1151,17 @@ namespace ifsm{
 
     
     private:
-      StateImpl* mSource;
-      StateImpl* mTarget;
-      std::string mEvent;
-      std::function<void(StateMachine&)> mAction;
-      std::function<bool(const StateMachine&)> mCondition;
+      StateIndex mSource;
+      //NoIndex for targetless transitions
+      StateIndex mTarget;
+      //least common ancestor of source and target, computed once the StateMachine is built
+      StateIndex mDomain;
+      //range of the states entered by the transition in StateMachine::mEntrySequences
+      std::uint32_t mEntryBegin;
+      std::uint32_t mEntryEnd;
+      EventId mEvent;
+      ActionCallback mAction;
+      ConditionCallback mCondition;
 
     };
   }
@@ -514,14 +1172,267 @@ namespace ifsm{
   namespace priv{
     struct initialTag_t{};
     struct parallelTag_t{};
+    struct shallowHistoryTag_t{};
+    struct deepHistoryTag_t{};
+
+    //configuration a state records when it is exited, to be entered again by default
+    enum History{ NoHistory, ShallowHistory, DeepHistory };
   }
 
   static priv::initialTag_t initialTag;
   static priv::parallelTag_t parallelTag;
+  static priv::shallowHistoryTag_t shallowHistoryTag;
+  static priv::deepHistoryTag_t deepHistoryTag;
+
+  namespace priv{
+    /**
+    Fixed size set of bits, used to store which states are active
+    */
+    class Bitset{
+    public:
+      typedef std::uint64_t Word;
+      static const std::size_t WordBits = 64;
+      static const std::size_t npos = static_cast<std::size_t>(-1);
+
+    public:
+      inline Bitset();
+
+      inline void resize(std::size_t pSize);
+
+      inline std::size_t size() const;
+
+      inline bool test(std::size_t pIndex) const;
+
+      inline void set(std::size_t pIndex);
+
+      inline void reset(std::size_t pIndex);
+
+      /*
+      returns the index of the last set bit in [pBegin, pEnd), or npos
+      */
+      inline std::size_t findPrevious(std::size_t pBegin, std::size_t pEnd) const;
+
+      /*
+      returns the index of the first set bit at or after pBegin, or npos
+      */
+      inline std::size_t findNext(std::size_t pBegin) const;
+
+      //number of set bits
+      inline std::size_t count() const;
+
+      /*
+      returns true if every bit set in pOther is set in this one, and whether they share a set bit.
+      both sets are expected to have the same size
+      */
+      inline bool includes(const Bitset& pOther) const;
+
+      inline bool intersects(const Bitset& pOther) const;
+
+      /*
+      the underlying words, bit i being bit (i % WordBits) of word (i / WordBits).
+      bits past size() are always 0
+      */
+      inline const Word* words() const;
+
+      inline std::size_t wordCount() const;
+
+      /*
+      clear every bit, or set the bits set in the wordCount() words at pWords
+      */
+      inline void clear();
+
+      inline void unite(const Word* pWords);
+
+    private:
+      inline static std::size_t highestBit(Word pWord);
+
+      inline static std::size_t lowestBit(Word pWord);
+
+      inline static std::size_t popCount(Word pWord);
+
+    private:
+      std::vector<Word> mWords;
+      std::size_t mSize;
+    };
+
+  }
+
+  /*
+  set of states of a chart indexed by StateId, as returned by StateMachine::activeConfiguration
+  */
+  typedef priv::Bitset StateSet;
 
   namespace priv{
-    template <class SearchType>
-    struct StateIterator;
+    /*
+    FNV-1a hash of integers and strings, used to fingerprint a StateChart.
+    integers are hashed as 8 little-endian bytes so that the result doesn't depend on the platform
+    */
+    inline std::uint64_t hashValue(std::uint64_t pHash, std::uint64_t pValue);
+
+    inline std::uint64_t hashString(std::uint64_t pHash, const std::string& pValue);
+
+    /*
+    LEB128 encoding of unsigned integers, used by StateMachine::snapshot.
+    readVarint returns false if the buffer ends before the integer
+    */
+    inline void appendVarint(std::vector<std::uint8_t>& pBuffer, std::uint64_t pValue);
+
+    inline bool readVarint(const std::uint8_t*& pBegin, const std::uint8_t* pEnd, std::uint64_t& pValue);
+
+    /*
+    bytes owned by containers, used by memoryUsage : the heap blocks of a vector by capacity, the heap block
+    of a string unless it is stored inline, and the buckets and nodes of a hash table of names, along with
+    the heap blocks of the names. allocator overhead isn't counted
+    */
+    template <class T>
+    std::size_t vectorBytes(const std::vector<T>& pVector);
+
+    inline std::size_t stringBytes(const std::string& pString);
+
+    template <class Map>
+    std::size_t nameTableBytes(const Map& pMap);
+
+    /**
+    FIFO queue stored in a circular buffer that is reused once it has grown
+    */
+    template <class T>
+    class RingBuffer{
+    public:
+      RingBuffer();
+
+      bool empty() const;
+
+      std::size_t size() const;
+
+      void push(const T& pValue);
+
+      void push(T&& pValue);
+
+      T& front();
+
+      void pop();
+
+      //make room for at least pCapacity elements
+      void reserve(std::size_t pCapacity);
+
+      //number of elements the buffer holds before it grows
+      std::size_t capacity() const;
+
+    private:
+      void grow(std::size_t pCapacity);
+
+    private:
+      std::vector<T> mBuffer;
+      std::size_t mFront;
+      std::size_t mSize;
+    };
+
+    /**
+    Unbounded lock-free queue with many producers and a single consumer.
+    push may be called from any thread, pop only from the consumer thread
+    */
+    template <class T>
+    class MpscQueue{
+    public:
+      MpscQueue();
+
+      ~MpscQueue();
+
+      void push(const T& pValue);
+
+      //returns false if the queue is empty
+      bool pop(T& pValue);
+
+      //consumer side only
+      bool empty() const;
+
+    private:
+      MpscQueue(const MpscQueue&);
+      MpscQueue& operator=(const MpscQueue&);
+
+      struct Node{
+        std::atomic<Node*> mNext;
+        T mValue;
+      };
+
+    private:
+      //last pushed node, exchanged by producers
+      std::atomic<Node*> mHead;
+      //node preceding the next one to pop, owned by the consumer
+      Node* mTail;
+      Node mStub;
+    };
+
+    /**
+    FIFO queue of events along with their payloads. Events with a payload are flagged with
+    PayloadFlag, and their payloads are stored in a second queue in the same order
+    */
+    class EventQueue{
+    public:
+      inline bool empty() const;
+
+      inline std::size_t size() const;
+
+      inline void push(EventId pEvent);
+
+      inline void push(EventId pEvent, Payload&& pPayload);
+
+      //remove the event at the front of the queue, and returns it along with its PayloadFlag
+      inline EventId pop();
+
+      //remove the payload of the event that was popped, when it has PayloadFlag
+      inline Payload popPayload();
+
+      inline void reserve(std::size_t pCapacity);
+
+      //bytes of the buffers of both queues
+      inline std::size_t bufferBytes() const;
+
+    private:
+      RingBuffer<EventId> mEvents;
+      RingBuffer<Payload> mPayloads;
+    };
+
+    /**
+    timer of an After transition : the source state pushes mEvent once it has been active for mDelay
+    */
+    struct TimerDef{
+      EventId mEvent;
+      std::chrono::nanoseconds mDelay;
+    };
+
+    /**
+    entry of the pushEventAsync mailbox : an event, or the timer mTimer of an After transition
+    that a TimerWheel fired as mTimerId, and that the consumer checks again before pushing its event
+    */
+    struct AsyncEvent{
+      EventId mEvent;
+      std::uint32_t mTimer;
+      TimerId mTimerId;
+    };
+
+    /**
+    event put aside by a state that defers it, until the state is exited
+    */
+    struct ParkedEvent{
+      EventId mEvent;
+      StateIndex mState;
+      std::size_t mPriority;
+      Payload mPayload;
+    };
+
+    /**
+    point of a microstep where its callbacks resume, once the Task a callback suspended it on has completed
+    */
+    struct ResumePoint{
+      enum Phase{ DefaultEntry, Exit, Action, Entry };
+
+      Phase mPhase;
+      //position in StateChart::mDefaultEntry, or in StateMachine::mStatesToExit, mEnabledTransitions or mStatesToEnter
+      std::uint32_t mItem;
+      //callback of the state to resume from
+      std::uint32_t mCallback;
+    };
   }
   
 }
@@ -530,10 +1441,13 @@ namespace ifsm{
   namespace priv{
     class StateDef;
     class StateImpl;
+    class DeferredEvent;
   }
 
   template <typename... Args>
   priv::StateDef State(const std::string& pName, Args&&... pArgs);
+
+  inline priv::DeferredEvent Defer(const std::string& pEvent);
   
 }
 
@@ -543,6 +1457,15 @@ namespace ifsm{
   ifsm::priv::StateDef State(const std::string& pName, Args&&... pArgs);
 
   namespace priv{
+
+    class DeferredEvent{
+      inline DeferredEvent(const std::string& pEvent);
+      friend DeferredEvent ifsm::Defer(const std::string& pEvent);
+      friend class ifsm::priv::StateDef;
+
+    private:
+      std::string mEvent;
+    };
   
     class StateDef{
 
@@ -551,6 +1474,7 @@ namespace ifsm{
 
       friend class ifsm::priv::StateImpl;
       friend class ifsm::StateMachine;
+      friend class ifsm::StateChart;
 
     private:
 
@@ -567,1288 +1491,6849 @@ namespace ifsm{
 
       inline void addParameter(OnExitAction && pAction);
 
+      inline void addParameter(DeferredEvent && pEvent);
+
       inline void addParameter(initialTag_t& pTag);
 
       inline void addParameter(parallelTag_t& pTag);
 
-      template <class FirstP>
-      void addParameters(FirstP && pFirst);
+      inline void addParameter(shallowHistoryTag_t& pTag);
 
-      template <class FirstP, typename... Params>
-      void addParameters(FirstP && pFirst, Params && ... pParameters);
+      inline void addParameter(deepHistoryTag_t& pTag);
 
     private:
       std::string                 mName;
       bool                        mIsInitial;
       bool                        mIsParallel;
+      History                     mHistory;
+      //sizes of the subtree rooted at this definition, so that StateChart::build can reserve its storage
+      std::size_t                 mSubtreeStates;
+      std::size_t                 mSubtreeTransitions;
+      std::size_t                 mSubtreeOnEntry;
+      std::size_t                 mSubtreeOnExit;
       std::vector<StateDef>       mChildren;
       std::vector<TransitionDef>  mTransitions;
       std::vector<OnEntryAction>  mOnEntryActions;
       std::vector<OnExitAction>   mOnExitActions;
+      std::vector<std::string>    mDeferredEvents;
     };
 
     class StateImpl{
-      //everything is private, only StateMachine is allowed to use a StateImpl
+      //everything is private, only StateChart, StateMachine and InstancePool are allowed to use a StateImpl
       friend class ifsm::StateMachine;
-
-      template <typename>
-      friend struct ifsm::priv::StateIterator;
+      friend class ifsm::StateChart;
+      friend class ifsm::InstancePool;
       
     public:
-      typedef std::vector<StateImpl*> ChildrenMap;
-      typedef std::multimap<std::string, std::unique_ptr<TransitionImpl>> TransitionsMap;
+      inline StateImpl(StateIndex pOrdinal, StateIndex pParent, const StateDef& pDef);
       
-    public:
-      inline StateImpl();
-
-      inline virtual ~StateImpl();
-      
-    protected:
-      inline void build(StateMachine* pRoot, StateImpl* pParent, StateDef&& pDef);
-
-      inline const std::string& getName() const;
-
+    private:
       inline bool isAtomic() const;
 
       inline bool isInitial() const;
 
       inline bool isParallel() const;
 
-      inline virtual bool isActive() const;
+      /*
+      returns true if pState is this state or one of its descendants
+      */
+      inline bool contains(StateIndex pState) const;
+
+      inline void enter(StateMachine& pRoot) const;
+
+      inline void leave(StateMachine& pRoot) const;
+
+      /*
+      the two halves of enter and leave : update the configuration of pRoot, then call the callbacks.
+      only the callbacks may run concurrently with other states'
+      */
+      inline void markEntered(StateMachine& pRoot) const;
+
+      inline void callOnEntry(StateMachine& pRoot) const;
+
+      inline void markExited(StateMachine& pRoot) const;
+
+      inline void callOnExit(StateMachine& pRoot) const;
 
-      inline void enter();
+      /*
+      call the callbacks from the pCallback-th one. returns false when one of them suspends pRoot on a Task,
+      pCallback being then the callback to resume from
+      */
+      inline bool callOnEntry(StateMachine& pRoot, std::uint32_t& pCallback) const;
 
-      inline void leave();
+      inline bool callOnExit(StateMachine& pRoot, std::uint32_t& pCallback) const;
 
-    protected:
-      std::string                                               mName;
-      StateImpl*                                                mParent;
-      StateMachine*                                             mRoot;
-      bool                                                      mIsInitial;
-      bool                                                      mIsParallel;
-      StateImpl*                                                mInitial;
-      StateImpl*                                                mActive;
-      ChildrenMap                                               mChildren;
-      TransitionsMap 	                                          mTransitions;
-      std::vector<priv::OnEntryAction>                          mOnEntryActions;
-      std::vector<priv::OnExitAction>                           mOnExitActions;
+    private:
+      StateIndex          mOrdinal;
+      StateIndex          mParent;
+      //ordinal following the last descendant of this state
+      StateIndex          mSubtreeEnd;
+      StateIndex          mInitial;
+      //row of the state in the dispatch table of the StateChart, for atomic states
+      std::uint32_t       mDispatchRow;
+      //ranges of the state in StateChart::mTransitions, mOnEntryActions and mOnExitActions
+      TransitionIndex     mTransitionsBegin;
+      TransitionIndex     mTransitionsEnd;
+      std::uint32_t       mOnEntryBegin;
+      std::uint32_t       mOnEntryEnd;
+      std::uint32_t       mOnExitBegin;
+      std::uint32_t       mOnExitEnd;
+      //range of the state in StateChart::mDeferredEvents
+      std::uint32_t       mDeferredBegin;
+      std::uint32_t       mDeferredEnd;
+      //range of the timers of the state in StateChart::mTimers
+      std::uint32_t       mTimersBegin;
+      std::uint32_t       mTimersEnd;
+      //history slot of the state in StateMachine::mHistorySizes, or NoIndex, and the range of its
+      //recorded states in StateMachine::mHistory
+      std::uint32_t       mHistorySlot;
+      std::uint32_t       mHistoryBegin;
+      std::uint32_t       mHistoryEnd;
+      bool                mIsInitial;
+      bool                mIsParallel;
+      History             mHistory;
     };
   }
 
-  class StateMachine {
-  
+  /*
+  bytes used by a StateChart or a StateMachine, by category : the objects themselves and the heap blocks they own,
+  by capacity. the heap storage of callables larger than a Callback, of payloads and of the events pushed by
+  pushEventAsync that are still in flight isn't counted, and neither is allocator overhead
+  */
+  struct MemoryUsage{
+    //states of the chart and their entry sequences, or active configuration and history of an instance
+    std::size_t mStates;
+    //transitions and dispatch tables of the chart, or buffers an instance reuses to take transitions
+    std::size_t mTransitions;
+    //OnEntry, OnExit, Action and Condition callbacks
+    std::size_t mCallbacks;
+    //event queues and deferred events
+    std::size_t mQueues;
+    //names of the states and events, and the tables resolving them
+    std::size_t mNames;
+    //the StateChart or StateMachine object itself
+    std::size_t mOther;
+
+    inline std::size_t total() const;
+  };
+
+  /*
+  Compiled and immutable definition of a state machine, built once from the same
+  parameters as a StateMachine. A StateChart may be shared by any number of StateMachine
+  instances, used from any thread : each instance only holds its configuration and events.
+  Callbacks are shared along with the chart, so per-instance data should be reached
+  through their StateMachine& parameter, for instance by deriving from StateMachine.
+  */
+  class StateChart{
+
+    friend class StateMachine;
+    friend class InstancePool;
     friend class priv::StateImpl;
 
   public:
-
     template <typename... Params>
-    StateMachine(Params && ... pParams);
+    explicit StateChart(Params && ... pParams);
 
-  public:
     /*
-    start the current state machine by calling State::enter ()
-    for all initial children, depth first
+    returns the EventId of the named event.
+    throws NoSuchEvent if no transition of the chart reacts to it
     */
-    inline void enter();
+    inline EventId event(const std::string& pEvent) const;
 
     /*
-    terminate the current state machine
-    by calling State::leave() for all active states
-    from leaves to root, depth first
+    returns a hash of the structure of the chart : names, hierarchy and transitions of its states.
+    StateMachine::restore only accepts snapshots taken on a chart with the same fingerprint
     */
-    inline void leave();
+    inline std::uint64_t fingerprint() const;
 
     /*
-    returns whether the state machine is active
+    states are numbered in document order, the root state being 0,
+    and transitions in document order of their source state
     */
-    inline virtual bool isActive() const;
+    inline std::size_t stateCount() const;
+
+    inline const std::string& stateName(std::size_t pState) const;
 
     /*
-    add an event to the event queue
+    returns the ordinal of the named state. throws NoSuchState if the chart doesn't declare it
     */
-    inline void pushEvent(const std::string& pEvent);
-    
+    inline std::size_t stateOrdinal(const std::string& pState) const;
+
     /*
-    returns whether the current configuration has the given state active
+    returns the StateId of the named state, to be resolved once and passed to StateMachine::inState.
+    throws NoSuchState if the chart doesn't declare it
     */
-    inline bool inState(const std::string& stateName);
-    
-  private: // functioning primitives
-    inline void processEvents();
+    inline StateId state(const std::string& pState) const;
 
-    inline void processTransitions(const std::string& pEvent);
-    
     /*
-    browse through the tree of states to select transitions with a matching event
-    and a realized condition
+    returns a set of the size of the chart holding the given states, to be tested
+    against StateMachine::activeConfiguration
     */
-    inline std::vector<priv::TransitionImpl*> selectTransitions(const std::string& pEvent);
-    
+    inline StateSet stateSet(std::initializer_list<StateId> pStates) const;
+
+    inline std::size_t transitionCount() const;
+
+    inline std::size_t transitionSource(std::size_t pTransition) const;
+
     /*
-    remove transitions having conflicting source/target state
+    returns the source of a C++ header declaring the tables of the chart in the namespace pName, to be run
+    by a TableStateMachine. throws UnexportableChart if the chart needs more than a TableStateMachine supports
     */
-    inline std::vector<priv::TransitionImpl*> removeConflicts(std::vector<priv::TransitionImpl*>& pTransitions);
-    
+    inline std::string exportTables(const std::string& pName) const;
+
     /*
-    compute a list of states that will be exited during execution of the transtion pTransition from the current configuration
+    returns the bytes used by the chart, shared by all its instances
     */
-    inline std::list<priv::StateImpl*> listExitStates(priv::TransitionImpl* pTransition);
-    
+    inline MemoryUsage memoryUsage() const;
+
+  private:
+    StateChart(const StateChart&);
+    StateChart& operator=(const StateChart&);
+
     /*
-    compute a list of states that will be entered to activate pState from the current configuration
+    flatten the tree of StateDef into the arrays of the StateChart
     */
-    inline std::list<priv::StateImpl*> listEntryStates(priv::StateImpl* pState);
-    
+    inline void build(priv::StateDef& pRoot);
+
     /*
-    returns true if pCheck is a descendant of pAgainst
+    compile, for each atomic state and each event, the ordered list of candidate
+    transitions from the atomic state up to the root
     */
-    inline bool isDescendant(priv::StateImpl* pCheck, priv::StateImpl* pAgainst);
-    
+    inline void buildDispatchTable();
+
     /*
-    execute exit behavior for each state that must be exited while executing the
-    given transitions
+    returns the EventId of the named event, allocating a new one
+    if it was not known yet
     */
-    inline void exitStates(const std::vector<priv::TransitionImpl*>& pTransitions);
-    
+    inline EventId internEvent(const std::string& pEvent);
+
     /*
-    execute enter behavior for each state that must be entered while executing the
-    given transitions
+    returns the EventId of a named event that may be pushed, InvalidEvent if the chart
+    has no such event or if it is internal to After and eventless transitions
     */
-    inline void enterStates(const std::vector<priv::TransitionImpl*>& pTransitions);
+    inline EventId findEvent(const std::string& pEvent) const;
 
     /*
-    trigger State::leave() to each state that needs to be exited when to enter pTarget
-    from the first active ancestor
+    append to pEntryStates the states that will be entered by the transition pTransition, in document order.
+    Since all the descendants of the transition domain have been exited, it doesn't depend on the configuration
     */
-    inline void exitStates(priv::StateImpl* pTarget);
+    inline void listEntryStates(const priv::TransitionImpl& pTransition, std::vector<priv::StateIndex>& pEntryStates) const;
 
     /*
-    trigger State::enter() to each state that needs to be entered when entering pTarget
-    from the first active ancestor
+    append pState and the states entered by default with it to pEntryStates, in document order
     */
-    inline void enterStates(priv::StateImpl* pTarget);
+    inline void listDefaultEntryStates(priv::StateIndex pState, std::vector<priv::StateIndex>& pEntryStates) const;
 
     /*
     get the common ancestor of the source and target states
     */
-    inline priv::StateImpl* getTransitionDomain(priv::TransitionImpl* pTransition);
+    inline priv::StateIndex getTransitionDomain(const priv::TransitionImpl& pTransition) const;
 
     /*
     find the lowest common ancestor of the two states
     */
-    inline priv::StateImpl* findLeastCommonAncestor(priv::StateImpl* pLhs, priv::StateImpl* pRhs);
-  private:
-    std::unordered_map<std::string, std::unique_ptr<priv::StateImpl>> mAllStates;
-    std::queue<std::string> mEvents;
-    std::queue<priv::TransitionImpl*> mTransitions;
-    bool mIsActive;
-    bool mInToplevelProcess;
-    priv::StateImpl* mImpl;
+    inline priv::StateIndex findLeastCommonAncestor(priv::StateIndex pLhs, priv::StateIndex pRhs) const;
 
+  private:
+    //index of each state by name, used to resolve targets and inState
+    std::unordered_map<std::string, priv::StateIndex> mStateIndices;
+    std::vector<std::string> mStateNames;
+    std::unordered_map<std::string, EventId> mEventIds;
+    //events [0, mPublicEvents) may be pushed. the internal events of the After and eventless
+    //transitions are numbered after them, and are rejected by every entry point taking an event
+    std::uint32_t mPublicEvents;
+    //all states, in document order : the descendants of a state follow it.
+    //the root state comes first
+    std::vector<priv::StateImpl> mStates;
+    //all transitions, grouped by source state
+    std::vector<priv::TransitionImpl> mTransitions;
+    //all callbacks, grouped by state
+    std::vector<priv::OnEntryAction> mOnEntryActions;
+    std::vector<priv::OnExitAction> mOnExitActions;
+    //states entered by each transition, in document order
+    std::vector<priv::StateIndex> mEntrySequences;
+    //states entered by StateMachine::enter, in document order
+    std::vector<priv::StateIndex> mDefaultEntry;
+    //for each atomic state and each event, range of the candidate transitions in mDispatchTransitions
+    std::vector<std::uint32_t> mDispatchOffsets;
+    std::vector<priv::TransitionIndex> mDispatchTransitions;
+    //for each atomic state, the bits of the events that have candidates in its row of the dispatch table
+    std::vector<priv::Bitset::Word> mHandledEvents;
+    //events deferred by each state, grouped by state
+    std::vector<EventId> mDeferredEvents;
+    //timers of the After transitions, grouped by state
+    std::vector<priv::TimerDef> mTimers;
+    //for each atomic state and each event, the closest state deferring the event from the atomic state
+    //up to the root, or NoIndex. empty when no state defers any event
+    std::vector<priv::StateIndex> mDeferringStates;
+    //event of the eventless transitions, InvalidEvent when the chart has none
+    EventId mEventless;
+    //number of history states, and of the states they may record in all
+    std::uint32_t mHistorySlots;
+    std::uint32_t mHistoryCapacity;
+    std::uint64_t mFingerprint;
+    //set when the chart has no parallel state : a single atomic state is active at a time
+    bool mSingleRegion;
   };
-}
 
-
-namespace ifsm{
   namespace priv{
+    //true when the parameters of a StateMachine constructor are a single StateChart pointer
+    template <typename... Params>
+    struct is_chart_pointer : std::false_type{};
 
-    /**
-    Iterates over children of a state
-    */
-    template <class SearchType>
-    struct StateIterator{
-      friend class ifsm::priv::StateImpl;
-      friend class ifsm::StateMachine;
+    template <typename Param>
+    struct is_chart_pointer<Param> : std::is_convertible<Param, std::shared_ptr<const StateChart>>{};
+  }
 
-    private: //only State is allowed to use iterators
-      StateIterator();
-      StateIterator(ifsm::priv::StateImpl* pFirst);
-      StateIterator operator++();
-      StateIterator operator++(int);
-      priv::StateImpl* operator*() const;
-      bool operator==(const StateIterator<SearchType>& pRhs) const;
-      bool operator!=(const StateIterator<SearchType>& pRhs) const;
-      void setTest(std::function < bool(::ifsm::priv::StateImpl*)>& pTest);
-      void setTest(std::function < bool(::ifsm::priv::StateImpl*)>&& pTest);
-
-      void lookupNextValidState();
-      
-    public:
-      const priv::StateImpl::ChildrenMap& getStateChildren(const priv::StateImpl* pState);
-    private:
-      SearchType mSearch;
-      std::function < bool(::ifsm::priv::StateImpl*)> mTest;
-    };
-    
-    struct DepthFirstSearch{
-      typedef DepthFirstSearch MyType;
-      typedef StateIterator<MyType> MyIterator;
+  class StateMachineExecutor;
 
-      inline DepthFirstSearch(MyIterator& pIterator, priv::StateImpl* pFirst);
-      inline void fetchNext();
-      inline priv::StateImpl* getCurrent() const;
+  class StateMachine {
+  
+    friend class priv::StateImpl;
+    friend class StateMachineExecutor;
+    friend class TimerWheel;
+    friend class InstancePool;
+    friend class EventLog;
 
-      MyIterator& mIterator;
-      std::list<priv::StateImpl*> mLifo;
-    };
-    
-    struct WidthFirstSearch{
-      typedef WidthFirstSearch MyType;
-      typedef StateIterator<MyType> MyIterator;
+    template <class Callable>
+    friend class priv::TaskCallback;
 
-      inline WidthFirstSearch(MyIterator& pIterator, priv::StateImpl* pFirst);
-      inline void fetchNext();
-      inline priv::StateImpl* getCurrent() const;
+  public:
 
-      MyIterator& mIterator;
-      std::list<priv::StateImpl*> mFifo;
-    };
+    /*
+    build a StateChart used only by this instance
+    */
+    template <typename... Params, typename B = typename std::enable_if<!priv::is_chart_pointer<Params...>::value>::type>
+    StateMachine(Params && ... pParams);
 
-  }
-}
+    /*
+    create an instance of a shared StateChart
+    */
+    inline explicit StateMachine(std::shared_ptr<const StateChart> pChart);
 
-template <class FunType>
-ifsm::priv::OnEntryAction ifsm::OnEntry(FunType && pFun){
-  using ifsm::priv::is_callable;
-  using ifsm::priv::is_callable_with;
-  static_assert(is_callable<FunType>::value || is_callable_with<FunType, StateMachine&>::value, "parameter to onEntry must be callable either with no parameter or a StateMachine& parameter");
-  return priv::OnEntryAction(priv::fixParams(std::forward<FunType>(pFun)));
-}
+    inline virtual ~StateMachine();
 
-template <class FunType>
-ifsm::priv::OnExitAction ifsm::OnExit(FunType && pFun){
-  using ifsm::priv::is_callable;
-  using ifsm::priv::is_callable_with;
-  static_assert(is_callable<FunType>::value || is_callable_with<FunType, StateMachine&>::value, "parameter to onExit must be callable either with no parameter or a StateMachine& parameter");
-  return priv::OnExitAction(priv::fixParams(std::forward<FunType>(pFun)));
-}
+  public:
+    /*
+    start the current state machine by calling State::enter ()
+    for all initial children, depth first
+    */
+    inline void enter();
 
-template <class FunType>
-ifsm::priv::TransitionDef ifsm::OnEvent(const std::string& pEvent, FunType && pFun){
-  return priv::TransitionDef(OnEvent(pEvent), Action(std::forward<FunType>(pFun)));
-}
+    /*
+    terminate the current state machine
+    by calling State::leave() for all active states
+    from leaves to root, depth first
+    */
+    inline void leave();
 
-ifsm::priv::TransitionTarget ifsm::Target(const std::string& pTargetName){
+    /*
+    returns whether the state machine is active
+    */
+    inline virtual bool isActive() const;
+
+    /*
+    add an event to the event queue
+    */
+    inline void pushEvent(const std::string& pEvent);
+
+    /*
+    add an event to the event queue, identified by the EventId
+    returned by StateMachine::event
+    */
+    inline void pushEvent(EventId pEvent);
+
+    /*
+    push an event along with a payload, available to the callbacks of the transitions it triggers.
+    when the event is processed right away, callbacks see pPayload itself. when it has to wait
+    in the queue, pPayload is moved, or copied if it is an lvalue, into the queue
+    */
+    template <class T>
+    void pushEvent(EventId pEvent, T&& pPayload);
+
+    template <class T>
+    void pushEvent(const std::string& pEvent, T&& pPayload);
+
+    /*
+    push an event to the queue of the given priority. pushEvent without priority uses EventPriority::Normal
+    */
+    inline void pushEvent(EventId pEvent, EventPriority pPriority);
+
+    inline void pushEvent(const std::string& pEvent, EventPriority pPriority);
+
+    template <class T>
+    void pushEvent(EventId pEvent, T&& pPayload, EventPriority pPriority);
+
+    template <class T>
+    void pushEvent(const std::string& pEvent, T&& pPayload, EventPriority pPriority);
+
+    /*
+    returns the payload of the event being processed if it is a T, nullptr otherwise.
+    payloads are only available from callbacks
+    */
+    template <class T>
+    const T* eventPayload() const;
+
+    /*
+    add a batch of events to the event queue, then process them in one pass
+    with the same run-to-completion semantics as successive calls to pushEvent.
+    the range may hold EventId or event names, unknown names are ignored
+    */
+    template <class InputIterator>
+    void pushEvents(InputIterator pBegin, InputIterator pEnd);
+
+    inline void pushEvents(const EventId* pEvents, std::size_t pCount);
+
+    inline void pushEvents(std::initializer_list<EventId> pEvents);
+
+    inline void pushEvents(std::initializer_list<std::string> pEvents);
+
+    /*
+    add an event to the event queue from any thread, without processing it.
+    events pushed this way are processed in order by the next call to processEvents,
+    or to pushEvent, from the thread that uses the StateMachine
+    */
+    inline void pushEventAsync(const std::string& pEvent);
+
+    inline void pushEventAsync(EventId pEvent);
+
+    /*
+    process the pending events, including those pushed with pushEventAsync
+    */
+    inline void processEvents();
+
+    /*
+    returns the EventId of the named event.
+    throws NoSuchEvent if no transition of the StateMachine reacts to it
+    */
+    inline EventId event(const std::string& pEvent) const;
+    
+    /*
+    returns whether the current configuration has the given state active
+    */
+    inline bool inState(const std::string& stateName) const;
+
+    /*
+    same as inState(name) for a StateId resolved by state(name) : a single bit test.
+    returns false for InvalidState and the ids of other charts' states
+    */
+    inline bool inState(StateId pState) const;
+
+    /*
+    returns the StateId of the named state.
+    throws NoSuchState if the StateMachine doesn't declare it
+    */
+    inline StateId state(const std::string& pState) const;
+
+    /*
+    returns the active states, bit i being set when the state of StateId i is active.
+    the reference stays valid as long as the StateMachine, its content changes as events are processed
+    */
+    inline const StateSet& activeConfiguration() const;
+
+    /*
+    returns the chart this instance runs
+    */
+    inline const std::shared_ptr<const StateChart>& chart() const;
+
+    /*
+    returns the active configuration in a compact binary form : a format version, the fingerprint
+    of the chart, the ordinals of the active atomic states and the states recorded by the history states.
+    Pending events are not included
+    */
+    inline std::vector<std::uint8_t> snapshot() const;
+
+    /*
+    replace the active configuration by the one of a snapshot, taken from an instance of this chart
+    or of one with the same fingerprint. No OnEntry or OnExit callback is called and the event queue
+    is left untouched. throws InvalidSnapshot if the blob doesn't hold a valid configuration of the chart,
+    in which case the current configuration is kept. must not be called from a callback
+    */
+    inline void restore(const std::vector<std::uint8_t>& pSnapshot);
+
+    inline void restore(const std::uint8_t* pSnapshot, std::size_t pSize);
+
+    /*
+    set the TimerWheel that runs the After transitions of this instance, before it is entered.
+    the wheel must outlive the StateMachine, and must not be advanced while the StateMachine is destroyed.
+    TimerWheel::global() is used by default
+    */
+    inline void setTimerWheel(TimerWheel& pWheel);
+
+    inline TimerWheel& timerWheel();
+
+    /*
+    when transitions are taken in several orthogonal regions for the same event, run their OnExit callbacks,
+    then their Actions, then their OnEntry callbacks on pExecutor, the transitions of each phase concurrently.
+    the configuration is updated on the calling thread before each phase : during an exit or entry phase,
+    every state exited or entered by the phase already is. callbacks run concurrently must not use the
+    StateMachine otherwise than to read it, or to call pushEventAsync, and the observer must be thread-safe.
+    nullptr, the default, runs every callback on the calling thread. the executor must outlive its use
+    */
+    inline void setRegionExecutor(RegionExecutor* pExecutor);
+
+    inline RegionExecutor* regionExecutor() const;
+
+    /*
+    returns whether a callback returned a Task that suspended the transition being taken : events are
+    queued until the Task has completed and processEvents or pushEvent is called. the Tasks of callbacks
+    run by leave or concurrently on a RegionExecutor aren't awaited, leave abandons a suspended transition
+    */
+    inline bool isSuspended() const;
+
+    /*
+    record the events processed from now on to pLog, which restarts from the current configuration,
+    or stop recording with nullptr. restore also restarts the log. the log must outlive its use
+    */
+    inline void setEventLog(EventLog* pLog);
+
+    inline EventLog* eventLog() const;
+
+    /*
+    set how many eventless transitions may be taken in a row, after which processing the events throws EventlessLoop
+    rather than looping on Conditions that never become false. 1000 by default
+    */
+    inline void setEventlessLimit(std::size_t pLimit);
+
+    inline std::size_t eventlessLimit() const;
+
+    /*
+    returns the number of events processed while no active state had a transition for them.
+    such events are rejected by a single bit test, before any transition is selected
+    */
+    inline std::uint64_t unhandledEvents() const;
+
+    /*
+    returns the bytes used by this instance : its configuration, queues and buffers, which grow with the
+    events it processes and are then reused. the chart is counted as well when no other owner shares it,
+    as the one built by the DSL constructor
+    */
+    inline MemoryUsage memoryUsage() const;
+
+#if defined(INSTANTFSM_TRACING)
+    /*
+    set the observer called while events are processed, or nullptr to remove it.
+    the observer must outlive its use by this StateMachine
+    */
+    inline void setObserver(StateMachineObserver* pObserver);
+
+    inline StateMachineObserver* observer() const;
+#endif
+    
+  private: // functioning primitives
+
+    //move the events pushed by pushEventAsync to the event queue
+    inline void takeAsyncEvents();
+
+    //process mEvents until it is empty
+    inline void processQueue();
+
+    inline void processEvent(EventId pEvent, const void* pPayload, const void* pPayloadType);
+
+    inline void enqueue(EventId pEvent, EventPriority pPriority = EventPriority::Normal);
+
+    inline void enqueue(const std::string& pEvent, EventPriority pPriority = EventPriority::Normal);
+
+    //returns the index of the highest priority queue that has events, or EventPriorityCount
+    inline std::size_t nextQueue() const;
+
+    /*
+    put the event aside if an active state defers it, called when it triggers no transition
+    */
+    inline void deferEvent(EventId pEvent, std::size_t pPriority, priv::Payload&& pPayload);
+
+    /*
+    push again the events deferred by pState, called when it is exited
+    */
+    inline void releaseDeferredEvents(priv::StateIndex pState);
+
+    /*
+    arm and cancel the timers of the After transitions in [pBegin, pEnd) of StateChart::mTimers,
+    called when their source state is entered and exited
+    */
+    inline void armTimers(std::uint32_t pBegin, std::uint32_t pEnd);
+
+    inline void cancelTimers(std::uint32_t pBegin, std::uint32_t pEnd);
+
+    /*
+    called by the TimerWheel when the timer pTimer, armed as pId, is due. a machine attached to
+    a StateMachineExecutor receives it through its mailbox, the others process it at once
+    */
+    inline void fireTimer(std::uint32_t pTimer, priv::TimerId pId);
+
+    //push the event of a timer that fired, unless it was canceled or armed again since
+    inline void pushTimerEvent(std::uint32_t pTimer, priv::TimerId pId);
+
+    template <class InputIterator>
+    void reserveEvents(InputIterator pBegin, InputIterator pEnd, std::input_iterator_tag);
+
+    template <class InputIterator>
+    void reserveEvents(InputIterator pBegin, InputIterator pEnd, std::forward_iterator_tag);
+
+    inline void processTransitions(EventId pEvent);
+
+    //execute the transitions of mEnabledTransitions
+    inline void takeTransitions(EventId pEvent);
+
+    /*
+    take the eventless transitions enabled in the states changed by the last microsteps, until none is.
+    throws EventlessLoop beyond mEventlessLimit microsteps
+    */
+    inline void processEventless();
+
+    //add the active atomic states below the domains of mEnabledTransitions to mChangedAtomics, once they have been taken
+    inline void trackChanges();
+
+    /*
+    returns whether an active state has a transition for pEvent, whatever its Condition.
+    mHandledEvents is only computed for the configurations with several active atomic states
+    */
+    inline bool handles(EventId pEvent);
+
+    /*
+    execute the callbacks of StateMachine::enter or of mEnabledTransitions from pFrom, exits then actions then entries,
+    updating the configuration along. when a callback suspends on a Task, stop and keep the point to resume from in mResume
+    */
+    inline void runMicrostep(priv::ResumePoint pFrom);
+
+    /*
+    resume the suspended microstep if its Task has completed, rethrowing the exception of the Task.
+    returns whether the StateMachine no longer is suspended
+    */
+    inline bool resumeMicrostep();
+
+    //suspend the current microstep until pTask completes, called by the callbacks returning a Task
+    inline void await(priv::TaskState* pTask);
+
+    //give up the Task of the suspended microstep, if any : the rest of the microstep is never run
+    inline void abandonMicrostep();
+
+    /*
+    order mEnabledTransitions by the orthogonal region they change, keeping document order within each one,
+    and set mRegionRanges. the region of a transition is the child of a parallel state containing its domain,
+    or its source if it is targetless. nested regions are grouped with the region containing them.
+    returns the number of regions
+    */
+    inline std::size_t groupRegions();
+
+    //execute mEnabledTransitions with the callbacks of each phase run on mRegionExecutor, one task per region
+    inline void processRegions();
+
+    /*
+    process an event of an EventLog, discarding the events it pushes. without callbacks, only the
+    configuration is updated : no Action, OnEntry or OnExit callback is called, and no timer is armed
+    */
+    inline void replayEvent(EventId pEvent, const void* pPayload, const void* pPayloadType, bool pCallbacks);
+
+    //enter or leave the StateMachine for an EventLog
+    inline void replayEntry(bool pEnter, bool pCallbacks);
+
+    //drop the queued and the deferred events, and the eventless transitions left to check : they are in the EventLog
+    inline void discardEvents();
+    
+    /*
+    fill mEnabledTransitions with the transitions of the atomic states pAtomics to take for pEvent :
+    without parallel states, by selectLeafTransitions, otherwise by selectTransitions then removeConflicts
+    */
+    inline void selectEnabledTransitions(EventId pEvent, const std::vector<priv::StateIndex>& pAtomics);
+
+    /*
+    select the transitions of the single atomic state pLeaf into mEnabledTransitions, for charts without parallel states :
+    the candidates of a single source, of which every targetless transition and a single targeted one are taken,
+    as removeConflicts would keep them, without checking their exit sets against each other
+    */
+    inline void selectLeafTransitions(EventId pEvent, priv::StateIndex pLeaf);
+
+    /*
+    look through the dispatch table of the active atomic states pAtomics to select transitions
+    with a matching event and a realized condition
+    */
+    inline void selectTransitions(EventId pEvent, const std::vector<priv::StateIndex>& pAtomics, std::vector<priv::TransitionIndex>& pTransitions);
+    
+    /*
+    remove transitions having conflicting source/target state
+    */
+    inline void removeConflicts(const std::vector<priv::TransitionIndex>& pTransitions, std::vector<priv::TransitionIndex>& pFiltered);
+    
+    /*
+    append to pExitStates the states that will be exited during execution of the transition pTransition
+    from the current configuration : the active descendants of its domain, in reverse document order.
+    without parallel states, the ancestors of the active atomic state below the domain
+    */
+    inline void listExitStates(const priv::TransitionImpl& pTransition, std::vector<priv::StateIndex>& pExitStates);
+
+    /*
+    append to pEntryStates the states that will be entered by the transition pTransition, in document order :
+    its precomputed entry sequence, where the history states entered by default that have recorded a configuration
+    are entered along with the recorded states rather than their default ones
+    */
+    inline void listEntryStates(const priv::TransitionImpl& pTransition, std::vector<priv::StateIndex>& pEntryStates) const;
+
+    /*
+    append to pEntryStates the descendants of the history state pState entered from its recorded configuration,
+    in document order
+    */
+    inline void listHistoryStates(const priv::StateImpl& pState, std::vector<priv::StateIndex>& pEntryStates) const;
+
+    /*
+    append pState and the states entered by default with it to pEntryStates, in document order,
+    honouring the history of the states entered along
+    */
+    inline void listRestoredStates(priv::StateIndex pState, std::vector<priv::StateIndex>& pEntryStates) const;
+
+    //returns the number of states recorded by the history state pState, 0 when it has none
+    inline std::uint32_t historySize(const priv::StateImpl& pState) const;
+
+    /*
+    record the configuration of the history states of mStatesToExit, before they are exited
+    */
+    inline void recordHistory();
+    
+    /*
+    returns true if the exit sets of both transitions intersect
+    */
+    inline bool conflict(const priv::TransitionImpl& pLhs, const priv::TransitionImpl& pRhs) const;
+    
+    /*
+    add pState to the active configuration, called by StateImpl::enter
+    */
+    inline void activate(priv::StateIndex pState);
+
+    /*
+    remove pState from the active configuration, called by StateImpl::leave
+    */
+    inline void deactivate(priv::StateIndex pState);
+  private:
+    std::shared_ptr<const StateChart> mChart;
+    //events waiting to be processed, indexed by EventPriority
+    priv::EventQueue mEvents[priv::EventPriorityCount];
+    //events deferred by active states, in the order they were deferred
+    std::vector<priv::ParkedEvent> mParked;
+    TimerWheel* mTimerWheel;
+    RegionExecutor* mRegionExecutor;
+    EventLog* mEventLog;
+    //armed timer of each After transition of the chart
+    std::vector<priv::TimerId> mTimers;
+    //payload of the event being processed, and its payloadType
+    const void* mPayload;
+    const void* mPayloadType;
+    //events pushed from other threads, moved to mEvents by processEvents
+    priv::MpscQueue<priv::AsyncEvent> mAsyncEvents;
+    //events in mAsyncEvents, counted by the producers before pushing : unlike mAsyncEvents.empty,
+    //it may be read from any thread
+    std::atomic<std::size_t> mAsyncCount;
+    //entry of the StateMachineExecutor the machine is attached to, read by the thread advancing its wheel
+    std::atomic<priv::ExecutorEntry*> mExecutorEntry;
+    //bits of the active states, indexed by ordinal
+    priv::Bitset mActiveStates;
+    //active atomic states, sorted by ordinal
+    std::vector<priv::StateIndex> mActiveAtomics;
+    //buffers reused from one event to the next : once they have grown,
+    //processing an event doesn't allocate
+    std::vector<priv::TransitionIndex> mSelectedTransitions;
+    std::vector<priv::TransitionIndex> mEnabledTransitions;
+    std::vector<priv::TransitionIndex> mPreemptedTransitions;
+    std::vector<priv::StateIndex> mStatesToExit;
+    //end of the states exited by each of mEnabledTransitions in mStatesToExit, for processRegions
+    std::vector<std::uint32_t> mExitRanges;
+    //states entered by mEnabledTransitions, and the end of those of each one, for processRegions
+    std::vector<priv::StateIndex> mStatesToEnter;
+    std::vector<std::uint32_t> mEntryRanges;
+    //region and position of each of mEnabledTransitions, and the end of the transitions of each region, for processRegions
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> mRegionKeys;
+    std::vector<std::uint32_t> mRegionRanges;
+    //active atomic states whose eventless transitions are to be checked, sorted by ordinal, and those being checked
+    std::vector<priv::StateIndex> mChangedAtomics;
+    std::vector<priv::StateIndex> mCheckedAtomics;
+    std::size_t mEventlessLimit;
+    //states recorded by the history states, in the ranges given by the chart, and how many each one holds
+    std::vector<priv::StateIndex> mHistory;
+    std::vector<std::uint32_t> mHistorySizes;
+    //events handled by the active atomic states, recomputed when mHandledChanged is set
+    priv::Bitset mHandledEvents;
+    std::uint64_t mUnhandledEvents;
+    //Task the current microstep is suspended on, and where it resumes
+    priv::TaskState* mAwaited;
+    priv::ResumePoint mResume;
+    bool mIsActive;
+    bool mInToplevelProcess;
+    //set while callbacks may not suspend the StateMachine : their Tasks run on their own
+    bool mDetachTasks;
+    //set when the active atomic states change
+    bool mHandledChanged;
+#if defined(INSTANTFSM_TRACING)
+    StateMachineObserver* mObserver;
+#endif
+
+  };
+}
+
+/**************************************************/
+/*
+EventLog : records the events processed by a StateMachine, to replay them into another instance.
+
+The log starts with a snapshot of the configuration the machine had when recording started, followed
+by one record per processed event, in processing order : the events pushed by callbacks, released
+deferred events and After transitions included. Each record holds the EventId and the time elapsed
+since the previous record, as varints, and the bytes of the payload for the registered payload types,
+usually 2 to 4 bytes in all. bytes() can be written as is to a file or a memory mapping, and given back
+to an EventLog to replay it.
+
+Replay restores the snapshot, then processes the recorded events one by one, discarding the events they
+push : they are in the log already. WithoutCallbacks only evaluates the Conditions, and updates the
+configuration without calling any Action, OnEntry or OnExit callback nor arming any After transition.
+
+  myLog.recordPayload<MyPayload>() : record the payloads of a trivially copyable type, in the log and the replayer alike
+  myMachine.setEventLog(&myLog) : start recording, nullptr to stop
+  EventLog myReplayer(myBytes) : read a recorded log. throws InvalidEventLog if it isn't one
+  myReplayer.replay(myFreshMachine) : reconstruct the configuration, myReplayer.replay(myFreshMachine, EventLog::WithoutCallbacks, myCount)
+    to reconstruct the one after the first myCount records
+*/
+
+namespace ifsm{
+  class InvalidEventLog : public StateMachineException{
+  public:
+    InvalidEventLog(const std::string& pReason)
+      : StateMachineException("The event log can't be replayed : "+pReason+".")
+      {}
+  };
+
+  namespace priv{
+    static const std::uint8_t EventLogVersion = 1;
+  }
+
+  class EventLog{
+
+    friend class StateMachine;
+
+  public:
+    enum ReplayMode{ WithCallbacks, WithoutCallbacks };
+
+    static const std::size_t AllRecords = static_cast<std::size_t>(-1);
+
+    struct Record{
+      enum Kind{ Enter, Leave, Event };
+
+      Kind mKind;
+      //the processed event, InvalidEvent for Enter and Leave
+      EventId mEvent;
+      //since recording started
+      std::chrono::nanoseconds mTime;
+      //false for the events without payload or with a payload of an unregistered type
+      bool mHasPayload;
+    };
+
+  public:
+    //an empty log, to record
+    inline EventLog();
+
+    /*
+    a recorded log, to replay once the same payload types as the recorder's are registered.
+    throws InvalidEventLog if it doesn't start with a valid header
+    */
+    inline explicit EventLog(std::vector<std::uint8_t> pBytes);
+
+    inline EventLog(const std::uint8_t* pBytes, std::size_t pSize);
+
+    /*
+    record the payloads of type T, copied byte by byte. the events with a payload of another type
+    are recorded without it
+    */
+    template <class T>
+    void recordPayload();
+
+    inline const std::vector<std::uint8_t>& bytes() const;
+
+    /*
+    decode the records. throws InvalidEventLog if a record is truncated or has an unregistered payload type
+    */
+    inline std::vector<Record> records() const;
+
+    /*
+    restore the recorded snapshot into pMachine, then process the pCount first records.
+    throws InvalidSnapshot if pMachine doesn't run the recorded chart, InvalidEventLog as records does.
+    must not be called from a callback
+    */
+    inline void replay(StateMachine& pMachine, ReplayMode pMode = WithCallbacks, std::size_t pCount = AllRecords) const;
+
+  private:
+    EventLog(const EventLog&);
+    EventLog& operator=(const EventLog&);
+
+    struct PayloadKind{
+      const void* mType;
+      std::size_t mSize;
+      //process the recorded event with a payload rebuilt from its bytes
+      void (*mReplay)(StateMachine&, EventId, const std::uint8_t*, bool);
+    };
+
+    template <class T>
+    static void replayPayload(StateMachine& pMachine, EventId pEvent, const std::uint8_t* pBytes, bool pCallbacks);
+
+    //check the header and find the records
+    inline void open();
+
+    //called by StateMachine : restart the log from the configuration of pMachine, and append records
+    inline void start(const StateMachine& pMachine);
+
+    inline void record(EventId pEvent, const void* pPayload, const void* pPayloadType);
+
+    inline void record(Record::Kind pKind);
+
+    //append the first varint of a record and the time elapsed since the previous one
+    inline void appendRecord(std::uint64_t pCode);
+
+    /*
+    decode the record at pCursor, moving it past the record, and return its payload bytes or nullptr.
+    the first varint of a record is 0 for Enter, 1 for Leave, otherwise 2 + 2 * event + whether a payload follows
+    */
+    inline const std::uint8_t* readRecord(const std::uint8_t*& pCursor, Record& pRecord, const PayloadKind*& pKind) const;
+
+  private:
+    std::vector<std::uint8_t> mBytes;
+    //offset of the snapshot in mBytes, and of the first record
+    std::size_t mSnapshotBegin;
+    std::size_t mRecordsBegin;
+    std::vector<PayloadKind> mPayloadKinds;
+    std::chrono::steady_clock::time_point mLastRecord;
+  };
+}
+
+ifsm::EventLog::EventLog()
+: mSnapshotBegin(0)
+, mRecordsBegin(0){
+}
+
+ifsm::EventLog::EventLog(std::vector<std::uint8_t> pBytes)
+: mBytes(std::move(pBytes))
+, mSnapshotBegin(0)
+, mRecordsBegin(0){
+  open();
+}
+
+ifsm::EventLog::EventLog(const std::uint8_t* pBytes, std::size_t pSize)
+: mBytes(pBytes, pBytes + pSize)
+, mSnapshotBegin(0)
+, mRecordsBegin(0){
+  open();
+}
+
+template <class T>
+void ifsm::EventLog::recordPayload(){
+  static_assert(std::is_trivially_copyable<T>::value, "only the payloads of trivially copyable types can be recorded");
+  PayloadKind lKind = { priv::payloadType<T>(), sizeof(T), &replayPayload<T> };
+  mPayloadKinds.push_back(lKind);
+}
+
+const std::vector<std::uint8_t>& ifsm::EventLog::bytes() const{
+  return mBytes;
+}
+
+std::vector<ifsm::EventLog::Record> ifsm::EventLog::records() const{
+  std::vector<Record> lRecords;
+  const std::uint8_t* lCursor = mBytes.data() + mRecordsBegin;
+  const std::uint8_t* lEnd = mBytes.data() + mBytes.size();
+  std::chrono::nanoseconds lTime(0);
+  while (lCursor != lEnd){
+    Record lRecord;
+    const PayloadKind* lKind;
+    readRecord(lCursor, lRecord, lKind);
+    lTime += lRecord.mTime;
+    lRecord.mTime = lTime;
+    lRecords.push_back(lRecord);
+  }
+  return lRecords;
+}
+
+void ifsm::EventLog::replay(StateMachine& pMachine, ReplayMode pMode, std::size_t pCount) const{
+  pMachine.restore(mBytes.data() + mSnapshotBegin, mRecordsBegin - mSnapshotBegin);
+  if (pMode == WithoutCallbacks && !pMachine.mTimers.empty()){
+    pMachine.cancelTimers(0, static_cast<std::uint32_t>(pMachine.mTimers.size()));
+  }
+
+  const std::uint8_t* lCursor = mBytes.data() + mRecordsBegin;
+  const std::uint8_t* lEnd = mBytes.data() + mBytes.size();
+  for (std::size_t lIndex = 0; lIndex < pCount && lCursor != lEnd; ++lIndex){
+    Record lRecord;
+    const PayloadKind* lKind;
+    const std::uint8_t* lPayload = readRecord(lCursor, lRecord, lKind);
+
+    if (lRecord.mKind == Record::Event){
+      if (lPayload){
+        lKind->mReplay(pMachine, lRecord.mEvent, lPayload, pMode == WithCallbacks);
+      }
+      else {
+        pMachine.replayEvent(lRecord.mEvent, nullptr, nullptr, pMode == WithCallbacks);
+      }
+    }
+    else {
+      pMachine.replayEntry(lRecord.mKind == Record::Enter, pMode == WithCallbacks);
+    }
+  }
+}
+
+template <class T>
+void ifsm::EventLog::replayPayload(StateMachine& pMachine, EventId pEvent, const std::uint8_t* pBytes, bool pCallbacks){
+  typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type lValue;
+  std::memcpy(&lValue, pBytes, sizeof(T));
+  pMachine.replayEvent(pEvent, &lValue, priv::payloadType<T>(), pCallbacks);
+}
+
+void ifsm::EventLog::open(){
+  const std::uint8_t* lCursor = mBytes.data();
+  const std::uint8_t* lEnd = lCursor + mBytes.size();
+  std::uint64_t lSnapshotSize;
+  if (lCursor == lEnd || *lCursor++ != priv::EventLogVersion
+    || !priv::readVarint(lCursor, lEnd, lSnapshotSize) || lSnapshotSize > static_cast<std::uint64_t>(lEnd - lCursor)){
+    throw InvalidEventLog("its header is invalid");
+  }
+  mSnapshotBegin = static_cast<std::size_t>(lCursor - mBytes.data());
+  mRecordsBegin = mSnapshotBegin + static_cast<std::size_t>(lSnapshotSize);
+}
+
+void ifsm::EventLog::start(const StateMachine& pMachine){
+  std::vector<std::uint8_t> lSnapshot(pMachine.snapshot());
+  mBytes.clear();
+  mBytes.push_back(priv::EventLogVersion);
+  priv::appendVarint(mBytes, lSnapshot.size());
+  mSnapshotBegin = mBytes.size();
+  mBytes.insert(mBytes.end(), lSnapshot.begin(), lSnapshot.end());
+  mRecordsBegin = mBytes.size();
+  mLastRecord = std::chrono::steady_clock::now();
+}
+
+void ifsm::EventLog::record(EventId pEvent, const void* pPayload, const void* pPayloadType){
+  if (pPayload){
+    for (std::size_t lKind = 0; lKind < mPayloadKinds.size(); ++lKind){
+      if (mPayloadKinds[lKind].mType == pPayloadType){
+        appendRecord(3 + 2 * static_cast<std::uint64_t>(pEvent));
+        priv::appendVarint(mBytes, lKind);
+        const std::uint8_t* lBytes = static_cast<const std::uint8_t*>(pPayload);
+        mBytes.insert(mBytes.end(), lBytes, lBytes + mPayloadKinds[lKind].mSize);
+        return;
+      }
+    }
+  }
+  appendRecord(2 + 2 * static_cast<std::uint64_t>(pEvent));
+}
+
+void ifsm::EventLog::record(Record::Kind pKind){
+  appendRecord(pKind == Record::Enter ? 0 : 1);
+}
+
+void ifsm::EventLog::appendRecord(std::uint64_t pCode){
+  std::chrono::steady_clock::time_point lNow = std::chrono::steady_clock::now();
+  priv::appendVarint(mBytes, pCode);
+  priv::appendVarint(mBytes, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(lNow - mLastRecord).count()));
+  mLastRecord = lNow;
+}
+
+const std::uint8_t* ifsm::EventLog::readRecord(const std::uint8_t*& pCursor, Record& pRecord, const PayloadKind*& pKind) const{
+  const std::uint8_t* lEnd = mBytes.data() + mBytes.size();
+  std::uint64_t lCode;
+  std::uint64_t lTime;
+  if (!priv::readVarint(pCursor, lEnd, lCode) || !priv::readVarint(pCursor, lEnd, lTime)){
+    throw InvalidEventLog("a record is truncated");
+  }
+
+  pRecord.mKind = lCode == 0 ? Record::Enter : lCode == 1 ? Record::Leave : Record::Event;
+  pRecord.mEvent = lCode < 2 ? InvalidEvent : static_cast<EventId>((lCode - 2) >> 1);
+  pRecord.mTime = std::chrono::nanoseconds(static_cast<std::chrono::nanoseconds::rep>(lTime));
+  pRecord.mHasPayload = lCode >= 2 && (lCode & 1) != 0;
+  pKind = nullptr;
+  if (!pRecord.mHasPayload){
+    return nullptr;
+  }
+
+  std::uint64_t lKind;
+  if (!priv::readVarint(pCursor, lEnd, lKind)){
+    throw InvalidEventLog("a record is truncated");
+  }
+  if (lKind >= mPayloadKinds.size()){
+    throw InvalidEventLog("a payload type isn't registered");
+  }
+  pKind = &mPayloadKinds[static_cast<std::size_t>(lKind)];
+  if (pKind->mSize > static_cast<std::size_t>(lEnd - pCursor)){
+    throw InvalidEventLog("a record is truncated");
+  }
+  const std::uint8_t* lPayload = pCursor;
+  pCursor += pKind->mSize;
+  return lPayload;
+}
+
+template <class FunType>
+ifsm::priv::OnEntryAction ifsm::OnEntry(FunType && pFun){
+  using ifsm::priv::is_callable;
+  using ifsm::priv::is_callable_with;
+  static_assert(is_callable<FunType>::value || is_callable_with<FunType, StateMachine&>::value, "parameter to onEntry must be callable either with no parameter or a StateMachine& parameter");
+  return priv::OnEntryAction(priv::fixParams(std::forward<FunType>(pFun)));
+}
+
+template <class FunType>
+ifsm::priv::OnExitAction ifsm::OnExit(FunType && pFun){
+  using ifsm::priv::is_callable;
+  using ifsm::priv::is_callable_with;
+  static_assert(is_callable<FunType>::value || is_callable_with<FunType, StateMachine&>::value, "parameter to onExit must be callable either with no parameter or a StateMachine& parameter");
+  return priv::OnExitAction(priv::fixParams(std::forward<FunType>(pFun)));
+}
+
+template <class FunType>
+ifsm::priv::TransitionDef ifsm::OnEvent(const std::string& pEvent, FunType && pFun){
+  return priv::TransitionDef(OnEvent(pEvent), Action(std::forward<FunType>(pFun)));
+}
+
+ifsm::priv::TransitionTarget ifsm::Target(const std::string& pTargetName){
   return priv::TransitionTarget(pTargetName);
 }
 
-template <class FunType>
-ifsm::priv::TransitionAction ifsm::Action(FunType&& pAction){
-  using ifsm::priv::is_callable;
-  using ifsm::priv::is_callable_with;
-  static_assert(is_callable<FunType>::value || is_callable_with<FunType, StateMachine&>::value,
-    "parameter to action must be callable either with no paramater or a 'StateMachine&' parameter");
-  return priv::TransitionAction(priv::fixParams(pAction));
+template <class FunType>
+ifsm::priv::TransitionAction ifsm::Action(FunType&& pAction){
+  using ifsm::priv::is_callable;
+  using ifsm::priv::is_callable_with;
+  using ifsm::priv::payload_signature;
+  static_assert(is_callable<FunType>::value || is_callable_with<FunType, StateMachine&>::value
+    || payload_signature<typename std::decay<FunType>::type>::value,
+    "parameter to action must be callable either with no paramater, a 'StateMachine&' parameter or an event payload");
+  return priv::TransitionAction(priv::fixParams(std::forward<FunType>(pAction)));
+}
+
+template <class FunType>
+ifsm::priv::TransitionCondition ifsm::Condition(FunType&& pCondition){
+  using ifsm::priv::returns;
+  using ifsm::priv::returns_with;
+  using ifsm::priv::payload_condition;
+  static_assert(returns<FunType, bool>::value || returns_with<FunType, bool, const StateMachine&>::value
+    || payload_condition<typename std::decay<FunType>::type>::value,
+    "parameter to action must be callable either with no paramater, a 'StateMachine&' parameter or an event payload and must return 'bool'");
+  return priv::TransitionCondition(priv::fixConditionParams(std::forward<FunType>(pCondition)));
+}
+
+ifsm::priv::TransitionEvent ifsm::OnEvent(const std::string& pEvent){
+  return priv::TransitionEvent(pEvent);
+}
+
+template <class Rep, class Period>
+ifsm::priv::TransitionDelay ifsm::After(const std::chrono::duration<Rep, Period>& pDelay){
+  return priv::TransitionDelay(std::chrono::duration_cast<std::chrono::nanoseconds>(pDelay));
+}
+
+ifsm::priv::TransitionDelay::TransitionDelay(std::chrono::nanoseconds pDelay)
+: mDelay(pDelay){
+
+}
+
+ifsm::priv::TransitionTarget::TransitionTarget(const std::string& pTargetName)
+  : mTargetName(pTargetName){}
+  
+ifsm::priv::TransitionAction::TransitionAction(ActionCallback&& pFun)
+  : mFun(std::move(pFun)){}
+
+void ifsm::priv::TransitionAction::operator()(StateMachine& pRoot){
+  mFun(pRoot);
+}
+
+ifsm::priv::TransitionCondition::TransitionCondition(ConditionCallback&& pCond)
+  : mCond(std::move(pCond))
+{}
+
+bool ifsm::priv::TransitionCondition::operator()(const StateMachine& pRoot){
+  return mCond(pRoot);
+}
+
+ifsm::priv::TransitionEvent::TransitionEvent(const std::string& pEvent)
+  : mEvent(pEvent){}
+
+ifsm::priv::TransitionDef::TransitionDef(TransitionDef&& pRhs)
+: mTarget(std::move(pRhs.mTarget))
+, mEvent(std::move(pRhs.mEvent))
+, mAction(std::move(pRhs.mAction))
+, mCondition(std::move(pRhs.mCondition))
+, mDelay(pRhs.mDelay)
+, mHasDelay(pRhs.mHasDelay){
+
+}
+  
+template <typename... Params>
+ifsm::priv::TransitionDef::TransitionDef(Params && ... pParams)
+: mDelay(0)
+, mHasDelay(false){
+  //expanded in order rather than recursively, so that long parameter lists don't instantiate deep templates
+  int lExpand[] = { 0, (addParameter(std::forward<Params>(pParams)), 0)... };
+  (void)lExpand;
+}
+
+void ifsm::priv::TransitionDef::addParameter(priv::TransitionTarget && pTarget){
+  if (!mTarget.empty()){
+    throw TargetAlreadySpecified(pTarget.mTargetName);
+  }
+
+  mTarget = pTarget.mTargetName;
+}
+
+void ifsm::priv::TransitionDef::addParameter(priv::TransitionAction && pAction){
+  if (mAction){
+    throw ActionAlreadySpecified();
+  }
+
+  mAction = std::move(pAction.mFun);
+}
+
+void ifsm::priv::TransitionDef::addParameter(priv::TransitionCondition && pCondition){
+  if (mCondition){
+    throw ConditionAlreadySpecified();
+  }
+
+  mCondition = std::move(pCondition.mCond);
+}
+
+void ifsm::priv::TransitionDef::addParameter(priv::TransitionEvent && pEvent){
+  if (!mEvent.empty() || mHasDelay){
+    throw EventAlreadySpecified();
+  }
+  
+  mEvent = pEvent.mEvent;
+}
+
+void ifsm::priv::TransitionDef::addParameter(priv::TransitionDelay && pDelay){
+  if (!mEvent.empty() || mHasDelay){
+    throw EventAlreadySpecified();
+  }
+
+  mDelay = pDelay.mDelay;
+  mHasDelay = true;
+}
+
+template <typename... Params>
+ifsm::priv::TransitionDef ifsm::Transition(Params && ... pParams){
+  return priv::TransitionDef(std::forward<Params>(pParams)...);
+}
+
+ifsm::priv::TransitionImpl::TransitionImpl(TransitionDef&& pDef, EventId pEvent)
+: mSource(NoIndex)
+, mTarget(NoIndex)
+, mDomain(NoIndex)
+, mEntryBegin(0)
+, mEntryEnd(0)
+, mEvent(pEvent)
+, mAction(std::move(pDef.mAction))
+, mCondition(std::move(pDef.mCondition)){
+  
+}
+
+ifsm::EventId ifsm::priv::TransitionImpl::getEvent() const {
+  return mEvent;
+}
+
+bool ifsm::priv::TransitionImpl::isTargetless() const {
+  return mTarget == NoIndex;
+}
+
+bool ifsm::priv::TransitionImpl::test(const StateMachine& pRoot) const {
+  if (!mCondition){
+    return true;
+  }
+  return mCondition(pRoot);
+}
+
+void ifsm::priv::TransitionImpl::doAction(StateMachine& pRoot) const {
+  if (mAction) {
+    mAction(pRoot);
+  }
+}
+
+template <typename... Args>
+ifsm::priv::StateDef ifsm::State(const std::string& pName, Args&&... pArgs){
+  return priv::StateDef(pName, std::forward<Args>(pArgs)...);
+}
+
+ifsm::priv::DeferredEvent ifsm::Defer(const std::string& pEvent){
+  return priv::DeferredEvent(pEvent);
+}
+
+ifsm::priv::DeferredEvent::DeferredEvent(const std::string& pEvent)
+: mEvent(pEvent){
+
+}
+
+ifsm::priv::StateDef::StateDef(const std::string& pName)
+  : mName(pName)
+  , mIsInitial(false)
+  , mIsParallel(false)
+  , mHistory(NoHistory)
+  , mSubtreeStates(1)
+  , mSubtreeTransitions(0)
+  , mSubtreeOnEntry(0)
+  , mSubtreeOnExit(0){
+
+}
+
+template <typename... Params>
+ifsm::priv::StateDef::StateDef(const std::string& pName, Params && ... pParameters)
+  : mName(pName)
+  , mIsInitial(false)
+  , mIsParallel(false)
+  , mHistory(NoHistory)
+  , mSubtreeStates(1)
+  , mSubtreeTransitions(0)
+  , mSubtreeOnEntry(0)
+  , mSubtreeOnExit(0){
+  mChildren.reserve(count_of<StateDef, Params...>::value);
+  mTransitions.reserve(count_of<TransitionDef, Params...>::value);
+
+  //expanded in order rather than recursively, so that charts with many states don't instantiate deep templates
+  int lExpand[] = { 0, (addParameter(std::forward<Params>(pParameters)), 0)... };
+  (void)lExpand;
+}
+
+
+void ifsm::priv::StateDef::addParameter(StateDef && pState){
+  mSubtreeStates += pState.mSubtreeStates;
+  mSubtreeTransitions += pState.mSubtreeTransitions;
+  mSubtreeOnEntry += pState.mSubtreeOnEntry;
+  mSubtreeOnExit += pState.mSubtreeOnExit;
+  mChildren.emplace_back(std::move(pState));
+}
+
+void ifsm::priv::StateDef::addParameter(TransitionDef && pTransition){
+  ++mSubtreeTransitions;
+  mTransitions.emplace_back(std::move(pTransition));
+}
+
+void ifsm::priv::StateDef::addParameter(priv::OnEntryAction && pAction){
+  ++mSubtreeOnEntry;
+  mOnEntryActions.emplace_back(std::move(pAction));
+}
+
+void ifsm::priv::StateDef::addParameter(priv::OnExitAction && pAction){
+  ++mSubtreeOnExit;
+  mOnExitActions.emplace_back(std::move(pAction));
+}
+
+void ifsm::priv::StateDef::addParameter(priv::DeferredEvent && pEvent){
+  mDeferredEvents.emplace_back(std::move(pEvent.mEvent));
+}
+
+void ifsm::priv::StateDef::addParameter(priv::initialTag_t& ){
+  mIsInitial = true;
+}
+
+void ifsm::priv::StateDef::addParameter(priv::parallelTag_t& ){
+  mIsParallel = true;
+}
+
+void ifsm::priv::StateDef::addParameter(priv::shallowHistoryTag_t& ){
+  mHistory = ShallowHistory;
+}
+
+void ifsm::priv::StateDef::addParameter(priv::deepHistoryTag_t& ){
+  mHistory = DeepHistory;
+}
+
+ifsm::priv::StateImpl::StateImpl(StateIndex pOrdinal, StateIndex pParent, const StateDef& pDef)
+: mOrdinal(pOrdinal)
+, mParent(pParent)
+, mSubtreeEnd(pOrdinal + 1)
+, mInitial(NoIndex)
+, mDispatchRow(NoIndex)
+, mTransitionsBegin(0)
+, mTransitionsEnd(0)
+, mOnEntryBegin(0)
+, mOnEntryEnd(0)
+, mOnExitBegin(0)
+, mOnExitEnd(0)
+, mDeferredBegin(0)
+, mDeferredEnd(0)
+, mTimersBegin(0)
+, mTimersEnd(0)
+, mHistorySlot(NoIndex)
+, mHistoryBegin(0)
+, mHistoryEnd(0)
+, mIsInitial(pDef.mIsInitial)
+, mIsParallel(pDef.mIsParallel)
+, mHistory(pDef.mHistory){
+
+}
+
+bool ifsm::priv::StateImpl::isAtomic() const{
+  return mSubtreeEnd == mOrdinal + 1;
+}
+
+bool ifsm::priv::StateImpl::isInitial() const{
+  return mIsInitial;
+}
+
+bool ifsm::priv::StateImpl::isParallel() const{
+  return mIsParallel;
+}
+
+bool ifsm::priv::StateImpl::contains(StateIndex pState) const{
+  return mOrdinal <= pState && pState < mSubtreeEnd;
+}
+
+void ifsm::priv::StateImpl::enter(StateMachine& pRoot) const{
+  markEntered(pRoot);
+  callOnEntry(pRoot);
+}
+
+void ifsm::priv::StateImpl::leave(StateMachine& pRoot) const{
+  markExited(pRoot);
+  callOnExit(pRoot);
+}
+
+void ifsm::priv::StateImpl::markEntered(StateMachine& pRoot) const{
+  pRoot.activate(mOrdinal);
+
+  if (mTimersBegin != mTimersEnd){
+    pRoot.armTimers(mTimersBegin, mTimersEnd);
+  }
+}
+
+void ifsm::priv::StateImpl::callOnEntry(StateMachine& pRoot) const{
+  std::uint32_t lCallback = 0;
+  callOnEntry(pRoot, lCallback);
+}
+
+bool ifsm::priv::StateImpl::callOnEntry(StateMachine& pRoot, std::uint32_t& pCallback) const{
+  if (pCallback == 0){
+    IFSM_TRACE(pRoot, beginEnter(pRoot, mOrdinal));
+  }
+  const StateChart& lChart = *pRoot.mChart;
+  for (std::uint32_t lAction = mOnEntryBegin + pCallback; lAction < mOnEntryEnd; ++lAction){
+    lChart.mOnEntryActions[lAction](pRoot);
+    if (pRoot.mAwaited){
+      pCallback = lAction + 1 - mOnEntryBegin;
+      return false;
+    }
+  }
+  IFSM_TRACE(pRoot, endEnter(pRoot, mOrdinal));
+  return true;
+}
+
+void ifsm::priv::StateImpl::markExited(StateMachine& pRoot) const{
+  pRoot.deactivate(mOrdinal);
+
+  if (mTimersBegin != mTimersEnd){
+    pRoot.cancelTimers(mTimersBegin, mTimersEnd);
+  }
+}
+
+void ifsm::priv::StateImpl::callOnExit(StateMachine& pRoot) const{
+  std::uint32_t lCallback = 0;
+  callOnExit(pRoot, lCallback);
+}
+
+bool ifsm::priv::StateImpl::callOnExit(StateMachine& pRoot, std::uint32_t& pCallback) const{
+  if (pCallback == 0){
+    IFSM_TRACE(pRoot, beginExit(pRoot, mOrdinal));
+  }
+  const StateChart& lChart = *pRoot.mChart;
+  for (std::uint32_t lAction = mOnExitBegin + pCallback; lAction < mOnExitEnd; ++lAction){
+    lChart.mOnExitActions[lAction](pRoot);
+    if (pRoot.mAwaited){
+      pCallback = lAction + 1 - mOnExitBegin;
+      return false;
+    }
+  }
+  IFSM_TRACE(pRoot, endExit(pRoot, mOrdinal));
+  return true;
+}
+
+template <typename... Params>
+ifsm::StateChart::StateChart(Params && ... pParams)
+: mPublicEvents(0)
+, mEventless(InvalidEvent)
+, mHistorySlots(0)
+, mHistoryCapacity(0)
+, mFingerprint(14695981039346656037ULL)
+, mSingleRegion(true){
+  //build the StateDef for the StateChart's StateImpl construction
+  priv::StateDef lCurrentDefinition("root", std::forward<Params>(pParams)...);
+
+  build(lCurrentDefinition);
+}
+
+void ifsm::StateChart::build(priv::StateDef& pRoot){
+  //the definitions know the size of their subtree : reserve everything upfront
+  mStates.reserve(pRoot.mSubtreeStates);
+  mStateNames.reserve(pRoot.mSubtreeStates);
+  mStateIndices.reserve(pRoot.mSubtreeStates);
+  mTransitions.reserve(pRoot.mSubtreeTransitions);
+  mEntrySequences.reserve(pRoot.mSubtreeTransitions);
+  mOnEntryActions.reserve(pRoot.mSubtreeOnEntry);
+  mOnExitActions.reserve(pRoot.mSubtreeOnExit);
+
+  //target and event names of each transition, resolved once every state is numbered.
+  //they point into the definitions, that outlive the build
+  std::vector<std::pair<const std::string*, const std::string*>> lPending;
+  lPending.reserve(pRoot.mSubtreeTransitions);
+
+  //transitions reacting to an internal event, along with their timer or NoIndex, numbered once the walk is done
+  std::vector<std::pair<priv::TransitionIndex, std::uint32_t>> lInternal;
+
+  //single walk in document order : a state's ordinal, subtree and initial child are known as soon as it is reached
+  std::vector<std::pair<priv::StateIndex, priv::StateDef*>> lLifo(1, std::make_pair(priv::NoIndex, &pRoot));
+
+  while (!lLifo.empty()){
+    priv::StateIndex lParent = lLifo.back().first;
+    priv::StateDef& lDef = *lLifo.back().second;
+    lLifo.pop_back();
+
+    priv::StateIndex lIndex = static_cast<priv::StateIndex>(mStates.size());
+    if (!mStateIndices.insert(std::make_pair(lDef.mName, lIndex)).second){
+      throw DuplicateStateIdentifier(lDef.mName);
+    }
+
+    mStates.push_back(priv::StateImpl(lIndex, lParent, lDef));
+    mStateNames.push_back(lDef.mName);
+    priv::StateImpl& lState = mStates.back();
+    lState.mSubtreeEnd = static_cast<priv::StateIndex>(lIndex + lDef.mSubtreeStates);
+
+    mFingerprint = priv::hashString(mFingerprint, lDef.mName);
+    mFingerprint = priv::hashValue(mFingerprint, lParent);
+    mFingerprint = priv::hashValue(mFingerprint, (lDef.mIsInitial ? 1 : 0) | (lDef.mIsParallel ? 2 : 0) | (lDef.mHistory << 2));
+    mSingleRegion = mSingleRegion && !lDef.mIsParallel;
+
+    //get initial child : children are numbered after their parent, each one after the subtree of the previous one
+    priv::StateIndex lChild = lIndex + 1;
+    for (const priv::StateDef& lChildDef : lDef.mChildren){
+      if (lChildDef.mIsInitial){
+        if (lState.mInitial != priv::NoIndex){
+          throw AlreadyHasInitial(lDef.mName);
+        }
+        lState.mInitial = lChild;
+      }
+      lChild += static_cast<priv::StateIndex>(lChildDef.mSubtreeStates);
+    }
+
+    //test whether this non-parallel non-atomic state has an initial child defined
+    if (!lState.isParallel() && !lState.isAtomic() && lState.mInitial == priv::NoIndex){
+      throw NoInitialState(lDef.mName);
+    }
+
+    lState.mOnEntryBegin = static_cast<std::uint32_t>(mOnEntryActions.size());
+    std::move(lDef.mOnEntryActions.begin(), lDef.mOnEntryActions.end(), std::back_inserter(mOnEntryActions));
+    lState.mOnEntryEnd = static_cast<std::uint32_t>(mOnEntryActions.size());
+
+    lState.mOnExitBegin = static_cast<std::uint32_t>(mOnExitActions.size());
+    std::move(lDef.mOnExitActions.begin(), lDef.mOnExitActions.end(), std::back_inserter(mOnExitActions));
+    lState.mOnExitEnd = static_cast<std::uint32_t>(mOnExitActions.size());
+
+    //build transitions, their targets are resolved below
+    lState.mTransitionsBegin = static_cast<priv::TransitionIndex>(mTransitions.size());
+    lState.mTimersBegin = static_cast<std::uint32_t>(mTimers.size());
+    for (auto& lTransitionDef : lDef.mTransitions){
+      //After transitions react to an event of their own, that can't be pushed by name
+      if (lTransitionDef.mHasDelay){
+        lTransitionDef.mEvent = std::string(1, '\0') + "after " + std::to_string(mTimers.size());
+      }
+      //and all eventless transitions to a single one, checked after the transitions
+      const bool lEventless = !lTransitionDef.mHasDelay && lTransitionDef.mEvent.empty();
+      if (lEventless){
+        lTransitionDef.mEvent = std::string(1, '\0') + "eventless";
+      }
+
+      EventId lEvent = InvalidEvent;
+      if (lTransitionDef.mHasDelay){
+        lInternal.push_back(std::make_pair(static_cast<priv::TransitionIndex>(mTransitions.size()), static_cast<std::uint32_t>(mTimers.size())));
+        priv::TimerDef lTimer = { InvalidEvent, lTransitionDef.mDelay };
+        mTimers.push_back(lTimer);
+      }
+      else if (lEventless){
+        lInternal.push_back(std::make_pair(static_cast<priv::TransitionIndex>(mTransitions.size()), priv::NoIndex));
+      }
+      else {
+        lEvent = internEvent(lTransitionDef.mEvent);
+      }
+      lPending.push_back(std::make_pair(&lTransitionDef.mTarget, &lTransitionDef.mEvent));
+      mTransitions.push_back(priv::TransitionImpl(std::move(lTransitionDef), lEvent));
+      mTransitions.back().mSource = lIndex;
+    }
+    lState.mTransitionsEnd = static_cast<priv::TransitionIndex>(mTransitions.size());
+    lState.mTimersEnd = static_cast<std::uint32_t>(mTimers.size());
+
+    lState.mDeferredBegin = static_cast<std::uint32_t>(mDeferredEvents.size());
+    for (const std::string& lEvent : lDef.mDeferredEvents){
+      mDeferredEvents.push_back(internEvent(lEvent));
+    }
+    lState.mDeferredEnd = static_cast<std::uint32_t>(mDeferredEvents.size());
+
+    for (auto lChildDef = lDef.mChildren.rbegin(); lChildDef != lDef.mChildren.rend(); ++lChildDef){
+      lLifo.push_back(std::make_pair(lIndex, &*lChildDef));
+    }
+  }
+
+  //the internal events follow the public ones
+  mPublicEvents = static_cast<std::uint32_t>(mEventIds.size());
+  for (const std::pair<priv::TransitionIndex, std::uint32_t>& lTransition : lInternal){
+    const EventId lEvent = internEvent(*lPending[lTransition.first].second);
+    mTransitions[lTransition.first].mEvent = lEvent;
+    if (lTransition.second != priv::NoIndex){
+      mTimers[lTransition.second].mEvent = lEvent;
+    }
+    else {
+      mEventless = lEvent;
+    }
+  }
+
+  //resolve targets with a single lookup each, then precompute the domain and the entered states of each transition
+  for (std::size_t lIndex = 0; lIndex < mTransitions.size(); ++lIndex){
+    priv::TransitionImpl& lTransition = mTransitions[lIndex];
+    const std::string& lTargetName = *lPending[lIndex].first;
+    if (!lTargetName.empty()){
+      auto lFindTarget = mStateIndices.find(lTargetName);
+      if (lFindTarget == mStateIndices.end()){
+        throw NoSuchState(lTargetName);
+      }
+      lTransition.mTarget = lFindTarget->second;
+    }
+
+    mFingerprint = priv::hashValue(mFingerprint, lTransition.mSource);
+    mFingerprint = priv::hashString(mFingerprint, *lPending[lIndex].second);
+    mFingerprint = priv::hashValue(mFingerprint, lTransition.mTarget);
+
+    lTransition.mDomain = getTransitionDomain(lTransition);
+    lTransition.mEntryBegin = static_cast<std::uint32_t>(mEntrySequences.size());
+    listEntryStates(lTransition, mEntrySequences);
+    lTransition.mEntryEnd = static_cast<std::uint32_t>(mEntrySequences.size());
+  }
+
+  //number the history states : a shallow one records its active child, a deep one the active atomic
+  //states of its subtree. history makes no difference to atomic and parallel states
+  std::vector<std::uint32_t> lAtomicsBefore(mStates.size() + 1, 0);
+  for (std::size_t lIndex = 0; lIndex < mStates.size(); ++lIndex){
+    lAtomicsBefore[lIndex + 1] = lAtomicsBefore[lIndex] + (mStates[lIndex].isAtomic() ? 1 : 0);
+  }
+  for (priv::StateImpl& lState : mStates){
+    if (lState.mHistory == priv::NoHistory || lState.isAtomic() || (lState.mHistory == priv::ShallowHistory && lState.isParallel())){
+      continue;
+    }
+    lState.mHistorySlot = mHistorySlots++;
+    lState.mHistoryBegin = mHistoryCapacity;
+    mHistoryCapacity += lState.mHistory == priv::ShallowHistory ? 1 : lAtomicsBefore[lState.mSubtreeEnd] - lAtomicsBefore[lState.mOrdinal];
+    lState.mHistoryEnd = mHistoryCapacity;
+  }
+
+  //now that all events are known, compile the dispatch table
+  buildDispatchTable();
+
+  listDefaultEntryStates(0, mDefaultEntry);
+}
+
+void ifsm::StateChart::buildDispatchTable(){
+  const std::size_t lRowSize = mEventIds.size() + 1;
+  std::vector<std::uint32_t> lFill(lRowSize);
+
+  std::size_t lAtomics = 0;
+  for (const auto& lState : mStates){
+    lAtomics += lState.isAtomic() ? 1 : 0;
+  }
+  mDispatchOffsets.reserve(lAtomics * lRowSize);
+  const std::size_t lHandledWords = (mEventIds.size() + priv::Bitset::WordBits - 1) / priv::Bitset::WordBits;
+  mHandledEvents.assign(lAtomics * lHandledWords, 0);
+
+  for (auto& lState : mStates){
+    if (!lState.isAtomic()){
+      continue;
+    }
+
+    lState.mDispatchRow = static_cast<std::uint32_t>(mDispatchOffsets.size() / lRowSize);
+    std::size_t lRowBegin = mDispatchOffsets.size();
+    mDispatchOffsets.resize(lRowBegin + lRowSize, 0);
+    std::uint32_t* lOffsets = &mDispatchOffsets[lRowBegin];
+
+    //count candidates per event, from this state up to the root
+    for (priv::StateIndex lSource = lState.mOrdinal; lSource != priv::NoIndex; lSource = mStates[lSource].mParent){
+      for (priv::TransitionIndex lTransition = mStates[lSource].mTransitionsBegin; lTransition < mStates[lSource].mTransitionsEnd; ++lTransition){
+        ++lOffsets[mTransitions[lTransition].getEvent() + 1];
+      }
+    }
+
+    priv::Bitset::Word* lHandled = &mHandledEvents[lState.mDispatchRow * lHandledWords];
+    for (std::size_t lEvent = 0; lEvent + 1 < lRowSize; ++lEvent){
+      if (lOffsets[lEvent + 1] != 0){
+        lHandled[lEvent / priv::Bitset::WordBits] |= priv::Bitset::Word(1) << (lEvent % priv::Bitset::WordBits);
+      }
+    }
+
+    lOffsets[0] = static_cast<std::uint32_t>(mDispatchTransitions.size());
+    for (std::size_t lEvent = 1; lEvent < lRowSize; ++lEvent){
+      lOffsets[lEvent] += lOffsets[lEvent - 1];
+    }
+
+    //then store them, closest states first, in declaration order
+    std::copy(lOffsets, lOffsets + lRowSize, lFill.begin());
+    mDispatchTransitions.resize(lOffsets[lRowSize - 1]);
+    for (priv::StateIndex lSource = lState.mOrdinal; lSource != priv::NoIndex; lSource = mStates[lSource].mParent){
+      for (priv::TransitionIndex lTransition = mStates[lSource].mTransitionsBegin; lTransition < mStates[lSource].mTransitionsEnd; ++lTransition){
+        mDispatchTransitions[lFill[mTransitions[lTransition].getEvent()]++] = lTransition;
+      }
+    }
+  }
+
+  if (mDeferredEvents.empty()){
+    return;
+  }
+
+  const std::size_t lEventCount = mEventIds.size();
+  mDeferringStates.resize(mDispatchOffsets.size() / lRowSize * lEventCount, priv::NoIndex);
+  for (auto& lState : mStates){
+    if (!lState.isAtomic()){
+      continue;
+    }
+
+    priv::StateIndex* lDeferring = &mDeferringStates[lState.mDispatchRow * lEventCount];
+    for (priv::StateIndex lSource = lState.mOrdinal; lSource != priv::NoIndex; lSource = mStates[lSource].mParent){
+      for (std::uint32_t lDeferred = mStates[lSource].mDeferredBegin; lDeferred < mStates[lSource].mDeferredEnd; ++lDeferred){
+        if (lDeferring[mDeferredEvents[lDeferred]] == priv::NoIndex){
+          lDeferring[mDeferredEvents[lDeferred]] = lSource;
+        }
+      }
+    }
+  }
+}
+
+template <typename... Params, typename B>
+ifsm::StateMachine::StateMachine(Params && ... pParams)
+: mChart(std::make_shared<const StateChart>(std::forward<Params>(pParams)...))
+, mTimerWheel(nullptr)
+, mRegionExecutor(nullptr)
+, mEventLog(nullptr)
+, mPayload(nullptr)
+, mPayloadType(nullptr)
+, mAsyncCount(0)
+, mExecutorEntry(nullptr)
+, mEventlessLimit(1000)
+, mUnhandledEvents(0)
+, mAwaited(nullptr)
+, mIsActive(false)
+, mInToplevelProcess(false)
+, mDetachTasks(false)
+, mHandledChanged(true)
+#if defined(INSTANTFSM_TRACING)
+, mObserver(nullptr)
+#endif
+{
+  mActiveStates.resize(mChart->mStates.size());
+  mHandledEvents.resize(mChart->mEventIds.size());
+  mTimers.resize(mChart->mTimers.size(), 0);
+  mHistory.resize(mChart->mHistoryCapacity);
+  mHistorySizes.resize(mChart->mHistorySlots, 0);
+}
+
+ifsm::StateMachine::StateMachine(std::shared_ptr<const StateChart> pChart)
+: mChart(std::move(pChart))
+, mTimerWheel(nullptr)
+, mRegionExecutor(nullptr)
+, mEventLog(nullptr)
+, mPayload(nullptr)
+, mPayloadType(nullptr)
+, mAsyncCount(0)
+, mExecutorEntry(nullptr)
+, mEventlessLimit(1000)
+, mUnhandledEvents(0)
+, mAwaited(nullptr)
+, mIsActive(false)
+, mInToplevelProcess(false)
+, mDetachTasks(false)
+, mHandledChanged(true)
+#if defined(INSTANTFSM_TRACING)
+, mObserver(nullptr)
+#endif
+{
+  mActiveStates.resize(mChart->mStates.size());
+  mHandledEvents.resize(mChart->mEventIds.size());
+  mTimers.resize(mChart->mTimers.size(), 0);
+  mHistory.resize(mChart->mHistoryCapacity);
+  mHistorySizes.resize(mChart->mHistorySlots, 0);
+}
+
+ifsm::StateMachine::~StateMachine(){
+  abandonMicrostep();
+
+  //the wheel outlives the instance, that may still have timers armed
+  if (mTimerWheel){
+    cancelTimers(0, static_cast<std::uint32_t>(mTimers.size()));
+  }
+}
+
+void ifsm::StateMachine::enter(){
+  const StateChart& lChart = *mChart;
+  if (mIsActive) {
+    return;
+  }
+
+  mIsActive = true;
+  if (mEventLog){
+    mEventLog->record(EventLog::Record::Enter);
+  }
+
+  //enter the root and its initial children in document order
+  priv::ResumePoint lStart = { priv::ResumePoint::DefaultEntry, 0, 0 };
+  runMicrostep(lStart);
+
+  //then the eventless transitions enabled by the initial configuration
+  if (lChart.mEventless != InvalidEvent){
+    processEvents();
+  }
+}
+
+void ifsm::StateMachine::leave(){
+  const StateChart& lChart = *mChart;
+  if (!mIsActive) {
+    return;
+  }
+
+  if (mEventLog){
+    mEventLog->record(EventLog::Record::Leave);
+  }
+
+  //deferred events are dropped along with the configuration
+  mParked.clear();
+  abandonMicrostep();
+
+  //leave active states in reverse document order : children before their parent
+  mDetachTasks = true;
+  for (std::size_t lIndex = mActiveStates.findPrevious(0, lChart.mStates.size());
+    lIndex != priv::Bitset::npos;
+    lIndex = mActiveStates.findPrevious(0, lIndex)){
+    lChart.mStates[lIndex].leave(*this);
+  }
+  mDetachTasks = false;
+
+  //a machine entered again starts afresh
+  std::fill(mHistorySizes.begin(), mHistorySizes.end(), 0);
+  mChangedAtomics.clear();
+  mIsActive = false;
+}
+
+bool ifsm::StateMachine::isActive() const{
+  return mIsActive;
+}
+
+void ifsm::StateMachine::pushEvent(const std::string& pEvent){
+  takeAsyncEvents();
+  enqueue(pEvent);
+  processEvents();
+}
+
+void ifsm::StateMachine::pushEvent(EventId pEvent){
+  takeAsyncEvents();
+  enqueue(pEvent);
+  processEvents();
+}
+
+void ifsm::StateMachine::pushEvent(EventId pEvent, EventPriority pPriority){
+  takeAsyncEvents();
+  enqueue(pEvent, pPriority);
+  processEvents();
+}
+
+void ifsm::StateMachine::pushEvent(const std::string& pEvent, EventPriority pPriority){
+  takeAsyncEvents();
+  enqueue(pEvent, pPriority);
+  processEvents();
+}
+
+template <class T>
+void ifsm::StateMachine::pushEvent(EventId pEvent, T&& pPayload){
+  pushEvent(pEvent, std::forward<T>(pPayload), EventPriority::Normal);
+}
+
+template <class T>
+void ifsm::StateMachine::pushEvent(EventId pEvent, T&& pPayload, EventPriority pPriority){
+  typedef typename std::decay<T>::type Type;
+  takeAsyncEvents();
+
+  //no transition reacts to this event
+  if (pEvent >= mChart->mPublicEvents){
+    processEvents();
+    return;
+  }
+
+  //an event that may be deferred, has to wait for a Task, or follows pending eventless transitions has to own its payload
+  if (mInToplevelProcess || mAwaited || nextQueue() != priv::EventPriorityCount || !mChart->mDeferringStates.empty() || !mChangedAtomics.empty()){
+    //the event waits for its turn in the queue, which owns the payload until then
+    mEvents[static_cast<std::size_t>(pPriority)].push(pEvent, priv::Payload(std::forward<T>(pPayload)));
+    processEvents();
+    return;
+  }
+
+  //processed right away : callbacks see the caller's object
+  mInToplevelProcess = true;
+  processEvent(pEvent, static_cast<const void*>(std::addressof(pPayload)), priv::payloadType<Type>());
+  processQueue();
+  mInToplevelProcess = false;
+}
+
+template <class T>
+void ifsm::StateMachine::pushEvent(const std::string& pEvent, T&& pPayload){
+  pushEvent(pEvent, std::forward<T>(pPayload), EventPriority::Normal);
+}
+
+template <class T>
+void ifsm::StateMachine::pushEvent(const std::string& pEvent, T&& pPayload, EventPriority pPriority){
+  pushEvent(mChart->findEvent(pEvent), std::forward<T>(pPayload), pPriority);
+}
+
+template <class T>
+const T* ifsm::StateMachine::eventPayload() const{
+  if (mPayloadType != priv::payloadType<T>()){
+    return nullptr;
+  }
+  return static_cast<const T*>(mPayload);
+}
+
+template <class InputIterator>
+void ifsm::StateMachine::pushEvents(InputIterator pBegin, InputIterator pEnd){
+  takeAsyncEvents();
+  reserveEvents(pBegin, pEnd, typename std::iterator_traits<InputIterator>::iterator_category());
+  for (; pBegin != pEnd; ++pBegin){
+    enqueue(*pBegin);
+  }
+  processEvents();
+}
+
+void ifsm::StateMachine::pushEvents(const EventId* pEvents, std::size_t pCount){
+  pushEvents(pEvents, pEvents + pCount);
+}
+
+void ifsm::StateMachine::pushEvents(std::initializer_list<EventId> pEvents){
+  pushEvents(pEvents.begin(), pEvents.end());
+}
+
+void ifsm::StateMachine::pushEvents(std::initializer_list<std::string> pEvents){
+  pushEvents(pEvents.begin(), pEvents.end());
+}
+
+void ifsm::StateMachine::takeAsyncEvents(){
+  priv::AsyncEvent lEvent;
+  while (mAsyncEvents.pop(lEvent)){
+    mAsyncCount.fetch_sub(1);
+    if (lEvent.mTimer != priv::NoIndex){
+      pushTimerEvent(lEvent.mTimer, lEvent.mTimerId);
+    }
+    else {
+      enqueue(lEvent.mEvent);
+    }
+  }
+}
+
+void ifsm::StateMachine::enqueue(EventId pEvent, EventPriority pPriority){
+  //no transition reacts to this event, or it is internal. this also keeps PayloadFlag for events with a payload
+  if (pEvent >= mChart->mPublicEvents){
+    return;
+  }
+  mEvents[static_cast<std::size_t>(pPriority)].push(pEvent);
+}
+
+void ifsm::StateMachine::enqueue(const std::string& pEvent, EventPriority pPriority){
+  const EventId lEvent = mChart->findEvent(pEvent);
+
+  //no transition reacts to this event
+  if (lEvent == InvalidEvent){
+    return;
+  }
+
+  mEvents[static_cast<std::size_t>(pPriority)].push(lEvent);
+}
+
+void ifsm::StateMachine::pushEventAsync(const std::string& pEvent){
+  //the chart is not modified after construction, concurrent lookups are safe
+  const EventId lFound = mChart->findEvent(pEvent);
+
+  if (lFound == InvalidEvent){
+    return;
+  }
+
+  const priv::AsyncEvent lEvent = { lFound, priv::NoIndex, 0 };
+  mAsyncCount.fetch_add(1);
+  mAsyncEvents.push(lEvent);
+}
+
+void ifsm::StateMachine::pushEventAsync(EventId pEvent){
+  const priv::AsyncEvent lEvent = { pEvent, priv::NoIndex, 0 };
+  mAsyncCount.fetch_add(1);
+  mAsyncEvents.push(lEvent);
+}
+
+template <class InputIterator>
+void ifsm::StateMachine::reserveEvents(InputIterator, InputIterator, std::input_iterator_tag){
+  //single pass range : the queue grows as needed
+}
+
+template <class InputIterator>
+void ifsm::StateMachine::reserveEvents(InputIterator pBegin, InputIterator pEnd, std::forward_iterator_tag){
+  priv::EventQueue& lQueue = mEvents[static_cast<std::size_t>(EventPriority::Normal)];
+  lQueue.reserve(lQueue.size() + static_cast<std::size_t>(std::distance(pBegin, pEnd)));
+}
+
+ifsm::EventId ifsm::StateChart::event(const std::string& pEvent) const{
+  const EventId lEvent = findEvent(pEvent);
+
+  if (lEvent == InvalidEvent){
+    throw NoSuchEvent(pEvent);
+  }
+
+  return lEvent;
+}
+
+ifsm::EventId ifsm::StateChart::findEvent(const std::string& pEvent) const{
+  auto itFind = mEventIds.find(pEvent);
+
+  if (itFind == mEventIds.end() || itFind->second >= mPublicEvents){
+    return InvalidEvent;
+  }
+
+  return itFind->second;
+}
+
+std::uint64_t ifsm::StateChart::fingerprint() const{
+  return mFingerprint;
+}
+
+std::size_t ifsm::MemoryUsage::total() const{
+  return mStates + mTransitions + mCallbacks + mQueues + mNames + mOther;
+}
+
+ifsm::MemoryUsage ifsm::StateChart::memoryUsage() const{
+  MemoryUsage lUsage = MemoryUsage();
+  lUsage.mStates = priv::vectorBytes(mStates) + priv::vectorBytes(mEntrySequences) + priv::vectorBytes(mDefaultEntry);
+
+  //the callbacks stored in the transitions are counted along with the other callbacks
+  const std::size_t lTransitionCallbacks = mTransitions.size() * (sizeof(priv::ActionCallback) + sizeof(priv::ConditionCallback));
+  lUsage.mTransitions = priv::vectorBytes(mTransitions) - lTransitionCallbacks
+    + priv::vectorBytes(mDispatchOffsets) + priv::vectorBytes(mDispatchTransitions) + priv::vectorBytes(mHandledEvents)
+    + priv::vectorBytes(mDeferredEvents) + priv::vectorBytes(mTimers) + priv::vectorBytes(mDeferringStates);
+  lUsage.mCallbacks = priv::vectorBytes(mOnEntryActions) + priv::vectorBytes(mOnExitActions) + lTransitionCallbacks;
+
+  lUsage.mNames = priv::vectorBytes(mStateNames) + priv::nameTableBytes(mStateIndices) + priv::nameTableBytes(mEventIds);
+  for (const std::string& lName : mStateNames){
+    lUsage.mNames += priv::stringBytes(lName);
+  }
+  lUsage.mOther = sizeof(StateChart);
+  return lUsage;
+}
+
+std::size_t ifsm::StateChart::stateCount() const{
+  return mStates.size();
+}
+
+const std::string& ifsm::StateChart::stateName(std::size_t pState) const{
+  return mStateNames[pState];
+}
+
+std::size_t ifsm::StateChart::stateOrdinal(const std::string& pState) const{
+  auto itFind = mStateIndices.find(pState);
+
+  if (itFind == mStateIndices.end()){
+    throw NoSuchState(pState);
+  }
+
+  return itFind->second;
+}
+
+ifsm::StateId ifsm::StateChart::state(const std::string& pState) const{
+  return static_cast<StateId>(stateOrdinal(pState));
+}
+
+ifsm::StateSet ifsm::StateChart::stateSet(std::initializer_list<StateId> pStates) const{
+  StateSet lSet;
+  lSet.resize(mStates.size());
+  for (StateId lState : pStates){
+    if (lState >= mStates.size()){
+      throw NoSuchState(std::to_string(lState));
+    }
+    lSet.set(lState);
+  }
+  return lSet;
+}
+
+std::size_t ifsm::StateChart::transitionCount() const{
+  return mTransitions.size();
+}
+
+std::size_t ifsm::StateChart::transitionSource(std::size_t pTransition) const{
+  return mTransitions[pTransition].mSource;
+}
+
+ifsm::EventId ifsm::StateChart::internEvent(const std::string& pEvent){
+  auto lRes = mEventIds.insert(std::make_pair(pEvent, static_cast<EventId>(mEventIds.size())));
+  return lRes.first->second;
+}
+
+ifsm::EventId ifsm::StateMachine::event(const std::string& pEvent) const{
+  return mChart->event(pEvent);
+}
+
+const std::shared_ptr<const ifsm::StateChart>& ifsm::StateMachine::chart() const{
+  return mChart;
+}
+
+bool ifsm::StateMachine::inState(const std::string& stateName) const{
+  const StateChart& lChart = *mChart;
+
+  auto itFind = lChart.mStateIndices.find(stateName);
+
+  if (itFind == lChart.mStateIndices.end()){
+    return false;
+  }
+
+  return inState(itFind->second);
+}
+
+bool ifsm::StateMachine::inState(StateId pState) const{
+  if (pState == 0){
+    return mIsActive;
+  }
+
+  return pState < mActiveStates.size() && mActiveStates.test(pState);
+}
+
+ifsm::StateId ifsm::StateMachine::state(const std::string& pState) const{
+  return mChart->state(pState);
+}
+
+const ifsm::StateSet& ifsm::StateMachine::activeConfiguration() const{
+  return mActiveStates;
+}
+
+namespace ifsm{
+  namespace priv{
+    static const std::uint8_t SnapshotVersion = 1;
+  }
+}
+
+std::vector<std::uint8_t> ifsm::StateMachine::snapshot() const{
+  std::vector<std::uint8_t> lBlob(9);
+  lBlob.reserve(10 + 2 * mActiveAtomics.size());
+
+  lBlob[0] = priv::SnapshotVersion;
+  const std::uint64_t lFingerprint = mChart->fingerprint();
+  for (std::size_t lByte = 0; lByte < 8; ++lByte){
+    lBlob[1 + lByte] = static_cast<std::uint8_t>(lFingerprint >> (8 * lByte));
+  }
+
+  //an inactive machine has no active atomic state.
+  //the configuration is made of the active atomic states and their ancestors,
+  //so only the atomic states are stored, as increasing ordinals using delta encoding
+  const std::size_t lCount = mIsActive ? mActiveAtomics.size() : 0;
+  priv::appendVarint(lBlob, lCount);
+  priv::StateIndex lPrevious = 0;
+  for (std::size_t lIndex = 0; lIndex < lCount; ++lIndex){
+    priv::appendVarint(lBlob, mActiveAtomics[lIndex] - lPrevious);
+    lPrevious = mActiveAtomics[lIndex];
+  }
+
+  //then, for the charts with history states, the states recorded by each one, increasing from the history state
+  for (std::size_t lIndex = 0; lCount != 0 && mChart->mHistorySlots != 0 && lIndex < mChart->mStates.size(); ++lIndex){
+    const priv::StateImpl& lState = mChart->mStates[lIndex];
+    if (lState.mHistorySlot == priv::NoIndex){
+      continue;
+    }
+    priv::appendVarint(lBlob, historySize(lState));
+    lPrevious = lState.mOrdinal;
+    for (std::uint32_t lRecorded = lState.mHistoryBegin; lRecorded < lState.mHistoryBegin + historySize(lState); ++lRecorded){
+      priv::appendVarint(lBlob, mHistory[lRecorded] - lPrevious);
+      lPrevious = mHistory[lRecorded];
+    }
+  }
+
+  return lBlob;
+}
+
+void ifsm::StateMachine::restore(const std::vector<std::uint8_t>& pSnapshot){
+  restore(pSnapshot.data(), pSnapshot.size());
+}
+
+void ifsm::StateMachine::restore(const std::uint8_t* pSnapshot, std::size_t pSize){
+  const StateChart& lChart = *mChart;
+  const std::uint8_t* lCursor = pSnapshot;
+  const std::uint8_t* lEnd = pSnapshot + pSize;
+
+  if (pSize < 9 || *lCursor++ != priv::SnapshotVersion){
+    throw InvalidSnapshot("unknown format");
+  }
+
+  std::uint64_t lFingerprint = 0;
+  for (std::size_t lByte = 0; lByte < 8; ++lByte){
+    lFingerprint |= static_cast<std::uint64_t>(*lCursor++) << (8 * lByte);
+  }
+  if (lFingerprint != lChart.fingerprint()){
+    throw InvalidSnapshot("it was taken on a different chart");
+  }
+
+  std::uint64_t lCount = 0;
+  if (!priv::readVarint(lCursor, lEnd, lCount) || lCount > lChart.mStates.size()){
+    throw InvalidSnapshot("truncated data");
+  }
+
+  //build the configuration aside, so that the current one is kept if the snapshot is invalid
+  priv::Bitset lActiveStates;
+  lActiveStates.resize(lChart.mStates.size());
+  std::vector<priv::StateIndex> lActiveAtomics;
+  lActiveAtomics.reserve(static_cast<std::size_t>(lCount));
+
+  std::uint64_t lState = 0;
+  for (std::uint64_t lIndex = 0; lIndex < lCount; ++lIndex){
+    std::uint64_t lDelta = 0;
+    if (!priv::readVarint(lCursor, lEnd, lDelta)){
+      throw InvalidSnapshot("truncated data");
+    }
+    if (lIndex != 0 && lDelta == 0){
+      throw InvalidSnapshot("unsorted states");
+    }
+    lState += lDelta;
+    if (lState >= lChart.mStates.size() || !lChart.mStates[static_cast<std::size_t>(lState)].isAtomic()){
+      throw InvalidSnapshot("unknown atomic state");
+    }
+
+    //activate the atomic state and the ancestors that aren't active yet
+    lActiveAtomics.push_back(static_cast<priv::StateIndex>(lState));
+    for (priv::StateIndex lAncestor = static_cast<priv::StateIndex>(lState);
+      lAncestor != priv::NoIndex && !lActiveStates.test(lAncestor);
+      lAncestor = lChart.mStates[lAncestor].mParent){
+      lActiveStates.set(lAncestor);
+    }
+  }
+
+  //each history state records up to its capacity of states of its subtree : its children for the shallow ones,
+  //atomic states for the deep ones
+  std::vector<priv::StateIndex> lHistory(lChart.mHistoryCapacity);
+  std::vector<std::uint32_t> lHistorySizes(lChart.mHistorySlots, 0);
+  for (std::size_t lIndex = 0; lCount != 0 && lChart.mHistorySlots != 0 && lIndex < lChart.mStates.size(); ++lIndex){
+    const priv::StateImpl& lHistoryState = lChart.mStates[lIndex];
+    if (lHistoryState.mHistorySlot == priv::NoIndex){
+      continue;
+    }
+
+    std::uint64_t lSize = 0;
+    if (!priv::readVarint(lCursor, lEnd, lSize)){
+      throw InvalidSnapshot("truncated data");
+    }
+    if (lSize > lHistoryState.mHistoryEnd - lHistoryState.mHistoryBegin){
+      throw InvalidSnapshot("inconsistent history");
+    }
+
+    std::uint64_t lRecorded = lIndex;
+    for (std::uint64_t lPosition = 0; lPosition < lSize; ++lPosition){
+      std::uint64_t lDelta = 0;
+      if (!priv::readVarint(lCursor, lEnd, lDelta)){
+        throw InvalidSnapshot("truncated data");
+      }
+      lRecorded += lDelta;
+      if (lDelta == 0 || lRecorded >= lHistoryState.mSubtreeEnd
+        || (lHistoryState.mHistory == priv::ShallowHistory ? lChart.mStates[static_cast<std::size_t>(lRecorded)].mParent != lIndex
+          : !lChart.mStates[static_cast<std::size_t>(lRecorded)].isAtomic())){
+        throw InvalidSnapshot("inconsistent history");
+      }
+      lHistory[lHistoryState.mHistoryBegin + lPosition] = static_cast<priv::StateIndex>(lRecorded);
+    }
+    lHistorySizes[lHistoryState.mHistorySlot] = static_cast<std::uint32_t>(lSize);
+  }
+
+  if (lCursor != lEnd){
+    throw InvalidSnapshot("trailing data");
+  }
+
+  //an active compound state has exactly one active child, an active parallel state all of them
+  for (priv::StateIndex lIndex = 0; lIndex < lChart.mStates.size(); ++lIndex){
+    const priv::StateImpl& lImpl = lChart.mStates[lIndex];
+    if (!lActiveStates.test(lIndex) || lImpl.isAtomic()){
+      continue;
+    }
+
+    std::size_t lActiveChildren = 0;
+    std::size_t lChildren = 0;
+    for (priv::StateIndex lChild = lIndex + 1; lChild < lImpl.mSubtreeEnd; lChild = lChart.mStates[lChild].mSubtreeEnd){
+      ++lChildren;
+      lActiveChildren += lActiveStates.test(lChild) ? 1 : 0;
+    }
+
+    if (lImpl.isParallel() ? lActiveChildren != lChildren : lActiveChildren != 1){
+      throw InvalidSnapshot("inconsistent configuration");
+    }
+  }
+
+  //timers restart from the restored configuration
+  if (!mTimers.empty()){
+    cancelTimers(0, static_cast<std::uint32_t>(mTimers.size()));
+  }
+
+  std::swap(mActiveStates, lActiveStates);
+  mActiveAtomics.swap(lActiveAtomics);
+  mHistory.swap(lHistory);
+  mHistorySizes.swap(lHistorySizes);
+  mHandledChanged = true;
+  //the eventless transitions are checked from the restored configuration
+  if (lChart.mEventless != InvalidEvent){
+    mChangedAtomics = mActiveAtomics;
+  }
+  //deferred events and a suspended microstep belong to the replaced configuration
+  mParked.clear();
+  abandonMicrostep();
+  mIsActive = lCount != 0;
+
+  for (std::size_t lIndex = mActiveStates.findPrevious(0, lChart.mStates.size());
+    !mTimers.empty() && lIndex != priv::Bitset::npos;
+    lIndex = mActiveStates.findPrevious(0, lIndex)){
+    const priv::StateImpl& lState = lChart.mStates[lIndex];
+    if (lState.mTimersBegin != lState.mTimersEnd){
+      armTimers(lState.mTimersBegin, lState.mTimersEnd);
+    }
+  }
+
+  if (mEventLog){
+    mEventLog->start(*this);
+  }
+}
+
+/**************************************************/
+void ifsm::StateMachine::processEvents(){
+  if (mInToplevelProcess){
+	  return;
+  }
+
+  mInToplevelProcess = true;
+  //only take the events already pushed, so that busy producers can't hold the consumer
+  takeAsyncEvents();
+  if (!mAwaited || resumeMicrostep()){
+    processQueue();
+  }
+  mInToplevelProcess = false;
+}
+
+void ifsm::StateMachine::processQueue(){
+  const StateChart& lChart = *mChart;
+
+  //the eventless transitions complete the macrostep of the previous event before the next one is processed
+  processEventless();
+
+  //stop at the event that suspends on a Task : the next ones wait for it
+  for (std::size_t lPriority = nextQueue(); lPriority != priv::EventPriorityCount && !mAwaited; lPriority = nextQueue()){
+    EventId lEvent = mEvents[lPriority].pop();
+
+    if (lEvent & priv::PayloadFlag){
+      //take the payload out of the queue : callbacks may push more payloads, and grow it
+      priv::Payload lPayload(mEvents[lPriority].popPayload());
+      lEvent &= ~priv::PayloadFlag;
+      processEvent(lEvent, lPayload.data(), lPayload.type());
+
+      if (mEnabledTransitions.empty() && !lChart.mDeferringStates.empty()){
+        deferEvent(lEvent, lPriority, std::move(lPayload));
+      }
+    }
+    else {
+      processEvent(lEvent, nullptr, nullptr);
+
+      if (mEnabledTransitions.empty() && !lChart.mDeferringStates.empty()){
+        deferEvent(lEvent, lPriority, priv::Payload());
+      }
+    }
+
+    processEventless();
+  }
+}
+
+std::size_t ifsm::StateMachine::nextQueue() const{
+  std::size_t lPriority = 0;
+  while (lPriority < priv::EventPriorityCount && mEvents[lPriority].empty()){
+    ++lPriority;
+  }
+  return lPriority;
+}
+
+void ifsm::StateMachine::deferEvent(EventId pEvent, std::size_t pPriority, priv::Payload&& pPayload){
+  const StateChart& lChart = *mChart;
+  const std::size_t lEventCount = lChart.mEventIds.size();
+
+  for (priv::StateIndex lState : mActiveAtomics){
+    priv::StateIndex lDeferring = lChart.mDeferringStates[lChart.mStates[lState].mDispatchRow * lEventCount + pEvent];
+    if (lDeferring != priv::NoIndex){
+      priv::ParkedEvent lParked = { pEvent, lDeferring, pPriority, std::move(pPayload) };
+      mParked.push_back(std::move(lParked));
+      return;
+    }
+  }
+}
+
+void ifsm::StateMachine::releaseDeferredEvents(priv::StateIndex pState){
+  //push the released events in the order they were deferred, and keep the others in order
+  std::size_t lKept = 0;
+  for (std::size_t lIndex = 0; lIndex < mParked.size(); ++lIndex){
+    priv::ParkedEvent& lParked = mParked[lIndex];
+    if (lParked.mState == pState){
+      if (lParked.mPayload.type()){
+        mEvents[lParked.mPriority].push(lParked.mEvent, std::move(lParked.mPayload));
+      }
+      else {
+        mEvents[lParked.mPriority].push(lParked.mEvent);
+      }
+    }
+    else {
+      if (lKept != lIndex){
+        mParked[lKept] = std::move(lParked);
+      }
+      ++lKept;
+    }
+  }
+  mParked.erase(mParked.begin() + lKept, mParked.end());
+}
+
+void ifsm::StateMachine::processEvent(EventId pEvent, const void* pPayload, const void* pPayloadType){
+  IFSM_TRACE(*this, onEvent(*this, pEvent));
+  if (mEventLog){
+    mEventLog->record(pEvent, pPayload, pPayloadType);
+  }
+
+  mPayload = pPayload;
+  mPayloadType = pPayloadType;
+
+  //process transitions linked to the event
+  processTransitions(pEvent);
+
+  mPayload = nullptr;
+  mPayloadType = nullptr;
+}
+
+void ifsm::StateMachine::processTransitions(EventId pEvent){
+  //no active state has a transition for the event : nothing to select
+  if (!handles(pEvent)){
+    mEnabledTransitions.clear();
+    ++mUnhandledEvents;
+    IFSM_TRACE(*this, onTransitionsSelected(*this, pEvent, mEnabledTransitions.data(), 0));
+    return;
+  }
+
+  selectEnabledTransitions(pEvent, mActiveAtomics);
+
+  takeTransitions(pEvent);
+}
+
+void ifsm::StateMachine::takeTransitions(EventId pEvent){
+  IFSM_TRACE(*this, onTransitionsSelected(*this, pEvent, mEnabledTransitions.data(), mEnabledTransitions.size()));
+  (void)pEvent;
+
+  if (mRegionExecutor && mEnabledTransitions.size() > 1 && groupRegions() > 1){
+    processRegions();
+    return;
+  }
+
+  const StateChart& lChart = *mChart;
+  mStatesToExit.clear();
+  for (priv::TransitionIndex lTransition : mEnabledTransitions){
+    if (!lChart.mTransitions[lTransition].isTargetless()){
+      listExitStates(lChart.mTransitions[lTransition], mStatesToExit);
+    }
+  }
+  recordHistory();
+
+  priv::ResumePoint lStart = { priv::ResumePoint::Exit, 0, 0 };
+  runMicrostep(lStart);
+}
+
+void ifsm::StateMachine::processEventless(){
+  const StateChart& lChart = *mChart;
+
+  //each microstep only checks the states changed by the previous one
+  for (std::size_t lSteps = 0; !mChangedAtomics.empty() && !mAwaited; ++lSteps){
+    mCheckedAtomics.swap(mChangedAtomics);
+    mChangedAtomics.clear();
+    //a callback may have taken transitions of its own meanwhile
+    mCheckedAtomics.erase(std::remove_if(mCheckedAtomics.begin(), mCheckedAtomics.end(),
+      [this](priv::StateIndex pState){ return !mActiveStates.test(pState); }), mCheckedAtomics.end());
+
+    selectEnabledTransitions(lChart.mEventless, mCheckedAtomics);
+    if (mEnabledTransitions.empty()){
+      return;
+    }
+    if (lSteps == mEventlessLimit){
+      mInToplevelProcess = false;
+      throw EventlessLoop(mEventlessLimit);
+    }
+
+    IFSM_TRACE(*this, onEvent(*this, lChart.mEventless));
+    if (mEventLog){
+      mEventLog->record(lChart.mEventless, nullptr, nullptr);
+    }
+    takeTransitions(lChart.mEventless);
+  }
+}
+
+void ifsm::StateMachine::trackChanges(){
+  const StateChart& lChart = *mChart;
+  if (lChart.mEventless == InvalidEvent){
+    return;
+  }
+
+  //a transition changes the configuration below its domain, the source of a targetless one
+  for (priv::TransitionIndex lTransition : mEnabledTransitions){
+    const priv::StateImpl& lDomain = lChart.mStates[lChart.mTransitions[lTransition].mDomain];
+    auto lBegin = std::lower_bound(mActiveAtomics.begin(), mActiveAtomics.end(), lDomain.mOrdinal);
+    auto lEnd = std::lower_bound(lBegin, mActiveAtomics.end(), lDomain.mSubtreeEnd);
+    mChangedAtomics.insert(mChangedAtomics.end(), lBegin, lEnd);
+  }
+  std::sort(mChangedAtomics.begin(), mChangedAtomics.end());
+  mChangedAtomics.erase(std::unique(mChangedAtomics.begin(), mChangedAtomics.end()), mChangedAtomics.end());
+}
+
+bool ifsm::StateMachine::handles(EventId pEvent){
+  const StateChart& lChart = *mChart;
+  if (pEvent >= lChart.mEventIds.size()){
+    return false;
+  }
+
+  //a single active atomic state : its row of the chart is the handled set
+  const std::size_t lWords = mHandledEvents.wordCount();
+  if (mActiveAtomics.size() == 1){
+    const priv::Bitset::Word* lRow = &lChart.mHandledEvents[lChart.mStates[mActiveAtomics.front()].mDispatchRow * lWords];
+    return (lRow[pEvent / priv::Bitset::WordBits] >> (pEvent % priv::Bitset::WordBits)) & 1;
+  }
+
+  if (mHandledChanged){
+    mHandledEvents.clear();
+    for (priv::StateIndex lState : mActiveAtomics){
+      mHandledEvents.unite(&lChart.mHandledEvents[lChart.mStates[lState].mDispatchRow * lWords]);
+    }
+    mHandledChanged = false;
+  }
+  return mHandledEvents.test(pEvent);
+}
+
+void ifsm::StateMachine::runMicrostep(priv::ResumePoint pFrom){
+  const StateChart& lChart = *mChart;
+
+  switch (pFrom.mPhase){
+  case priv::ResumePoint::DefaultEntry:
+    for (; pFrom.mItem < lChart.mDefaultEntry.size(); ++pFrom.mItem, pFrom.mCallback = 0){
+      const priv::StateImpl& lState = lChart.mStates[lChart.mDefaultEntry[pFrom.mItem]];
+      if (pFrom.mCallback == 0){
+        lState.markEntered(*this);
+      }
+      if (!lState.callOnEntry(*this, pFrom.mCallback)){
+        mResume = pFrom;
+        return;
+      }
+    }
+    if (lChart.mEventless != InvalidEvent){
+      mChangedAtomics = mActiveAtomics;
+    }
+    return;
+
+  case priv::ResumePoint::Exit:
+    for (; pFrom.mItem < mStatesToExit.size(); ++pFrom.mItem, pFrom.mCallback = 0){
+      const priv::StateImpl& lState = lChart.mStates[mStatesToExit[pFrom.mItem]];
+      if (pFrom.mCallback == 0){
+        lState.markExited(*this);
+      }
+      if (!lState.callOnExit(*this, pFrom.mCallback)){
+        mResume = pFrom;
+        return;
+      }
+    }
+    pFrom.mPhase = priv::ResumePoint::Action;
+    pFrom.mItem = 0;
+    //the actions follow the exits
+    IFSM_FALLTHROUGH;
+
+  case priv::ResumePoint::Action:
+    for (; pFrom.mItem < mEnabledTransitions.size(); ++pFrom.mItem){
+      priv::TransitionIndex lTransition = mEnabledTransitions[pFrom.mItem];
+      IFSM_TRACE(*this, beginAction(*this, lTransition));
+      lChart.mTransitions[lTransition].doAction(*this);
+      IFSM_TRACE(*this, endAction(*this, lTransition));
+      if (mAwaited){
+        ++pFrom.mItem;
+        mResume = pFrom;
+        return;
+      }
+    }
+    pFrom.mPhase = priv::ResumePoint::Entry;
+    pFrom.mItem = 0;
+    //the entries follow the actions, their precomputed sequences amended by the recorded history
+    mStatesToEnter.clear();
+    for (priv::TransitionIndex lTransition : mEnabledTransitions){
+      listEntryStates(lChart.mTransitions[lTransition], mStatesToEnter);
+    }
+    IFSM_FALLTHROUGH;
+
+  case priv::ResumePoint::Entry:
+    for (; pFrom.mItem < mStatesToEnter.size(); ++pFrom.mItem, pFrom.mCallback = 0){
+      const priv::StateImpl& lState = lChart.mStates[mStatesToEnter[pFrom.mItem]];
+      if (pFrom.mCallback == 0){
+        lState.markEntered(*this);
+      }
+      if (!lState.callOnEntry(*this, pFrom.mCallback)){
+        mResume = pFrom;
+        return;
+      }
+    }
+    trackChanges();
+  }
+}
+
+bool ifsm::StateMachine::resumeMicrostep(){
+  priv::TaskState* lTask = mAwaited;
+  if (!priv::taskDone(lTask)){
+    return false;
+  }
+
+  mAwaited = nullptr;
+  std::exception_ptr lError = lTask->mError;
+  priv::releaseTask(lTask);
+  if (lError){
+    //the rest of the microstep is dropped, the queued events stay
+    mInToplevelProcess = false;
+    std::rethrow_exception(lError);
+  }
+
+  runMicrostep(mResume);
+  return !mAwaited;
+}
+
+void ifsm::StateMachine::await(priv::TaskState* pTask){
+  if (!pTask){
+    return;
+  }
+
+  //a coroutine that completed without suspending is a synchronous callback
+  if (priv::taskDone(pTask)){
+    std::exception_ptr lError = pTask->mError;
+    priv::releaseTask(pTask);
+    if (lError){
+      std::rethrow_exception(lError);
+    }
+    return;
+  }
+
+  if (mDetachTasks){
+    priv::releaseTask(pTask);
+    return;
+  }
+
+  mAwaited = pTask;
+}
+
+void ifsm::StateMachine::abandonMicrostep(){
+  if (mAwaited){
+    priv::releaseTask(mAwaited);
+    mAwaited = nullptr;
+  }
+}
+
+bool ifsm::StateMachine::isSuspended() const{
+  return mAwaited != nullptr;
+}
+
+void ifsm::StateMachine::setEventLog(EventLog* pLog){
+  mEventLog = pLog;
+  if (mEventLog){
+    mEventLog->start(*this);
+  }
+}
+
+ifsm::EventLog* ifsm::StateMachine::eventLog() const{
+  return mEventLog;
+}
+
+void ifsm::StateMachine::setEventlessLimit(std::size_t pLimit){
+  mEventlessLimit = pLimit;
+}
+
+std::size_t ifsm::StateMachine::eventlessLimit() const{
+  return mEventlessLimit;
+}
+
+std::uint64_t ifsm::StateMachine::unhandledEvents() const{
+  return mUnhandledEvents;
+}
+
+ifsm::MemoryUsage ifsm::StateMachine::memoryUsage() const{
+  MemoryUsage lUsage = MemoryUsage();
+  if (mChart.use_count() == 1){
+    lUsage = mChart->memoryUsage();
+  }
+
+  lUsage.mStates += mActiveStates.wordCount() * sizeof(priv::Bitset::Word) + priv::vectorBytes(mActiveAtomics)
+    + priv::vectorBytes(mHistory) + priv::vectorBytes(mHistorySizes)
+    + priv::vectorBytes(mChangedAtomics) + priv::vectorBytes(mCheckedAtomics);
+  lUsage.mTransitions += priv::vectorBytes(mSelectedTransitions) + priv::vectorBytes(mEnabledTransitions)
+    + priv::vectorBytes(mPreemptedTransitions) + priv::vectorBytes(mStatesToExit) + priv::vectorBytes(mExitRanges)
+    + priv::vectorBytes(mStatesToEnter) + priv::vectorBytes(mEntryRanges) + priv::vectorBytes(mTimers)
+    + priv::vectorBytes(mRegionKeys) + priv::vectorBytes(mRegionRanges)
+    + mHandledEvents.wordCount() * sizeof(priv::Bitset::Word);
+  for (const priv::EventQueue& lQueue : mEvents){
+    lUsage.mQueues += lQueue.bufferBytes();
+  }
+  lUsage.mQueues += priv::vectorBytes(mParked);
+  lUsage.mOther += sizeof(StateMachine);
+  return lUsage;
+}
+
+void ifsm::StateMachine::replayEvent(EventId pEvent, const void* pPayload, const void* pPayloadType, bool pCallbacks){
+  if (pCallbacks){
+    //the events pushed by the callbacks are queued, and the Tasks they return aren't awaited
+    mInToplevelProcess = true;
+    mDetachTasks = true;
+    processEvent(pEvent, pPayload, pPayloadType);
+    mDetachTasks = false;
+    mInToplevelProcess = false;
+    discardEvents();
+    return;
+  }
+
+  const StateChart& lChart = *mChart;
+  mPayload = pPayload;
+  mPayloadType = pPayloadType;
+  selectEnabledTransitions(pEvent, mActiveAtomics);
+  mPayload = nullptr;
+  mPayloadType = nullptr;
+
+  mStatesToExit.clear();
+  for (priv::TransitionIndex lTransition : mEnabledTransitions){
+    if (!lChart.mTransitions[lTransition].isTargetless()){
+      listExitStates(lChart.mTransitions[lTransition], mStatesToExit);
+    }
+  }
+  recordHistory();
+  for (priv::StateIndex lState : mStatesToExit){
+    deactivate(lState);
+  }
+
+  mStatesToEnter.clear();
+  for (priv::TransitionIndex lTransition : mEnabledTransitions){
+    listEntryStates(lChart.mTransitions[lTransition], mStatesToEnter);
+  }
+  for (priv::StateIndex lState : mStatesToEnter){
+    activate(lState);
+  }
+}
+
+void ifsm::StateMachine::replayEntry(bool pEnter, bool pCallbacks){
+  if (pCallbacks){
+    mInToplevelProcess = true;
+    mDetachTasks = true;
+    if (pEnter){
+      enter();
+    }
+    else {
+      leave();
+    }
+    mDetachTasks = false;
+    mInToplevelProcess = false;
+    discardEvents();
+    return;
+  }
+
+  const StateChart& lChart = *mChart;
+  if (pEnter && !mIsActive){
+    for (priv::StateIndex lState : lChart.mDefaultEntry){
+      activate(lState);
+    }
+  }
+  else if (!pEnter){
+    for (std::size_t lIndex = mActiveStates.findPrevious(0, lChart.mStates.size());
+      lIndex != priv::Bitset::npos;
+      lIndex = mActiveStates.findPrevious(0, lIndex)){
+      deactivate(static_cast<priv::StateIndex>(lIndex));
+    }
+  }
+  mIsActive = pEnter;
+}
+
+void ifsm::StateMachine::discardEvents(){
+  for (std::size_t lPriority = nextQueue(); lPriority != priv::EventPriorityCount; lPriority = nextQueue()){
+    if (mEvents[lPriority].pop() & priv::PayloadFlag){
+      mEvents[lPriority].popPayload();
+    }
+  }
+  mParked.clear();
+  mChangedAtomics.clear();
+}
+
+std::size_t ifsm::StateMachine::groupRegions(){
+  const StateChart& lChart = *mChart;
+
+  mRegionKeys.clear();
+  for (std::size_t lPosition = 0; lPosition < mEnabledTransitions.size(); ++lPosition){
+    const priv::TransitionImpl& lTransition = lChart.mTransitions[mEnabledTransitions[lPosition]];
+    priv::StateIndex lRegion = lTransition.isTargetless() ? lTransition.mSource : lTransition.mDomain;
+    while (lChart.mStates[lRegion].mParent != priv::NoIndex && !lChart.mStates[lChart.mStates[lRegion].mParent].isParallel()){
+      lRegion = lChart.mStates[lRegion].mParent;
+    }
+    mRegionKeys.push_back(std::make_pair(lRegion, static_cast<std::uint32_t>(lPosition)));
+  }
+
+  //regions in document order : a region nested in the previous one follows it, within its subtree
+  std::sort(mRegionKeys.begin(), mRegionKeys.end());
+  std::uint32_t lGroup = 0;
+  priv::StateIndex lGroupEnd = 0;
+  for (std::pair<std::uint32_t, std::uint32_t>& lKey : mRegionKeys){
+    if (lKey.first >= lGroupEnd){
+      lGroupEnd = lChart.mStates[lKey.first].mSubtreeEnd;
+      ++lGroup;
+    }
+    lKey.first = lGroup - 1;
+  }
+  if (lGroup < 2){
+    return lGroup;
+  }
+
+  std::sort(mRegionKeys.begin(), mRegionKeys.end());
+  mRegionRanges.clear();
+  for (std::pair<std::uint32_t, std::uint32_t>& lKey : mRegionKeys){
+    lKey.second = mEnabledTransitions[lKey.second];
+  }
+  for (std::size_t lIndex = 0; lIndex < mRegionKeys.size(); ++lIndex){
+    mEnabledTransitions[lIndex] = mRegionKeys[lIndex].second;
+    if (lIndex + 1 == mRegionKeys.size() || mRegionKeys[lIndex + 1].first != mRegionKeys[lIndex].first){
+      mRegionRanges.push_back(static_cast<std::uint32_t>(lIndex + 1));
+    }
+  }
+  return lGroup;
+}
+
+void ifsm::StateMachine::processRegions(){
+  const StateChart& lChart = *mChart;
+  const std::size_t lCount = mRegionRanges.size();
+
+  //the regions are disjoint : each one exits and enters its own states, and runs the callbacks of its transitions in order
+  mStatesToExit.clear();
+  mExitRanges.clear();
+  for (priv::TransitionIndex lTransition : mEnabledTransitions){
+    if (!lChart.mTransitions[lTransition].isTargetless()){
+      listExitStates(lChart.mTransitions[lTransition], mStatesToExit);
+    }
+    mExitRanges.push_back(static_cast<std::uint32_t>(mStatesToExit.size()));
+  }
+  recordHistory();
+
+  //the tasks only capture this, so that std::function doesn't allocate.
+  //the callbacks run concurrently can't suspend the StateMachine
+  mDetachTasks = true;
+  try{
+    for (priv::StateIndex lState : mStatesToExit){
+      lChart.mStates[lState].markExited(*this);
+    }
+    //the transitions of region pRegion are [mRegionRanges[pRegion - 1], mRegionRanges[pRegion]), and their
+    //exited states are those up to the end of the exit range of their last transition
+    mRegionExecutor->forEach(lCount, [this](std::size_t pRegion){
+      const std::uint32_t lFirst = pRegion == 0 ? 0 : mRegionRanges[pRegion - 1];
+      for (std::uint32_t lExit = lFirst == 0 ? 0 : mExitRanges[lFirst - 1]; lExit < mExitRanges[mRegionRanges[pRegion] - 1]; ++lExit){
+        mChart->mStates[mStatesToExit[lExit]].callOnExit(*this);
+      }
+    });
+
+    mRegionExecutor->forEach(lCount, [this](std::size_t pRegion){
+      for (std::uint32_t lIndex = pRegion == 0 ? 0 : mRegionRanges[pRegion - 1]; lIndex < mRegionRanges[pRegion]; ++lIndex){
+        IFSM_TRACE(*this, beginAction(*this, mEnabledTransitions[lIndex]));
+        mChart->mTransitions[mEnabledTransitions[lIndex]].doAction(*this);
+        IFSM_TRACE(*this, endAction(*this, mEnabledTransitions[lIndex]));
+      }
+    });
+
+    mStatesToEnter.clear();
+    mEntryRanges.clear();
+    for (priv::TransitionIndex lTransition : mEnabledTransitions){
+      listEntryStates(lChart.mTransitions[lTransition], mStatesToEnter);
+      mEntryRanges.push_back(static_cast<std::uint32_t>(mStatesToEnter.size()));
+    }
+    for (priv::StateIndex lState : mStatesToEnter){
+      lChart.mStates[lState].markEntered(*this);
+    }
+    mRegionExecutor->forEach(lCount, [this](std::size_t pRegion){
+      const std::uint32_t lFirst = pRegion == 0 ? 0 : mRegionRanges[pRegion - 1];
+      for (std::uint32_t lEntry = lFirst == 0 ? 0 : mEntryRanges[lFirst - 1]; lEntry < mEntryRanges[mRegionRanges[pRegion] - 1]; ++lEntry){
+        mChart->mStates[mStatesToEnter[lEntry]].callOnEntry(*this);
+      }
+    });
+  }
+  catch (...){
+    //forEach rethrows what a callback threw : later Tasks may suspend the StateMachine again
+    mDetachTasks = false;
+    throw;
+  }
+  mDetachTasks = false;
+  trackChanges();
+}
+
+void ifsm::StateMachine::selectEnabledTransitions(EventId pEvent, const std::vector<priv::StateIndex>& pAtomics){
+  if (mChart->mSingleRegion){
+    mEnabledTransitions.clear();
+    if (!pAtomics.empty()){
+      selectLeafTransitions(pEvent, pAtomics.front());
+    }
+    return;
+  }
+
+  selectTransitions(pEvent, pAtomics, mSelectedTransitions);
+  removeConflicts(mSelectedTransitions, mEnabledTransitions);
+}
+
+void ifsm::StateMachine::selectLeafTransitions(EventId pEvent, priv::StateIndex pLeaf){
+  const StateChart& lChart = *mChart;
+  if (pEvent >= lChart.mEventIds.size()){
+    return;
+  }
+
+  const std::uint32_t* lOffsets = &lChart.mDispatchOffsets[lChart.mStates[pLeaf].mDispatchRow * (lChart.mEventIds.size() + 1) + pEvent];
+  priv::StateIndex lMatchedSource = priv::NoIndex;
+  std::size_t lTargeted = mEnabledTransitions.size();
+
+  for (std::uint32_t lCandidate = lOffsets[0]; lCandidate < lOffsets[1]; ++lCandidate){
+    priv::TransitionIndex lTransition = lChart.mDispatchTransitions[lCandidate];
+    const priv::TransitionImpl& lImpl = lChart.mTransitions[lTransition];
+    if (lMatchedSource != priv::NoIndex && lImpl.mSource != lMatchedSource){
+      break;
+    }
+    if (!lImpl.test(*this)){
+      continue;
+    }
+    lMatchedSource = lImpl.mSource;
+
+    //the targeted transitions of a source all conflict : a later one preempts the kept one
+    //when it targets a descendant of its target
+    if (!lImpl.isTargetless()){
+      if (lTargeted != mEnabledTransitions.size()){
+        if (!lChart.mStates[lChart.mTransitions[mEnabledTransitions[lTargeted]].mTarget].contains(lImpl.mTarget)){
+          continue;
+        }
+        mEnabledTransitions.erase(mEnabledTransitions.begin() + lTargeted);
+      }
+      lTargeted = mEnabledTransitions.size();
+    }
+    mEnabledTransitions.push_back(lTransition);
+  }
+}
+
+void ifsm::StateMachine::selectTransitions(EventId pEvent, const std::vector<priv::StateIndex>& pAtomics, std::vector<priv::TransitionIndex>& pTransitions) {
+  const StateChart& lChart = *mChart;
+  pTransitions.clear();
+
+  if (pEvent >= lChart.mEventIds.size()){
+    return;
+  }
+
+  //look for valid transitions in the dispatch table of each atomic state.
+  //candidates are sorted from the atomic state up to the root : stop after the
+  //first state that has a valid transition
+  const std::size_t lRowSize = lChart.mEventIds.size() + 1;
+  for (priv::StateIndex lState : pAtomics){
+    const std::uint32_t* lOffsets = &lChart.mDispatchOffsets[lChart.mStates[lState].mDispatchRow * lRowSize + pEvent];
+    priv::StateIndex lMatchedSource = priv::NoIndex;
+
+    for (std::uint32_t lCandidate = lOffsets[0]; lCandidate < lOffsets[1]; ++lCandidate){
+      priv::TransitionIndex lTransition = lChart.mDispatchTransitions[lCandidate];
+      if (lMatchedSource != priv::NoIndex && lChart.mTransitions[lTransition].mSource != lMatchedSource){
+        break;
+      }
+
+      //transitions of a parallel ancestor are candidates for each of its active atomic descendants
+      if (std::find(pTransitions.begin(), pTransitions.end(), lTransition) != pTransitions.end()){
+        lMatchedSource = lChart.mTransitions[lTransition].mSource;
+      }
+      else if (lChart.mTransitions[lTransition].test(*this)){
+        pTransitions.push_back(lTransition);
+        lMatchedSource = lChart.mTransitions[lTransition].mSource;
+      }
+    }
+  }
+}
+
+void ifsm::StateMachine::removeConflicts(const std::vector<priv::TransitionIndex>& pTransitions, std::vector<priv::TransitionIndex>& pFiltered) {
+  const StateChart& lChart = *mChart;
+  std::vector<priv::TransitionIndex>& lFiltered = pFiltered;
+  std::vector<priv::TransitionIndex>& lToRemove = mPreemptedTransitions;
+  bool lCheckPreempted = false;
+
+  lFiltered.clear();
+
+  //for each transition to check
+  for (auto lTransitionToCheck : pTransitions){
+    lCheckPreempted = false;
+    lToRemove.clear();
+
+    const priv::TransitionImpl& lToCheck = lChart.mTransitions[lTransitionToCheck];
+
+    if (lFiltered.empty() || lToCheck.isTargetless()){
+      lFiltered.push_back(lTransitionToCheck);
+      continue;
+    }
+
+    //check against already filtered transitions
+    for (auto lCheckAgainst : lFiltered){
+
+      const priv::TransitionImpl& lAgainst = lChart.mTransitions[lCheckAgainst];
+
+      if (lAgainst.isTargetless()){
+        continue;
+      }
+
+      if (conflict(lToCheck, lAgainst)){
+        if (lChart.mStates[lAgainst.mTarget].contains(lToCheck.mTarget)){
+          lToRemove.push_back(lCheckAgainst);
+        }
+        else {
+          lCheckPreempted = true;
+          break;
+        }
+      }
+    }
+
+    if (!lCheckPreempted){
+      for (auto lToRemoveTsn : lToRemove){
+        auto lDel = std::remove(std::begin(lFiltered), std::end(lFiltered), lToRemoveTsn);
+        lFiltered.erase(lDel, std::end(lFiltered));
+      }
+      lFiltered.push_back(lTransitionToCheck);
+    }
+  }
+}
+
+void ifsm::StateMachine::listExitStates(const priv::TransitionImpl& pTransition, std::vector<priv::StateIndex>& pExitStates){
+  const priv::StateImpl& lDomain = mChart->mStates[pTransition.mDomain];
+
+  if (mChart->mSingleRegion){
+    for (priv::StateIndex lState = mActiveAtomics.front(); lState != lDomain.mOrdinal; lState = mChart->mStates[lState].mParent){
+      pExitStates.push_back(lState);
+    }
+    return;
+  }
+
+  //the descendants of the domain are the ordinals following it, up to the end of its subtree
+  for (std::size_t lIndex = mActiveStates.findPrevious(lDomain.mOrdinal + 1, lDomain.mSubtreeEnd);
+    lIndex != priv::Bitset::npos;
+    lIndex = mActiveStates.findPrevious(lDomain.mOrdinal + 1, lIndex)){
+    pExitStates.push_back(static_cast<priv::StateIndex>(lIndex));
+  }
+}
+
+void ifsm::StateMachine::listEntryStates(const priv::TransitionImpl& pTransition, std::vector<priv::StateIndex>& pEntryStates) const{
+  const StateChart& lChart = *mChart;
+  const priv::StateIndex* lEntry = lChart.mEntrySequences.data() + pTransition.mEntryBegin;
+  const priv::StateIndex* lEnd = lChart.mEntrySequences.data() + pTransition.mEntryEnd;
+  if (lChart.mHistorySlots == 0){
+    pEntryStates.insert(pEntryStates.end(), lEntry, lEnd);
+    return;
+  }
+
+  while (lEntry != lEnd){
+    const priv::StateImpl& lState = lChart.mStates[*lEntry++];
+    pEntryStates.push_back(lState.mOrdinal);
+
+    //the ancestors of the target are entered towards it, the other states by default.
+    //a history state is a subtree of the sequence, replaced by the recorded one
+    if (historySize(lState) == 0 || (lState.mOrdinal != pTransition.mTarget && lState.contains(pTransition.mTarget))){
+      continue;
+    }
+    while (lEntry != lEnd && lState.contains(*lEntry)){
+      ++lEntry;
+    }
+    listHistoryStates(lState, pEntryStates);
+  }
+}
+
+void ifsm::StateMachine::listHistoryStates(const priv::StateImpl& pState, std::vector<priv::StateIndex>& pEntryStates) const{
+  const priv::StateIndex* lRecorded = mHistory.data() + pState.mHistoryBegin;
+  if (pState.mHistory == priv::ShallowHistory){
+    listRestoredStates(lRecorded[0], pEntryStates);
+    return;
+  }
+
+  //the recorded atomic states and their ancestors up to pState, whose paths share their common ancestors
+  const StateChart& lChart = *mChart;
+  const std::size_t lBegin = pEntryStates.size();
+  for (const priv::StateIndex* lAtomic = lRecorded; lAtomic != lRecorded + historySize(pState); ++lAtomic){
+    for (priv::StateIndex lState = *lAtomic; lState != pState.mOrdinal; lState = lChart.mStates[lState].mParent){
+      pEntryStates.push_back(lState);
+    }
+  }
+  std::sort(pEntryStates.begin() + lBegin, pEntryStates.end());
+  pEntryStates.erase(std::unique(pEntryStates.begin() + lBegin, pEntryStates.end()), pEntryStates.end());
+}
+
+void ifsm::StateMachine::listRestoredStates(priv::StateIndex pState, std::vector<priv::StateIndex>& pEntryStates) const{
+  const StateChart& lChart = *mChart;
+  const priv::StateImpl& lState = lChart.mStates[pState];
+  pEntryStates.push_back(pState);
+
+  if (historySize(lState) != 0){
+    listHistoryStates(lState, pEntryStates);
+  }
+  else if (lState.isParallel()){
+    for (priv::StateIndex lChild = pState + 1; lChild < lState.mSubtreeEnd; lChild = lChart.mStates[lChild].mSubtreeEnd){
+      listRestoredStates(lChild, pEntryStates);
+    }
+  }
+  else if (priv::NoIndex != lState.mInitial){
+    listRestoredStates(lState.mInitial, pEntryStates);
+  }
+}
+
+std::uint32_t ifsm::StateMachine::historySize(const priv::StateImpl& pState) const{
+  return pState.mHistorySlot == priv::NoIndex ? 0 : mHistorySizes[pState.mHistorySlot];
+}
+
+void ifsm::StateMachine::recordHistory(){
+  const StateChart& lChart = *mChart;
+  if (lChart.mHistorySlots == 0){
+    return;
+  }
+
+  for (priv::StateIndex lIndex : mStatesToExit){
+    const priv::StateImpl& lState = lChart.mStates[lIndex];
+    if (lState.mHistorySlot == priv::NoIndex){
+      continue;
+    }
+
+    priv::StateIndex* lRecorded = mHistory.data() + lState.mHistoryBegin;
+    if (lState.mHistory == priv::ShallowHistory){
+      //children follow their parent : the first active descendant is the active child
+      lRecorded[0] = static_cast<priv::StateIndex>(mActiveStates.findNext(lIndex + 1));
+      mHistorySizes[lState.mHistorySlot] = 1;
+    }
+    else {
+      auto lBegin = std::lower_bound(mActiveAtomics.begin(), mActiveAtomics.end(), lIndex);
+      auto lEnd = std::lower_bound(lBegin, mActiveAtomics.end(), lState.mSubtreeEnd);
+      std::copy(lBegin, lEnd, lRecorded);
+      mHistorySizes[lState.mHistorySlot] = static_cast<std::uint32_t>(lEnd - lBegin);
+    }
+  }
+}
+
+void ifsm::StateChart::listEntryStates(const priv::TransitionImpl& pTransition, std::vector<priv::StateIndex>& pEntryStates) const{
+  if (pTransition.isTargetless()){
+    return;
+  }
+
+  std::size_t lBegin = pEntryStates.size();
+
+  //children of target should be entered after target
+  listDefaultEntryStates(pTransition.mTarget, pEntryStates);
+
+  //ancestors of target should be entered before target, up to the domain.
+  //when an ancestor is parallel, its other children must be entered as well
+  priv::StateIndex lChild = pTransition.mTarget;
+  for (priv::StateIndex lAncestor = mStates[lChild].mParent; lAncestor != priv::NoIndex; lChild = lAncestor, lAncestor = mStates[lAncestor].mParent){
+    const priv::StateImpl& lAncestorState = mStates[lAncestor];
+    if (lAncestorState.isParallel()){
+      for (priv::StateIndex lSibling = lAncestor + 1; lSibling < lAncestorState.mSubtreeEnd; lSibling = mStates[lSibling].mSubtreeEnd){
+        if (lSibling != lChild){
+          listDefaultEntryStates(lSibling, pEntryStates);
+        }
+      }
+    }
+
+    if (lAncestor == pTransition.mDomain){
+      break;
+    }
+    pEntryStates.push_back(lAncestor);
+  }
+
+  std::sort(pEntryStates.begin() + lBegin, pEntryStates.end());
+}
+
+void ifsm::StateChart::listDefaultEntryStates(priv::StateIndex pState, std::vector<priv::StateIndex>& pEntryStates) const{
+  const priv::StateImpl& lState = mStates[pState];
+  pEntryStates.push_back(pState);
+
+  if (lState.isParallel()){
+    for (priv::StateIndex lChild = pState + 1; lChild < lState.mSubtreeEnd; lChild = mStates[lChild].mSubtreeEnd){
+      listDefaultEntryStates(lChild, pEntryStates);
+    }
+  }
+  else if (priv::NoIndex != lState.mInitial){
+    listDefaultEntryStates(lState.mInitial, pEntryStates);
+  }
+}
+
+bool ifsm::StateMachine::conflict(const priv::TransitionImpl& pLhs, const priv::TransitionImpl& pRhs) const{
+  const StateChart& lChart = *mChart;
+  //the exit set of a transition is the active part of the subtree of its domain :
+  //two subtrees either are disjoint or one contains the other
+  return lChart.mStates[pLhs.mDomain].contains(pRhs.mDomain) || lChart.mStates[pRhs.mDomain].contains(pLhs.mDomain);
+}
+
+ifsm::priv::StateIndex ifsm::StateChart::getTransitionDomain(const priv::TransitionImpl& pTransition) const{
+  if (pTransition.isTargetless()){
+    return pTransition.mSource;
+  }
+  else {
+    return findLeastCommonAncestor(pTransition.mSource, pTransition.mTarget);
+  }
+}
+
+ifsm::priv::StateIndex ifsm::StateChart::findLeastCommonAncestor(priv::StateIndex pLhs, priv::StateIndex pRhs) const{
+  for (priv::StateIndex lAncestor = mStates[pLhs].mParent; lAncestor != priv::NoIndex; lAncestor = mStates[lAncestor].mParent){
+    if (lAncestor != pRhs && mStates[lAncestor].contains(pRhs)){
+      return lAncestor;
+    }
+  }
+
+  return 0;
+}
+
+void ifsm::StateMachine::activate(priv::StateIndex pState){
+  mActiveStates.set(pState);
+
+  if (mChart->mStates[pState].isAtomic()){
+    auto lPosition = std::lower_bound(mActiveAtomics.begin(), mActiveAtomics.end(), pState);
+    mActiveAtomics.insert(lPosition, pState);
+    mHandledChanged = true;
+  }
+}
+
+void ifsm::StateMachine::deactivate(priv::StateIndex pState){
+  mActiveStates.reset(pState);
+
+  if (!mParked.empty()){
+    releaseDeferredEvents(pState);
+  }
+
+  if (mChart->mStates[pState].isAtomic()){
+    auto lDel = std::remove(mActiveAtomics.begin(), mActiveAtomics.end(), pState);
+    mActiveAtomics.erase(lDel, mActiveAtomics.end());
+    mHandledChanged = true;
+  }
+}
+
+/**************************************************/
+/*
+Tracing : a StateMachineObserver is called at each step of event processing
+when instantFSM.h is compiled with INSTANTFSM_TRACING.
+States and transitions are identified by their ordinals, see StateChart::stateName.
+
+StatsCollector is an observer that counts fired transitions, accumulates the dwell time
+of each state and keeps a latency histogram of each callback. It observes a single StateMachine.
+
+  StatsCollector myStats(*myMachine.chart());
+  myMachine.setObserver(&myStats);
+  myStats.fireCount(myTransition), myStats.dwellTime(myState), myStats.entryLatency(myState)...
+*/
+
+namespace ifsm{
+  /*
+  histogram of durations in power of two buckets :
+  bucket 0 counts durations under 2ns, bucket i those in [2^i, 2^(i+1)) ns, the last one all longer durations
+  */
+  class LatencyHistogram{
+  public:
+    static const std::size_t BucketCount = 32;
+
+  public:
+    inline LatencyHistogram();
+
+    inline void record(std::chrono::nanoseconds pDuration);
+
+    inline std::uint64_t count() const;
+
+    inline std::chrono::nanoseconds total() const;
+
+    inline std::uint64_t bucket(std::size_t pIndex) const;
+
+  private:
+    std::uint64_t mBuckets[BucketCount];
+    std::uint64_t mCount;
+    std::chrono::nanoseconds mTotal;
+  };
+
+  class StatsCollector : public StateMachineObserver{
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+  public:
+    inline explicit StatsCollector(const StateChart& pChart);
+
+    inline std::uint64_t eventCount() const;
+
+    inline std::uint64_t fireCount(std::size_t pTransition) const;
+
+    /*
+    number of times the state was entered, and time spent in it over all the visits
+    that are over. the current visit of an active state isn't counted
+    */
+    inline std::uint64_t visitCount(std::size_t pState) const;
+
+    inline std::chrono::nanoseconds dwellTime(std::size_t pState) const;
+
+    //latency of the OnEntry and OnExit callbacks of a state, taken together
+    inline const LatencyHistogram& entryLatency(std::size_t pState) const;
+
+    inline const LatencyHistogram& exitLatency(std::size_t pState) const;
+
+    inline const LatencyHistogram& actionLatency(std::size_t pTransition) const;
+
+    //forget everything recorded so far
+    inline void reset();
+
+  public:
+    inline virtual void onEvent(const StateMachine& pMachine, EventId pEvent);
+    inline virtual void beginEnter(const StateMachine& pMachine, std::size_t pState);
+    inline virtual void endEnter(const StateMachine& pMachine, std::size_t pState);
+    inline virtual void beginExit(const StateMachine& pMachine, std::size_t pState);
+    inline virtual void endExit(const StateMachine& pMachine, std::size_t pState);
+    inline virtual void beginAction(const StateMachine& pMachine, std::size_t pTransition);
+    inline virtual void endAction(const StateMachine& pMachine, std::size_t pTransition);
+
+  private:
+    struct StateStats{
+      std::uint64_t mVisits;
+      Clock::time_point mEnteredAt;
+      std::chrono::nanoseconds mDwellTime;
+      LatencyHistogram mEntryLatency;
+      LatencyHistogram mExitLatency;
+    };
+
+    struct TransitionStats{
+      std::uint64_t mFired;
+      LatencyHistogram mActionLatency;
+    };
+
+  private:
+    std::vector<StateStats> mStates;
+    std::vector<TransitionStats> mTransitions;
+    std::uint64_t mEvents;
+    //start of the callbacks being measured : they don't nest
+    Clock::time_point mCallbackStart;
+  };
+}
+
+#if defined(INSTANTFSM_TRACING)
+void ifsm::StateMachine::setObserver(StateMachineObserver* pObserver){
+  mObserver = pObserver;
+}
+
+ifsm::StateMachineObserver* ifsm::StateMachine::observer() const{
+  return mObserver;
+}
+#endif
+
+ifsm::LatencyHistogram::LatencyHistogram()
+: mCount(0)
+, mTotal(0){
+  std::fill(mBuckets, mBuckets + BucketCount, 0);
+}
+
+void ifsm::LatencyHistogram::record(std::chrono::nanoseconds pDuration){
+  std::uint64_t lNanoseconds = pDuration.count() > 0 ? static_cast<std::uint64_t>(pDuration.count()) : 0;
+  std::size_t lBucket = 0;
+  while (lNanoseconds >>= 1){
+    ++lBucket;
+  }
+
+  ++mBuckets[std::min<std::size_t>(lBucket, BucketCount - 1)];
+  ++mCount;
+  mTotal += pDuration;
+}
+
+std::uint64_t ifsm::LatencyHistogram::count() const{
+  return mCount;
+}
+
+std::chrono::nanoseconds ifsm::LatencyHistogram::total() const{
+  return mTotal;
+}
+
+std::uint64_t ifsm::LatencyHistogram::bucket(std::size_t pIndex) const{
+  return mBuckets[pIndex];
+}
+
+ifsm::StatsCollector::StatsCollector(const StateChart& pChart)
+: mStates(pChart.stateCount())
+, mTransitions(pChart.transitionCount())
+, mEvents(0){
+  reset();
+}
+
+std::uint64_t ifsm::StatsCollector::eventCount() const{
+  return mEvents;
+}
+
+std::uint64_t ifsm::StatsCollector::fireCount(std::size_t pTransition) const{
+  return mTransitions[pTransition].mFired;
+}
+
+std::uint64_t ifsm::StatsCollector::visitCount(std::size_t pState) const{
+  return mStates[pState].mVisits;
+}
+
+std::chrono::nanoseconds ifsm::StatsCollector::dwellTime(std::size_t pState) const{
+  return mStates[pState].mDwellTime;
+}
+
+const ifsm::LatencyHistogram& ifsm::StatsCollector::entryLatency(std::size_t pState) const{
+  return mStates[pState].mEntryLatency;
+}
+
+const ifsm::LatencyHistogram& ifsm::StatsCollector::exitLatency(std::size_t pState) const{
+  return mStates[pState].mExitLatency;
+}
+
+const ifsm::LatencyHistogram& ifsm::StatsCollector::actionLatency(std::size_t pTransition) const{
+  return mTransitions[pTransition].mActionLatency;
+}
+
+void ifsm::StatsCollector::reset(){
+  for (StateStats& lState : mStates){
+    lState.mVisits = 0;
+    lState.mDwellTime = std::chrono::nanoseconds(0);
+    lState.mEntryLatency = LatencyHistogram();
+    lState.mExitLatency = LatencyHistogram();
+  }
+  for (TransitionStats& lTransition : mTransitions){
+    lTransition.mFired = 0;
+    lTransition.mActionLatency = LatencyHistogram();
+  }
+  mEvents = 0;
+}
+
+void ifsm::StatsCollector::onEvent(const StateMachine& /*pMachine*/, EventId /*pEvent*/){
+  ++mEvents;
+}
+
+void ifsm::StatsCollector::beginEnter(const StateMachine& /*pMachine*/, std::size_t /*pState*/){
+  mCallbackStart = Clock::now();
+}
+
+void ifsm::StatsCollector::endEnter(const StateMachine& /*pMachine*/, std::size_t pState){
+  StateStats& lState = mStates[pState];
+  lState.mEnteredAt = Clock::now();
+  lState.mEntryLatency.record(lState.mEnteredAt - mCallbackStart);
+  ++lState.mVisits;
+}
+
+void ifsm::StatsCollector::beginExit(const StateMachine& /*pMachine*/, std::size_t pState){
+  StateStats& lState = mStates[pState];
+  mCallbackStart = Clock::now();
+  //a state restored from a snapshot wasn't entered through endEnter
+  if (lState.mVisits != 0){
+    lState.mDwellTime += mCallbackStart - lState.mEnteredAt;
+  }
+}
+
+void ifsm::StatsCollector::endExit(const StateMachine& /*pMachine*/, std::size_t pState){
+  mStates[pState].mExitLatency.record(Clock::now() - mCallbackStart);
+}
+
+void ifsm::StatsCollector::beginAction(const StateMachine& /*pMachine*/, std::size_t pTransition){
+  ++mTransitions[pTransition].mFired;
+  mCallbackStart = Clock::now();
+}
+
+void ifsm::StatsCollector::endAction(const StateMachine& /*pMachine*/, std::size_t pTransition){
+  mTransitions[pTransition].mActionLatency.record(Clock::now() - mCallbackStart);
+}
+
+/**************************************************/
+/*
+TimerWheel : hierarchical timing wheel running the After transitions of any number of StateMachine.
+
+Time is counted in ticks of the resolution of the wheel. Timers due within 256 ticks are stored in
+the slots of the first level, those due later in one of the 3 coarser levels, of 256 slots each, and
+move down to finer levels as time advances. Arming and canceling a timer are O(1), and advancing
+the wheel costs O(1) per elapsed tick besides the timers that fire.
+
+Timers are armed and canceled under the lock of the wheel, so machines processed on different threads,
+such as those of a StateMachineExecutor, may share a wheel. advance must be called from one thread at
+a time, and fires the timers without holding the lock : a machine attached to a StateMachineExecutor
+receives the event of its timer in its pushEventAsync mailbox and is scheduled on the executor, any
+other machine processes it at once with pushEvent, so it must be processed by the thread calling advance.
+Delays are counted from the last call to advance.
+
+  TimerWheel myWheel(std::chrono::milliseconds(1));
+  myMachine.setTimerWheel(myWheel);
+  myWheel.advance() : from the event loop of the thread
+*/
+
+namespace ifsm{
+  class TimerWheel{
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const std::size_t SlotBits = 8;
+    static const std::size_t SlotCount = std::size_t(1) << SlotBits;
+    static const std::size_t LevelCount = 4;
+
+  public:
+    inline explicit TimerWheel(std::chrono::nanoseconds pResolution = std::chrono::milliseconds(1), Clock::time_point pStart = Clock::now());
+
+    /*
+    wheel used by the StateMachine instances that weren't given one
+    */
+    inline static TimerWheel& global();
+
+    /*
+    fire the timers due until pNow, returns the number of timers fired
+    */
+    inline std::size_t advance(Clock::time_point pNow);
+
+    inline std::size_t advance();
+
+    inline std::size_t pendingCount() const;
+
+    inline std::chrono::nanoseconds resolution() const;
+
+  private:
+    friend class StateMachine;
+
+    TimerWheel(const TimerWheel&);
+    TimerWheel& operator=(const TimerWheel&);
+
+    struct Node{
+      StateMachine* mMachine;
+      std::uint64_t mExpiry;
+      std::uint32_t mTimer;
+      std::uint32_t mGeneration;
+      std::uint32_t mPrevious;
+      std::uint32_t mNext;
+      std::uint32_t mList;
+    };
+
+    //list of the timers being fired by advance
+    static const std::uint32_t FiringList = static_cast<std::uint32_t>(LevelCount * SlotCount);
+    static const std::uint32_t NoList = FiringList + 1;
+
+    /*
+    arm a timer calling pMachine.fireTimer(pTimer) after pDelay
+    */
+    inline priv::TimerId schedule(StateMachine& pMachine, std::uint32_t pTimer, std::chrono::nanoseconds pDelay);
+
+    inline void cancel(priv::TimerId pTimer);
+
+    //store the node in the slot matching its expiry
+    inline void insert(std::uint32_t pNode);
+
+    inline void link(std::uint32_t pNode, std::uint32_t pList);
+
+    inline void unlink(std::uint32_t pNode);
+
+    inline void release(std::uint32_t pNode);
+
+    //move the timers of a slot of a coarse level to finer levels
+    inline void cascade(std::size_t pLevel);
+
+    //fire the timers of the list, released by pLock while each machine is called
+    inline std::size_t fire(std::uint32_t pList, std::unique_lock<std::mutex>& pLock);
+
+  private:
+    //guards every member below
+    mutable std::mutex mMutex;
+    std::chrono::nanoseconds mResolution;
+    Clock::time_point mStart;
+    std::uint64_t mTick;
+    std::vector<Node> mNodes;
+    //first node of each slot, then of the firing list
+    std::vector<std::uint32_t> mLists;
+    std::uint32_t mFreeNodes;
+    std::size_t mPendingCount;
+  };
+}
+
+ifsm::TimerWheel::TimerWheel(std::chrono::nanoseconds pResolution, Clock::time_point pStart)
+: mResolution(pResolution)
+, mStart(pStart)
+, mTick(0)
+, mLists(LevelCount * SlotCount + 1, priv::NoIndex)
+, mFreeNodes(priv::NoIndex)
+, mPendingCount(0){
+
+}
+
+ifsm::TimerWheel& ifsm::TimerWheel::global(){
+  static TimerWheel lWheel;
+  return lWheel;
+}
+
+std::size_t ifsm::TimerWheel::advance(){
+  return advance(Clock::now());
+}
+
+std::size_t ifsm::TimerWheel::advance(Clock::time_point pNow){
+  std::unique_lock<std::mutex> lLock(mMutex);
+  if (pNow <= mStart){
+    return 0;
+  }
+
+  const std::uint64_t lTarget = static_cast<std::uint64_t>((pNow - mStart) / mResolution);
+  std::size_t lFired = 0;
+
+  while (mTick < lTarget){
+    //nothing to fire until the target
+    if (mPendingCount == 0){
+      mTick = lTarget;
+      break;
+    }
+
+    ++mTick;
+
+    //when a level wraps around, a slot of the next level is due
+    for (std::size_t lLevel = 1; lLevel < LevelCount && (mTick & (((std::uint64_t(1) << (SlotBits * lLevel))) - 1)) == 0; ++lLevel){
+      cascade(lLevel);
+    }
+
+    const std::uint32_t lSlot = static_cast<std::uint32_t>(mTick & (SlotCount - 1));
+    if (mLists[lSlot] != priv::NoIndex){
+      //detach the slot first : fired transitions may arm timers in it
+      std::uint32_t lNode = mLists[lSlot];
+      while (lNode != priv::NoIndex){
+        std::uint32_t lNext = mNodes[lNode].mNext;
+        unlink(lNode);
+        link(lNode, FiringList);
+        lNode = lNext;
+      }
+      lFired += fire(FiringList, lLock);
+    }
+  }
+
+  return lFired;
+}
+
+std::size_t ifsm::TimerWheel::pendingCount() const{
+  std::lock_guard<std::mutex> lLock(mMutex);
+  return mPendingCount;
+}
+
+std::chrono::nanoseconds ifsm::TimerWheel::resolution() const{
+  return mResolution;
+}
+
+ifsm::priv::TimerId ifsm::TimerWheel::schedule(StateMachine& pMachine, std::uint32_t pTimer, std::chrono::nanoseconds pDelay){
+  std::lock_guard<std::mutex> lLock(mMutex);
+  std::uint32_t lNode = mFreeNodes;
+  if (lNode == priv::NoIndex){
+    lNode = static_cast<std::uint32_t>(mNodes.size());
+    Node lNew = { nullptr, 0, 0, 1, priv::NoIndex, priv::NoIndex, NoList };
+    mNodes.push_back(lNew);
+  }
+  else {
+    mFreeNodes = mNodes[lNode].mNext;
+  }
+
+  //a timer fires at the earliest on the next tick
+  std::uint64_t lTicks = static_cast<std::uint64_t>((pDelay + mResolution - std::chrono::nanoseconds(1)) / mResolution);
+  Node& lTimer = mNodes[lNode];
+  lTimer.mMachine = &pMachine;
+  lTimer.mTimer = pTimer;
+  lTimer.mExpiry = mTick + std::max<std::uint64_t>(lTicks, 1);
+  insert(lNode);
+  ++mPendingCount;
+
+  return (static_cast<priv::TimerId>(lTimer.mGeneration) << 32) | lNode;
+}
+
+void ifsm::TimerWheel::cancel(priv::TimerId pTimer){
+  std::lock_guard<std::mutex> lLock(mMutex);
+  const std::uint32_t lNode = static_cast<std::uint32_t>(pTimer);
+  if (lNode >= mNodes.size() || mNodes[lNode].mGeneration != static_cast<std::uint32_t>(pTimer >> 32) || mNodes[lNode].mList == NoList){
+    return;
+  }
+
+  unlink(lNode);
+  release(lNode);
+  --mPendingCount;
+}
+
+void ifsm::TimerWheel::insert(std::uint32_t pNode){
+  const std::uint64_t lDelta = mNodes[pNode].mExpiry - mTick;
+
+  std::size_t lLevel = 0;
+  while (lLevel + 1 < LevelCount && lDelta >= (std::uint64_t(1) << (SlotBits * (lLevel + 1)))){
+    ++lLevel;
+  }
+
+  //timers beyond the range of the wheel wait in the last slot of the coarsest level,
+  //and are stored again when it is due
+  std::uint64_t lExpiry = std::min(mNodes[pNode].mExpiry, mTick + (std::uint64_t(1) << (SlotBits * LevelCount)) - 1);
+  std::uint32_t lSlot = static_cast<std::uint32_t>((lExpiry >> (SlotBits * lLevel)) & (SlotCount - 1));
+  link(pNode, static_cast<std::uint32_t>(lLevel * SlotCount + lSlot));
+}
+
+void ifsm::TimerWheel::link(std::uint32_t pNode, std::uint32_t pList){
+  Node& lNode = mNodes[pNode];
+  lNode.mList = pList;
+  lNode.mPrevious = priv::NoIndex;
+  lNode.mNext = mLists[pList];
+  if (lNode.mNext != priv::NoIndex){
+    mNodes[lNode.mNext].mPrevious = pNode;
+  }
+  mLists[pList] = pNode;
+}
+
+void ifsm::TimerWheel::unlink(std::uint32_t pNode){
+  Node& lNode = mNodes[pNode];
+  if (lNode.mPrevious != priv::NoIndex){
+    mNodes[lNode.mPrevious].mNext = lNode.mNext;
+  }
+  else {
+    mLists[lNode.mList] = lNode.mNext;
+  }
+  if (lNode.mNext != priv::NoIndex){
+    mNodes[lNode.mNext].mPrevious = lNode.mPrevious;
+  }
+  lNode.mList = NoList;
+}
+
+void ifsm::TimerWheel::release(std::uint32_t pNode){
+  Node& lNode = mNodes[pNode];
+  //outdate the TimerId handed to the machine
+  ++lNode.mGeneration;
+  lNode.mMachine = nullptr;
+  lNode.mNext = mFreeNodes;
+  mFreeNodes = pNode;
+}
+
+void ifsm::TimerWheel::cascade(std::size_t pLevel){
+  const std::uint32_t lList = static_cast<std::uint32_t>(pLevel * SlotCount + ((mTick >> (SlotBits * pLevel)) & (SlotCount - 1)));
+  std::uint32_t lNode = mLists[lList];
+  mLists[lList] = priv::NoIndex;
+
+  while (lNode != priv::NoIndex){
+    std::uint32_t lNext = mNodes[lNode].mNext;
+    insert(lNode);
+    lNode = lNext;
+  }
+}
+
+std::size_t ifsm::TimerWheel::fire(std::uint32_t pList, std::unique_lock<std::mutex>& pLock){
+  std::size_t lFired = 0;
+
+  //fired transitions, and other threads while the lock is released, may cancel the other timers of the list
+  while (mLists[pList] != priv::NoIndex){
+    const std::uint32_t lNode = mLists[pList];
+    StateMachine* lMachine = mNodes[lNode].mMachine;
+    const std::uint32_t lTimer = mNodes[lNode].mTimer;
+    const priv::TimerId lId = (static_cast<priv::TimerId>(mNodes[lNode].mGeneration) << 32) | lNode;
+
+    unlink(lNode);
+    release(lNode);
+    --mPendingCount;
+    ++lFired;
+
+    //the machine arms and cancels timers of this wheel
+    pLock.unlock();
+    lMachine->fireTimer(lTimer, lId);
+    pLock.lock();
+  }
+
+  return lFired;
+}
+
+void ifsm::StateMachine::setTimerWheel(TimerWheel& pWheel){
+  mTimerWheel = &pWheel;
+}
+
+void ifsm::StateMachine::setRegionExecutor(RegionExecutor* pExecutor){
+  mRegionExecutor = pExecutor;
+}
+
+ifsm::RegionExecutor* ifsm::StateMachine::regionExecutor() const{
+  return mRegionExecutor;
+}
+
+ifsm::TimerWheel& ifsm::StateMachine::timerWheel(){
+  if (!mTimerWheel){
+    mTimerWheel = &TimerWheel::global();
+  }
+  return *mTimerWheel;
+}
+
+void ifsm::StateMachine::armTimers(std::uint32_t pBegin, std::uint32_t pEnd){
+  const StateChart& lChart = *mChart;
+  TimerWheel& lWheel = timerWheel();
+
+  for (std::uint32_t lTimer = pBegin; lTimer < pEnd; ++lTimer){
+    mTimers[lTimer] = lWheel.schedule(*this, lTimer, lChart.mTimers[lTimer].mDelay);
+  }
+}
+
+void ifsm::StateMachine::cancelTimers(std::uint32_t pBegin, std::uint32_t pEnd){
+  for (std::uint32_t lTimer = pBegin; lTimer < pEnd; ++lTimer){
+    if (mTimers[lTimer] != 0){
+      mTimerWheel->cancel(mTimers[lTimer]);
+      mTimers[lTimer] = 0;
+    }
+  }
+}
+
+void ifsm::StateMachine::pushTimerEvent(std::uint32_t pTimer, priv::TimerId pId){
+  if (mTimers[pTimer] != pId){
+    return;
+  }
+  mTimers[pTimer] = 0;
+  //internal event : enqueue would reject it
+  mEvents[static_cast<std::size_t>(EventPriority::Normal)].push(mChart->mTimers[pTimer].mEvent);
+}
+
+/**************************************************/
+/*
+StateMachineExecutor : runs many StateMachine instances on a pool of worker threads.
+
+Events posted to a machine go to its pushEventAsync mailbox, and the machine is scheduled
+on a worker. A machine is processed by at most one worker at a time, so run-to-completion
+holds as with pushEvent. Each worker takes machines from the back of its own queue and,
+once it is empty, steals from the front of the queues of the other workers.
+
+As a RegionExecutor, it runs the tasks of forEach on its workers, with priority over the machines,
+along with the calling thread : forEach may be called from a machine processed by the executor.
+
+  StateMachineExecutor myExecutor(4) : start 4 worker threads
+  StateMachineExecutor::Handle myHandle = myExecutor.attach(myMachine) : myMachine must outlive myExecutor
+  myExecutor.post(myHandle, std::string("myEvent")) : post an event from any thread
+  myExecutor.wait() : block until every posted event has been processed, rethrows what a callback threw
+*/
+
+namespace ifsm{
+  namespace priv{
+    struct ExecutorEntry{
+      ExecutorEntry(StateMachineExecutor& pExecutor, StateMachine& pMachine)
+        : mExecutor(&pExecutor)
+        , mMachine(&pMachine)
+        , mScheduled(false)
+      {}
+
+      StateMachineExecutor* mExecutor;
+      StateMachine* mMachine;
+      //true while the machine is queued on a worker or being processed
+      std::atomic<bool> mScheduled;
+    };
+
+    struct ExecutorWorker{
+      const void* mExecutor;
+      std::size_t mIndex;
+    };
+
+    struct ExecutorQueue{
+      std::mutex mMutex;
+      std::deque<ExecutorEntry*> mEntries;
+    };
+
+    //tasks of a call to StateMachineExecutor::forEach, taken by index
+    struct ExecutorBatch{
+      ExecutorBatch(const std::function<void(std::size_t)>& pTask, std::size_t pCount)
+        : mTask(&pTask)
+        , mCount(pCount)
+        , mNext(0)
+        , mDone(0)
+      {}
+
+      const std::function<void(std::size_t)>* mTask;
+      std::size_t mCount;
+      std::atomic<std::size_t> mNext;
+      //tasks done and the first error, guarded by mMutex
+      std::size_t mDone;
+      std::exception_ptr mError;
+      std::mutex mMutex;
+      std::condition_variable mFinished;
+    };
+  }
+
+  class StateMachineExecutor : public RegionExecutor{
+    friend class StateMachine;
+
+  public:
+    class Handle{
+      friend class StateMachineExecutor;
+
+    public:
+      inline Handle();
+
+    private:
+      inline explicit Handle(priv::ExecutorEntry* pEntry);
+
+      priv::ExecutorEntry* mEntry;
+    };
+
+  public:
+    /*
+    start pThreadCount workers, or one per hardware thread if pThreadCount is 0
+    */
+    inline explicit StateMachineExecutor(std::size_t pThreadCount = 0);
+
+    /*
+    process the pending events, then stop the workers
+    */
+    inline ~StateMachineExecutor();
+
+    /*
+    register a machine, entered or not. The machine must outlive the executor,
+    and it must not be used directly while attached, except through pushEventAsync.
+    its timers are then processed on the workers, whichever thread advances its TimerWheel,
+    but the wheel must not be advanced while the executor is destroyed
+    */
+    inline Handle attach(StateMachine& pMachine);
+
+    /*
+    add an event to the mailbox of the machine, from any thread
+    */
+    inline void post(Handle pMachine, EventId pEvent);
+
+    inline void post(Handle pMachine, const std::string& pEvent);
+
+    /*
+    block until every posted event has been processed. If processing a machine threw, the other
+    machines are still processed, and wait rethrows the first exception since the previous call
+    */
+    inline void wait();
+
+    inline std::size_t threadCount() const;
+
+    /*
+    run the tasks on the workers and the calling thread, returns once they are all done
+    */
+    inline virtual void forEach(std::size_t pCount, const std::function<void(std::size_t)>& pTask);
+
+  private:
+    StateMachineExecutor(const StateMachineExecutor&);
+    StateMachineExecutor& operator=(const StateMachineExecutor&);
+
+    inline void schedule(priv::ExecutorEntry& pEntry);
+
+    inline priv::ExecutorEntry* take(std::size_t pWorker);
+
+    inline void run(std::size_t pWorker);
+
+    inline void process(std::size_t pWorker, priv::ExecutorEntry& pEntry);
+
+    //wait without rethrowing, for the destructor
+    inline void waitIdle();
+
+    //run one task of a pending forEach batch, returns false if there is none
+    inline bool runBatch();
+
+    inline static void runTask(priv::ExecutorBatch& pBatch, std::size_t pIndex);
+
+    //worker running on the calling thread, if any
+    inline static priv::ExecutorWorker& currentWorker();
+
+  private:
+    //sleeps are bounded : the conditions are re-checked even without notification
+    inline static std::chrono::milliseconds idleTimeout();
+
+    std::vector<std::unique_ptr<priv::ExecutorQueue>> mQueues;
+    std::vector<std::thread> mThreads;
+
+    std::mutex mEntriesMutex;
+    std::vector<std::unique_ptr<priv::ExecutorEntry>> mEntries;
+
+    //machines scheduled and not yet done
+    std::atomic<std::size_t> mScheduledCount;
+    //machines waiting in mQueues
+    std::atomic<std::size_t> mQueuedCount;
+    std::atomic<std::size_t> mSleepingCount;
+    std::atomic<std::size_t> mNextQueue;
+    std::atomic<bool> mStopping;
+
+    //first exception thrown by processEvents, guarded by mErrorMutex
+    std::mutex mErrorMutex;
+    std::exception_ptr mError;
+
+    //batches of forEach that may still have tasks to start
+    std::mutex mBatchesMutex;
+    std::vector<priv::ExecutorBatch*> mBatches;
+    std::atomic<std::size_t> mBatchCount;
+
+    //idle workers and wait() sleep on these
+    std::mutex mSleepMutex;
+    std::condition_variable mWorkAvailable;
+    std::condition_variable mAllDone;
+  };
+}
+
+ifsm::StateMachineExecutor::Handle::Handle()
+: mEntry(nullptr){
+
+}
+
+ifsm::StateMachineExecutor::Handle::Handle(priv::ExecutorEntry* pEntry)
+: mEntry(pEntry){
+
+}
+
+ifsm::StateMachineExecutor::StateMachineExecutor(std::size_t pThreadCount)
+: mScheduledCount(0)
+, mQueuedCount(0)
+, mSleepingCount(0)
+, mNextQueue(0)
+, mStopping(false)
+, mBatchCount(0){
+  if (pThreadCount == 0){
+    pThreadCount = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+  }
+
+  for (std::size_t lWorker = 0; lWorker < pThreadCount; ++lWorker){
+    mQueues.push_back(std::unique_ptr<priv::ExecutorQueue>(new priv::ExecutorQueue));
+  }
+  for (std::size_t lWorker = 0; lWorker < pThreadCount; ++lWorker){
+    mThreads.push_back(std::thread(&StateMachineExecutor::run, this, lWorker));
+  }
+}
+
+ifsm::StateMachineExecutor::~StateMachineExecutor(){
+  waitIdle();
+
+  {
+    std::lock_guard<std::mutex> lLock(mSleepMutex);
+    mStopping.store(true);
+  }
+  mWorkAvailable.notify_all();
+
+  for (std::thread& lThread : mThreads){
+    lThread.join();
+  }
+
+  //the timers of the machines fire on the thread advancing their wheel from now on
+  for (const std::unique_ptr<priv::ExecutorEntry>& lEntry : mEntries){
+    lEntry->mMachine->mExecutorEntry.store(nullptr);
+  }
+}
+
+ifsm::StateMachineExecutor::Handle ifsm::StateMachineExecutor::attach(StateMachine& pMachine){
+  std::lock_guard<std::mutex> lLock(mEntriesMutex);
+  mEntries.push_back(std::unique_ptr<priv::ExecutorEntry>(new priv::ExecutorEntry(*this, pMachine)));
+  priv::ExecutorEntry* lEntry = mEntries.back().get();
+  pMachine.mExecutorEntry.store(lEntry);
+
+  //events pushed with pushEventAsync before attaching
+  schedule(*lEntry);
+  return Handle(lEntry);
+}
+
+void ifsm::StateMachineExecutor::post(Handle pMachine, EventId pEvent){
+  pMachine.mEntry->mMachine->pushEventAsync(pEvent);
+  schedule(*pMachine.mEntry);
+}
+
+void ifsm::StateMachineExecutor::post(Handle pMachine, const std::string& pEvent){
+  pMachine.mEntry->mMachine->pushEventAsync(pEvent);
+  schedule(*pMachine.mEntry);
+}
+
+void ifsm::StateMachineExecutor::wait(){
+  waitIdle();
+
+  std::exception_ptr lError;
+  {
+    std::lock_guard<std::mutex> lLock(mErrorMutex);
+    std::swap(lError, mError);
+  }
+  if (lError){
+    std::rethrow_exception(lError);
+  }
+}
+
+void ifsm::StateMachineExecutor::waitIdle(){
+  std::unique_lock<std::mutex> lLock(mSleepMutex);
+  while (mScheduledCount.load() != 0){
+    mAllDone.wait_for(lLock, idleTimeout());
+  }
+}
+
+std::chrono::milliseconds ifsm::StateMachineExecutor::idleTimeout(){
+  return std::chrono::milliseconds(10);
+}
+
+std::size_t ifsm::StateMachineExecutor::threadCount() const{
+  return mThreads.size();
+}
+
+void ifsm::StateMachineExecutor::schedule(priv::ExecutorEntry& pEntry){
+  //already queued or being processed : the worker will see the new events
+  if (pEntry.mScheduled.exchange(true, std::memory_order_acq_rel)){
+    return;
+  }
+
+  mScheduledCount.fetch_add(1);
+
+  //keep the machines posted from a worker on that worker, spread the others
+  std::size_t lQueue = currentWorker().mIndex;
+  if (currentWorker().mExecutor != this){
+    lQueue = mNextQueue.fetch_add(1, std::memory_order_relaxed) % mQueues.size();
+  }
+
+  {
+    std::lock_guard<std::mutex> lLock(mQueues[lQueue]->mMutex);
+    mQueues[lQueue]->mEntries.push_back(&pEntry);
+  }
+  mQueuedCount.fetch_add(1);
+
+  if (mSleepingCount.load() != 0){
+    std::lock_guard<std::mutex> lLock(mSleepMutex);
+    mWorkAvailable.notify_one();
+  }
+}
+
+ifsm::priv::ExecutorEntry* ifsm::StateMachineExecutor::take(std::size_t pWorker){
+  {
+    priv::ExecutorQueue& lOwn = *mQueues[pWorker];
+    std::lock_guard<std::mutex> lLock(lOwn.mMutex);
+    if (!lOwn.mEntries.empty()){
+      priv::ExecutorEntry* lEntry = lOwn.mEntries.back();
+      lOwn.mEntries.pop_back();
+      mQueuedCount.fetch_sub(1);
+      return lEntry;
+    }
+  }
+
+  //steal the oldest machine of another worker
+  for (std::size_t lOffset = 1; lOffset < mQueues.size(); ++lOffset){
+    priv::ExecutorQueue& lVictim = *mQueues[(pWorker + lOffset) % mQueues.size()];
+    std::lock_guard<std::mutex> lLock(lVictim.mMutex);
+    if (!lVictim.mEntries.empty()){
+      priv::ExecutorEntry* lEntry = lVictim.mEntries.front();
+      lVictim.mEntries.pop_front();
+      mQueuedCount.fetch_sub(1);
+      return lEntry;
+    }
+  }
+
+  return nullptr;
+}
+
+void ifsm::StateMachineExecutor::run(std::size_t pWorker){
+  currentWorker().mExecutor = this;
+  currentWorker().mIndex = pWorker;
+
+  for (;;){
+    //a thread is blocked in forEach until its batch is done
+    if (runBatch()){
+      continue;
+    }
+
+    priv::ExecutorEntry* lEntry = take(pWorker);
+    if (lEntry){
+      process(pWorker, *lEntry);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lLock(mSleepMutex);
+    if (mStopping.load()){
+      return;
+    }
+    //schedule() checks mSleepingCount after queuing : either it sees this worker asleep,
+    //or this worker sees the queued entry
+    mSleepingCount.fetch_add(1);
+    if (mQueuedCount.load() == 0 && mBatchCount.load() == 0){
+      mWorkAvailable.wait_for(lLock, idleTimeout());
+    }
+    mSleepingCount.fetch_sub(1);
+  }
+}
+
+void ifsm::StateMachineExecutor::process(std::size_t pWorker, priv::ExecutorEntry& pEntry){
+  //an exception must not end the worker : it is kept for wait, and the machine is released as usual
+  std::exception_ptr lError;
+  try{
+    pEntry.mMachine->processEvents();
+  }
+  catch (...){
+    lError = std::current_exception();
+  }
+  if (lError){
+    std::lock_guard<std::mutex> lLock(mErrorMutex);
+    if (!mError){
+      mError = lError;
+    }
+  }
+
+  //clear the flag with a read-modify-write so that events pushed before a concurrent
+  //schedule() call are visible to the check below. once it is cleared, another worker may
+  //be draining the mailbox : only the producers' count may be read, not the queue itself
+  pEntry.mScheduled.exchange(false, std::memory_order_acq_rel);
+  if (pEntry.mMachine->mAsyncCount.load() != 0 && !pEntry.mScheduled.exchange(true, std::memory_order_acq_rel)){
+    {
+      std::lock_guard<std::mutex> lLock(mQueues[pWorker]->mMutex);
+      mQueues[pWorker]->mEntries.push_back(&pEntry);
+    }
+    mQueuedCount.fetch_add(1);
+    return;
+  }
+
+  if (mScheduledCount.fetch_sub(1) == 1){
+    std::lock_guard<std::mutex> lLock(mSleepMutex);
+    mAllDone.notify_all();
+  }
+}
+
+void ifsm::StateMachineExecutor::forEach(std::size_t pCount, const std::function<void(std::size_t)>& pTask){
+  if (pCount == 0){
+    return;
+  }
+
+  priv::ExecutorBatch lBatch(pTask, pCount);
+  {
+    std::lock_guard<std::mutex> lLock(mBatchesMutex);
+    mBatches.push_back(&lBatch);
+  }
+  mBatchCount.fetch_add(1);
+
+  if (mSleepingCount.load() != 0){
+    std::lock_guard<std::mutex> lLock(mSleepMutex);
+    mWorkAvailable.notify_all();
+  }
+
+  //take part, then make sure no worker starts a task once the batch has returned
+  for (std::size_t lIndex = lBatch.mNext.fetch_add(1); lIndex < pCount; lIndex = lBatch.mNext.fetch_add(1)){
+    runTask(lBatch, lIndex);
+  }
+  {
+    std::lock_guard<std::mutex> lLock(mBatchesMutex);
+    auto lFind = std::find(mBatches.begin(), mBatches.end(), &lBatch);
+    if (lFind != mBatches.end()){
+      mBatches.erase(lFind);
+      mBatchCount.fetch_sub(1);
+    }
+  }
+
+  std::unique_lock<std::mutex> lLock(lBatch.mMutex);
+  while (lBatch.mDone != pCount){
+    lBatch.mFinished.wait_for(lLock, idleTimeout());
+  }
+
+  if (lBatch.mError){
+    std::rethrow_exception(lBatch.mError);
+  }
+}
+
+bool ifsm::StateMachineExecutor::runBatch(){
+  if (mBatchCount.load() == 0){
+    return false;
+  }
+
+  priv::ExecutorBatch* lBatch = nullptr;
+  std::size_t lIndex = 0;
+  {
+    //tasks are claimed under the lock, so that forEach can't return before a claimed task is done
+    std::lock_guard<std::mutex> lLock(mBatchesMutex);
+    while (!mBatches.empty()){
+      lIndex = mBatches.front()->mNext.fetch_add(1);
+      if (lIndex < mBatches.front()->mCount){
+        lBatch = mBatches.front();
+        break;
+      }
+
+      //every task of the batch has been started : stop looking at it, so that idle workers can sleep
+      mBatches.erase(mBatches.begin());
+      mBatchCount.fetch_sub(1);
+    }
+  }
+
+  if (!lBatch){
+    return false;
+  }
+
+  runTask(*lBatch, lIndex);
+  return true;
+}
+
+void ifsm::StateMachineExecutor::runTask(priv::ExecutorBatch& pBatch, std::size_t pIndex){
+  std::exception_ptr lError;
+  try{
+    (*pBatch.mTask)(pIndex);
+  }
+  catch (...){
+    lError = std::current_exception();
+  }
+
+  //once the last task is counted, forEach may return and destroy the batch
+  std::lock_guard<std::mutex> lLock(pBatch.mMutex);
+  if (lError && !pBatch.mError){
+    pBatch.mError = lError;
+  }
+  if (++pBatch.mDone == pBatch.mCount){
+    pBatch.mFinished.notify_one();
+  }
+}
+
+ifsm::priv::ExecutorWorker& ifsm::StateMachineExecutor::currentWorker(){
+  static thread_local priv::ExecutorWorker sWorker = { nullptr, 0 };
+  return sWorker;
+}
+
+void ifsm::StateMachine::fireTimer(std::uint32_t pTimer, priv::TimerId pId){
+  //the wheel may be advanced by any thread : leave the timer to the worker processing the machine
+  priv::ExecutorEntry* lEntry = mExecutorEntry.load();
+  if (lEntry){
+    const priv::AsyncEvent lEvent = { InvalidEvent, pTimer, pId };
+    mAsyncCount.fetch_add(1);
+    mAsyncEvents.push(lEvent);
+    lEntry->mExecutor->schedule(*lEntry);
+    return;
+  }
+
+  takeAsyncEvents();
+  pushTimerEvent(pTimer, pId);
+  processEvents();
+}
+
+/**************************************************/
+/*
+InstancePool : many instances of a shared StateChart, stepped together.
+
+The configuration of each instance is stored as a single integer, the dispatch row of its active
+atomic state, in one contiguous array. For each event and each row, the pool precomputes the row
+that the event leads to when the transition runs no callback. broadcast then updates every instance
+with one table lookup, and only the instances whose transition has a Condition, an Action,
+an OnExit or an OnEntry callback are run through a StateMachine, one after the other.
+
+Charts with parallel states, After transitions or deferred events are not supported.
+Callbacks receive the StateMachine that runs the pooled instances, current() tells which
+instance it is. They must not use the pool itself.
+
+  InstancePool myPool(myChart) : throws UnsupportedChart for the charts that aren't supported
+  myPool.add(1000) : enter 1000 new instances
+  myPool.broadcast(myEventId) : push the event to every instance
+  myPool.pushEvent(myInstance, myEventId) : push the event to a single instance
+  myPool.inState(myInstance, myStateId) : returns true if the state is active in the instance
+*/
+
+namespace ifsm{
+  class UnsupportedChart : public StateMachineException{
+  public:
+    UnsupportedChart(const std::string& pReason)
+      : StateMachineException("The chart can't be run by an InstancePool : "+pReason+".")
+      {}
+  };
+
+  class InstancePool{
+  public:
+    static const std::size_t NoInstance = static_cast<std::size_t>(-1);
+
+  public:
+    inline explicit InstancePool(std::shared_ptr<const StateChart> pChart);
+
+    /*
+    add and enter new instances, returns the index of the first one
+    */
+    inline std::size_t add(std::size_t pCount = 1);
+
+    inline std::size_t size() const;
+
+    /*
+    push the event to every instance, processed with the same run-to-completion semantics as
+    StateMachine::pushEvent for each of them. unknown events are ignored
+    */
+    inline void broadcast(EventId pEvent);
+
+    inline void broadcast(const std::string& pEvent);
+
+    inline void pushEvent(std::size_t pInstance, EventId pEvent);
+
+    inline bool inState(std::size_t pInstance, StateId pState) const;
+
+    /*
+    returns the active atomic state of the instance
+    */
+    inline StateId activeState(std::size_t pInstance) const;
+
+    /*
+    returns the index of the instance whose callbacks are being called, or NoInstance
+    */
+    inline std::size_t current() const;
+
+    inline EventId event(const std::string& pEvent) const;
+
+    inline const std::shared_ptr<const StateChart>& chart() const;
+
+  private:
+    InstancePool(const InstancePool&);
+    InstancePool& operator=(const InstancePool&);
+
+    //set in a row of mNextRows when the instances in the row must be run by mMachine
+    static const std::uint32_t SlowRow = 0x80000000u;
+
+    /*
+    returns the row an instance in pRow moves to on pEvent, flagged with SlowRow
+    when it can't be computed without running callbacks
+    */
+    inline std::uint32_t nextRow(std::uint32_t pRow, EventId pEvent) const;
+
+    //reset the configuration of mMachine, without calling any callback
+    inline void clear();
+
+    /*
+    give mMachine the configuration of an instance in pRow, and get the row back once it has processed events
+    */
+    inline void load(std::uint32_t pRow);
+
+    inline std::uint32_t store() const;
+
+    inline void run(std::size_t pInstance, std::uint32_t pRow, EventId pEvent);
+
+  private:
+    std::shared_ptr<const StateChart> mChart;
+    //runs the instances whose callbacks must be called
+    StateMachine mMachine;
+    //dispatch row of the active atomic state of each instance
+    std::vector<std::uint32_t> mRows;
+    //atomic state of each dispatch row
+    std::vector<priv::StateIndex> mRowStates;
+    //for each event and each row, the row it leads to, or the same row flagged with SlowRow
+    std::vector<std::uint32_t> mNextRows;
+    //row entered by default, or SlowRow when entering calls callbacks
+    std::uint32_t mDefaultRow;
+    std::size_t mCurrent;
+  };
+}
+
+ifsm::InstancePool::InstancePool(std::shared_ptr<const StateChart> pChart)
+: mChart(std::move(pChart))
+, mMachine(mChart)
+, mDefaultRow(SlowRow)
+, mCurrent(NoInstance){
+  const StateChart& lChart = *mChart;
+  for (const priv::StateImpl& lState : lChart.mStates){
+    if (lState.isParallel()){
+      throw UnsupportedChart("it has parallel states");
+    }
+  }
+  if (!lChart.mTimers.empty()){
+    throw UnsupportedChart("it has After transitions");
+  }
+  if (!lChart.mDeferredEvents.empty()){
+    throw UnsupportedChart("it defers events");
+  }
+  if (lChart.mHistorySlots != 0){
+    throw UnsupportedChart("it has history states");
+  }
+  if (lChart.mEventless != InvalidEvent){
+    throw UnsupportedChart("it has eventless transitions");
+  }
+  //the instances share the cursor : none of them can be suspended on a Task
+  mMachine.mDetachTasks = true;
+
+  for (const priv::StateImpl& lState : lChart.mStates){
+    if (lState.isAtomic()){
+      mRowStates.push_back(lState.mOrdinal);
+    }
+  }
+
+  const std::size_t lEventCount = lChart.mEventIds.size();
+  mNextRows.resize(lEventCount * mRowStates.size());
+  for (EventId lEvent = 0; lEvent < lEventCount; ++lEvent){
+    for (std::uint32_t lRow = 0; lRow < mRowStates.size(); ++lRow){
+      mNextRows[lEvent * mRowStates.size() + lRow] = nextRow(lRow, lEvent);
+    }
+  }
+
+  bool lSilentEntry = true;
+  for (priv::StateIndex lState : lChart.mDefaultEntry){
+    lSilentEntry = lSilentEntry && lChart.mStates[lState].mOnEntryBegin == lChart.mStates[lState].mOnEntryEnd;
+  }
+  if (lSilentEntry){
+    mDefaultRow = lChart.mStates[lChart.mDefaultEntry.back()].mDispatchRow;
+  }
+}
+
+std::uint32_t ifsm::InstancePool::nextRow(std::uint32_t pRow, EventId pEvent) const{
+  const StateChart& lChart = *mChart;
+  const std::uint32_t* lOffsets = &lChart.mDispatchOffsets[pRow * (lChart.mEventIds.size() + 1) + pEvent];
+  if (lOffsets[0] == lOffsets[1]){
+    return pRow;
+  }
+
+  //the first candidate is the only one selected unless it has a Condition,
+  //or other transitions of the same state react to the event
+  const priv::TransitionImpl& lTransition = lChart.mTransitions[lChart.mDispatchTransitions[lOffsets[0]]];
+  if (lOffsets[1] - lOffsets[0] > 1 && lChart.mTransitions[lChart.mDispatchTransitions[lOffsets[0] + 1]].mSource == lTransition.mSource){
+    return pRow | SlowRow;
+  }
+  if (lTransition.mCondition || lTransition.mAction){
+    return pRow | SlowRow;
+  }
+  if (lTransition.isTargetless()){
+    return pRow;
+  }
+
+  //without parallel states, the exited states are the ancestors of the atomic state up to the domain
+  for (priv::StateIndex lState = mRowStates[pRow]; lState != lTransition.mDomain; lState = lChart.mStates[lState].mParent){
+    if (lChart.mStates[lState].mOnExitBegin != lChart.mStates[lState].mOnExitEnd){
+      return pRow | SlowRow;
+    }
+  }
+  for (std::uint32_t lEntry = lTransition.mEntryBegin; lEntry < lTransition.mEntryEnd; ++lEntry){
+    const priv::StateImpl& lState = lChart.mStates[lChart.mEntrySequences[lEntry]];
+    if (lState.mOnEntryBegin != lState.mOnEntryEnd){
+      return pRow | SlowRow;
+    }
+  }
+
+  //and the last entered state is the new atomic state
+  return lChart.mStates[lChart.mEntrySequences[lTransition.mEntryEnd - 1]].mDispatchRow;
+}
+
+std::size_t ifsm::InstancePool::add(std::size_t pCount){
+  const std::size_t lFirst = mRows.size();
+  if (mDefaultRow != SlowRow){
+    mRows.resize(lFirst + pCount, mDefaultRow);
+    return lFirst;
+  }
+
+  mRows.reserve(lFirst + pCount);
+  for (std::size_t lInstance = lFirst; lInstance < lFirst + pCount; ++lInstance){
+    mCurrent = lInstance;
+    clear();
+    mMachine.enter();
+    mRows.push_back(store());
+  }
+  mCurrent = NoInstance;
+  return lFirst;
+}
+
+std::size_t ifsm::InstancePool::size() const{
+  return mRows.size();
+}
+
+void ifsm::InstancePool::broadcast(EventId pEvent){
+  if (pEvent >= mChart->mPublicEvents){
+    return;
+  }
+
+  //a gather over contiguous rows, that compilers can vectorize
+  const std::uint32_t* lNextRows = &mNextRows[pEvent * mRowStates.size()];
+  std::uint32_t* lRows = mRows.data();
+  const std::size_t lCount = mRows.size();
+  std::uint32_t lFlags = 0;
+  for (std::size_t lInstance = 0; lInstance < lCount; ++lInstance){
+    lRows[lInstance] = lNextRows[lRows[lInstance]];
+    lFlags |= lRows[lInstance];
+  }
+
+  if ((lFlags & SlowRow) == 0){
+    return;
+  }
+
+  std::size_t lInstance = 0;
+  try{
+    for (; lInstance < lCount; ++lInstance){
+      if (lRows[lInstance] & SlowRow){
+        run(lInstance, lRows[lInstance] & ~SlowRow, pEvent);
+      }
+    }
+  }
+  catch (...){
+    //a callback threw : the instances not run yet, and the one that threw, stay in their row
+    for (; lInstance < lCount; ++lInstance){
+      lRows[lInstance] &= ~SlowRow;
+    }
+    throw;
+  }
+}
+
+void ifsm::InstancePool::broadcast(const std::string& pEvent){
+  broadcast(mChart->findEvent(pEvent));
+}
+
+void ifsm::InstancePool::pushEvent(std::size_t pInstance, EventId pEvent){
+  if (pEvent >= mChart->mPublicEvents){
+    return;
+  }
+
+  const std::uint32_t lNext = mNextRows[pEvent * mRowStates.size() + mRows[pInstance]];
+  if (lNext & SlowRow){
+    run(pInstance, mRows[pInstance], pEvent);
+  }
+  else {
+    mRows[pInstance] = lNext;
+  }
+}
+
+bool ifsm::InstancePool::inState(std::size_t pInstance, StateId pState) const{
+  //the active states are the atomic state and its ancestors, whose subtrees contain it
+  return pState < mChart->mStates.size() && mChart->mStates[pState].contains(mRowStates[mRows[pInstance]]);
+}
+
+ifsm::StateId ifsm::InstancePool::activeState(std::size_t pInstance) const{
+  return mRowStates[mRows[pInstance]];
+}
+
+std::size_t ifsm::InstancePool::current() const{
+  return mCurrent;
+}
+
+ifsm::EventId ifsm::InstancePool::event(const std::string& pEvent) const{
+  return mChart->event(pEvent);
+}
+
+const std::shared_ptr<const ifsm::StateChart>& ifsm::InstancePool::chart() const{
+  return mChart;
+}
+
+void ifsm::InstancePool::clear(){
+  for (priv::StateIndex lAtomic : mMachine.mActiveAtomics){
+    for (priv::StateIndex lState = lAtomic; lState != priv::NoIndex; lState = mChart->mStates[lState].mParent){
+      mMachine.mActiveStates.reset(lState);
+    }
+  }
+  mMachine.mActiveAtomics.clear();
+  mMachine.mHandledChanged = true;
+  mMachine.mIsActive = false;
+}
+
+void ifsm::InstancePool::load(std::uint32_t pRow){
+  clear();
+
+  mMachine.mIsActive = true;
+  mMachine.mActiveAtomics.push_back(mRowStates[pRow]);
+  for (priv::StateIndex lState = mRowStates[pRow]; lState != priv::NoIndex; lState = mChart->mStates[lState].mParent){
+    mMachine.mActiveStates.set(lState);
+  }
+}
+
+std::uint32_t ifsm::InstancePool::store() const{
+  return mChart->mStates[mMachine.mActiveAtomics.front()].mDispatchRow;
+}
+
+void ifsm::InstancePool::run(std::size_t pInstance, std::uint32_t pRow, EventId pEvent){
+  mCurrent = pInstance;
+  load(pRow);
+  try{
+    mMachine.pushEvent(pEvent);
+  }
+  catch (...){
+    //the events left by the instance aren't run for the next one
+    for (priv::EventQueue& lQueue : mMachine.mEvents){
+      while (!lQueue.empty()){
+        if (lQueue.pop() & priv::PayloadFlag){
+          lQueue.popPayload();
+        }
+      }
+    }
+    mMachine.mInToplevelProcess = false;
+    mCurrent = NoInstance;
+    throw;
+  }
+  mRows[pInstance] = store();
+  mCurrent = NoInstance;
+}
+
+/**************************************************/
+/*
+Compiled tables : a StateChart exported as a header of constexpr tables, run by a TableStateMachine that builds
+nothing when it starts and never allocates : the tables are constant initialized, and an instance only holds its
+active state and a fixed capacity event queue.
+
+The DSL stays the source of truth : the header is generated from the StateChart, and its callbacks, which can't be
+exported, are bound to the numbered slots the header declares, as arrays of function pointers.
+The exported chart has a single active atomic state : it has no parallel, history or deferring state, no After
+or eventless transition, and at most 64 transitions of a state react to the same event.
+
+  std::string mySource = myChart.exportTables("player") : generate playerTables.h, when building or once the chart changes
+
+  #include "playerTables.h"
+  TableStateMachine::Callback myCallbacks[player::CallbackCount] = {} : the Action, OnEntry and OnExit callbacks,
+    myCallbacks[player::callback::onEntry_Playing] = &myFunction
+  TableStateMachine::Condition myConditions[player::ConditionCount] = {} : the Conditions, by player::condition
+  TableStateMachine myMachine(player::Tables, myCallbacks, myConditions, &myContext)
+  myMachine.enter(), myMachine.pushEvent(player::event::play), myMachine.inState(player::state::Playing)
+*/
+
+namespace ifsm{
+  class UnexportableChart : public StateMachineException{
+  public:
+    UnexportableChart(const std::string& pReason)
+      : StateMachineException("The chart can't be exported to tables : "+pReason+".")
+      {}
+  };
+
+  class EventQueueFull : public StateMachineException{
+  public:
+    EventQueueFull(std::size_t pCapacity)
+      : StateMachineException("The event queue of a TableStateMachine already holds "+std::to_string(pCapacity)+" events.")
+      {}
+  };
+
+  //index of no state, transition or slot in a ChartTables
+  static const std::uint32_t NoTableIndex = static_cast<std::uint32_t>(-1);
+
+  /*
+  a state of a ChartTables, numbered as in its StateChart
+  */
+  struct TableState{
+    std::uint32_t mParent;
+    //ordinal following the last descendant of the state
+    std::uint32_t mSubtreeEnd;
+    //row of the state in the dispatch table, for atomic states
+    std::uint32_t mDispatchRow;
+    //ranges of the callback slots of the OnEntry and OnExit callbacks of the state
+    std::uint32_t mOnEntryBegin;
+    std::uint32_t mOnEntryEnd;
+    std::uint32_t mOnExitBegin;
+    std::uint32_t mOnExitEnd;
+  };
+
+  struct TableTransition{
+    std::uint32_t mSource;
+    //NoTableIndex for targetless transitions
+    std::uint32_t mTarget;
+    std::uint32_t mDomain;
+    //range of the states entered by the transition in ChartTables::mEntrySequences
+    std::uint32_t mEntryBegin;
+    std::uint32_t mEntryEnd;
+    //callback slot of the Action, condition slot of the Condition, or NoTableIndex
+    std::uint32_t mAction;
+    std::uint32_t mCondition;
+  };
+
+  /*
+  the tables of a chart, as defined by the header StateChart::exportTables generates
+  */
+  struct ChartTables{
+    //fingerprint of the exported StateChart
+    std::uint64_t mFingerprint;
+    std::uint32_t mStateCount;
+    const TableState* mStates;
+    const char* const* mStateNames;
+    std::uint32_t mEventCount;
+    const char* const* mEventNames;
+    const TableTransition* mTransitions;
+    //for each atomic state and each event, range of the candidate transitions in mDispatchTransitions,
+    //from the atomic state up to the root
+    const std::uint32_t* mDispatchOffsets;
+    const std::uint32_t* mDispatchTransitions;
+    //states entered by each transition, and by TableStateMachine::enter, in document order
+    const std::uint32_t* mEntrySequences;
+    const std::uint32_t* mDefaultEntry;
+    std::uint32_t mDefaultEntrySize;
+    std::uint32_t mCallbackCount;
+    std::uint32_t mConditionCount;
+  };
+
+  class TableStateMachine{
+  public:
+    typedef void (*Callback)(TableStateMachine&);
+    typedef bool (*Condition)(const TableStateMachine&);
+
+    static const std::size_t QueueCapacity = 32;
+
+  public:
+    /*
+    an instance of pTables, whose Action, OnEntry and OnExit callbacks are pCallbacks[slot], and Conditions
+    pConditions[slot]. a nullptr callback does nothing, a nullptr condition is true.
+    the tables and both arrays must outlive the machine
+    */
+    inline TableStateMachine(const ChartTables& pTables, const Callback* pCallbacks, const Condition* pConditions, void* pContext = nullptr);
+
+    /*
+    enter the root state and its initial children, then process the events their callbacks pushed
+    */
+    inline void enter();
+
+    /*
+    leave all active states, from the active atomic state up to the root
+    */
+    inline void leave();
+
+    inline bool isActive() const;
+
+    /*
+    add an event to the event queue, and process it unless a callback is running.
+    unknown events are ignored. throws EventQueueFull when QueueCapacity events are waiting already
+    */
+    inline void pushEvent(EventId pEvent);
+
+    /*
+    lookups by name, throwing NoSuchEvent and NoSuchState when the tables don't declare the name
+    */
+    inline EventId event(const std::string& pEvent) const;
+
+    inline StateId state(const std::string& pState) const;
+
+    inline bool inState(StateId pState) const;
+
+    /*
+    returns the active atomic state, or InvalidState when the machine isn't active.
+    from a callback, the deepest state active at this point of the transition
+    */
+    inline StateId activeState() const;
+
+    //the pointer given to the constructor, for the callbacks to reach their data
+    inline void* context() const;
+
+    inline const ChartTables& tables() const;
+
+    //returns the number of events processed while the active state had no transition for them
+    inline std::uint64_t unhandledEvents() const;
+
+  private:
+    TableStateMachine(const TableStateMachine&);
+    TableStateMachine& operator=(const TableStateMachine&);
+
+    inline void processEvents();
+
+    inline void processEvent(EventId pEvent);
+
+    //call the callbacks of the slots [pBegin, pEnd)
+    inline void call(std::uint32_t pBegin, std::uint32_t pEnd);
+
+    inline bool test(std::uint32_t pCondition) const;
+
+  private:
+    const ChartTables* mTables;
+    const Callback* mCallbacks;
+    const Condition* mConditions;
+    void* mContext;
+    //deepest active state : the active atomic state, except while a transition is taken. NoTableIndex when inactive
+    std::uint32_t mLeaf;
+    EventId mEvents[QueueCapacity];
+    std::uint32_t mFront;
+    std::uint32_t mSize;
+    std::uint64_t mUnhandledEvents;
+    bool mIsActive;
+    bool mInToplevelProcess;
+  };
+
+  namespace priv{
+    /*
+    returns pName as a C++ identifier missing from pUsed, and adds it to pUsed : characters other than letters,
+    digits and underscores become underscores, keywords get a trailing underscore and duplicates a numbered suffix
+    */
+    inline std::string exportIdentifier(const std::string& pName, std::unordered_set<std::string>& pUsed);
+
+    //returns pValue as a C++ string literal
+    inline std::string exportLiteral(const std::string& pValue);
+
+    //append the definition of a constexpr array of pValues, or of a null pointer when there is none
+    inline void exportArray(std::string& pOut, const std::string& pName, const std::vector<std::uint32_t>& pValues);
+  }
+}
+
+std::string ifsm::StateChart::exportTables(const std::string& pName) const{
+  for (const priv::StateImpl& lState : mStates){
+    if (lState.isParallel()){
+      throw UnexportableChart("it has parallel states");
+    }
+  }
+  if (!mTimers.empty()){
+    throw UnexportableChart("it has After transitions");
+  }
+  if (!mDeferredEvents.empty()){
+    throw UnexportableChart("it defers events");
+  }
+  if (mHistorySlots != 0){
+    throw UnexportableChart("it has history states");
+  }
+  if (mEventless != InvalidEvent){
+    throw UnexportableChart("it has eventless transitions");
+  }
+
+  //the enabled transitions of a state are selected with a 64 bits mask
+  std::vector<std::uint32_t> lPerEvent(mEventIds.size(), 0);
+  for (const priv::StateImpl& lState : mStates){
+    for (priv::TransitionIndex lTransition = lState.mTransitionsBegin; lTransition < lState.mTransitionsEnd; ++lTransition){
+      if (++lPerEvent[mTransitions[lTransition].getEvent()] > 64){
+        throw UnexportableChart("a state has more than 64 transitions for the same event");
+      }
+    }
+    for (priv::TransitionIndex lTransition = lState.mTransitionsBegin; lTransition < lState.mTransitionsEnd; ++lTransition){
+      lPerEvent[mTransitions[lTransition].getEvent()] = 0;
+    }
+  }
+
+  std::vector<const std::string*> lEventNames(mEventIds.size());
+  for (const auto& lEvent : mEventIds){
+    lEventNames[lEvent.second] = &lEvent.first;
+  }
+
+  //callback slots : the OnEntry callbacks, then the OnExit ones, then the Actions, in chart order
+  const std::uint32_t lExitSlots = static_cast<std::uint32_t>(mOnEntryActions.size());
+  std::uint32_t lCallbackCount = static_cast<std::uint32_t>(mOnEntryActions.size() + mOnExitActions.size());
+  std::uint32_t lConditionCount = 0;
+  std::vector<std::uint32_t> lActions(mTransitions.size(), NoTableIndex);
+  std::vector<std::uint32_t> lConditions(mTransitions.size(), NoTableIndex);
+  for (std::size_t lIndex = 0; lIndex < mTransitions.size(); ++lIndex){
+    if (mTransitions[lIndex].mAction){
+      lActions[lIndex] = lCallbackCount++;
+    }
+    if (mTransitions[lIndex].mCondition){
+      lConditions[lIndex] = lConditionCount++;
+    }
+  }
+
+  std::string lGuard = "INSTANTFSM_";
+  for (char lChar : pName){
+    lGuard += static_cast<char>(std::isalnum(static_cast<unsigned char>(lChar)) ? std::toupper(static_cast<unsigned char>(lChar)) : '_');
+  }
+  lGuard += "_TABLES_H";
+
+  std::string lOut;
+  lOut += "//generated by ifsm::StateChart::exportTables, do not edit : export the chart again once it has changed\n";
+  lOut += "#ifndef " + lGuard + "\n#define " + lGuard + "\n\n#include \"instantFSM.h\"\n\n";
+  lOut += "namespace " + pName + "{\n";
+
+  //named constants, in namespaces of their own so that a state and an event may share their name
+  std::unordered_set<std::string> lUsed;
+  lOut += "  namespace state{\n    enum : ifsm::StateId{\n";
+  for (std::size_t lState = 0; lState < mStates.size(); ++lState){
+    lOut += "      " + priv::exportIdentifier(mStateNames[lState], lUsed) + " = " + std::to_string(lState) + ",\n";
+  }
+  lOut += "    };\n  }\n\n";
+
+  if (!lEventNames.empty()){
+    lUsed.clear();
+    lOut += "  namespace event{\n    enum : ifsm::EventId{\n";
+    for (std::size_t lEvent = 0; lEvent < lEventNames.size(); ++lEvent){
+      lOut += "      " + priv::exportIdentifier(*lEventNames[lEvent], lUsed) + " = " + std::to_string(lEvent) + ",\n";
+    }
+    lOut += "    };\n  }\n\n";
+  }
+
+  lUsed.clear();
+  lOut += "  //slots of the Action, OnEntry and OnExit callbacks in the TableStateMachine::Callback array\n";
+  if (lCallbackCount != 0){
+    lOut += "  namespace callback{\n    enum : std::uint32_t{\n";
+    for (std::size_t lState = 0; lState < mStates.size(); ++lState){
+      for (std::uint32_t lSlot = mStates[lState].mOnEntryBegin; lSlot < mStates[lState].mOnEntryEnd; ++lSlot){
+        lOut += "      " + priv::exportIdentifier("onEntry_" + mStateNames[lState], lUsed) + " = " + std::to_string(lSlot) + ",\n";
+      }
+    }
+    for (std::size_t lState = 0; lState < mStates.size(); ++lState){
+      for (std::uint32_t lSlot = mStates[lState].mOnExitBegin; lSlot < mStates[lState].mOnExitEnd; ++lSlot){
+        lOut += "      " + priv::exportIdentifier("onExit_" + mStateNames[lState], lUsed) + " = " + std::to_string(lExitSlots + lSlot) + ",\n";
+      }
+    }
+    for (std::size_t lIndex = 0; lIndex < mTransitions.size(); ++lIndex){
+      if (lActions[lIndex] != NoTableIndex){
+        const priv::TransitionImpl& lTransition = mTransitions[lIndex];
+        lOut += "      " + priv::exportIdentifier("action_" + mStateNames[lTransition.mSource] + "_" + *lEventNames[lTransition.getEvent()], lUsed)
+          + " = " + std::to_string(lActions[lIndex]) + ",\n";
+      }
+    }
+    lOut += "    };\n  }\n";
+  }
+  lOut += "  static const std::uint32_t CallbackCount = " + std::to_string(lCallbackCount) + ";\n\n";
+
+  lUsed.clear();
+  lOut += "  //slots of the Conditions in the TableStateMachine::Condition array\n";
+  if (lConditionCount != 0){
+    lOut += "  namespace condition{\n    enum : std::uint32_t{\n";
+    for (std::size_t lIndex = 0; lIndex < mTransitions.size(); ++lIndex){
+      if (lConditions[lIndex] != NoTableIndex){
+        const priv::TransitionImpl& lTransition = mTransitions[lIndex];
+        lOut += "      " + priv::exportIdentifier("condition_" + mStateNames[lTransition.mSource] + "_" + *lEventNames[lTransition.getEvent()], lUsed)
+          + " = " + std::to_string(lConditions[lIndex]) + ",\n";
+      }
+    }
+    lOut += "    };\n  }\n";
+  }
+  lOut += "  static const std::uint32_t ConditionCount = " + std::to_string(lConditionCount) + ";\n\n";
+
+  //the tables themselves
+  lOut += "  static constexpr ifsm::TableState States[] = {\n";
+  for (std::size_t lState = 0; lState < mStates.size(); ++lState){
+    const priv::StateImpl& lImpl = mStates[lState];
+    lOut += "    { " + (lImpl.mParent == priv::NoIndex ? std::string("ifsm::NoTableIndex") : std::to_string(lImpl.mParent))
+      + ", " + std::to_string(lImpl.mSubtreeEnd)
+      + ", " + (lImpl.mDispatchRow == priv::NoIndex ? std::string("ifsm::NoTableIndex") : std::to_string(lImpl.mDispatchRow))
+      + ", " + std::to_string(lImpl.mOnEntryBegin) + ", " + std::to_string(lImpl.mOnEntryEnd)
+      + ", " + std::to_string(lExitSlots + lImpl.mOnExitBegin) + ", " + std::to_string(lExitSlots + lImpl.mOnExitEnd)
+      + " }, //" + priv::exportLiteral(mStateNames[lState]) + "\n";
+  }
+  lOut += "  };\n\n";
+
+  lOut += "  static constexpr const char* StateNames[] = {\n";
+  for (const std::string& lName : mStateNames){
+    lOut += "    " + priv::exportLiteral(lName) + ",\n";
+  }
+  lOut += "  };\n\n";
+
+  if (lEventNames.empty()){
+    lOut += "  static constexpr const char* const* EventNames = nullptr;\n\n";
+  }
+  else {
+    lOut += "  static constexpr const char* EventNames[] = {\n";
+    for (const std::string* lName : lEventNames){
+      lOut += "    " + priv::exportLiteral(*lName) + ",\n";
+    }
+    lOut += "  };\n\n";
+  }
+
+  if (mTransitions.empty()){
+    lOut += "  static constexpr const ifsm::TableTransition* Transitions = nullptr;\n\n";
+  }
+  else {
+    lOut += "  static constexpr ifsm::TableTransition Transitions[] = {\n";
+    for (std::size_t lIndex = 0; lIndex < mTransitions.size(); ++lIndex){
+      const priv::TransitionImpl& lTransition = mTransitions[lIndex];
+      lOut += "    { " + std::to_string(lTransition.mSource)
+        + ", " + (lTransition.isTargetless() ? std::string("ifsm::NoTableIndex") : std::to_string(lTransition.mTarget))
+        + ", " + std::to_string(lTransition.mDomain)
+        + ", " + std::to_string(lTransition.mEntryBegin) + ", " + std::to_string(lTransition.mEntryEnd)
+        + ", " + (lActions[lIndex] == NoTableIndex ? std::string("ifsm::NoTableIndex") : std::to_string(lActions[lIndex]))
+        + ", " + (lConditions[lIndex] == NoTableIndex ? std::string("ifsm::NoTableIndex") : std::to_string(lConditions[lIndex]))
+        + " }, //" + priv::exportLiteral(mStateNames[lTransition.mSource]) + " on " + priv::exportLiteral(*lEventNames[lTransition.getEvent()]) + "\n";
+    }
+    lOut += "  };\n\n";
+  }
+
+  priv::exportArray(lOut, "DispatchOffsets", mDispatchOffsets);
+  priv::exportArray(lOut, "DispatchTransitions", mDispatchTransitions);
+  priv::exportArray(lOut, "EntrySequences", mEntrySequences);
+  priv::exportArray(lOut, "DefaultEntry", mDefaultEntry);
+
+  lOut += "  static constexpr ifsm::ChartTables Tables = {\n";
+  lOut += "    " + std::to_string(mFingerprint) + "ULL,\n";
+  lOut += "    " + std::to_string(mStates.size()) + ", States, StateNames,\n";
+  lOut += "    " + std::to_string(lEventNames.size()) + ", EventNames,\n";
+  lOut += "    Transitions, DispatchOffsets, DispatchTransitions, EntrySequences,\n";
+  lOut += "    DefaultEntry, " + std::to_string(mDefaultEntry.size()) + ",\n";
+  lOut += "    CallbackCount, ConditionCount\n";
+  lOut += "  };\n}\n\n#endif\n";
+  return lOut;
+}
+
+std::string ifsm::priv::exportIdentifier(const std::string& pName, std::unordered_set<std::string>& pUsed){
+  static const char* const sKeywords[] = {
+    "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case", "catch",
+    "char", "char16_t", "char32_t", "class", "compl", "const", "constexpr", "const_cast", "continue", "decltype",
+    "default", "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false",
+    "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept",
+    "not", "not_eq", "nullptr", "operator", "or", "or_eq", "private", "protected", "public", "register",
+    "reinterpret_cast", "return", "short", "signed", "sizeof", "static", "static_assert", "static_cast", "struct",
+    "switch", "template", "this", "thread_local", "throw", "true", "try", "typedef", "typeid", "typename", "union",
+    "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq"
+  };
+
+  std::string lIdentifier;
+  for (char lChar : pName){
+    lIdentifier += std::isalnum(static_cast<unsigned char>(lChar)) ? lChar : '_';
+  }
+  if (lIdentifier.empty() || std::isdigit(static_cast<unsigned char>(lIdentifier[0]))){
+    lIdentifier.insert(lIdentifier.begin(), '_');
+  }
+  for (const char* lKeyword : sKeywords){
+    if (lIdentifier == lKeyword){
+      lIdentifier += '_';
+      break;
+    }
+  }
+
+  std::string lUnique = lIdentifier;
+  for (std::size_t lSuffix = 2; !pUsed.insert(lUnique).second; ++lSuffix){
+    lUnique = lIdentifier + "_" + std::to_string(lSuffix);
+  }
+  return lUnique;
+}
+
+std::string ifsm::priv::exportLiteral(const std::string& pValue){
+  static const char sDigits[] = "01234567";
+  std::string lLiteral(1, '"');
+  for (char lChar : pValue){
+    const unsigned char lByte = static_cast<unsigned char>(lChar);
+    if (lChar == '"' || lChar == '\\'){
+      lLiteral += '\\';
+      lLiteral += lChar;
+    }
+    else if (lByte < 0x20 || lByte >= 0x7f){
+      //octal escapes are at most 3 digits long : the next character can't extend them
+      lLiteral += '\\';
+      lLiteral += sDigits[lByte >> 6];
+      lLiteral += sDigits[(lByte >> 3) & 7];
+      lLiteral += sDigits[lByte & 7];
+    }
+    else {
+      lLiteral += lChar;
+    }
+  }
+  lLiteral += '"';
+  return lLiteral;
+}
+
+void ifsm::priv::exportArray(std::string& pOut, const std::string& pName, const std::vector<std::uint32_t>& pValues){
+  if (pValues.empty()){
+    pOut += "  static constexpr const std::uint32_t* " + pName + " = nullptr;\n\n";
+    return;
+  }
+
+  pOut += "  static constexpr std::uint32_t " + pName + "[] = {";
+  for (std::size_t lIndex = 0; lIndex < pValues.size(); ++lIndex){
+    pOut += lIndex % 16 == 0 ? "\n    " : " ";
+    pOut += std::to_string(pValues[lIndex]) + ",";
+  }
+  pOut += "\n  };\n\n";
 }
 
-template <class FunType>
-ifsm::priv::TransitionCondition ifsm::Condition(FunType&& pCondition){
-  using ifsm::priv::returns;
-  using ifsm::priv::returns_with;
-  static_assert(returns<FunType, bool>::value || returns_with<FunType, bool, const StateMachine&>::value,
-    "parameter to action must be callable either with no paramater or a 'StateMachine&' parameter and must return 'bool'");
-  return priv::TransitionCondition(priv::fixConditionParams(pCondition));
+ifsm::TableStateMachine::TableStateMachine(const ChartTables& pTables, const Callback* pCallbacks, const Condition* pConditions, void* pContext)
+: mTables(&pTables)
+, mCallbacks(pCallbacks)
+, mConditions(pConditions)
+, mContext(pContext)
+, mLeaf(NoTableIndex)
+, mFront(0)
+, mSize(0)
+, mUnhandledEvents(0)
+, mIsActive(false)
+, mInToplevelProcess(false){
+
 }
 
-ifsm::priv::TransitionEvent ifsm::OnEvent(const std::string& pEvent){
-  return priv::TransitionEvent(pEvent);
+void ifsm::TableStateMachine::enter(){
+  if (mIsActive){
+    return;
+  }
+
+  const ChartTables& lTables = *mTables;
+  const bool lInToplevelProcess = mInToplevelProcess;
+  mIsActive = true;
+  mInToplevelProcess = true;
+  for (std::uint32_t lIndex = 0; lIndex < lTables.mDefaultEntrySize; ++lIndex){
+    mLeaf = lTables.mDefaultEntry[lIndex];
+    call(lTables.mStates[mLeaf].mOnEntryBegin, lTables.mStates[mLeaf].mOnEntryEnd);
+  }
+  mInToplevelProcess = lInToplevelProcess;
+
+  processEvents();
 }
 
-ifsm::priv::TransitionTarget::TransitionTarget(const std::string& pTargetName)
-  : mTargetName(pTargetName){}
-  
-ifsm::priv::TransitionAction::TransitionAction(std::function<void(StateMachine&)>&& pFun)
-  : mFun(pFun){}
+void ifsm::TableStateMachine::leave(){
+  if (!mIsActive){
+    return;
+  }
 
-void ifsm::priv::TransitionAction::operator()(StateMachine& pRoot){
-  mFun(pRoot);
+  const ChartTables& lTables = *mTables;
+  for (std::uint32_t lState = mLeaf; lState != NoTableIndex; lState = mLeaf){
+    mLeaf = lTables.mStates[lState].mParent;
+    call(lTables.mStates[lState].mOnExitBegin, lTables.mStates[lState].mOnExitEnd);
+  }
+  mIsActive = false;
 }
 
-ifsm::priv::TransitionCondition::TransitionCondition(std::function<bool(const StateMachine&)>&& pCond)
-  : mCond(pCond)
-{}
+bool ifsm::TableStateMachine::isActive() const{
+  return mIsActive;
+}
 
-bool ifsm::priv::TransitionCondition::operator()(const StateMachine& pRoot){
-  return mCond(pRoot);
+void ifsm::TableStateMachine::pushEvent(EventId pEvent){
+  if (pEvent < mTables->mEventCount){
+    if (mSize == QueueCapacity){
+      throw EventQueueFull(QueueCapacity);
+    }
+    mEvents[(mFront + mSize) % QueueCapacity] = pEvent;
+    ++mSize;
+  }
+  processEvents();
 }
 
-ifsm::priv::TransitionEvent::TransitionEvent(const std::string& pEvent)
-  : mEvent(pEvent){}
+ifsm::EventId ifsm::TableStateMachine::event(const std::string& pEvent) const{
+  for (std::uint32_t lEvent = 0; lEvent < mTables->mEventCount; ++lEvent){
+    if (pEvent == mTables->mEventNames[lEvent]){
+      return lEvent;
+    }
+  }
+  throw NoSuchEvent(pEvent);
+}
 
-ifsm::priv::TransitionDef::TransitionDef(TransitionDef&& pRhs)
-: mTarget(std::move(pRhs.mTarget))
-, mEvent(std::move(pRhs.mEvent))
-, mAction(std::move(pRhs.mAction))
-, mCondition(std::move(pRhs.mCondition)){
+ifsm::StateId ifsm::TableStateMachine::state(const std::string& pState) const{
+  for (std::uint32_t lState = 0; lState < mTables->mStateCount; ++lState){
+    if (pState == mTables->mStateNames[lState]){
+      return lState;
+    }
+  }
+  throw NoSuchState(pState);
+}
+
+bool ifsm::TableStateMachine::inState(StateId pState) const{
+  if (pState == 0){
+    return mIsActive;
+  }
 
+  //the active states are the deepest one and its ancestors, whose subtrees contain it
+  return pState < mTables->mStateCount && pState <= mLeaf && mLeaf < mTables->mStates[pState].mSubtreeEnd;
 }
-  
-template <typename... Params>
-ifsm::priv::TransitionDef::TransitionDef(Params && ... pParams){
-  addParameters(std::forward<Params>(pParams)...);
+
+ifsm::StateId ifsm::TableStateMachine::activeState() const{
+  return mIsActive ? mLeaf : InvalidState;
+}
+
+void* ifsm::TableStateMachine::context() const{
+  return mContext;
+}
+
+const ifsm::ChartTables& ifsm::TableStateMachine::tables() const{
+  return *mTables;
+}
+
+std::uint64_t ifsm::TableStateMachine::unhandledEvents() const{
+  return mUnhandledEvents;
+}
+
+void ifsm::TableStateMachine::processEvents(){
+  if (mInToplevelProcess){
+    return;
+  }
+
+  mInToplevelProcess = true;
+  while (mSize != 0){
+    const EventId lEvent = mEvents[mFront];
+    mFront = (mFront + 1) % QueueCapacity;
+    --mSize;
+    if (mIsActive){
+      processEvent(lEvent);
+    }
+  }
+  mInToplevelProcess = false;
+}
+
+void ifsm::TableStateMachine::processEvent(EventId pEvent){
+  const ChartTables& lTables = *mTables;
+  const std::uint32_t* lOffsets = &lTables.mDispatchOffsets[lTables.mStates[mLeaf].mDispatchRow * (lTables.mEventCount + 1) + pEvent];
+  if (lOffsets[0] == lOffsets[1]){
+    ++mUnhandledEvents;
+    return;
+  }
+
+  //the enabled candidates of the closest state that has one, as bits from the first of them
+  std::uint32_t lFirst = lOffsets[0];
+  std::uint64_t lEnabled = 0;
+  for (std::uint32_t lCandidate = lOffsets[0]; lCandidate < lOffsets[1]; ++lCandidate){
+    const TableTransition& lTransition = lTables.mTransitions[lTables.mDispatchTransitions[lCandidate]];
+    if (lEnabled != 0 && lTransition.mSource != lTables.mTransitions[lTables.mDispatchTransitions[lFirst]].mSource){
+      break;
+    }
+    if (test(lTransition.mCondition)){
+      lFirst = lEnabled == 0 ? lCandidate : lFirst;
+      lEnabled |= std::uint64_t(1) << (lCandidate - lFirst);
+    }
+  }
+
+  //as StateMachine selects them : every enabled targetless transition, and of the targeted ones the first,
+  //unless a later one targets a descendant of its target
+  std::uint32_t lSelected = NoTableIndex;
+  for (std::uint32_t lBit = 0; lBit < 64 && (lEnabled >> lBit) != 0; ++lBit){
+    const std::uint32_t lTransition = lTables.mDispatchTransitions[lFirst + lBit];
+    const std::uint32_t lTarget = lTables.mTransitions[lTransition].mTarget;
+    if (((lEnabled >> lBit) & 1) == 0 || lTarget == NoTableIndex){
+      continue;
+    }
+    if (lSelected == NoTableIndex || (lTables.mTransitions[lSelected].mTarget <= lTarget
+      && lTarget < lTables.mStates[lTables.mTransitions[lSelected].mTarget].mSubtreeEnd)){
+      lSelected = lTransition;
+    }
+  }
+
+  //with a single active atomic state, the exited states are its ancestors up to the domain
+  if (lSelected != NoTableIndex){
+    const std::uint32_t lDomain = lTables.mTransitions[lSelected].mDomain;
+    for (std::uint32_t lState = mLeaf; lState != lDomain; lState = mLeaf){
+      mLeaf = lTables.mStates[lState].mParent;
+      call(lTables.mStates[lState].mOnExitBegin, lTables.mStates[lState].mOnExitEnd);
+    }
+  }
+
+  for (std::uint32_t lBit = 0; lBit < 64 && (lEnabled >> lBit) != 0; ++lBit){
+    const std::uint32_t lTransition = lTables.mDispatchTransitions[lFirst + lBit];
+    const std::uint32_t lAction = lTables.mTransitions[lTransition].mAction;
+    if (((lEnabled >> lBit) & 1) != 0 && lAction != NoTableIndex
+      && (lTransition == lSelected || lTables.mTransitions[lTransition].mTarget == NoTableIndex)){
+      call(lAction, lAction + 1);
+    }
+  }
+
+  //and the entered states a path from the domain down to the new atomic state
+  if (lSelected != NoTableIndex){
+    for (std::uint32_t lEntry = lTables.mTransitions[lSelected].mEntryBegin; lEntry < lTables.mTransitions[lSelected].mEntryEnd; ++lEntry){
+      mLeaf = lTables.mEntrySequences[lEntry];
+      call(lTables.mStates[mLeaf].mOnEntryBegin, lTables.mStates[mLeaf].mOnEntryEnd);
+    }
+  }
+}
+
+void ifsm::TableStateMachine::call(std::uint32_t pBegin, std::uint32_t pEnd){
+  for (std::uint32_t lSlot = pBegin; mCallbacks && lSlot < pEnd; ++lSlot){
+    if (mCallbacks[lSlot]){
+      mCallbacks[lSlot](*this);
+    }
+  }
+}
+
+bool ifsm::TableStateMachine::test(std::uint32_t pCondition) const{
+  return pCondition == NoTableIndex || !mConditions || !mConditions[pCondition] || mConditions[pCondition](*this);
 }
 
-void ifsm::priv::TransitionDef::addParameter(priv::TransitionTarget && pTarget){
-  if (!mTarget.empty()){
-    throw TargetAlreadySpecified(pTarget.mTargetName);
-  }
+/**************************************************/
+/*
+StaticStateMachine : compile-time variant of StateMachine.
+
+States and events are identified by types instead of strings, callbacks keep their
+concrete type instead of being wrapped into std::function, and the transitions for
+each (event, atomic state) pair are resolved at compile time : pushing an event is
+an indexed call to a function where exits, actions and entries are inlined.
+Parallel states are not supported, use StateMachine for charts with parallel regions.
+Callbacks are callable with no parameter.
+
+struct stopped; struct playing; struct play;
+
+auto myMachine = makeStaticStateMachine( typed::State|typed::Transition|typed::OnEntry|typed::OnExit|typed::OnEvent )
+  myMachine.enter() / myMachine.leave()
+  myMachine.pushEvent<play>() : push an event
+  myMachine.inState<playing>() : returns true if the state is active
+
+typed::State<stopped>(initialTag|typed::State|typed::OnEntry|typed::OnExit|typed::OnEvent|typed::Transition)
+typed::Transition(typed::OnEvent<play>()|typed::Target<playing>()|typed::Action(void(void))|typed::Condition(bool(void)))
+typed::OnEvent<play>( void(void) ) : targetless transition
+*/
+
+namespace ifsm{
+  namespace priv{
+    static const std::size_t NoPosition = static_cast<std::size_t>(-1);
+
+    template <class... Types>
+    struct TypeList{};
+
+    template <class Lhs, class Rhs>
+    struct Concat;
+
+    template <class... Lhs, class... Rhs>
+    struct Concat<TypeList<Lhs...>, TypeList<Rhs...>>{
+      typedef TypeList<Lhs..., Rhs...> type;
+    };
+
+    template <std::size_t Index, class List>
+    struct TypeAt;
+
+    template <class Head, class... Tail>
+    struct TypeAt<0, TypeList<Head, Tail...>>{
+      typedef Head type;
+    };
+
+    template <std::size_t Index, class Head, class... Tail>
+    struct TypeAt<Index, TypeList<Head, Tail...>>{
+      typedef typename TypeAt<Index - 1, TypeList<Tail...>>::type type;
+    };
+
+    //position of the first of Types satisfying Pred, or NoPosition
+    template <template <class> class Pred, std::size_t Index, class... Types>
+    struct FindIf{
+      static const std::size_t value = NoPosition;
+    };
+
+    template <template <class> class Pred, std::size_t Index, class Head, class... Tail>
+    struct FindIf<Pred, Index, Head, Tail...>{
+      static const std::size_t value = Pred<Head>::value ? Index : FindIf<Pred, Index + 1, Tail...>::value;
+    };
+
+    template <template <class> class Pred, class... Types>
+    struct CountIf{
+      static const std::size_t value = 0;
+    };
+
+    template <template <class> class Pred, class Head, class... Tail>
+    struct CountIf<Pred, Head, Tail...>{
+      static const std::size_t value = (Pred<Head>::value ? 1 : 0) + CountIf<Pred, Tail...>::value;
+    };
+
+    template <class Event>
+    struct StaticEvent{};
+
+    template <class State>
+    struct StaticTarget{};
+
+    template <class FunType>
+    struct StaticAction{
+      FunType mFun;
+    };
+
+    template <class FunType>
+    struct StaticCondition{
+      FunType mFun;
+    };
+
+    template <class FunType>
+    struct StaticOnEntry{
+      FunType mFun;
+    };
+
+    template <class FunType>
+    struct StaticOnExit{
+      FunType mFun;
+    };
+
+    template <class... Params>
+    struct StaticTransitionDef{
+      std::tuple<Params...> mParams;
+    };
+
+    template <class Tag, class... Params>
+    struct StaticStateDef{
+      typedef Tag TagType;
+      std::tuple<Params...> mParams;
+    };
+
+    //tag of the root state of a StaticStateMachine
+    struct StaticRoot{};
+
+    template <class T> struct IsStaticEvent : std::false_type{};
+    template <class E> struct IsStaticEvent<StaticEvent<E>> : std::true_type{};
+
+    template <class T> struct IsStaticTarget : std::false_type{};
+    template <class S> struct IsStaticTarget<StaticTarget<S>> : std::true_type{};
+
+    template <class T> struct IsStaticAction : std::false_type{};
+    template <class F> struct IsStaticAction<StaticAction<F>> : std::true_type{};
+
+    template <class T> struct IsStaticCondition : std::false_type{};
+    template <class F> struct IsStaticCondition<StaticCondition<F>> : std::true_type{};
+
+    template <class T> struct IsStaticOnEntry : std::false_type{};
+    template <class F> struct IsStaticOnEntry<StaticOnEntry<F>> : std::true_type{};
+
+    template <class T> struct IsStaticOnExit : std::false_type{};
+    template <class F> struct IsStaticOnExit<StaticOnExit<F>> : std::true_type{};
+
+    template <class T> struct IsStaticState : std::false_type{};
+    template <class Tag, class... P> struct IsStaticState<StaticStateDef<Tag, P...>> : std::true_type{};
+
+    template <class T> struct IsInitialTag : std::is_same<T, initialTag_t>{};
+
+    template <class T> struct IsParallelTag : std::is_same<T, parallelTag_t>{};
+
+    template <class T> struct StaticEventOf{ typedef void type; };
+    template <class E> struct StaticEventOf<StaticEvent<E>>{ typedef E type; };
+
+    template <class T> struct StaticTargetOf{ typedef void type; };
+    template <class S> struct StaticTargetOf<StaticTarget<S>>{ typedef S type; };
+
+    template <std::size_t Index, class List>
+    struct TypeAtOrVoid{
+      typedef typename TypeAt<Index, List>::type type;
+    };
+
+    template <class List>
+    struct TypeAtOrVoid<NoPosition, List>{
+      typedef void type;
+    };
+
+    template <class Transition>
+    struct StaticTransitionTraits;
+
+    template <class... Params>
+    struct StaticTransitionTraits<StaticTransitionDef<Params...>>{
+      static_assert(CountIf<IsStaticEvent, Params...>::value == 1, "a typed::Transition must have exactly one typed::OnEvent parameter");
+      static_assert(CountIf<IsStaticTarget, Params...>::value <= 1, "a typed::Transition defines two Targets. Only one is allowed");
+      static_assert(CountIf<IsStaticAction, Params...>::value <= 1, "a typed::Transition has two Action parameters defined. Only one is allowed");
+      static_assert(CountIf<IsStaticCondition, Params...>::value <= 1, "a typed::Transition has two Condition parameters defined. Only one is allowed");
+
+      static const std::size_t action = FindIf<IsStaticAction, 0, Params...>::value;
+      static const std::size_t condition = FindIf<IsStaticCondition, 0, Params...>::value;
+      typedef typename StaticEventOf<typename TypeAtOrVoid<FindIf<IsStaticEvent, 0, Params...>::value, TypeList<Params...>>::type>::type Event;
+      typedef typename StaticTargetOf<typename TypeAtOrVoid<FindIf<IsStaticTarget, 0, Params...>::value, TypeList<Params...>>::type>::type Target;
+    };
+
+    template <class T, class Event>
+    struct IsStaticTransitionOn : std::false_type{};
+
+    template <class Event, class... Params>
+    struct IsStaticTransitionOn<StaticTransitionDef<Params...>, Event>
+      : std::is_same<typename StaticTransitionTraits<StaticTransitionDef<Params...>>::Event, Event>{};
+
+    /*
+    access to the definition of a state from the definition of the root
+    */
+    struct StaticRootAccessor{
+      template <class Root>
+      static Root& get(Root& pRoot){
+        return pRoot;
+      }
+    };
+
+    template <class Parent, std::size_t Index>
+    struct StaticChildAccessor{
+      template <class Root>
+      static auto get(Root& pRoot) -> decltype(std::get<Index>(Parent::get(pRoot).mParams)){
+        return std::get<Index>(Parent::get(pRoot).mParams);
+      }
+    };
+
+    /*
+    compile-time counterpart of StateImpl
+    */
+    template <class Def, class Accessor, std::size_t Ordinal, std::size_t Parent, std::size_t SubtreeEnd, std::size_t Initial>
+    struct StaticStateInfo{
+      typedef Def Definition;
+      typedef typename Def::TagType Tag;
+      typedef Accessor DefinitionAccessor;
+      static const std::size_t ordinal = Ordinal;
+      static const std::size_t parent = Parent;
+      static const std::size_t subtreeEnd = SubtreeEnd;
+      static const std::size_t initial = Initial;
+      static const bool atomic = SubtreeEnd == Ordinal + 1;
+    };
+
+    /*
+    flatten a tree of StaticStateDef into a TypeList of StaticStateInfo, in document order
+    */
+    template <class Def, class Accessor, std::size_t Ordinal, std::size_t Parent>
+    struct StaticFlattenState;
+
+    template <class Param, class Accessor, std::size_t Next, std::size_t Parent>
+    struct StaticFlattenParam{
+      typedef TypeList<> type;
+      static const std::size_t end = Next;
+      static const std::size_t initial = NoPosition;
+      static const std::size_t initialCount = 0;
+    };
+
+    template <class Tag, class... Params, class Accessor, std::size_t Next, std::size_t Parent>
+    struct StaticFlattenParam<StaticStateDef<Tag, Params...>, Accessor, Next, Parent>{
+      typedef StaticFlattenState<StaticStateDef<Tag, Params...>, Accessor, Next, Parent> Flat;
+      typedef typename Flat::type type;
+      static const std::size_t end = Flat::end;
+      static const bool isInitial = CountIf<IsInitialTag, Params...>::value > 0;
+      static const std::size_t initial = isInitial ? Next : NoPosition;
+      static const std::size_t initialCount = isInitial ? 1 : 0;
+    };
+
+    template <class Accessor, std::size_t TupleIndex, std::size_t Next, std::size_t Parent, class... Params>
+    struct StaticFlattenChildren{
+      typedef TypeList<> type;
+      static const std::size_t end = Next;
+      static const std::size_t initial = NoPosition;
+      static const std::size_t initialCount = 0;
+    };
+
+    template <class Accessor, std::size_t TupleIndex, std::size_t Next, std::size_t Parent, class Head, class... Tail>
+    struct StaticFlattenChildren<Accessor, TupleIndex, Next, Parent, Head, Tail...>{
+      typedef StaticFlattenParam<Head, StaticChildAccessor<Accessor, TupleIndex>, Next, Parent> First;
+      typedef StaticFlattenChildren<Accessor, TupleIndex + 1, First::end, Parent, Tail...> Rest;
+      typedef typename Concat<typename First::type, typename Rest::type>::type type;
+      static const std::size_t end = Rest::end;
+      static const std::size_t initial = First::initial != NoPosition ? First::initial : Rest::initial;
+      static const std::size_t initialCount = First::initialCount + Rest::initialCount;
+    };
+
+    template <class Tag, class... Params, class Accessor, std::size_t Ordinal, std::size_t Parent>
+    struct StaticFlattenState<StaticStateDef<Tag, Params...>, Accessor, Ordinal, Parent>{
+      static_assert(CountIf<IsParallelTag, Params...>::value == 0, "StaticStateMachine doesn't support parallel states. Use StateMachine instead");
+
+      typedef StaticFlattenChildren<Accessor, 0, Ordinal + 1, Ordinal, Params...> Children;
+      static_assert(Children::initialCount <= 1, "a typed::State has two children with initialTag parameter set. Only one initial child is permitted");
+      static_assert(Children::end == Ordinal + 1 || Children::initialCount == 1, "a nested typed::State doesn't have any initial child. One initial child is required");
+
+      static const std::size_t end = Children::end;
+      typedef StaticStateInfo<StaticStateDef<Tag, Params...>, Accessor, Ordinal, Parent, end, Children::initial> Info;
+      typedef typename Concat<TypeList<Info>, typename Children::type>::type type;
+    };
+
+    template <class Tag, class List>
+    struct StaticStateCount;
+
+    template <class Tag, class... Infos>
+    struct StaticStateCount<Tag, TypeList<Infos...>>{
+      template <class Info> struct HasTag : std::is_same<typename Info::Tag, Tag>{};
+      static const std::size_t value = CountIf<HasTag, Infos...>::value;
+      static const std::size_t position = FindIf<HasTag, 0, Infos...>::value;
+    };
+
+    /*
+    grants the static helpers below access to the StaticStateMachine internals
+    */
+    template <class Machine>
+    struct StaticAccess{
+      static typename Machine::Definition& definition(Machine& pMachine){
+        return pMachine.mDefinition;
+      }
+
+      static void setLeaf(Machine& pMachine, std::size_t pLeaf){
+        pMachine.mLeaf = pLeaf;
+      }
+
+      static std::size_t getLeaf(const Machine& pMachine){
+        return pMachine.mLeaf;
+      }
+    };
+
+    template <class Machine, std::size_t Ordinal>
+    struct StaticState{
+      typedef typename TypeAt<Ordinal, typename Machine::States>::type type;
+
+      static auto definition(Machine& pMachine) -> decltype(type::DefinitionAccessor::get(StaticAccess<Machine>::definition(pMachine))){
+        return type::DefinitionAccessor::get(StaticAccess<Machine>::definition(pMachine));
+      }
+    };
+
+    template <class Machine, class Tag>
+    struct StaticStateOrdinal{
+      typedef StaticStateCount<Tag, typename Machine::States> Count;
+      static_assert(Count::value == 1, "the StaticStateMachine must declare exactly one typed::State for this tag");
+      static const std::size_t value = Count::position;
+    };
+
+    template <class Machine, std::size_t Lhs, std::size_t Rhs>
+    struct StaticContains{
+      static const bool value = StaticState<Machine, Lhs>::type::ordinal <= Rhs && Rhs < StaticState<Machine, Lhs>::type::subtreeEnd;
+    };
+
+    /*
+    call the member mFun of each element of the tuple satisfying Pred
+    */
+    template <template <class> class Pred, std::size_t Index, std::size_t Size>
+    struct StaticCallEach{
+      template <class Tuple>
+      static void call(Tuple& pTuple){
+        callIf(pTuple, std::integral_constant<bool, Pred<typename std::tuple_element<Index, Tuple>::type>::value>());
+        StaticCallEach<Pred, Index + 1, Size>::call(pTuple);
+      }
+
+      template <class Tuple>
+      static void callIf(Tuple& pTuple, std::true_type){
+        std::get<Index>(pTuple).mFun();
+      }
+
+      template <class Tuple>
+      static void callIf(Tuple&, std::false_type){}
+    };
+
+    template <template <class> class Pred, std::size_t Size>
+    struct StaticCallEach<Pred, Size, Size>{
+      template <class Tuple>
+      static void call(Tuple&){}
+    };
+
+    template <class Machine, std::size_t Ordinal>
+    struct StaticEnterState{
+      static void run(Machine& pMachine){
+        auto& lParams = StaticState<Machine, Ordinal>::definition(pMachine).mParams;
+        StaticCallEach<IsStaticOnEntry, 0, std::tuple_size<typename std::decay<decltype(lParams)>::type>::value>::call(lParams);
+      }
+    };
+
+    template <class Machine, std::size_t Ordinal>
+    struct StaticExitState{
+      static void run(Machine& pMachine){
+        auto& lParams = StaticState<Machine, Ordinal>::definition(pMachine).mParams;
+        StaticCallEach<IsStaticOnExit, 0, std::tuple_size<typename std::decay<decltype(lParams)>::type>::value>::call(lParams);
+      }
+    };
+
+    /*
+    enter a state and its initial children. leaf is the atomic state entered last
+    */
+    template <class Machine, std::size_t Ordinal, std::size_t Initial = StaticState<Machine, Ordinal>::type::initial>
+    struct StaticEnterDefault{
+      static const std::size_t leaf = StaticEnterDefault<Machine, Initial>::leaf;
+
+      static void run(Machine& pMachine){
+        StaticEnterState<Machine, Ordinal>::run(pMachine);
+        StaticEnterDefault<Machine, Initial>::run(pMachine);
+      }
+    };
+
+    template <class Machine, std::size_t Ordinal>
+    struct StaticEnterDefault<Machine, Ordinal, NoPosition>{
+      static const std::size_t leaf = Ordinal;
+
+      static void run(Machine& pMachine){
+        StaticEnterState<Machine, Ordinal>::run(pMachine);
+      }
+    };
+
+    /*
+    enter the ancestors of a state that are descendants of the domain, from the outermost one
+    */
+    template <class Machine, std::size_t Domain, std::size_t Ordinal, std::size_t Parent = StaticState<Machine, Ordinal>::type::parent>
+    struct StaticEnterAncestors{
+      static void run(Machine& pMachine){
+        StaticEnterAncestors<Machine, Domain, Parent>::run(pMachine);
+        StaticEnterState<Machine, Parent>::run(pMachine);
+      }
+    };
+
+    template <class Machine, std::size_t Domain, std::size_t Ordinal>
+    struct StaticEnterAncestors<Machine, Domain, Ordinal, Domain>{
+      static void run(Machine&){}
+    };
+
+    /*
+    exit a state and its ancestors up to the domain, excluded
+    */
+    template <class Machine, std::size_t Ordinal, std::size_t Domain>
+    struct StaticExitPath{
+      static void run(Machine& pMachine){
+        StaticExitState<Machine, Ordinal>::run(pMachine);
+        StaticExitPath<Machine, StaticState<Machine, Ordinal>::type::parent, Domain>::run(pMachine);
+      }
+    };
+
+    template <class Machine, std::size_t Domain>
+    struct StaticExitPath<Machine, Domain, Domain>{
+      static void run(Machine&){}
+    };
 
-  mTarget = pTarget.mTargetName;
-}
+    /*
+    least common ancestor of the source and target states, from the ancestor Candidate up
+    */
+    template <class Machine, std::size_t Candidate, std::size_t Target>
+    struct StaticDomainFrom{
+      static const bool found = Candidate != Target && StaticContains<Machine, Candidate, Target>::value;
+      static const std::size_t value = found ? Candidate
+        : StaticDomainFrom<Machine, (found ? NoPosition : StaticState<Machine, Candidate>::type::parent), Target>::value;
+    };
 
-void ifsm::priv::TransitionDef::addParameter(priv::TransitionAction && pAction){
-  if (mAction){
-    throw ActionAlreadySpecified();
-  }
+    template <class Machine, std::size_t Target>
+    struct StaticDomainFrom<Machine, NoPosition, Target>{
+      static const std::size_t value = 0;
+    };
 
-  mAction = pAction.mFun;
-}
+    /*
+    compile-time description of a targeted transition
+    */
+    template <class Machine, std::size_t Source, class Transition, class Target = typename StaticTransitionTraits<Transition>::Target>
+    struct StaticTransitionPath{
+      static const bool targetless = false;
+      static const std::size_t target = StaticStateOrdinal<Machine, Target>::value;
+      static const std::size_t targetEnd = StaticState<Machine, target>::type::subtreeEnd;
+      static const std::size_t domain = StaticDomainFrom<Machine, StaticState<Machine, Source>::type::parent, target>::value;
+      static const std::size_t leaf = StaticEnterDefault<Machine, target>::leaf;
+
+      template <std::size_t Leaf>
+      static void exit(Machine& pMachine){
+        StaticExitPath<Machine, Leaf, domain>::run(pMachine);
+      }
 
-void ifsm::priv::TransitionDef::addParameter(priv::TransitionCondition && pCondition){
-  if (mCondition){
-    throw ConditionAlreadySpecified();
-  }
+      static void enter(Machine& pMachine){
+        StaticEnterAncestors<Machine, domain, target>::run(pMachine);
+        StaticEnterDefault<Machine, target>::run(pMachine);
+        StaticAccess<Machine>::setLeaf(pMachine, leaf);
+      }
+    };
 
-  mCondition = pCondition.mCond;
-}
+    template <class Machine, std::size_t Source, class Transition>
+    struct StaticTransitionPath<Machine, Source, Transition, void>{
+      static const bool targetless = true;
+      static const std::size_t target = NoPosition;
+      static const std::size_t targetEnd = NoPosition;
+      static const std::size_t domain = Source;
 
-void ifsm::priv::TransitionDef::addParameter(priv::TransitionEvent && pEvent){
-  if (!mEvent.empty()){
-    throw EventAlreadySpecified();
-  }
-  
-  mEvent = pEvent.mEvent;
-}
+      template <std::size_t Leaf>
+      static void exit(Machine&){}
 
-template <class T>
-void ifsm::priv::TransitionDef::addParameters(T&& pParam1){
-  addParameter(std::forward<T>(pParam1));
-}
+      static void enter(Machine&){}
+    };
 
-template <class T, typename... Params>
-void ifsm::priv::TransitionDef::addParameters(T&& pParam1, Params && ... pParams){
-  addParameter(std::forward<T>(pParam1));
-  addParameters(std::forward<Params>(pParams)...);
-}
+    template <class Transition, std::size_t Index = StaticTransitionTraits<Transition>::condition>
+    struct StaticTestCondition{
+      static bool test(Transition& pTransition){
+        return std::get<Index>(pTransition.mParams).mFun();
+      }
+    };
 
-template <typename... Params>
-ifsm::priv::TransitionDef ifsm::Transition(Params && ... pParams){
-  return priv::TransitionDef(std::forward<Params>(pParams)...);
-}
+    template <class Transition>
+    struct StaticTestCondition<Transition, NoPosition>{
+      static bool test(Transition&){
+        return true;
+      }
+    };
 
-ifsm::priv::TransitionImpl::TransitionImpl(const TransitionDef& pDef)
-: mSource(nullptr)
-, mTarget(nullptr)
-, mEvent(std::move(pDef.mEvent))
-, mAction(std::move(pDef.mAction))
-, mCondition(std::move(pDef.mCondition)){
-  
-}
+    template <class Transition, std::size_t Index = StaticTransitionTraits<Transition>::action>
+    struct StaticDoAction{
+      static void run(Transition& pTransition){
+        std::get<Index>(pTransition.mParams).mFun();
+      }
+    };
 
-void ifsm::priv::TransitionImpl::setSource(StateImpl* pSource){
-  mSource = pSource;
-}
+    template <class Transition>
+    struct StaticDoAction<Transition, NoPosition>{
+      static void run(Transition&){}
+    };
 
-void ifsm::priv::TransitionImpl::setTarget(StateImpl* pTarget){
- mTarget = pTarget;
-}
+    /*
+    walk the parameters of the state Source for the transitions reacting to Event,
+    while the atomic state Leaf is active.
+    Same selection as StateMachine : every enabled targetless transition fires, and of the
+    enabled targeted ones, a later one preempts an earlier one only if its target is
+    a descendant of the earlier target
+    */
+    template <class Machine, class Event, std::size_t Leaf, std::size_t Source, std::size_t Index, std::size_t Size>
+    struct StaticTransitionLoop{
+      typedef typename std::decay<decltype(StaticState<Machine, Source>::definition(std::declval<Machine&>()).mParams)>::type Params;
+      typedef typename std::tuple_element<Index, Params>::type Param;
+      typedef StaticTransitionLoop<Machine, Event, Leaf, Source, Index + 1, Size> Next;
+      typedef std::integral_constant<bool, IsStaticTransitionOn<Param, Event>::value> Matches;
+
+      static Param& param(Machine& pMachine){
+        return std::get<Index>(StaticState<Machine, Source>::definition(pMachine).mParams);
+      }
 
-const ifsm::priv::StateImpl* ifsm::priv::TransitionImpl::getSource() const{
-  return mSource;
-}
+      static void test(Machine& pMachine, std::uint64_t& pEnabled){
+        test(pMachine, pEnabled, Matches());
+        Next::test(pMachine, pEnabled);
+      }
 
-const ifsm::priv::StateImpl* ifsm::priv::TransitionImpl::getTarget() const{
-  return mTarget;
-}
+      static void test(Machine& pMachine, std::uint64_t& pEnabled, std::true_type){
+        if (StaticTestCondition<Param>::test(param(pMachine))){
+          pEnabled |= std::uint64_t(1) << Index;
+        }
+      }
 
-const std::string& ifsm::priv::TransitionImpl::getEvent() const {
-  return mEvent;
-}
+      static void test(Machine&, std::uint64_t&, std::false_type){}
 
-bool ifsm::priv::TransitionImpl::test(const StateMachine& pRoot) const {
-  if (!mCondition){
-    return true;
-  }
-  return mCondition(pRoot);
-}
+      static void select(std::uint64_t pEnabled, std::size_t& pSelected, std::size_t& pTargetBegin, std::size_t& pTargetEnd){
+        select(pEnabled, pSelected, pTargetBegin, pTargetEnd, Matches());
+        Next::select(pEnabled, pSelected, pTargetBegin, pTargetEnd);
+      }
 
-void ifsm::priv::TransitionImpl::doAction(StateMachine& pRoot) const {
-  if (mAction) {
-    mAction(pRoot);
-  }
-}
+      static void select(std::uint64_t pEnabled, std::size_t& pSelected, std::size_t& pTargetBegin, std::size_t& pTargetEnd, std::true_type){
+        typedef StaticTransitionPath<Machine, Source, Param> Path;
+        if (Path::targetless || !(pEnabled & (std::uint64_t(1) << Index))){
+          return;
+        }
+        if (pSelected == NoPosition || (pTargetBegin <= Path::target && Path::target < pTargetEnd)){
+          pSelected = Index;
+          pTargetBegin = Path::target;
+          pTargetEnd = Path::targetEnd;
+        }
+      }
 
-template <typename... Args>
-ifsm::priv::StateDef ifsm::State(const std::string& pName, Args&&... pArgs){
-  return priv::StateDef(pName, std::forward<Args>(pArgs)...);
-}
+      static void select(std::uint64_t, std::size_t&, std::size_t&, std::size_t&, std::false_type){}
 
-ifsm::priv::StateDef::StateDef(const std::string& pName)
-  : mName(pName)
-  , mIsInitial(false)
-  , mIsParallel(false){
+      static void exit(Machine& pMachine, std::size_t pSelected){
+        exit(pMachine, pSelected, Matches());
+        Next::exit(pMachine, pSelected);
+      }
 
-}
+      static void exit(Machine& pMachine, std::size_t pSelected, std::true_type){
+        if (pSelected == Index){
+          StaticTransitionPath<Machine, Source, Param>::template exit<Leaf>(pMachine);
+        }
+      }
 
-template <typename... Params>
-ifsm::priv::StateDef::StateDef(const std::string& pName, Params && ... pParameters)
-  : mName(pName)
-  , mIsInitial(false)
-  , mIsParallel(false){
-  addParameters(std::forward<Params>(pParameters)...);
-}
+      static void exit(Machine&, std::size_t, std::false_type){}
 
+      static void act(Machine& pMachine, std::uint64_t pEnabled, std::size_t pSelected){
+        act(pMachine, pEnabled, pSelected, Matches());
+        Next::act(pMachine, pEnabled, pSelected);
+      }
 
-void ifsm::priv::StateDef::addParameter(StateDef && pState){
-  mChildren.emplace_back(std::move(pState));
-}
+      static void act(Machine& pMachine, std::uint64_t pEnabled, std::size_t pSelected, std::true_type){
+        if ((pEnabled & (std::uint64_t(1) << Index)) && (StaticTransitionPath<Machine, Source, Param>::targetless || pSelected == Index)){
+          StaticDoAction<Param>::run(param(pMachine));
+        }
+      }
 
-void ifsm::priv::StateDef::addParameter(TransitionDef && pTransition){
-  mTransitions.emplace_back(std::move(pTransition));
-}
+      static void act(Machine&, std::uint64_t, std::size_t, std::false_type){}
 
-void ifsm::priv::StateDef::addParameter(priv::OnEntryAction && pAction){
-  mOnEntryActions.emplace_back(std::move(pAction));
-}
+      static void enter(Machine& pMachine, std::size_t pSelected){
+        enter(pMachine, pSelected, Matches());
+        Next::enter(pMachine, pSelected);
+      }
 
-void ifsm::priv::StateDef::addParameter(priv::OnExitAction && pAction){
-  mOnExitActions.emplace_back(std::move(pAction));
-}
+      static void enter(Machine& pMachine, std::size_t pSelected, std::true_type){
+        if (pSelected == Index){
+          StaticTransitionPath<Machine, Source, Param>::enter(pMachine);
+        }
+      }
 
-void ifsm::priv::StateDef::addParameter(priv::initialTag_t& ){
-  mIsInitial = true;
-}
+      static void enter(Machine&, std::size_t, std::false_type){}
+    };
 
-void ifsm::priv::StateDef::addParameter(priv::parallelTag_t& ){
-  mIsParallel = true;
-}
+    template <class Machine, class Event, std::size_t Leaf, std::size_t Source, std::size_t Size>
+    struct StaticTransitionLoop<Machine, Event, Leaf, Source, Size, Size>{
+      static void test(Machine&, std::uint64_t&){}
+      static void select(std::uint64_t, std::size_t&, std::size_t&, std::size_t&){}
+      static void exit(Machine&, std::size_t){}
+      static void act(Machine&, std::uint64_t, std::size_t){}
+      static void enter(Machine&, std::size_t){}
+    };
 
-template <class FirstP>
-void ifsm::priv::StateDef::addParameters(FirstP && pFirst){
-  addParameter(std::forward<FirstP>(pFirst));
-}
+    /*
+    handle Event from the state Source, then from its ancestors until a transition is enabled
+    */
+    template <class Machine, class Event, std::size_t Leaf, std::size_t Source>
+    struct StaticHandleFrom{
+      static void run(Machine& pMachine){
+        typedef typename std::decay<decltype(StaticState<Machine, Source>::definition(pMachine).mParams)>::type Params;
+        typedef StaticTransitionLoop<Machine, Event, Leaf, Source, 0, std::tuple_size<Params>::value> Loop;
+        static_assert(std::tuple_size<Params>::value <= 64, "a typed::State of a StaticStateMachine is limited to 64 parameters");
+
+        std::uint64_t lEnabled = 0;
+        Loop::test(pMachine, lEnabled);
+
+        if (lEnabled == 0){
+          StaticHandleFrom<Machine, Event, Leaf, StaticState<Machine, Source>::type::parent>::run(pMachine);
+          return;
+        }
 
-template <class FirstP, typename... Params>
-void ifsm::priv::StateDef::addParameters(FirstP && pFirst, Params && ... pParameters){
-  addParameter(std::forward<FirstP>(pFirst));
+        std::size_t lSelected = NoPosition;
+        std::size_t lTargetBegin = 0;
+        std::size_t lTargetEnd = 0;
+        Loop::select(lEnabled, lSelected, lTargetBegin, lTargetEnd);
 
-  addParameters(std::forward<Params>(pParameters)...);
-}
+        Loop::exit(pMachine, lSelected);
+        Loop::act(pMachine, lEnabled, lSelected);
+        Loop::enter(pMachine, lSelected);
+      }
+    };
 
-ifsm::priv::StateImpl::StateImpl()
-: mParent(nullptr)
-, mRoot(nullptr)
-, mIsInitial(false)
-, mIsParallel(false)
-, mInitial(nullptr)
-, mActive(nullptr){
+    template <class Machine, class Event, std::size_t Leaf>
+    struct StaticHandleFrom<Machine, Event, Leaf, NoPosition>{
+      static void run(Machine&){}
+    };
 
-}
+    template <class Machine, class Event, class Info, bool Atomic = Info::atomic>
+    struct StaticHandleEvent{
+      static void run(Machine& pMachine){
+        StaticHandleFrom<Machine, Event, Info::ordinal, Info::ordinal>::run(pMachine);
+      }
+    };
 
-ifsm::priv::StateImpl::~StateImpl(){
-  
-}
+    //only atomic states may be the active leaf
+    template <class Machine, class Event, class Info>
+    struct StaticHandleEvent<Machine, Event, Info, false>{
+      static void run(Machine&){}
+    };
+
+    template <class Machine, class Info, bool Atomic = Info::atomic>
+    struct StaticLeave{
+      static void run(Machine& pMachine){
+        StaticExitPath<Machine, Info::ordinal, NoPosition>::run(pMachine);
+      }
+    };
 
-void ifsm::priv::StateImpl::build(StateMachine* pRoot, StateImpl* pParent, StateDef&& pDef){
-  mRoot = pRoot;
-  mParent = pParent;
-  mName = std::move(pDef.mName);
-  mIsInitial = pDef.mIsInitial;
-  mIsParallel = pDef.mIsParallel;
-  mOnEntryActions = std::move(pDef.mOnEntryActions);
-  mOnExitActions = std::move(pDef.mOnExitActions);
+    template <class Machine, class Info>
+    struct StaticLeave<Machine, Info, false>{
+      static void run(Machine&){}
+    };
 
-  //get children references
-  for (auto& lChildDef : pDef.mChildren){
-    auto lChild = mRoot->mAllStates[lChildDef.mName].get();
-    mChildren.push_back(lChild);
-    if (lChildDef.mIsInitial){
-      if (mInitial != nullptr){
-        throw AlreadyHasInitial(mName);
+    /*
+    tables of handlers indexed by the ordinal of the active leaf
+    */
+    template <class Machine, class Event, class States = typename Machine::States>
+    struct StaticDispatchTable;
+
+    template <class Machine, class Event, class... Infos>
+    struct StaticDispatchTable<Machine, Event, TypeList<Infos...>>{
+      static void run(Machine& pMachine){
+        typedef void(*Handler)(Machine&);
+        static const Handler sHandlers[] = { &StaticHandleEvent<Machine, Event, Infos>::run... };
+        sHandlers[StaticAccess<Machine>::getLeaf(pMachine)](pMachine);
       }
-      mInitial = lChild;
-    }
-  }
+    };
 
-  //test whether this non-parallel non-atomic state has an initial child defined
-  if (!mIsParallel && !mChildren.empty() && mInitial == nullptr){
-    throw NoInitialState(mName);
-  }
-  
-  //build transitions
-  for (auto& lTransitionDef : pDef.mTransitions){
-    
-    std::unique_ptr<TransitionImpl> lTransition(new TransitionImpl(lTransitionDef));
-    if (!lTransitionDef.mTarget.empty()){
-      auto lFindTarget = mRoot->mAllStates.find(lTransitionDef.mTarget);
-      if (lFindTarget==mRoot->mAllStates.end()){
-        throw NoSuchState(lTransitionDef.mTarget);
+    template <class Machine, class States = typename Machine::States>
+    struct StaticLeaveTable;
+
+    template <class Machine, class... Infos>
+    struct StaticLeaveTable<Machine, TypeList<Infos...>>{
+      static void run(Machine& pMachine){
+        typedef void(*Handler)(Machine&);
+        static const Handler sHandlers[] = { &StaticLeave<Machine, Infos>::run... };
+        sHandlers[StaticAccess<Machine>::getLeaf(pMachine)](pMachine);
       }
-      lTransition->setTarget(lFindTarget->second.get());
-    }
-    
-    lTransition->setSource(this);
-    mTransitions.insert(std::make_pair(lTransition->getEvent(), std::move(lTransition)));
+    };
   }
-}
 
-const std::string& ifsm::priv::StateImpl::getName() const{
-  return mName;
-}
+  namespace typed{
+    /*
+    create a state identified by the type Tag
+    */
+    template <class Tag, typename... Args>
+    priv::StaticStateDef<Tag, typename std::decay<Args>::type...> State(Args&&... pArgs){
+      priv::StaticStateDef<Tag, typename std::decay<Args>::type...> lState = { std::tuple<typename std::decay<Args>::type...>(std::forward<Args>(pArgs)...) };
+      return lState;
+    }
 
-bool ifsm::priv::StateImpl::isAtomic() const{
-  return mChildren.empty();
-}
+    /*
+    create a transition when called as a parameter of typed::State
+    */
+    template <typename... Args>
+    priv::StaticTransitionDef<typename std::decay<Args>::type...> Transition(Args&&... pArgs){
+      priv::StaticTransitionDef<typename std::decay<Args>::type...> lTransition = { std::tuple<typename std::decay<Args>::type...>(std::forward<Args>(pArgs)...) };
+      return lTransition;
+    }
 
-bool ifsm::priv::StateImpl::isInitial() const{
-  return mIsInitial;
-}
+    /*
+    define the event type that will trigger the transition
+    */
+    template <class Event>
+    priv::StaticEvent<Event> OnEvent(){
+      return priv::StaticEvent<Event>();
+    }
 
-bool ifsm::priv::StateImpl::isParallel() const{
-  return mIsParallel;
-}
+    /*
+    define the state activated when the transition is realised
+    */
+    template <class Tag>
+    priv::StaticTarget<Tag> Target(){
+      return priv::StaticTarget<Tag>();
+    }
 
-bool ifsm::priv::StateImpl::isActive() const{
-  return mParent == nullptr ? mRoot->isActive() : mParent->mActive == this || (mParent->mIsParallel && mParent->isActive());
-}
+    /*
+    define the callback called during execution of the transition, in the form void(void)
+    */
+    template <class FunType>
+    priv::StaticAction<typename std::decay<FunType>::type> Action(FunType&& pFun){
+      static_assert(priv::is_callable<FunType>::value, "parameter to typed::Action must be callable with no parameter");
+      priv::StaticAction<typename std::decay<FunType>::type> lAction = { std::forward<FunType>(pFun) };
+      return lAction;
+    }
 
-void ifsm::priv::StateImpl::enter(){
-  if (!mIsParallel){
-    if (nullptr != mInitial){
-      mActive = mInitial;
+    /*
+    define a condition for the selection of the transition, in the form bool(void)
+    */
+    template <class FunType>
+    priv::StaticCondition<typename std::decay<FunType>::type> Condition(FunType&& pFun){
+      static_assert(priv::returns<FunType, bool>::value, "parameter to typed::Condition must be callable with no parameter and must return 'bool'");
+      priv::StaticCondition<typename std::decay<FunType>::type> lCondition = { std::forward<FunType>(pFun) };
+      return lCondition;
     }
-    else if (!mChildren.empty()){
-      throw NoInitialState(mName);
+
+    template <class FunType>
+    priv::StaticOnEntry<typename std::decay<FunType>::type> OnEntry(FunType&& pFun){
+      static_assert(priv::is_callable<FunType>::value, "parameter to typed::OnEntry must be callable with no parameter");
+      priv::StaticOnEntry<typename std::decay<FunType>::type> lEntry = { std::forward<FunType>(pFun) };
+      return lEntry;
     }
-  }
 
-  if (nullptr != mParent && !mParent->mIsParallel){
-    mParent->mActive = this;
-  }
+    template <class FunType>
+    priv::StaticOnExit<typename std::decay<FunType>::type> OnExit(FunType&& pFun){
+      static_assert(priv::is_callable<FunType>::value, "parameter to typed::OnExit must be callable with no parameter");
+      priv::StaticOnExit<typename std::decay<FunType>::type> lExit = { std::forward<FunType>(pFun) };
+      return lExit;
+    }
 
-  for (auto& lAction : mOnEntryActions){
-    lAction(*mRoot);
+    /*
+    shortcut for a targetless transition
+    */
+    template <class Event, class FunType>
+    priv::StaticTransitionDef<priv::StaticEvent<Event>, priv::StaticAction<typename std::decay<FunType>::type>> OnEvent(FunType&& pFun){
+      return Transition(OnEvent<Event>(), Action(std::forward<FunType>(pFun)));
+    }
   }
-}
 
-void ifsm::priv::StateImpl::leave(){
-  if (nullptr != mParent && !mParent->mIsParallel){
-    mParent->mActive = nullptr;
-  }
+  template <typename... Params>
+  class StaticStateMachine{
 
-  for (auto& lAction : mOnExitActions){
-    lAction(*mRoot);
-  }
-}
+    template <class>
+    friend struct priv::StaticAccess;
 
-template <typename... Params>
-ifsm::StateMachine::StateMachine(Params && ... pParams)
-: mIsActive(false)
-, mInToplevelProcess(false){
+  public:
+    typedef priv::StaticStateDef<priv::StaticRoot, Params...> Definition;
+    typedef typename priv::StaticFlattenState<Definition, priv::StaticRootAccessor, 0, priv::NoPosition>::type States;
 
-  //build the StateDef for the StateMachine's StateImpl construction
-  priv::StateDef lCurrentDefinition("root", std::forward<Params>(pParams)...);
-  
-  //build all children states recursively
-  std::list<priv::StateDef*> lWorkingQueue;
-  lWorkingQueue.push_back(&lCurrentDefinition);
+  public:
+    explicit StaticStateMachine(Definition&& pDefinition);
 
-  while (!lWorkingQueue.empty()){
-    priv::StateDef* lDef = lWorkingQueue.front();
-    lWorkingQueue.pop_front();
+    /*
+    enter the root state and its initial children
+    */
+    void enter();
 
-    auto lRes = mAllStates.insert(std::make_pair(lDef->mName, std::unique_ptr<priv::StateImpl>(new priv::StateImpl())));
-    if (!lRes.second){
-      throw DuplicateStateIdentifier(lDef->mName);
-    }
+    /*
+    leave all active states, from the active atomic state up to the root
+    */
+    void leave();
 
-    for (auto& lChild : lDef->mChildren){
-      lWorkingQueue.push_back(&lChild);
-    }
+    bool isActive() const;
 
-  }
+    /*
+    add the event of type Event to the event queue
+    */
+    template <class Event>
+    void pushEvent();
 
-  mImpl = mAllStates["root"].get();
+    /*
+    returns whether the state of type Tag is active
+    */
+    template <class Tag>
+    bool inState() const;
 
-  //then build them
-  //list contains pair<parent, def of child>
-  std::list<std::pair<priv::StateImpl*, priv::StateDef*>> lBuildQueue;
-  lBuildQueue.push_back(std::make_pair(nullptr, &lCurrentDefinition));
+  private:
+    void processEvents();
 
-  while (!lBuildQueue.empty()){
-    priv::StateImpl* lParent = lBuildQueue.front().first;
-    priv::StateDef* lDef = lBuildQueue.front().second;
-    lBuildQueue.pop_front();
+  private:
+    Definition mDefinition;
+    //ordinal of the active atomic state
+    std::size_t mLeaf;
+    priv::RingBuffer<void(*)(StaticStateMachine&)> mEvents;
+    bool mIsActive;
+    bool mInToplevelProcess;
+  };
 
-    priv::StateImpl* lCurrent = mAllStates[lDef->mName].get();
-    lCurrent->build(this, lParent, std::move(*lDef));
+  /*
+  instantiate a StaticStateMachine, from the same parameters as the root typed::State
+  */
+  template <typename... Args>
+  StaticStateMachine<typename std::decay<Args>::type...> makeStaticStateMachine(Args&&... pArgs);
+}
 
-    for (auto& lChild : lDef->mChildren){
-      lBuildQueue.push_back(std::make_pair(lCurrent, &lChild));
-    }
-  }
-#if 0
-  std::vector<priv::StateDef*> lDirectChildren;
-  gatherStateDefs(lDirectChildren, pParam1, pParams...);
+template <typename... Params>
+ifsm::StaticStateMachine<Params...>::StaticStateMachine(Definition&& pDefinition)
+: mDefinition(std::move(pDefinition))
+, mLeaf(0)
+, mIsActive(false)
+, mInToplevelProcess(false){
 
-  std::list<priv::StateDef*> lWorkingQueue;
-  
-  for (auto lChildDef : lDirectChildren){
-    auto lRes = mAllStates.insert(std::make_pair(lChildDef->mName, std::unique_ptr<priv::StateImpl>(new priv::StateImpl())));
-    if (!lRes.second){
-      throw DuplicateStateIdentifier(lChildDef->mName);
-    }
+}
 
-    mChildren.push_back(lRes.first->second.get());
+template <typename... Params>
+void ifsm::StaticStateMachine<Params...>::enter(){
+  if (mIsActive){
+    return;
+  }
 
-    if (lChildDef->mIsInitial){
-      if (mIsParallel){
-        //parallel should not have initial states
-      }
-      else {
-        if (mInitial != nullptr){
-          throw AlreadyHasInitial(mName);
-        }
-        else {
-          mInitial = lRes.first->second.get();
-        }
-      }
-    }
+  mIsActive = true;
+  priv::StaticEnterDefault<StaticStateMachine, 0>::run(*this);
+  mLeaf = priv::StaticEnterDefault<StaticStateMachine, 0>::leaf;
+}
 
-    for (auto& lChild : lChildDef->mChildren){
-      lWorkingQueue.push_back(&lChild);
-    }
+template <typename... Params>
+void ifsm::StaticStateMachine<Params...>::leave(){
+  if (!mIsActive){
+    return;
   }
 
-  //instantiate all children states
-  while (!lWorkingQueue.empty()){
-    priv::StateDef* lDef = lWorkingQueue.front();
-    lWorkingQueue.pop_front();
-    
-    auto lRes = mAllStates.insert(std::make_pair(lDef->mName, std::unique_ptr<priv::StateImpl>(new priv::StateImpl())));
-    if (!lRes.second){
-      throw DuplicateStateIdentifier(lDef->mName);
-    }
+  priv::StaticLeaveTable<StaticStateMachine>::run(*this);
+  mIsActive = false;
+}
 
-    for (auto& lChild : lDef->mChildren){
-      lWorkingQueue.push_back(&lChild);
-    }
-    
-  }
+template <typename... Params>
+bool ifsm::StaticStateMachine<Params...>::isActive() const{
+  return mIsActive;
+}
 
-  if (!mIsParallel && !mChildren.empty() && mInitial == nullptr) {
-    throw NoInitialState(mName);
-  }
-  
-  //then build them
-  std::list<std::pair<priv::StateImpl*,priv::StateDef*>> lBuildQueue;
+template <typename... Params>
+template <class Event>
+void ifsm::StaticStateMachine<Params...>::pushEvent(){
+  mEvents.push(&priv::StaticDispatchTable<StaticStateMachine, Event>::run);
+  processEvents();
+}
 
-  for (auto lChildDef : lDirectChildren){
-    lBuildQueue.push_back(std::make_pair(this, lChildDef));
+template <typename... Params>
+template <class Tag>
+bool ifsm::StaticStateMachine<Params...>::inState() const{
+  typedef typename priv::StaticState<StaticStateMachine, priv::StaticStateOrdinal<StaticStateMachine, Tag>::value>::type Info;
+  return mIsActive && Info::ordinal <= mLeaf && mLeaf < Info::subtreeEnd;
+}
+
+template <typename... Params>
+void ifsm::StaticStateMachine<Params...>::processEvents(){
+  if (mInToplevelProcess){
+    return;
   }
 
-  while (!lBuildQueue.empty()){
-    priv::StateImpl* lParent = lBuildQueue.front().first;
-    priv::StateDef* lDef = lBuildQueue.front().second;
-    lBuildQueue.pop_front();
-    
-    priv::StateImpl* lCurrent = mAllStates[lDef->mName].get();
-    lCurrent->build(this, lParent, std::move(*lDef));
-    
-    for (auto& lChild : lDef->mChildren){
-      lBuildQueue.push_back(std::make_pair(lCurrent, &lChild));
+  mInToplevelProcess = true;
+  while (!mEvents.empty()){
+    void(*lHandler)(StaticStateMachine&) = mEvents.front();
+    if (mIsActive){
+      lHandler(*this);
     }
+    mEvents.pop();
   }
-#endif
+  mInToplevelProcess = false;
 }
 
+template <typename... Args>
+ifsm::StaticStateMachine<typename std::decay<Args>::type...> ifsm::makeStaticStateMachine(Args&&... pArgs){
+  return StaticStateMachine<typename std::decay<Args>::type...>(typed::State<priv::StaticRoot>(std::forward<Args>(pArgs)...));
+}
 
-void ifsm::StateMachine::enter(){
-  if (mIsActive) {
-    return;
-  }
+template <class Ret, typename... Args>
+ifsm::priv::Callback<Ret(Args...)>::Callback() NOEXCEPT
+: mInvoke(nullptr)
+, mManage(nullptr){
 
-  mIsActive = true;
+}
 
-  //enter children states in  depth first fashion
-  std::list<priv::StateImpl*> lToEnter;
-  lToEnter.push_back(mImpl);
+template <class Ret, typename... Args>
+template <class Callable, typename B>
+ifsm::priv::Callback<Ret(Args...)>::Callback(Callable&& pCallable)
+: mInvoke(&invoke<typename std::decay<Callable>::type>)
+, mManage(&manage<typename std::decay<Callable>::type>){
+  typedef typename std::decay<Callable>::type Stored;
+  store(std::forward<Callable>(pCallable), std::integral_constant<bool, isInline<Stored>::value>());
+}
 
-  while (!lToEnter.empty()) {
-    priv::StateImpl* lCurrent = lToEnter.front();
-    lToEnter.pop_front();
-    lCurrent->enter();
+template <class Ret, typename... Args>
+template <class Callable>
+void ifsm::priv::Callback<Ret(Args...)>::store(Callable&& pCallable, std::true_type){
+  new (&mStorage) typename std::decay<Callable>::type(std::forward<Callable>(pCallable));
+}
 
-    if (!lCurrent->isParallel()){
-      if (lCurrent->mInitial != nullptr){
-        lToEnter.push_front(lCurrent->mInitial);
-      }
-    }
-    else {
-      std::for_each(lCurrent->mChildren.rbegin(), lCurrent->mChildren.rend(), [&lToEnter](priv::StateImpl* pChild){
-        lToEnter.push_front(pChild);
-      });
-    }
+template <class Ret, typename... Args>
+template <class Callable>
+void ifsm::priv::Callback<Ret(Args...)>::store(Callable&& pCallable, std::false_type){
+  *reinterpret_cast<typename std::decay<Callable>::type**>(&mStorage) = new typename std::decay<Callable>::type(std::forward<Callable>(pCallable));
+}
 
+template <class Ret, typename... Args>
+ifsm::priv::Callback<Ret(Args...)>::Callback(Callback&& pRhs) NOEXCEPT
+: mInvoke(pRhs.mInvoke)
+, mManage(pRhs.mManage){
+  if (mManage){
+    mManage(MoveTo, &pRhs.mStorage, &mStorage);
+    pRhs.mInvoke = nullptr;
+    pRhs.mManage = nullptr;
   }
 }
 
-void ifsm::StateMachine::leave(){
-  if (!mIsActive) {
-    return;
+template <class Ret, typename... Args>
+ifsm::priv::Callback<Ret(Args...)>& ifsm::priv::Callback<Ret(Args...)>::operator=(Callback&& pRhs) NOEXCEPT{
+  if (this != &pRhs){
+    reset();
+    if (pRhs.mManage){
+      pRhs.mManage(MoveTo, &pRhs.mStorage, &mStorage);
+      mInvoke = pRhs.mInvoke;
+      mManage = pRhs.mManage;
+      pRhs.mInvoke = nullptr;
+      pRhs.mManage = nullptr;
+    }
   }
+  return *this;
+}
 
-  std::list<priv::StateImpl*> lToLeave;
-
-  std::list<priv::StateImpl*> lLifo;
-  lLifo.push_back(mImpl);
-
-  while (!lLifo.empty()) {
-    priv::StateImpl* lCurrent = lLifo.front();
-    lLifo.pop_front();
-    lToLeave.push_front(lCurrent);
+template <class Ret, typename... Args>
+ifsm::priv::Callback<Ret(Args...)>::~Callback(){
+  reset();
+}
 
-    if (!lCurrent->isActive()){
-      continue;
-    }
+template <class Ret, typename... Args>
+ifsm::priv::Callback<Ret(Args...)>::operator bool() const NOEXCEPT{
+  return mInvoke != nullptr;
+}
 
-    if (lCurrent->isParallel()){
-      std::for_each(lCurrent->mChildren.rbegin(), lCurrent->mChildren.rend(), [&lLifo](priv::StateImpl* pChild){
-        lLifo.push_front(pChild);
-      });
-    }
-    else if (lCurrent->mActive!=nullptr){
-      lLifo.push_front(lCurrent->mActive);
-    }
-  }
+template <class Ret, typename... Args>
+Ret ifsm::priv::Callback<Ret(Args...)>::operator()(Args... pArgs) const{
+  return mInvoke(const_cast<Storage*>(&mStorage), std::forward<Args>(pArgs)...);
+}
 
-  for (priv::StateImpl* lState : lToLeave){
-    lState->leave();
-  }
+template <class Ret, typename... Args>
+template <class Callable>
+Callable& ifsm::priv::Callback<Ret(Args...)>::get(void* pStorage, std::true_type){
+  return *static_cast<Callable*>(pStorage);
+}
 
-  mIsActive = false;
+template <class Ret, typename... Args>
+template <class Callable>
+Callable& ifsm::priv::Callback<Ret(Args...)>::get(void* pStorage, std::false_type){
+  return **static_cast<Callable**>(pStorage);
 }
 
-bool ifsm::StateMachine::isActive() const{
-  return mIsActive;
+template <class Ret, typename... Args>
+template <class Callable>
+Ret ifsm::priv::Callback<Ret(Args...)>::invoke(void* pStorage, Args... pArgs){
+  return call(get<Callable>(pStorage, std::integral_constant<bool, isInline<Callable>::value>()),
+    std::integral_constant<bool, is_callable_with<Callable&, Args...>::value>(), std::forward<Args>(pArgs)...);
 }
 
-void ifsm::StateMachine::pushEvent(const std::string& pEvent){
-  //TO DO : enqueue event, determine dispatch policy
-  mEvents.push(pEvent);
-  processEvents();
+template <class Ret, typename... Args>
+template <class Callable>
+Ret ifsm::priv::Callback<Ret(Args...)>::call(Callable& pCallable, std::true_type, Args... pArgs){
+  return pCallable(std::forward<Args>(pArgs)...);
 }
 
-bool ifsm::StateMachine::inState(const std::string& stateName){
+template <class Ret, typename... Args>
+template <class Callable>
+Ret ifsm::priv::Callback<Ret(Args...)>::call(Callable& pCallable, std::false_type, Args...){
+  return pCallable();
+}
 
-  auto itFind = mAllStates.find(stateName);
+template <class Ret, typename... Args>
+template <class Callable>
+void ifsm::priv::Callback<Ret(Args...)>::manage(Operation pOperation, void* pStorage, void* pDestination){
+  manage<Callable>(pOperation, pStorage, pDestination, std::integral_constant<bool, isInline<Callable>::value>());
+}
 
-  if (itFind == mAllStates.end()){
-    return false;
+template <class Ret, typename... Args>
+template <class Callable>
+void ifsm::priv::Callback<Ret(Args...)>::manage(Operation pOperation, void* pStorage, void* pDestination, std::true_type){
+  Callable& lCallable = *static_cast<Callable*>(pStorage);
+  if (pOperation == MoveTo){
+    new (pDestination) Callable(std::move(lCallable));
   }
+  lCallable.~Callable();
+}
 
-  if (itFind->second.get() == mImpl){
-    return mIsActive;
+template <class Ret, typename... Args>
+template <class Callable>
+void ifsm::priv::Callback<Ret(Args...)>::manage(Operation pOperation, void* pStorage, void* pDestination, std::false_type){
+  Callable*& lCallable = *static_cast<Callable**>(pStorage);
+  if (pOperation == MoveTo){
+    *static_cast<Callable**>(pDestination) = lCallable;
+  } else {
+    delete lCallable;
   }
+  lCallable = nullptr;
+}
 
-  if (itFind->second->isActive()){
-    return true;
+template <class Ret, typename... Args>
+void ifsm::priv::Callback<Ret(Args...)>::reset() NOEXCEPT{
+  if (mManage){
+    mManage(Destroy, &mStorage, nullptr);
+    mInvoke = nullptr;
+    mManage = nullptr;
   }
+}
 
-  return false;
+template <class T>
+const void* ifsm::priv::payloadType(){
+  static const char lType = 0;
+  return &lType;
 }
 
-/**************************************************/
-void ifsm::StateMachine::processEvents(){
-  if (mInToplevelProcess){
-	  return;
+void ifsm::priv::releaseTask(TaskState* pTask){
+  if (pTask->mReferences.fetch_sub(1, std::memory_order_acq_rel) == 1){
+    pTask->mDestroy(pTask);
   }
+}
 
-  mInToplevelProcess = true;
-  while (!mEvents.empty()){
-	  const std::string& lEvent = mEvents.front();
-
-    //process transitions linked to the event
-    processTransitions(lEvent);
-	  mEvents.pop();
-  }
-  mInToplevelProcess = false;
+bool ifsm::priv::taskDone(const TaskState* pTask){
+  return pTask->mReferences.load(std::memory_order_acquire) == 1;
 }
 
-void ifsm::StateMachine::processTransitions(const std::string& pEvent){
-  
-  std::vector<priv::TransitionImpl*> lTransitions = selectTransitions(pEvent);
+#if defined(INSTANTFSM_COROUTINES)
+ifsm::Task::promise_type::promise_type(){
+  //one reference for the coroutine, one for the Task
+  mReferences.store(2, std::memory_order_relaxed);
+  mDestroy = &destroy;
+}
 
-  std::vector<priv::TransitionImpl*> lFiltered = removeConflicts(lTransitions);
+ifsm::Task ifsm::Task::promise_type::get_return_object(){
+  return Task(this);
+}
 
-  exitStates(lFiltered);
+std::suspend_never ifsm::Task::promise_type::initial_suspend() const NOEXCEPT{
+  return std::suspend_never();
+}
 
-  for (priv::TransitionImpl* lTransition : lFiltered){
-    lTransition->doAction(*this);
-  }
+ifsm::Task::FinalAwaiter ifsm::Task::promise_type::final_suspend() const NOEXCEPT{
+  return FinalAwaiter();
+}
 
-  enterStates(lFiltered);
+void ifsm::Task::promise_type::return_void() const NOEXCEPT{
+}
 
+void ifsm::Task::promise_type::unhandled_exception(){
+  mError = std::current_exception();
 }
 
-std::vector<ifsm::priv::TransitionImpl*> ifsm::StateMachine::selectTransitions(const std::string& pEvent) {
+void ifsm::Task::promise_type::destroy(priv::TaskState* pTask){
+  std::coroutine_handle<promise_type>::from_promise(static_cast<promise_type&>(*pTask)).destroy();
+}
 
-  //list all atomic active states
-  priv::StateIterator<priv::DepthFirstSearch> lAtomicsIt(mImpl);
-  lAtomicsIt.setTest(std::function<bool(priv::StateImpl*)>([](priv::StateImpl* pState){
-    return pState->isAtomic() && pState->isActive();
-  }));
+ifsm::Task::Task() NOEXCEPT
+: mState(nullptr){
+}
 
-  std::vector<priv::StateImpl*> lAtomics;
+ifsm::Task::Task(priv::TaskState* pState) NOEXCEPT
+: mState(pState){
+}
 
-  for (; priv::StateIterator<priv::DepthFirstSearch>(nullptr) != lAtomicsIt; ++lAtomicsIt){
-    lAtomics.push_back(*lAtomicsIt);
-  }
+ifsm::Task::Task(Task&& pRhs) NOEXCEPT
+: mState(pRhs.release()){
+}
 
-  //look for a valid transition from each active atomic state all the way up to the root
-  std::vector<priv::TransitionImpl*> lTransitions;
-  for (priv::StateImpl* lState : lAtomics){
-    bool lMatched = false;
-    while (lState != nullptr && !lMatched){
-      auto lRangeMatch = lState->mTransitions.equal_range(pEvent);
-      std::for_each(lRangeMatch.first, lRangeMatch.second, [=,&lMatched,&lTransitions](decltype(*lRangeMatch.first) &pTransition){
-        if (pTransition.second->test(*this)){
-          lTransitions.push_back(pTransition.second.get());
-          lMatched = true;
-        }
-      });
-      lState = lState->mParent;
+ifsm::Task& ifsm::Task::operator=(Task&& pRhs) NOEXCEPT{
+  if (this != &pRhs){
+    if (mState){
+      priv::releaseTask(mState);
     }
+    mState = pRhs.release();
   }
-
-  return lTransitions;
+  return *this;
 }
 
-std::vector<ifsm::priv::TransitionImpl*> ifsm::StateMachine::removeConflicts(std::vector<priv::TransitionImpl*>& pTransitions) {
-  std::vector<priv::TransitionImpl*> lFiltered;
-  std::vector<priv::StateImpl*> lIntersect;
+ifsm::Task::~Task(){
+  if (mState){
+    priv::releaseTask(mState);
+  }
+}
 
-  std::vector<priv::TransitionImpl*> lToRemove;
-  bool lCheckPreempted = false;
+bool ifsm::Task::done() const{
+  return !mState || priv::taskDone(mState);
+}
 
-  //for each transition to check
-  for (auto lTransitionToCheck : pTransitions){
-    lCheckPreempted = false;
-    lToRemove.clear();
+ifsm::priv::TaskState* ifsm::Task::release() NOEXCEPT{
+  priv::TaskState* lState = mState;
+  mState = nullptr;
+  return lState;
+}
 
-    priv::StateImpl* lToCheckTarget = lTransitionToCheck->mTarget;
+bool ifsm::Task::FinalAwaiter::await_ready() const NOEXCEPT{
+  return false;
+}
 
-    if (lFiltered.empty() || lToCheckTarget==nullptr){
-      lFiltered.push_back(lTransitionToCheck);
-      continue;
-    }
+bool ifsm::Task::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> pCoroutine) const NOEXCEPT{
+  //stay suspended until the Task releases the frame, unless it already has : the frame is then destroyed.
+  //nothing of the frame may be used after the reference is released
+  return pCoroutine.promise().mReferences.fetch_sub(1, std::memory_order_acq_rel) != 1;
+}
 
-    std::list<priv::StateImpl*> lToCheckExitsList = listExitStates(lTransitionToCheck);
-    std::vector<priv::StateImpl*> lToCheckExits(std::begin(lToCheckExitsList), std::end(lToCheckExitsList));
-    std::sort(std::begin(lToCheckExits), std::end(lToCheckExits));
+void ifsm::Task::FinalAwaiter::await_resume() const NOEXCEPT{
+}
+#endif
 
-    //check against already filtered transitions
-    for (auto lCheckAgainst : lFiltered){
+ifsm::priv::Payload::Payload() NOEXCEPT
+: mType(nullptr)
+, mManage(nullptr)
+, mIsInline(false){
 
-      //compute exit states of both transitions
-      priv::StateImpl* lCheckAgainstTarget = lCheckAgainst->mTarget;
+}
 
-      if (lCheckAgainstTarget == nullptr){
-        continue;
-      }
+template <class T, typename B>
+ifsm::priv::Payload::Payload(T&& pValue)
+: mType(payloadType<typename std::decay<T>::type>())
+, mManage(nullptr)
+, mIsInline(false){
+  typedef typename std::decay<T>::type Type;
+  store<Type>(std::forward<T>(pValue), std::integral_constant<bool, isInline<Type>::value>());
+}
 
-      std::list<priv::StateImpl*> lCheckAgainstExitsList = listExitStates(lCheckAgainst);
-      std::vector<priv::StateImpl*> lCheckAgainstExits(std::begin(lCheckAgainstExitsList), std::end(lCheckAgainstExitsList));
-      std::sort(std::begin(lCheckAgainstExits), std::end(lCheckAgainstExits));
-      lIntersect.insert(lIntersect.end(), lToCheckExits.size() + lCheckAgainstExits.size(), nullptr);
+template <class T, class Arg>
+void ifsm::priv::Payload::store(Arg&& pValue, std::true_type){
+  ::new (static_cast<void*>(&mStorage)) T(std::forward<Arg>(pValue));
+  mManage = &manage<T, true>;
+  mIsInline = true;
+}
 
-      //compute intersection of exit states
-      std::set_intersection(std::begin(lToCheckExits), std::end(lToCheckExits),
-        std::begin(lCheckAgainstExits), std::end(lCheckAgainstExits),
-        std::begin(lIntersect));
+template <class T, class Arg>
+void ifsm::priv::Payload::store(Arg&& pValue, std::false_type){
+  *reinterpret_cast<T**>(&mStorage) = new T(std::forward<Arg>(pValue));
+  mManage = &manage<T, false>;
+}
 
-      if (!lIntersect.empty()){
-        if (isDescendant(lToCheckTarget, lCheckAgainstTarget)){
-          lToRemove.push_back(lCheckAgainst);
-        }
-        else {
-          lCheckPreempted = true;
-          break;
-        }
-      }
-    }
+ifsm::priv::Payload::Payload(Payload&& pRhs) NOEXCEPT
+: mType(pRhs.mType)
+, mManage(pRhs.mManage)
+, mIsInline(pRhs.mIsInline){
+  if (mManage){
+    mManage(MoveTo, &pRhs.mStorage, &mStorage);
+    pRhs.mType = nullptr;
+    pRhs.mManage = nullptr;
+    pRhs.mIsInline = false;
+  }
+}
 
-    if (!lCheckPreempted){
-      for (auto lToRemoveTsn : lToRemove){
-        auto lDel = std::remove(std::begin(lFiltered), std::end(lFiltered), lToRemoveTsn);
-        lFiltered.erase(lDel, std::end(lFiltered));
-      }
-      lFiltered.push_back(lTransitionToCheck);
+ifsm::priv::Payload& ifsm::priv::Payload::operator=(Payload&& pRhs) NOEXCEPT{
+  if (this != &pRhs){
+    reset();
+    if (pRhs.mManage){
+      pRhs.mManage(MoveTo, &pRhs.mStorage, &mStorage);
+      mType = pRhs.mType;
+      mManage = pRhs.mManage;
+      mIsInline = pRhs.mIsInline;
+      pRhs.mType = nullptr;
+      pRhs.mManage = nullptr;
+      pRhs.mIsInline = false;
     }
   }
+  return *this;
+}
 
-  return lFiltered;
+ifsm::priv::Payload::~Payload(){
+  reset();
 }
 
-std::list<ifsm::priv::StateImpl*> ifsm::StateMachine::listExitStates(priv::TransitionImpl* pTransition){
-  std::list<priv::StateImpl*> lToExitList;
+const void* ifsm::priv::Payload::data() const NOEXCEPT{
+  if (mIsInline){
+    return &mStorage;
+  }
+  return *reinterpret_cast<void* const*>(&mStorage);
+}
 
-  priv::StateImpl* lCommonAncestor = findLeastCommonAncestor(pTransition->mSource, pTransition->mTarget);
+const void* ifsm::priv::Payload::type() const NOEXCEPT{
+  return mType;
+}
 
-  std::list<priv::StateImpl*> lFifo;
+template <class T, bool Inline>
+void ifsm::priv::Payload::manage(Operation pOperation, void* pStorage, void* pDestination){
+  manage<T>(pOperation, pStorage, pDestination, std::integral_constant<bool, Inline>());
+}
 
-  if (lCommonAncestor->isActive()){
-    lFifo.push_back(lCommonAncestor);
+template <class T>
+void ifsm::priv::Payload::manage(Operation pOperation, void* pStorage, void* pDestination, std::true_type){
+  T* lValue = static_cast<T*>(pStorage);
+  if (pOperation == MoveTo){
+    ::new (pDestination) T(std::move(*lValue));
   }
+  lValue->~T();
+}
 
-  while (!lFifo.empty()){
-    priv::StateImpl* lCurrent = lFifo.front();
-    lFifo.pop_front();
-
-    for (auto lChild : lCurrent->mChildren){
-      if (lChild->isActive()){
-        lFifo.push_back(lChild);
-        lToExitList.push_front(lChild);
-      }
-    }
+template <class T>
+void ifsm::priv::Payload::manage(Operation pOperation, void* pStorage, void* pDestination, std::false_type){
+  T** lValue = static_cast<T**>(pStorage);
+  if (pOperation == MoveTo){
+    *static_cast<T**>(pDestination) = *lValue;
+  }
+  else {
+    delete *lValue;
   }
-  
-  return lToExitList;
 }
 
-std::list<ifsm::priv::StateImpl*> ifsm::StateMachine::listEntryStates(priv::StateImpl* pState){
-  std::list<priv::StateImpl*> lToEnterList;
-
-  if (pState == nullptr){
-    return lToEnterList;
+void ifsm::priv::Payload::reset() NOEXCEPT{
+  if (mManage){
+    mManage(Destroy, &mStorage, nullptr);
+    mType = nullptr;
+    mManage = nullptr;
+    mIsInline = false;
   }
+}
 
-  lToEnterList.push_back(pState);
+ifsm::priv::Bitset::Bitset()
+: mSize(0){
 
-  //children of target should be entered after target
-  std::list<priv::StateImpl*> lFifo;
-  lFifo.push_back(pState);
-  while (!lFifo.empty()){
-    priv::StateImpl* lCurrent = lFifo.front();
-    lFifo.pop_front();
+}
 
-    if (lCurrent->mIsParallel){
-      for (auto lChild : lCurrent->mChildren){
-        lFifo.push_back(lChild);
-        lToEnterList.push_back(lChild);
-      }
-    }
-    else if (nullptr != lCurrent->mInitial){
-      lFifo.push_back(lCurrent->mInitial);
-      lToEnterList.push_back(lCurrent->mInitial);
-    }
+void ifsm::priv::Bitset::resize(std::size_t pSize){
+  mSize = pSize;
+  mWords.resize((pSize + WordBits - 1) / WordBits, 0);
+}
 
-  }
+std::size_t ifsm::priv::Bitset::size() const{
+  return mSize;
+}
 
-  //ancestors of target should be entered before target
-  //until the first active state
-  priv::StateImpl* lActive = pState->mParent;
-  while (nullptr != lActive && !lActive->isActive()){
-    lToEnterList.push_front(lActive);
-    lActive = lActive->mParent;
-  }
+bool ifsm::priv::Bitset::test(std::size_t pIndex) const{
+  return (mWords[pIndex / WordBits] >> (pIndex % WordBits)) & 1;
+}
 
-  //check whether an ancestor is a parallel, in which case its children must be added in correct order
-  auto lEnterListIt = lToEnterList.begin();
-  while (lEnterListIt != lToEnterList.end()){
-    if ((*lEnterListIt)->isParallel()){
-      auto lAlreadyInserted = lEnterListIt;
-      ++lAlreadyInserted;
-      for (auto lChild : (*lEnterListIt)->mChildren){
-        if (lChild == *lAlreadyInserted){
-          ++lEnterListIt;
-          continue;
-        }
-        lEnterListIt = lToEnterList.insert(++lEnterListIt, lChild);
-      }
-    }
-    ++lEnterListIt;
-  }
+void ifsm::priv::Bitset::set(std::size_t pIndex){
+  mWords[pIndex / WordBits] |= Word(1) << (pIndex % WordBits);
+}
 
-  return lToEnterList;
+void ifsm::priv::Bitset::reset(std::size_t pIndex){
+  mWords[pIndex / WordBits] &= ~(Word(1) << (pIndex % WordBits));
 }
 
-bool ifsm::StateMachine::isDescendant(priv::StateImpl* pCheck, priv::StateImpl* pAgainst){
-  priv::StateImpl* lStart = pCheck;
-  while (lStart != pAgainst && lStart != nullptr){
-    lStart = lStart->mParent;
+std::size_t ifsm::priv::Bitset::findPrevious(std::size_t pBegin, std::size_t pEnd) const{
+  if (pEnd <= pBegin){
+    return npos;
   }
 
-  if (lStart != nullptr){
-    return true;
+  std::size_t lWordIndex = (pEnd - 1) / WordBits;
+  std::size_t lLastBit = (pEnd - 1) % WordBits;
+  Word lWord = mWords[lWordIndex];
+  if (lLastBit != WordBits - 1){
+    lWord &= (Word(1) << (lLastBit + 1)) - 1;
   }
 
-  return false;
+  while (true){
+    if (lWord != 0){
+      std::size_t lIndex = lWordIndex * WordBits + highestBit(lWord);
+      return lIndex >= pBegin ? lIndex : npos;
+    }
+    if (lWordIndex * WordBits <= pBegin){
+      return npos;
+    }
+    lWord = mWords[--lWordIndex];
+  }
 }
 
-void ifsm::StateMachine::exitStates(const std::vector<priv::TransitionImpl*>& pTransitions){
-  std::vector<priv::StateImpl*> lToExit;
+std::size_t ifsm::priv::Bitset::findNext(std::size_t pBegin) const{
+  if (pBegin >= mSize){
+    return npos;
+  }
+
+  std::size_t lWordIndex = pBegin / WordBits;
+  Word lWord = mWords[lWordIndex] & (~Word(0) << (pBegin % WordBits));
 
-  for (auto lTransition : pTransitions) {
-    if (lTransition->mTarget == nullptr){
-      continue;
+  while (lWord == 0){
+    if (++lWordIndex == mWords.size()){
+      return npos;
     }
-    std::list<priv::StateImpl*> lCurrentExit = listExitStates(lTransition);
-    lToExit.insert(std::end(lToExit), std::begin(lCurrentExit), std::end(lCurrentExit));
+    lWord = mWords[lWordIndex];
   }
+  return lWordIndex * WordBits + lowestBit(lWord);
+}
 
-  for (auto lState : lToExit){
-    lState->leave();
+std::size_t ifsm::priv::Bitset::count() const{
+  std::size_t lCount = 0;
+  for (Word lWord : mWords){
+    lCount += popCount(lWord);
   }
+  return lCount;
 }
 
-void ifsm::StateMachine::enterStates(const std::vector<priv::TransitionImpl*>& pTransitions){
-  std::vector<priv::StateImpl*> lToEnter;
-
-  for (auto lTransition : pTransitions) {
-    if (lTransition->mTarget == nullptr){
-      continue;
+bool ifsm::priv::Bitset::includes(const Bitset& pOther) const{
+  for (std::size_t lIndex = 0; lIndex < pOther.mWords.size(); ++lIndex){
+    const Word lWord = lIndex < mWords.size() ? mWords[lIndex] : 0;
+    if ((pOther.mWords[lIndex] & ~lWord) != 0){
+      return false;
     }
-    std::list<priv::StateImpl*> lCurrentEnter = listEntryStates(lTransition->mTarget);
-    lToEnter.insert(std::end(lToEnter), std::begin(lCurrentEnter), std::end(lCurrentEnter));
   }
+  return true;
+}
 
-  for (auto lState : lToEnter){
-    lState->enter();
+bool ifsm::priv::Bitset::intersects(const Bitset& pOther) const{
+  const std::size_t lWords = std::min(mWords.size(), pOther.mWords.size());
+  for (std::size_t lIndex = 0; lIndex < lWords; ++lIndex){
+    if ((mWords[lIndex] & pOther.mWords[lIndex]) != 0){
+      return true;
+    }
   }
+  return false;
 }
 
-void ifsm::StateMachine::exitStates(priv::StateImpl* pTarget){
-  std::list<priv::StateImpl*> lToExit;
+const ifsm::priv::Bitset::Word* ifsm::priv::Bitset::words() const{
+  return mWords.data();
+}
 
-  std::list<priv::StateImpl*> lFifo;
+std::size_t ifsm::priv::Bitset::wordCount() const{
+  return mWords.size();
+}
 
+void ifsm::priv::Bitset::clear(){
+  std::fill(mWords.begin(), mWords.end(), Word(0));
+}
 
-  if (pTarget->isActive()){
-	  lToExit.push_front(pTarget);
-	  lFifo.push_front(pTarget);
+void ifsm::priv::Bitset::unite(const Word* pWords){
+  for (std::size_t lWord = 0; lWord < mWords.size(); ++lWord){
+    mWords[lWord] |= pWords[lWord];
   }
-  else {
-
-	//browse up to the first active ancestor
-    priv::StateImpl* lActive = pTarget->mParent;
-	while (nullptr != lActive && !lActive->isActive()){
-	  lActive = lActive->mParent;
-	}
+}
 
-	if (nullptr == lActive){
-	  //TODO, we shouldn't ever get there
-	  return;
-	}
+std::uint64_t ifsm::priv::hashValue(std::uint64_t pHash, std::uint64_t pValue){
+  for (std::size_t lByte = 0; lByte < 8; ++lByte){
+    pHash ^= (pValue >> (8 * lByte)) & 0xff;
+    pHash *= 1099511628211ULL;
+  }
+  return pHash;
+}
 
-	lFifo.push_front(lActive);
+std::uint64_t ifsm::priv::hashString(std::uint64_t pHash, const std::string& pValue){
+  pHash = hashValue(pHash, pValue.size());
+  for (char lChar : pValue){
+    pHash ^= static_cast<std::uint8_t>(lChar);
+    pHash *= 1099511628211ULL;
   }
+  return pHash;
+}
 
-  //now we've got the first active ancestor, 
-  //let's follow active states to know what states must be exited
-  while (!lFifo.empty()){
-    priv::StateImpl* lActive = lFifo.front();
-	  lFifo.pop_front();
+template <class T>
+std::size_t ifsm::priv::vectorBytes(const std::vector<T>& pVector){
+  return pVector.capacity() * sizeof(T);
+}
 
-	  if (lActive->mIsParallel){
-	    for (auto lChild : lActive->mChildren){
-		  lFifo.push_back(lChild);
-		  lToExit.push_front(lChild);
-	    }
-	  }
-	  else if (nullptr != lActive->mActive){
-	    lFifo.push_back(lActive->mActive);
-	    lToExit.push_front(lActive->mActive);
-	  }
+std::size_t ifsm::priv::stringBytes(const std::string& pString){
+  //short strings are stored inside the std::string object
+  const char* lObject = reinterpret_cast<const char*>(&pString);
+  if (pString.data() >= lObject && pString.data() < lObject + sizeof(std::string)){
+    return 0;
   }
+  return pString.capacity() + 1;
+}
 
-  //we've got our exit list, let's exit then
-  for (auto lExit : lToExit){
-	  lExit->leave();
+template <class Map>
+std::size_t ifsm::priv::nameTableBytes(const Map& pMap){
+  //a node holds its value, the next node and the cached hash of the name
+  std::size_t lBytes = pMap.bucket_count() * sizeof(void*)
+    + pMap.size() * (sizeof(typename Map::value_type) + sizeof(void*) + sizeof(std::size_t));
+  for (const auto& lEntry : pMap){
+    lBytes += stringBytes(lEntry.first);
   }
-
+  return lBytes;
 }
 
-void ifsm::StateMachine::enterStates(priv::StateImpl* pTarget){
-  std::list<priv::StateImpl*> lToEnter;
-  lToEnter.push_back(pTarget);
-
-  //children of target should be entered after target
-  std::list<priv::StateImpl*> lFifo;
-  lFifo.push_back(pTarget);
-  while (!lFifo.empty()){
-    priv::StateImpl* lCurrent = lFifo.front();
-	  lFifo.pop_front();
+void ifsm::priv::appendVarint(std::vector<std::uint8_t>& pBuffer, std::uint64_t pValue){
+  while (pValue >= 0x80){
+    pBuffer.push_back(static_cast<std::uint8_t>(pValue | 0x80));
+    pValue >>= 7;
+  }
+  pBuffer.push_back(static_cast<std::uint8_t>(pValue));
+}
 
-	  if (lCurrent->mIsParallel){
-	    for (auto lChild : lCurrent->mChildren){
-		  lFifo.push_back(lChild);
-		  lToEnter.push_back(lChild);
-	    }
-	  }
-	  else if (nullptr != lCurrent->mInitial){
-	    lFifo.push_back(lCurrent->mInitial);
-	    lToEnter.push_back(lCurrent->mInitial);
-	  }
+bool ifsm::priv::readVarint(const std::uint8_t*& pBegin, const std::uint8_t* pEnd, std::uint64_t& pValue){
+  pValue = 0;
+  for (std::size_t lShift = 0; pBegin != pEnd && lShift < 64; lShift += 7){
+    const std::uint8_t lByte = *pBegin++;
+    pValue |= static_cast<std::uint64_t>(lByte & 0x7f) << lShift;
+    if ((lByte & 0x80) == 0){
+      return true;
+    }
+  }
+  return false;
+}
 
+std::size_t ifsm::priv::Bitset::highestBit(Word pWord){
+#if defined(__GNUC__)
+  return WordBits - 1 - __builtin_clzll(pWord);
+#else
+  std::size_t lIndex = 0;
+  while (pWord >>= 1){
+    ++lIndex;
   }
+  return lIndex;
+#endif
+}
 
-  //ancestors of target should be entered before target
-  //until the first active state
-  priv::StateImpl* lActive = pTarget->mParent;
-  while (nullptr != lActive && !lActive->isActive()){
-	  lToEnter.push_front(lActive);
-	  lActive = lActive->mParent;
+std::size_t ifsm::priv::Bitset::lowestBit(Word pWord){
+#if defined(__GNUC__)
+  return __builtin_ctzll(pWord);
+#else
+  std::size_t lIndex = 0;
+  while ((pWord & 1) == 0){
+    pWord >>= 1;
+    ++lIndex;
   }
+  return lIndex;
+#endif
+}
 
-  for (auto lEnter : lToEnter){
-	  lEnter->enter();
+std::size_t ifsm::priv::Bitset::popCount(Word pWord){
+#if defined(__GNUC__)
+  return __builtin_popcountll(pWord);
+#else
+  std::size_t lCount = 0;
+  for (; pWord != 0; pWord &= pWord - 1){
+    ++lCount;
   }
+  return lCount;
+#endif
+}
+
+
+template <class T>
+ifsm::priv::RingBuffer<T>::RingBuffer()
+: mFront(0)
+, mSize(0){
 
 }
 
-ifsm::priv::StateImpl* ifsm::StateMachine::getTransitionDomain(priv::TransitionImpl* pTransition){
-  if (pTransition->mTarget == nullptr){
-    return pTransition->mSource;
-  }
-  else {
-    return findLeastCommonAncestor(pTransition->mSource, pTransition->mTarget);
-  }
+template <class T>
+bool ifsm::priv::RingBuffer<T>::empty() const{
+  return mSize == 0;
 }
 
-ifsm::priv::StateImpl* ifsm::StateMachine::findLeastCommonAncestor(priv::StateImpl* pLhs, priv::StateImpl* pRhs) {
-  std::vector<priv::StateImpl*> lLhsParents;
-  priv::StateImpl* lCurrentParent = pLhs->mParent;
-  lLhsParents.push_back(lCurrentParent);
+template <class T>
+std::size_t ifsm::priv::RingBuffer<T>::size() const{
+  return mSize;
+}
 
-  while (lCurrentParent != nullptr){
-    lCurrentParent = lCurrentParent->mParent;
-    lLhsParents.push_back(lCurrentParent);
+template <class T>
+void ifsm::priv::RingBuffer<T>::push(const T& pValue){
+  if (mSize == mBuffer.size()){
+    grow(std::max<std::size_t>(8, mBuffer.size() * 2));
   }
 
-  for (auto lState : lLhsParents){
-    if (isDescendant(pRhs, lState)){
-      return lState;
-    }
+  mBuffer[(mFront + mSize) % mBuffer.size()] = pValue;
+  ++mSize;
+}
+
+template <class T>
+void ifsm::priv::RingBuffer<T>::push(T&& pValue){
+  if (mSize == mBuffer.size()){
+    grow(std::max<std::size_t>(8, mBuffer.size() * 2));
   }
 
-  return mImpl;
+  mBuffer[(mFront + mSize) % mBuffer.size()] = std::move(pValue);
+  ++mSize;
 }
 
-template <class SearchType>
-ifsm::priv::StateIterator<SearchType>::StateIterator(){
-
+template <class T>
+T& ifsm::priv::RingBuffer<T>::front(){
+  return mBuffer[mFront];
 }
 
-template <class SearchType>
-ifsm::priv::StateIterator<SearchType>::StateIterator(priv::StateImpl* pFirst)
-: mSearch(*this, pFirst)
-, mTest([](priv::StateImpl*){return true; }){
-  lookupNextValidState();
+template <class T>
+void ifsm::priv::RingBuffer<T>::pop(){
+  mFront = (mFront + 1) % mBuffer.size();
+  --mSize;
 }
 
-template <class SearchType>
-ifsm::priv::StateIterator<SearchType> ifsm::priv::StateIterator<SearchType>::operator++(){
-  
-  mSearch.fetchNext();
-  lookupNextValidState();
+template <class T>
+void ifsm::priv::RingBuffer<T>::reserve(std::size_t pCapacity){
+  if (pCapacity > mBuffer.size()){
+    grow(pCapacity);
+  }
+}
 
-  return *this;
+template <class T>
+std::size_t ifsm::priv::RingBuffer<T>::capacity() const{
+  return mBuffer.size();
 }
 
-template <class SearchType>
-ifsm::priv::StateImpl* ifsm::priv::StateIterator<SearchType>::operator*() const{
-  return mSearch.getCurrent();
+template <class T>
+void ifsm::priv::RingBuffer<T>::grow(std::size_t pCapacity){
+  //unroll the queue at the beginning of the new buffer
+  std::vector<T> lBuffer(pCapacity);
+  for (std::size_t lIndex = 0; lIndex < mSize; ++lIndex){
+    lBuffer[lIndex] = std::move(mBuffer[(mFront + lIndex) % mBuffer.size()]);
+  }
+
+  mBuffer.swap(lBuffer);
+  mFront = 0;
 }
 
-template <class SearchType>
-bool ifsm::priv::StateIterator<SearchType>::operator==(const StateIterator<SearchType>& pRhs) const{
-  return mSearch.getCurrent() == pRhs.mSearch.getCurrent();
+bool ifsm::priv::EventQueue::empty() const{
+  return mEvents.empty();
 }
 
-template <class SearchType>
-bool ifsm::priv::StateIterator<SearchType>::operator!=(const StateIterator<SearchType>& pRhs) const{
-  return !(*this == pRhs);
+std::size_t ifsm::priv::EventQueue::size() const{
+  return mEvents.size();
 }
 
-template <class SearchType>
-void ifsm::priv::StateIterator<SearchType>::setTest(std::function < bool(priv::StateImpl*)>& pTest){
-  mTest = pTest;
-  lookupNextValidState();
+void ifsm::priv::EventQueue::push(EventId pEvent){
+  mEvents.push(pEvent);
 }
 
-template <class SearchType>
-void ifsm::priv::StateIterator<SearchType>::setTest(std::function < bool(::ifsm::priv::StateImpl*)>&& pTest){
-  setTest(pTest);
+void ifsm::priv::EventQueue::push(EventId pEvent, Payload&& pPayload){
+  mPayloads.push(std::move(pPayload));
+  mEvents.push(pEvent | PayloadFlag);
 }
 
-template <class SearchType>
-void ifsm::priv::StateIterator<SearchType>::lookupNextValidState(){
-  while (mSearch.getCurrent() != nullptr && !mTest(mSearch.getCurrent())){
-    mSearch.fetchNext();
-  }
+ifsm::EventId ifsm::priv::EventQueue::pop(){
+  EventId lEvent = mEvents.front();
+  mEvents.pop();
+  return lEvent;
 }
 
+ifsm::priv::Payload ifsm::priv::EventQueue::popPayload(){
+  Payload lPayload(std::move(mPayloads.front()));
+  mPayloads.pop();
+  return lPayload;
+}
 
-template <class SearchType>
-const ifsm::priv::StateImpl::ChildrenMap& ifsm::priv::StateIterator<SearchType>::getStateChildren(const priv::StateImpl* pState){
-  return pState->mChildren;
+void ifsm::priv::EventQueue::reserve(std::size_t pCapacity){
+  mEvents.reserve(pCapacity);
 }
 
-ifsm::priv::DepthFirstSearch::DepthFirstSearch(MyIterator& pIterator, priv::StateImpl* pFirst)
-: mIterator(pIterator){
-  if (nullptr == pFirst){
-    return;
-  }
+std::size_t ifsm::priv::EventQueue::bufferBytes() const{
+  return mEvents.capacity() * sizeof(EventId) + mPayloads.capacity() * sizeof(Payload);
+}
 
-  mLifo.push_front(pFirst);
+template <class T>
+ifsm::priv::MpscQueue<T>::MpscQueue()
+: mHead(&mStub)
+, mTail(&mStub){
+  mStub.mNext.store(nullptr, std::memory_order_relaxed);
 }
 
-void ifsm::priv::DepthFirstSearch::fetchNext(){
-  if (mLifo.size() <= 0){
-    return;
+template <class T>
+ifsm::priv::MpscQueue<T>::~MpscQueue(){
+  T lValue;
+  while (pop(lValue)){
   }
-  ifsm::priv::StateImpl* lCurrent = mLifo.front();
-  mLifo.pop_front();
-
-  priv::StateImpl::ChildrenMap::const_reverse_iterator lIt = mIterator.getStateChildren(lCurrent).crbegin(),
-    lItEnd = mIterator.getStateChildren(lCurrent).crend();
-  for (; lIt != lItEnd; ++lIt){
-    mLifo.push_front(*lIt);
+  if (mTail != &mStub){
+    delete mTail;
   }
 }
 
-ifsm::priv::StateImpl* ifsm::priv::DepthFirstSearch::getCurrent() const{
-  return (mLifo.size()>0)? mLifo.front():nullptr;
+template <class T>
+void ifsm::priv::MpscQueue<T>::push(const T& pValue){
+  Node* lNode = new Node;
+  lNode->mNext.store(nullptr, std::memory_order_relaxed);
+  lNode->mValue = pValue;
+
+  //publish the node : until mNext of the previous one is set, the consumer sees the queue as empty
+  Node* lPrevious = mHead.exchange(lNode, std::memory_order_acq_rel);
+  lPrevious->mNext.store(lNode, std::memory_order_release);
 }
 
-ifsm::priv::WidthFirstSearch::WidthFirstSearch(MyIterator& pIterator, priv::StateImpl* pFirst)
-: mIterator(pIterator){
-  if (nullptr == pFirst){
-    return;
-  }
-
-  mFifo.push_front(pFirst);
+template <class T>
+bool ifsm::priv::MpscQueue<T>::empty() const{
+  return mTail->mNext.load(std::memory_order_acquire) == nullptr;
 }
 
-void ifsm::priv::WidthFirstSearch::fetchNext(){
-  if (mFifo.size() <= 0){
-    return;
-  }
-  ifsm::priv::StateImpl* lCurrent = mFifo.front();
-  mFifo.pop_front();
-  /*
-  
-  State::ChildrenMap::const_reverse_iterator lIt = mIterator.getStateChildren(lCurrent).crbegin();
-  State::ChildrenMap::const_reverse_iterator lItEnd = mIterator.getStateChildren(lCurrent).crend();
-  for (; lIt != lItEnd; ++lIt){
-    mFifo.push_back(lIt->second);
+template <class T>
+bool ifsm::priv::MpscQueue<T>::pop(T& pValue){
+  Node* lNext = mTail->mNext.load(std::memory_order_acquire);
+  if (lNext == nullptr){
+    return false;
   }
-  */
-  for (auto& lChild : mIterator.getStateChildren(lCurrent)){
-    mFifo.push_back(lChild);
+
+  //lNext becomes the new stub, its value is consumed
+  pValue = lNext->mValue;
+  if (mTail != &mStub){
+    delete mTail;
   }
+  mTail = lNext;
+  return true;
 }
 
-
 #endif //INSTANTFSM_H